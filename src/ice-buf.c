@@ -3,6 +3,9 @@
 #include <pthread.h>
 #include <string.h>
 #include <unistd.h> 
+#include <stdint.h> 
+#include <poll.h> 
+#include <sys/eventfd.h> 
 #include "ice-buf.h"
 
 
@@ -11,6 +14,16 @@
 
 static size_t buffer_count = 0; 
 
+#define MAX_BUFS_PER_WAIT_GROUP 8 
+
+struct ice_buf_wait_group
+{
+  int fd; 
+  volatile int sleeping; 
+  int nbufs; 
+  ice_buf_t * bufs[MAX_BUFS_PER_WAIT_GROUP]; 
+}; 
+
 struct ice_buf
 {
   void * mem; 
@@ -19,6 +32,7 @@ struct ice_buf
   size_t memb_size;
   size_t capacity; 
   size_t index; 
+  ice_buf_wait_group_t * wg; 
 }; 
 
 
@@ -47,6 +61,7 @@ ice_buf_t* ice_buf_init(size_t max_capacity, size_t memb_size)
   b->capacity = max_capacity; 
   b->memb_size = memb_size; 
   b->index = buffer_count++; 
+  b->wg = 0; 
 
   
   return b; 
@@ -84,6 +99,17 @@ void ice_buf_commit(ice_buf_t * b)
 {
   MEMORY_FENCE
   b->produced_count++;
+
+  //if the consumer is sleeping, wake it up. The fence pairs with the one in 
+  //ice_buf_wait_group_wait, so either we see it sleeping or it sees our item. 
+  if (b->wg) 
+  {
+    MEMORY_FENCE
+    if (__atomic_exchange_n(&b->wg->sleeping, 0, __ATOMIC_SEQ_CST))
+    {
+      ice_buf_wait_group_wake(b->wg); 
+    }
+  }
 }
 
 void ice_buf_push(ice_buf_t *b, const void * mem)
@@ -118,5 +144,84 @@ int ice_buf_destroy(ice_buf_t *b)
 }
 
 
+ice_buf_wait_group_t * ice_buf_wait_group_init(void) 
+{
+  ice_buf_wait_group_t * wg = calloc(sizeof(ice_buf_wait_group_t),1); 
+  if (!wg) 
+  {
+    fprintf(stderr,"Can't allocate wait group. Are we out of memory!?"); 
+    return 0; 
+  }
+
+  wg->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); 
+  if (wg->fd < 0) 
+  {
+    fprintf(stderr,"Can't create eventfd for wait group\n"); 
+    free(wg); 
+    return 0; 
+  }
+
+  return wg; 
+}
+
+int ice_buf_wait_group_add(ice_buf_wait_group_t * wg, ice_buf_t * b) 
+{
+  if (wg->nbufs >= MAX_BUFS_PER_WAIT_GROUP || b->wg) 
+  {
+    fprintf(stderr,"Can't add buffer %zd to wait group\n", b->index); 
+    return -1; 
+  }
 
+  wg->bufs[wg->nbufs++] = b; 
+  b->wg = wg; 
+  return 0; 
+}
 
+static int wait_group_has_data(const ice_buf_wait_group_t * wg) 
+{
+  for (int i = 0; i < wg->nbufs; i++) 
+  {
+    if (ice_buf_occupancy(wg->bufs[i])) return 1; 
+  }
+  return 0; 
+}
+
+int ice_buf_wait_group_wait(ice_buf_wait_group_t * wg, float timeout) 
+{
+  if (wait_group_has_data(wg)) return 1; 
+
+  //let the producers know we're going to sleep, then check again in case something came in meanwhile 
+  __atomic_store_n(&wg->sleeping, 1, __ATOMIC_SEQ_CST); 
+  MEMORY_FENCE
+
+  if (!wait_group_has_data(wg)) 
+  {
+    struct pollfd pfd = {.fd = wg->fd, .events = POLLIN}; 
+    poll(&pfd, 1, timeout < 0 ? -1 : (int) (timeout * 1000)); 
+  }
+
+  __atomic_store_n(&wg->sleeping, 0, __ATOMIC_SEQ_CST); 
+
+  //drain the eventfd (it's non-blocking, so it's fine if there's nothing there) 
+  uint64_t val; 
+  if (read(wg->fd, &val, sizeof(val)) < 0) val = 0; 
+
+  return wait_group_has_data(wg); 
+}
+
+void ice_buf_wait_group_wake(ice_buf_wait_group_t * wg) 
+{
+  uint64_t one = 1; 
+  if (write(wg->fd, &one, sizeof(one)) < 0) 
+  {
+    //only fails if the counter would overflow, in which case the waiter is already awake
+  }
+}
+
+int ice_buf_wait_group_destroy(ice_buf_wait_group_t * wg) 
+{
+  for (int i = 0; i < wg->nbufs; i++) wg->bufs[i]->wg = 0; 
+  close(wg->fd); 
+  free(wg); 
+  return 0; 
+}
@@ -49,4 +49,37 @@ void* ice_buf_pop(ice_buf_t *, void * destination);
  **/ 
 int ice_buf_destroy(ice_buf_t *);
 
+
+/** Wait groups. 
+ *
+ * A wait group lets the consumer of one or more buffers sleep until any of them has 
+ * something in it, it is explicitly woken up (e.g. because it's time to quit) or a timeout 
+ * elapses, rather than polling the occupancies. 
+ *
+ * This is implemented with an eventfd. The producers only poke it when the consumer is 
+ * actually asleep, so when things are busy, committing costs no extra syscall. 
+ *
+ * Each buffer may belong to at most one wait group, and each wait group should only 
+ * have one waiter. 
+ **/ 
+struct ice_buf_wait_group; 
+typedef struct ice_buf_wait_group ice_buf_wait_group_t; 
+
+/* Create a new (empty) wait group */ 
+ice_buf_wait_group_t * ice_buf_wait_group_init(void); 
+
+/* Add a buffer to the wait group. Should be done before the buffer is used. */ 
+int ice_buf_wait_group_add(ice_buf_wait_group_t *, ice_buf_t *); 
+
+/* Block until one of the buffers in the group is not empty, the group is woken up or 
+ * timeout seconds pass (a negative timeout waits forever). Returns 1 if at least one buffer 
+ * has something in it, otherwise 0. */ 
+int ice_buf_wait_group_wait(ice_buf_wait_group_t *, float timeout); 
+
+/* Wake up the waiter. This is async-signal-safe, so may be called from a signal handler */ 
+void ice_buf_wait_group_wake(ice_buf_wait_group_t *); 
+
+/* Deinits and frees the wait group (but not the buffers in it!) */ 
+int ice_buf_wait_group_destroy(ice_buf_wait_group_t *); 
+
 #endif
@@ -0,0 +1,199 @@
+#define _GNU_SOURCE
+#include "ice-cfgwatch.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#define FILE_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+struct ice_cfgwatch
+{
+  int fd; 
+  char * cfg_file; 
+  char * once_dir; 
+
+  //the config file is watched through its directory, so replacing it with a rename is noticed too 
+  char * file_dir; 
+  const char * file_name; 
+  int file_wd; 
+
+  char * once_parent; 
+  const char * once_name; 
+  int once_wd; 
+  int once_parent_wd; 
+
+  double debounce; 
+  int pending; 
+  double first[2]; 
+  double last[2]; 
+}; 
+
+static double now_mono() 
+{
+  struct timespec now; 
+  clock_gettime(CLOCK_MONOTONIC, &now); 
+  return now.tv_sec + 1e-9 * now.tv_nsec; 
+}
+
+/* splits path into a (new) directory and the name in it */ 
+static char * split_path(const char * path, const char ** name) 
+{
+  const char * slash = strrchr(path, '/'); 
+  if (!slash) 
+  {
+    *name = path; 
+    return strdup("."); 
+  }
+  *name = slash + 1; 
+  return slash == path ? strdup("/") : strndup(path, slash - path); 
+}
+
+static int ends_with(const char * s, const char * end) 
+{
+  size_t ls = strlen(s), le = strlen(end); 
+  return ls >= le && !strcmp(s + ls - le, end); 
+}
+
+static int same(const char * a, const char * b) 
+{
+  if (!a || !b) return a == b; 
+  return !strcmp(a,b); 
+}
+
+ice_cfgwatch_t * ice_cfgwatch_open(const char * cfg_file, const char * once_dir, double debounce) 
+{
+  ice_cfgwatch_t * w = calloc(1, sizeof(ice_cfgwatch_t)); 
+  w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); 
+  w->file_wd = w->once_wd = w->once_parent_wd = -1; 
+  w->debounce = debounce; 
+  if (w->fd < 0) 
+  {
+    fprintf(stderr,"Could not set up inotify\n"); 
+    free(w); 
+    return NULL; 
+  }
+
+  if (cfg_file) 
+  {
+    w->cfg_file = strdup(cfg_file); 
+    w->file_dir = split_path(w->cfg_file, &w->file_name); 
+    // IN_MASK_ADD, since the one-time directory's parent is often the same directory 
+    w->file_wd = inotify_add_watch(w->fd, w->file_dir, FILE_EVENTS | IN_ONLYDIR | IN_MASK_ADD); 
+    if (w->file_wd < 0) fprintf(stderr,"Could not watch %s for changes to %s\n", w->file_dir, w->file_name); 
+  }
+
+  if (once_dir) 
+  {
+    w->once_dir = strdup(once_dir); 
+    w->once_parent = split_path(w->once_dir, &w->once_name); 
+    w->once_wd = inotify_add_watch(w->fd, w->once_dir, FILE_EVENTS | IN_ONLYDIR); // fine if it doesn't exist (yet) 
+    w->once_parent_wd = inotify_add_watch(w->fd, w->once_parent, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_MASK_ADD); 
+  }
+
+  if (w->file_wd < 0 && w->once_wd < 0 && w->once_parent_wd < 0) 
+  {
+    ice_cfgwatch_close(w); 
+    return NULL; 
+  }
+
+  return w; 
+}
+
+void ice_cfgwatch_close(ice_cfgwatch_t * w) 
+{
+  if (!w) return; 
+  close(w->fd); 
+  free(w->cfg_file); 
+  free(w->file_dir); 
+  free(w->once_dir); 
+  free(w->once_parent); 
+  free(w); 
+}
+
+int ice_cfgwatch_is_watching(const ice_cfgwatch_t * w, const char * cfg_file, const char * once_dir) 
+{
+  return w && same(w->cfg_file, cfg_file) && same(w->once_dir, once_dir); 
+}
+
+static void mark(ice_cfgwatch_t * w, int what, double now) 
+{
+  int i = what == ICE_CFGWATCH_ONCE; 
+  if (!(w->pending & what)) w->first[i] = now; 
+  w->last[i] = now; 
+  w->pending |= what; 
+}
+
+static void read_events(ice_cfgwatch_t * w) 
+{
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event)))); 
+  ssize_t n; 
+  while ((n = read(w->fd, buf, sizeof(buf))) > 0) 
+  {
+    double now = now_mono(); 
+    for (char * p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event*) p)->len) 
+    {
+      const struct inotify_event * ev = (const struct inotify_event*) p; 
+
+      if (ev->wd == w->once_wd && (ev->mask & IN_IGNORED)) 
+      {
+        w->once_wd = -1; // the directory went away, we'll see if it comes back 
+        continue; 
+      }
+      if (!ev->len) continue; 
+
+      if (ev->wd == w->file_wd && (ev->mask & FILE_EVENTS) && !strcmp(ev->name, w->file_name)) 
+      {
+        mark(w, ICE_CFGWATCH_FILE, now); 
+      }
+
+      if (ev->wd == w->once_wd && (ev->mask & FILE_EVENTS) && ends_with(ev->name, ".cfg")) 
+      {
+        mark(w, ICE_CFGWATCH_ONCE, now); 
+      }
+
+      if (ev->wd == w->once_parent_wd && (ev->mask & IN_ISDIR) && !strcmp(ev->name, w->once_name)) 
+      {
+        //the one-time directory was made (or moved in), possibly with something in it already 
+        w->once_wd = inotify_add_watch(w->fd, w->once_dir, FILE_EVENTS | IN_ONLYDIR); 
+        mark(w, ICE_CFGWATCH_ONCE, now); 
+      }
+    }
+  }
+}
+
+void ice_cfgwatch_wait(ice_cfgwatch_t * w, int timeout_ms) 
+{
+  read_events(w); 
+  double now = now_mono(); 
+  for (int i = 0; i < 2; i++) 
+  {
+    if (!(w->pending & (i ? ICE_CFGWATCH_ONCE : ICE_CFGWATCH_FILE))) continue; 
+    double left = w->last[i] + w->debounce - now; 
+    int left_ms = left > 0 ? ceil(1e3 * left) : 0; 
+    if (left_ms < timeout_ms) timeout_ms = left_ms; 
+  }
+
+  struct pollfd pfd = {.fd = w->fd, .events = POLLIN}; 
+  poll(&pfd, 1, timeout_ms); 
+}
+
+int ice_cfgwatch_check(ice_cfgwatch_t * w, double * first_seen) 
+{
+  read_events(w); 
+  double now = now_mono(); 
+  int due = 0; 
+  for (int i = 0; i < 2; i++) 
+  {
+    int what = i ? ICE_CFGWATCH_ONCE : ICE_CFGWATCH_FILE; 
+    if (!(w->pending & what) || now < w->last[i] + w->debounce) continue; 
+    if (first_seen && (!due || w->first[i] < *first_seen)) *first_seen = w->first[i]; 
+    due |= what; 
+    w->pending &= ~what; 
+  }
+  return due; 
+}
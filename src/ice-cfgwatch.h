@@ -0,0 +1,41 @@
+#ifndef _RNO_G_ICE_CFGWATCH_H
+#define _RNO_G_ICE_CFGWATCH_H
+
+/** Watching the config with inotify, so edits get picked up without a SIGUSR1.
+ *
+ * Two things are watched: the config file in use (written in place or replaced by a rename, as editors and rsync do), 
+ * and the one-time config directory (see find_config), where a new .cfg file means "use this once". If the one-time
+ * directory doesn't exist yet, its parent is watched so we notice when it's made.
+ *
+ * Editors tend to write a file in several goes, so a change is only reported once things have been quiet for the
+ * debounce time.
+ *
+ * This doesn't read or check the config, that's up to the caller. It's meant to be used from one thread.
+ **/ 
+
+struct ice_cfgwatch; 
+typedef struct ice_cfgwatch ice_cfgwatch_t; 
+
+enum
+{
+  ICE_CFGWATCH_FILE = 1,  // the config file changed 
+  ICE_CFGWATCH_ONCE = 2   // something showed up in the one-time directory 
+}; 
+
+/* Watch cfg_file and once_dir (either may be NULL). Returns NULL if nothing could be watched. */ 
+ice_cfgwatch_t * ice_cfgwatch_open(const char * cfg_file, const char * once_dir, double debounce); 
+
+void ice_cfgwatch_close(ice_cfgwatch_t * w); 
+
+/* Is this watching these? (so the caller can tell if it needs a new one) */ 
+int ice_cfgwatch_is_watching(const ice_cfgwatch_t * w, const char * cfg_file, const char * once_dir); 
+
+/* Sleep for up to timeout_ms, or until there is something to report */ 
+void ice_cfgwatch_wait(ice_cfgwatch_t * w, int timeout_ms); 
+
+/* What changed (ICE_CFGWATCH_FILE and/or ICE_CFGWATCH_ONCE) and has been quiet for the debounce time, or 0.
+ * If first_seen isn't NULL, it gets the CLOCK_MONOTONIC time of the first event (for the reload latency).
+ * Reported changes are forgotten. */ 
+int ice_cfgwatch_check(ice_cfgwatch_t * w, double * first_seen); 
+
+#endif
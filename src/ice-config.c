@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 
 /** This implements configuration of the DAQ.  This is nominally done with
  * libconfig, although this makes heavy use of macros to form a horrific DSL.
@@ -38,11 +39,39 @@ int init_acq_config(acq_config_t * cfg)
   SECT.daqstatus_interval = 1;
   SECT.seconds_per_run = 7200;
   SECT.comment = "";
+  SECT.index_interval = 10;
+  SECT.header_columns = 1;
+  SECT.recover_previous_runs = 3;
+  SECT.compact_previous_run = 0;
+  SECT.compact_target_kB = 20480;
+  SECT.servo_history = 1;
+  SECT.io.preallocate_kB = 0;
+  SECT.io.writeback_kB = 512;
+  SECT.io.drop_cache_on_close = 1;
+  SECT.io.use_io_uring = 0;
+  SECT.container.enable = 0;
+  SECT.container.seconds_per_file = 3600;
+  SECT.degrade.enable = 1;
+  SECT.degrade.compress_below_MB = 4096;
+  SECT.degrade.drop_forced_below_MB = 2048;
+  SECT.degrade.headers_only_below_MB = 1024;
+  SECT.degrade.hysteresis_MB = 256;
+  SECT.degrade.forecast_seconds = 3600;
+  SECT.degrade.waveform_compression_level = 6;
+  SECT.rollover.enable = 0;
+  SECT.rollover.retake_pedestals = 0;
+  SECT.rollover.rerun_equalization = 0;
 
 #undef SECT
 #define SECT cfg->runtime
 
   SECT.status_shmem_file = "/rno-g/run/daqstatus.dat" ;
+  SECT.status_history_file = "/rno-g/run/daqstatus-history.dat" ;
+  SECT.status_history_seconds = 3600;
+  SECT.metrics_socket = "/rno-g/run/acq-metrics.sock";
+  SECT.metrics_port = 0;
+  SECT.watch_config = 1;
+  SECT.watch_config_debounce_ms = 250;
   SECT.acq_buf_size = 256;
   SECT.mon_buf_size = 128;
 
@@ -220,6 +249,10 @@ int init_acq_config(acq_config_t * cfg)
   SECT.D = 0;
   SECT.max_thresh_change = 0.01;
   SECT.max_sum_err = 10000;
+  SECT.adaptive_polling.enable = 0;
+  SECT.adaptive_polling.max_interval = 8;
+  SECT.adaptive_polling.rate_tolerance = 0.2;
+  SECT.adaptive_polling.thresh_tolerance = 0.001;
 
 
 #undef SECT
@@ -399,6 +432,28 @@ int read_acq_config(FILE * f, acq_config_t * cfg)
   LOOKUP_INT(output.min_free_space_MB_output_partition);
   LOOKUP_INT(output.min_free_space_MB_runfile_partition);
   LOOKUP_INT(output.allow_rundir_overwrite);
+  LOOKUP_INT(output.index_interval);
+  LOOKUP_INT(output.header_columns);
+  LOOKUP_INT(output.recover_previous_runs);
+  LOOKUP_INT(output.compact_previous_run);
+  LOOKUP_INT(output.compact_target_kB);
+  LOOKUP_INT(output.servo_history);
+  LOOKUP_INT(output.io.preallocate_kB);
+  LOOKUP_INT(output.io.writeback_kB);
+  LOOKUP_INT(output.io.drop_cache_on_close);
+  LOOKUP_INT(output.io.use_io_uring);
+  LOOKUP_INT(output.container.enable);
+  LOOKUP_INT(output.container.seconds_per_file);
+  LOOKUP_INT(output.degrade.enable);
+  LOOKUP_INT(output.degrade.compress_below_MB);
+  LOOKUP_INT(output.degrade.drop_forced_below_MB);
+  LOOKUP_INT(output.degrade.headers_only_below_MB);
+  LOOKUP_INT(output.degrade.hysteresis_MB);
+  LOOKUP_INT(output.degrade.forecast_seconds);
+  LOOKUP_INT(output.degrade.waveform_compression_level);
+  LOOKUP_INT(output.rollover.enable);
+  LOOKUP_INT(output.rollover.retake_pedestals);
+  LOOKUP_INT(output.rollover.rerun_equalization);
 
 
   //RADIANT
@@ -493,6 +548,10 @@ int read_acq_config(FILE * f, acq_config_t * cfg)
   LOOKUP_FLOAT(radiant.servo.D);
   LOOKUP_FLOAT(radiant.servo.max_thresh_change);
   LOOKUP_FLOAT(radiant.servo.max_sum_err);
+  LOOKUP_INT(radiant.servo.adaptive_polling.enable);
+  LOOKUP_FLOAT(radiant.servo.adaptive_polling.max_interval);
+  LOOKUP_FLOAT(radiant.servo.adaptive_polling.rate_tolerance);
+  LOOKUP_FLOAT(radiant.servo.adaptive_polling.thresh_tolerance);
 
 
   //thresholds
@@ -532,6 +591,12 @@ int read_acq_config(FILE * f, acq_config_t * cfg)
 
   //runtime
   LOOKUP_STRING(runtime,status_shmem_file);
+  LOOKUP_STRING(runtime,status_history_file);
+  LOOKUP_INT(runtime.status_history_seconds);
+  LOOKUP_STRING(runtime,metrics_socket);
+  LOOKUP_INT(runtime.metrics_port);
+  LOOKUP_INT(runtime.watch_config);
+  LOOKUP_INT(runtime.watch_config_debounce_ms);
   LOOKUP_INT(runtime.acq_buf_size);
   LOOKUP_INT(runtime.mon_buf_size);
 
@@ -598,6 +663,17 @@ int read_acq_config(FILE * f, acq_config_t * cfg)
   return 0;
 }
 
+int check_acq_config(FILE * f)
+{
+  config_t config;
+  config_init(&config);
+  int ok = config_read(&config, f);
+  if (!ok) fprintf(stderr,"Trouble reading config: %s, line: %d\n", config_error_text(&config), config_error_line(&config));
+  config_destroy(&config);
+  rewind(f);
+  return ok ? 0 : -1;
+}
+
 
 
 int dump_acq_config(FILE *f, const acq_config_t * cfg)
@@ -667,6 +743,12 @@ int dump_acq_config(FILE *f, const acq_config_t * cfg)
     WRITE_FLT(radiant.servo,I,"servo PID loop I");
     WRITE_FLT(radiant.servo,D,"servo PID loop D");
     WRITE_FLT(radiant.servo, max_sum_err, "Maximum allowed error sum (in Hz)");
+    SECT(adaptive_polling, "Read the scalers less often while nothing is happening. The interval doubles (up to max_interval) with each reading where every trigger channel's rate is close to its recent average and the servo has settled, and drops straight back to scaler_update_interval otherwise. The servo windows are in readings, so they get longer too. The interval in effect is recorded in aux/daqstatus-aux.dat");
+      WRITE_INT(radiant.servo.adaptive_polling, enable, "Enable adaptive scaler polling");
+      WRITE_FLT(radiant.servo.adaptive_polling, max_interval, "The longest time between scaler readings, in seconds");
+      WRITE_FLT(radiant.servo.adaptive_polling, rate_tolerance, "How far (as a fraction, on top of 3 sigma of counting noise) a rate can be from its recent average and still count as steady");
+      WRITE_FLT(radiant.servo.adaptive_polling, thresh_tolerance, "The servo counts as settled if no threshold moved more than this (in V) in its last step");
+    UNSECT();
   UNSECT();
 
   SECT(trigger,"Trigger configuration");
@@ -810,6 +892,12 @@ int dump_acq_config(FILE *f, const acq_config_t * cfg)
 
   SECT(runtime,"Runtime settings");
     WRITE_STR(runtime,status_shmem_file,"The file holding the current daqstatus");
+    WRITE_STR(runtime,status_history_file,"The file holding the recent daqstatus history (see rno-g-status-trends), empty to not keep one");
+    WRITE_INT(runtime,status_history_seconds,"How long a history to keep there, in seconds (at output.daqstatus_interval)");
+    WRITE_STR(runtime,metrics_socket,"Unix socket to serve metrics on, in the Prometheus text format (e.g. curl --unix-socket), empty to not");
+    WRITE_INT(runtime,metrics_port,"If > 0, also serve the metrics on this port on localhost");
+    WRITE_INT(runtime,watch_config,"Reload the config as soon as it (or the one-time config directory) changes, rather than waiting for a SIGUSR1");
+    WRITE_INT(runtime,watch_config_debounce_ms,"Wait until the config hasn't been touched for this long before reloading it");
     WRITE_INT(runtime,acq_buf_size,"acq circular buffer size (temporarily stores events between acquisition and writing to disk)");
     WRITE_INT(runtime,mon_buf_size,"monitoring circular buffer size (temporarily stores daqstatus between recording and writing to disk)");
   UNSECT();
@@ -829,6 +917,36 @@ int dump_acq_config(FILE *f, const acq_config_t * cfg)
     WRITE_INT(output,min_free_space_MB_runfile_partition,"Minimum free space on the partition where the runfile gets stored");
     WRITE_INT(output,allow_rundir_overwrite,"Allow overwriting output directories (only effective if there's a runfile)");
     WRITE_INT(output,print_interval,"Interval for printing a bunch of stuff to a screen nobody will see. Ideally done in green text with The Matrix font...");
+    WRITE_INT(output,header_columns,"Also keep a few header fields for the whole run as uncompressed columns in hdcol/ (for quick scans with rno-g-header-query)");
+    WRITE_INT(output,recover_previous_runs,"At startup, recover files left open in this many previous runs (e.g. after a crash or power loss)");
+    WRITE_INT(output,compact_previous_run,"At startup, merge the small files of the previous run in the background (with rno-g-compact-run)");
+    WRITE_INT(output,compact_target_kB,"Target size for merged files when compacting");
+    WRITE_INT(output,servo_history,"Keep a compact history of every threshold servo step (RADIANT and flower) in aux/servo-history.dat.gz");
+    WRITE_INT(output,index_interval,"Add a random-access point (and .idx sidecar entry) to waveform and header files every this many events, or 0 to not");
+    SECT(io, "I/O policy for output files (helps with SD card latency spikes and page cache pressure)");
+      WRITE_INT(output.io,preallocate_kB,"Preallocate this many kB when opening an output file (unused space is given back at close), or 0 to not");
+      WRITE_INT(output.io,writeback_kB,"Start writing out dirty pages every time this many kB (compressed) are written to a file, or 0 to leave it to the kernel");
+      WRITE_INT(output.io,drop_cache_on_close,"Drop output files from the page cache once they are closed");
+      WRITE_INT(output.io,use_io_uring,"Write compressed output asynchronously with io_uring, with our own compressor (otherwise, or if the kernel doesn't support it, zlib writes it as usual)");
+    UNSECT();
+    SECT(container, "Run containers: put waveform, header and daqstatus files (and their indices) into a few big files instead of lots of little ones. Use rno-g-container-extract to get the usual layout back.");
+      WRITE_INT(output.container,enable,"Write into run containers instead of separate files");
+      WRITE_INT(output.container,seconds_per_file,"Start a new container after this many seconds (or 0 for one per run)");
+    UNSECT();
+    SECT(degrade, "What to give up as the output partition fills, before stopping the run (which only happens below min_free_space_MB_output_partition). Each step is taken when the free space, or what it's forecast to be, drops below its threshold. Changes are logged in aux/degradation-log.txt");
+      WRITE_INT(output.degrade,enable,"Enable stepping down (otherwise we just stop when we run out of space)");
+      WRITE_INT(output.degrade,compress_below_MB,"Below this, compress harder");
+      WRITE_INT(output.degrade,drop_forced_below_MB,"Below this, don't write waveforms for soft and PPS triggers (their headers are still written)");
+      WRITE_INT(output.degrade,headers_only_below_MB,"Below this, don't write any waveforms, just headers");
+      WRITE_INT(output.degrade,hysteresis_MB,"Only step back up once there's this much more than the threshold free");
+      WRITE_INT(output.degrade,forecast_seconds,"Use the free space forecast this far ahead (from the recent fill rate), or 0 to just use the current free space");
+      WRITE_INT(output.degrade,waveform_compression_level,"zlib compression level for waveforms when compressing harder (normally 3)");
+    UNSECT();
+    SECT(rollover, "Starting the next run in place after seconds_per_run, rather than exiting (and getting restarted by systemd). Avoids the deadtime of a restart.");
+      WRITE_INT(output.rollover,enable,"Roll over to the next run without exiting");
+      WRITE_INT(output.rollover,retake_pedestals,"Retake pedestals at each rollover (as at startup with radiant.pedestals.compute_at_start)");
+      WRITE_INT(output.rollover,rerun_equalization,"Redo the flower gain equalization at each rollover (if lt.gain.auto_gain)");
+    UNSECT();
   UNSECT();
 
   SECT(calib, "In-situ Calibration settings");
@@ -855,3 +973,124 @@ int dump_acq_config(FILE *f, const acq_config_t * cfg)
  return 0;
 
 }
+
+
+/** The runtime-changeable settings that need the hardware touched, and what to redo for each.
+ * Anything not in here (servo settings, threshold limits, intervals, output settings...) is just read by the threads
+ * as they go, so changing it doesn't need anything reapplied. Strings are only used at startup, so aren't here either.
+ */
+enum { FIELD_INT, FIELD_FLT, FIELD_HEX, FIELD_BYTES };
+
+static const struct config_field
+{
+  const char * name;
+  size_t offset;
+  size_t size;
+  int type;
+  uint32_t changes;
+} config_fields[] =
+{
+#define FIELD(path, type, changes) { #path, offsetof(acq_config_t, path), sizeof(((acq_config_t*)0)->path), type, changes }
+  FIELD(radiant.pps.use_internal, FIELD_INT, ACQ_CFG_RADIANT_PPS),
+  FIELD(radiant.pps.sync_out, FIELD_INT, ACQ_CFG_RADIANT_PPS),
+  FIELD(radiant.pps.pps_holdoff, FIELD_INT, ACQ_CFG_RADIANT_PPS),
+  FIELD(radiant.trigger.RF[0].readout_delay, FIELD_INT, ACQ_CFG_RADIANT_DELAYS),
+  FIELD(radiant.trigger.RF[0].readout_delay_mask, FIELD_HEX, ACQ_CFG_RADIANT_DELAYS),
+  FIELD(radiant.trigger.RF[1].readout_delay, FIELD_INT, ACQ_CFG_RADIANT_DELAYS),
+  FIELD(radiant.trigger.RF[1].readout_delay_mask, FIELD_HEX, ACQ_CFG_RADIANT_DELAYS),
+  FIELD(radiant.scalers.use_pps, FIELD_INT, ACQ_CFG_RADIANT_SCALERS),
+  FIELD(radiant.scalers.period, FIELD_FLT, ACQ_CFG_RADIANT_SCALERS),
+  FIELD(radiant.scalers.prescal_m1, FIELD_BYTES, ACQ_CFG_RADIANT_SCALERS),
+  FIELD(radiant.trigger.RF[0].enabled, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER),
+  FIELD(radiant.trigger.RF[0].mask, FIELD_HEX, ACQ_CFG_RADIANT_TRIGGER),
+  FIELD(radiant.trigger.RF[0].window, FIELD_FLT, ACQ_CFG_RADIANT_TRIGGER),
+  FIELD(radiant.trigger.RF[0].num_coincidences, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER),
+  FIELD(radiant.trigger.RF[1].enabled, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER),
+  FIELD(radiant.trigger.RF[1].mask, FIELD_HEX, ACQ_CFG_RADIANT_TRIGGER),
+  FIELD(radiant.trigger.RF[1].window, FIELD_FLT, ACQ_CFG_RADIANT_TRIGGER),
+  FIELD(radiant.trigger.RF[1].num_coincidences, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER),
+  FIELD(radiant.trigger.output_enabled, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER_ENABLES),
+  FIELD(radiant.trigger.ext.enabled, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER_ENABLES),
+  FIELD(radiant.trigger.pps.enabled, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER_ENABLES),
+  FIELD(radiant.trigger.pps.output_enabled, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER_ENABLES),
+  FIELD(radiant.trigger.soft.output_enabled, FIELD_INT, ACQ_CFG_RADIANT_TRIGGER_ENABLES),
+  FIELD(lt.trigger.window, FIELD_INT, ACQ_CFG_LT_TRIGGER),
+  FIELD(lt.trigger.vpp, FIELD_INT, ACQ_CFG_LT_TRIGGER),
+  FIELD(lt.trigger.min_coincidence, FIELD_INT, ACQ_CFG_LT_TRIGGER),
+  FIELD(lt.trigger.enable_rf_trigger, FIELD_INT, ACQ_CFG_LT_TRIGGER | ACQ_CFG_LT_TRIGGER_ENABLES),
+  FIELD(lt.trigger.enable_rf_trigger_sma_out, FIELD_INT, ACQ_CFG_LT_TRIGGER_ENABLES),
+  FIELD(lt.trigger.enable_rf_trigger_sys_out, FIELD_INT, ACQ_CFG_LT_TRIGGER_ENABLES),
+  FIELD(lt.trigger.enable_pps_trigger_sma_out, FIELD_INT, ACQ_CFG_LT_TRIGGER_ENABLES | ACQ_CFG_LT_PPS_DELAY),
+  FIELD(lt.trigger.enable_pps_trigger_sys_out, FIELD_INT, ACQ_CFG_LT_TRIGGER_ENABLES | ACQ_CFG_LT_PPS_DELAY),
+  FIELD(lt.trigger.pps_trigger_delay, FIELD_FLT, ACQ_CFG_LT_PPS_DELAY),
+  FIELD(lt.gain.auto_gain, FIELD_INT, ACQ_CFG_LT_GAINS),
+  FIELD(lt.gain.fixed_gain_codes, FIELD_BYTES, ACQ_CFG_LT_GAINS),
+  FIELD(calib.enable_cal, FIELD_INT, ACQ_CFG_CALIB),
+  FIELD(calib.i2c_bus, FIELD_INT, ACQ_CFG_CALIB),
+  FIELD(calib.gpio, FIELD_INT, ACQ_CFG_CALIB),
+  FIELD(calib.channel, FIELD_INT, ACQ_CFG_CALIB),
+  FIELD(calib.type, FIELD_INT, ACQ_CFG_CALIB),
+  FIELD(calib.atten, FIELD_FLT, ACQ_CFG_CALIB),
+#undef FIELD
+};
+
+static int field_int(const void * p, size_t size)
+{
+  if (size == sizeof(int)) return *(const int*) p;
+  if (size == sizeof(int16_t)) return *(const int16_t*) p;
+  return *(const int8_t*) p;
+}
+
+static void log_field_change(FILE * log, const struct config_field * fld, const uint8_t * old_p, const uint8_t * new_p)
+{
+  switch (fld->type)
+  {
+    case FIELD_FLT:
+      fprintf(log, "  %s: %g -> %g\n", fld->name, *(const float*) old_p, *(const float*) new_p);
+      break;
+    case FIELD_HEX:
+      fprintf(log, "  %s: 0x%x -> 0x%x\n", fld->name, *(const uint32_t*) old_p, *(const uint32_t*) new_p);
+      break;
+    case FIELD_BYTES:
+      for (size_t i = 0; i < fld->size; i++)
+      {
+        if (old_p[i] != new_p[i]) fprintf(log, "  %s[%zu]: %u -> %u\n", fld->name, i, old_p[i], new_p[i]);
+      }
+      break;
+    default:
+      fprintf(log, "  %s: %d -> %d\n", fld->name, field_int(old_p, fld->size), field_int(new_p, fld->size));
+  }
+}
+
+uint32_t acq_config_changes(const acq_config_t * old_cfg, const acq_config_t * new_cfg, FILE * log)
+{
+  uint32_t changes = 0;
+  for (size_t i = 0; i < sizeof(config_fields) / sizeof(*config_fields); i++)
+  {
+    const struct config_field * fld = &config_fields[i];
+    const uint8_t * old_p = (const uint8_t*) old_cfg + fld->offset;
+    const uint8_t * new_p = (const uint8_t*) new_cfg + fld->offset;
+    if (!memcmp(old_p, new_p, fld->size)) continue;
+    changes |= fld->changes;
+    if (log) log_field_change(log, fld, old_p, new_p);
+  }
+  return changes;
+}
+
+const char * acq_config_change_name(uint32_t change)
+{
+  switch (change)
+  {
+    case ACQ_CFG_RADIANT_PPS: return "radiant-pps";
+    case ACQ_CFG_RADIANT_DELAYS: return "radiant-readout-delays";
+    case ACQ_CFG_RADIANT_SCALERS: return "radiant-scalers";
+    case ACQ_CFG_RADIANT_TRIGGER: return "radiant-trigger";
+    case ACQ_CFG_RADIANT_TRIGGER_ENABLES: return "radiant-trigger-enables";
+    case ACQ_CFG_LT_TRIGGER: return "lt-trigger";
+    case ACQ_CFG_LT_TRIGGER_ENABLES: return "lt-trigger-enables";
+    case ACQ_CFG_LT_PPS_DELAY: return "lt-pps-delay";
+    case ACQ_CFG_LT_GAINS: return "lt-gains";
+    case ACQ_CFG_CALIB: return "calib";
+    default: return "?";
+  }
+}
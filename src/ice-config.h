@@ -51,6 +51,13 @@ typedef struct acq_config
       float P;
       float I;
       float D;
+      struct
+      {
+        int enable;
+        float max_interval;
+        float rate_tolerance;
+        float thresh_tolerance;
+      } adaptive_polling;
     } servo;
 
     struct
@@ -237,6 +244,12 @@ typedef struct acq_config
   struct
   {
     const char * status_shmem_file;
+    const char * status_history_file;
+    int status_history_seconds;
+    const char * metrics_socket;
+    int metrics_port;
+    int watch_config;
+    int watch_config_debounce_ms;
     int acq_buf_size;
     int mon_buf_size;
   } runtime;
@@ -259,6 +272,44 @@ typedef struct acq_config
     int min_free_space_MB_runfile_partition;
     int print_interval;
     int allow_rundir_overwrite;
+    int index_interval;
+    int header_columns;
+    int recover_previous_runs;
+    int compact_previous_run;
+    int compact_target_kB;
+    int servo_history;
+
+    struct
+    {
+      int preallocate_kB;
+      int writeback_kB;
+      int drop_cache_on_close;
+      int use_io_uring;
+    } io;
+
+    struct
+    {
+      int enable;
+      int seconds_per_file;
+    } container;
+
+    struct
+    {
+      int enable;
+      int compress_below_MB;
+      int drop_forced_below_MB;
+      int headers_only_below_MB;
+      int hysteresis_MB;
+      int forecast_seconds;
+      int waveform_compression_level;
+    } degrade;
+
+    struct
+    {
+      int enable;
+      int retake_pedestals;
+      int rerun_equalization;
+    } rollover;
   } output;
 
   //calibration
@@ -291,8 +342,38 @@ typedef struct acq_config
 /** Fill in some reasonable defaults for the acq_config_t */
 int init_acq_config(acq_config_t * cfg);
 int read_acq_config(FILE *f, acq_config_t * cfg);
+/** Just parses f, to see if read_acq_config would manage to (returns 0 if so). f is rewound after. */
+int check_acq_config(FILE *f);
 int dump_acq_config(FILE *f, const acq_config_t * cfg);
 
+/** What has to be redone on the hardware when the config changes at runtime. Settings not covered here either only
+ * matter at startup or are just read by the threads (servo gains, threshold limits, intervals...), so changing them
+ * doesn't need any registers touched. */
+enum
+{
+  ACQ_CFG_RADIANT_PPS             = 1 << 0,  // radiant.pps
+  ACQ_CFG_RADIANT_DELAYS          = 1 << 1,  // radiant.trigger.RF[].readout_delay(_mask)
+  ACQ_CFG_RADIANT_SCALERS         = 1 << 2,  // radiant.scalers (period and prescalers)
+  ACQ_CFG_RADIANT_TRIGGER         = 1 << 3,  // radiant.trigger.RF[] (masks, coincidences, windows)
+  ACQ_CFG_RADIANT_TRIGGER_ENABLES = 1 << 4,  // the RADIANT trigger and trigger output enables
+  ACQ_CFG_LT_TRIGGER              = 1 << 5,  // lt.trigger window, vpp mode and coincidences
+  ACQ_CFG_LT_TRIGGER_ENABLES      = 1 << 6,  // the flower trigger and trigger output enables
+  ACQ_CFG_LT_PPS_DELAY            = 1 << 7,  // the flower's delayed PPS
+  ACQ_CFG_LT_GAINS                = 1 << 8,  // fixed flower gains
+  ACQ_CFG_CALIB                   = 1 << 9,  // the calpulser
+  ACQ_CFG_NUM_CHANGE_TYPES        = 10
+};
+
+#define ACQ_CFG_RADIANT_ANY (ACQ_CFG_RADIANT_PPS | ACQ_CFG_RADIANT_DELAYS | ACQ_CFG_RADIANT_SCALERS | ACQ_CFG_RADIANT_TRIGGER | ACQ_CFG_RADIANT_TRIGGER_ENABLES)
+#define ACQ_CFG_LT_ANY (ACQ_CFG_LT_TRIGGER | ACQ_CFG_LT_TRIGGER_ENABLES | ACQ_CFG_LT_PPS_DELAY | ACQ_CFG_LT_GAINS)
+
+/** Compare two configs field by field, returning which of the above changed. If log isn't NULL, each changed field
+ * gets a line there (name: old -> new). */
+uint32_t acq_config_changes(const acq_config_t * old_cfg, const acq_config_t * new_cfg, FILE * log);
+
+/** A short name for one of the change types above */
+const char * acq_config_change_name(uint32_t change);
+
 
 typedef struct xfer_config
 {
@@ -0,0 +1,335 @@
+#define _GNU_SOURCE
+#include "ice-container.h" 
+#include <stdio.h> 
+#include <stdlib.h> 
+#include <string.h> 
+#include <unistd.h> 
+#include <fcntl.h> 
+#include <errno.h> 
+#include <sys/stat.h> 
+#include <sys/uio.h> 
+#include <zlib.h> 
+
+struct ice_container
+{
+  int fd; 
+  uint64_t end;   // end of the last chunk, i.e. where the footer goes 
+  int nchunks; 
+  int cap; 
+  ice_container_footer_entry_t * chunks; 
+}; 
+
+static const char * stream_names[] = {"wf","hd","ds","idx","other"}; 
+
+const char * ice_container_stream_name(int stream) 
+{
+  if (stream < 0 || stream > ICE_CONTAINER_OTHER) return "?"; 
+  return stream_names[stream]; 
+}
+
+
+static int pread_all(int fd, void * buf, size_t len, uint64_t off) 
+{
+  char * p = buf; 
+  while (len) 
+  {
+    ssize_t n = pread(fd, p, len, off); 
+    if (n < 0 && errno == EINTR) continue; 
+    if (n <= 0) return -1; 
+    p += n; 
+    len -= n; 
+    off += n; 
+  }
+  return 0; 
+}
+
+static int pwritev_all(int fd, struct iovec * iov, int niov, uint64_t off) 
+{
+  while (niov) 
+  {
+    ssize_t n = pwritev(fd, iov, niov, off); 
+    if (n < 0) 
+    {
+      if (errno == EINTR) continue; 
+      return -errno; 
+    }
+    off += n; 
+    while (niov && (size_t) n >= iov->iov_len) 
+    {
+      n -= iov->iov_len; 
+      iov++; 
+      niov--; 
+    }
+    if (niov) 
+    {
+      iov->iov_base = (char*) iov->iov_base + n; 
+      iov->iov_len -= n; 
+    }
+  }
+  return 0; 
+}
+
+static int crc_of_fd(int fd, uint64_t off, uint64_t len, uint32_t * crc_out) 
+{
+  static __thread unsigned char buf[64 << 10]; 
+  uLong crc = crc32(0, Z_NULL, 0); 
+  while (len) 
+  {
+    size_t n = len < sizeof(buf) ? len : sizeof(buf); 
+    if (pread_all(fd, buf, n, off)) return -1; 
+    crc = crc32(crc, buf, n); 
+    off += n; 
+    len -= n; 
+  }
+  *crc_out = crc; 
+  return 0; 
+}
+
+/* Try the footer. Returns the number of chunks or -1 if it's no good */ 
+static int read_footer(int fd, uint64_t size, ice_container_footer_entry_t ** chunks) 
+{
+  ice_container_trailer_t t; 
+  if (size < sizeof(ice_container_file_header_t) + sizeof(t)) return -1; 
+  if (pread_all(fd, &t, sizeof(t), size - sizeof(t))) return -1; 
+  if (t.magic != ICE_CONTAINER_FOOTER_MAGIC) return -1; 
+  if (t.footer_offset + (uint64_t) t.nchunks * sizeof(ice_container_footer_entry_t) + sizeof(t) != size) return -1; 
+
+  ice_container_footer_entry_t * c = calloc(t.nchunks ? t.nchunks : 1, sizeof(*c)); 
+  if (!c) return -1; 
+  if (pread_all(fd, c, t.nchunks * sizeof(*c), t.footer_offset) || 
+      crc32(crc32(0, Z_NULL, 0), (unsigned char*) c, t.nchunks * sizeof(*c)) != t.crc32) 
+  {
+    free(c); 
+    return -1; 
+  }
+
+  *chunks = c; 
+  return t.nchunks; 
+}
+
+/* Walk the chunks from the start, stopping at the first bad one. *end is set to the end of the last good one. 
+ * Returns the number of good chunks, or -1 if we ran out of memory (and *chunks is NULL) */ 
+static int scan_chunks(int fd, uint64_t size, ice_container_footer_entry_t ** chunks, uint64_t * end) 
+{
+  int n = 0, cap = 0; 
+  ice_container_footer_entry_t * c = NULL; 
+  uint64_t off = sizeof(ice_container_file_header_t); 
+
+  while (off + sizeof(ice_container_chunk_header_t) <= size) 
+  {
+    ice_container_chunk_header_t h; 
+    if (pread_all(fd, &h, sizeof(h), off)) break; 
+    if (h.magic != ICE_CONTAINER_CHUNK_MAGIC) break; 
+    uint64_t payload_off = off + sizeof(h) + h.name_len; 
+    if (payload_off + h.payload_len > size) break; 
+    uint32_t crc; 
+    if (crc_of_fd(fd, payload_off, h.payload_len, &crc) || crc != h.crc32) break; 
+
+    if (n == cap) 
+    {
+      cap = cap ? 2 * cap : 64; 
+      ice_container_footer_entry_t * new_c = realloc(c, cap * sizeof(*c)); 
+      if (!new_c) 
+      {
+        free(c); 
+        *chunks = NULL; 
+        return -1; 
+      }
+      c = new_c; 
+    }
+    c[n].offset = off; 
+    c[n].payload_len = h.payload_len; 
+    c[n].stream = h.stream; 
+    c[n].name_len = h.name_len; 
+    c[n].first_event = h.first_event; 
+    n++; 
+    off = payload_off + h.payload_len; 
+  }
+
+  *chunks = c; 
+  *end = off; 
+  return n; 
+}
+
+static int write_footer(ice_container_t * c) 
+{
+  ice_container_trailer_t t = { .footer_offset = c->end, .nchunks = c->nchunks, 
+                                .magic = ICE_CONTAINER_FOOTER_MAGIC, .version = ICE_CONTAINER_VERSION }; 
+  size_t len = c->nchunks * sizeof(*c->chunks); 
+  t.crc32 = crc32(crc32(0, Z_NULL, 0), (unsigned char*) c->chunks, len); 
+
+  struct iovec iov[2] = { { .iov_base = c->chunks, .iov_len = len }, { .iov_base = &t, .iov_len = sizeof(t) } }; 
+  return pwritev_all(c->fd, iov, 2, c->end); 
+}
+
+ice_container_t * ice_container_open(const char * path) 
+{
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644); 
+  if (fd < 0) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    return NULL; 
+  }
+
+  ice_container_t * c = calloc(sizeof(ice_container_t),1); 
+  if (!c) 
+  {
+    close(fd); 
+    return NULL; 
+  }
+  c->fd = fd; 
+
+  struct stat st; 
+  fstat(fd, &st); 
+  ice_container_file_header_t fh = { .magic = ICE_CONTAINER_MAGIC, .version = ICE_CONTAINER_VERSION }; 
+
+  if (st.st_size < (off_t) sizeof(fh))  // new (or hopelessly broken) 
+  {
+    if (ftruncate(fd, 0) || pwrite(fd, &fh, sizeof(fh), 0) != sizeof(fh)) 
+    {
+      fprintf(stderr,"Could not write to %s\n", path); 
+      close(fd); 
+      free(c); 
+      return NULL; 
+    }
+    c->end = sizeof(fh); 
+  }
+  else
+  {
+    ice_container_file_header_t existing; 
+    if (pread_all(fd, &existing, sizeof(existing), 0) || existing.magic != ICE_CONTAINER_MAGIC) 
+    {
+      fprintf(stderr,"%s exists but is not a container, not touching it\n", path); 
+      close(fd); 
+      free(c); 
+      return NULL; 
+    }
+
+    //always scan rather than trusting the footer, since we're about to build on it 
+    uint64_t end; 
+    c->nchunks = scan_chunks(fd, st.st_size, &c->chunks, &end); 
+    if (c->nchunks < 0) // leave it alone, we don't know where it ends 
+    {
+      fprintf(stderr,"Out of memory scanning %s\n", path); 
+      close(fd); 
+      free(c); 
+      return NULL; 
+    }
+    c->cap = c->nchunks; 
+    c->end = end; 
+    if (ftruncate(fd, end)) 
+    {
+      fprintf(stderr,"Could not truncate %s\n", path); 
+    }
+  }
+
+  write_footer(c); 
+  return c; 
+}
+
+int ice_container_append(ice_container_t * c, int stream, uint32_t first_event, const char * name, const void * data, size_t len) 
+{
+  ice_container_chunk_header_t h = { .magic = ICE_CONTAINER_CHUNK_MAGIC, .stream = stream, 
+                                     .name_len = strlen(name), .first_event = first_event, .payload_len = len }; 
+  h.crc32 = crc32(crc32(0, Z_NULL, 0), data, len); 
+
+  if (c->nchunks == c->cap) 
+  {
+    int new_cap = c->cap ? 2 * c->cap : 64; 
+    ice_container_footer_entry_t * new_chunks = realloc(c->chunks, new_cap * sizeof(*new_chunks)); 
+    if (!new_chunks) return -ENOMEM; 
+    c->chunks = new_chunks; 
+    c->cap = new_cap; 
+  }
+
+  struct iovec iov[3] = { { .iov_base = &h, .iov_len = sizeof(h) }, 
+                          { .iov_base = (void*) name, .iov_len = h.name_len }, 
+                          { .iov_base = (void*) data, .iov_len = len } }; 
+
+  // this overwrites the old footer, so until the new one is written, readers have to scan 
+  int ret = pwritev_all(c->fd, iov, 3, c->end); 
+  if (ret) 
+  {
+    fprintf(stderr,"Problem appending %s to container (%s)\n", name, strerror(-ret)); 
+    write_footer(c); // try to put things back the way they were 
+    return ret; 
+  }
+
+  ice_container_footer_entry_t * e = &c->chunks[c->nchunks++]; 
+  e->offset = c->end; 
+  e->payload_len = len; 
+  e->stream = stream; 
+  e->name_len = h.name_len; 
+  e->first_event = first_event; 
+  c->end += sizeof(h) + h.name_len + len; 
+
+  return write_footer(c); 
+}
+
+uint64_t ice_container_size(const ice_container_t * c) 
+{
+  return c->end + c->nchunks * sizeof(*c->chunks) + sizeof(ice_container_trailer_t); 
+}
+
+int ice_container_close(ice_container_t * c) 
+{
+  int ret = write_footer(c); 
+  ret = close(c->fd) || ret; 
+  free(c->chunks); 
+  free(c); 
+  return ret; 
+}
+
+
+int ice_container_list(const char * path, ice_container_footer_entry_t ** chunks, int * recovered) 
+{
+  *chunks = NULL; 
+  int fd = open(path, O_RDONLY | O_CLOEXEC); 
+  if (fd < 0) return -1; 
+
+  struct stat st; 
+  fstat(fd, &st); 
+  ice_container_file_header_t fh; 
+  if (pread_all(fd, &fh, sizeof(fh), 0) || fh.magic != ICE_CONTAINER_MAGIC) 
+  {
+    close(fd); 
+    return -1; 
+  }
+
+  int n = read_footer(fd, st.st_size, chunks); 
+  if (recovered) *recovered = n < 0; 
+  if (n < 0) 
+  {
+    uint64_t end; 
+    n = scan_chunks(fd, st.st_size, chunks, &end); 
+  }
+
+  close(fd); 
+  return n; 
+}
+
+ssize_t ice_container_read_chunk(int fd, const ice_container_footer_entry_t * chunk, char * name, int name_size, void ** data) 
+{
+  *data = NULL; 
+  ice_container_chunk_header_t h; 
+  if (pread_all(fd, &h, sizeof(h), chunk->offset) || h.magic != ICE_CONTAINER_CHUNK_MAGIC || 
+      h.payload_len != chunk->payload_len || h.name_len >= name_size) 
+  {
+    return -1; 
+  }
+
+  if (pread_all(fd, name, h.name_len, chunk->offset + sizeof(h))) return -1; 
+  name[h.name_len] = 0; 
+
+  void * payload = malloc(h.payload_len ? h.payload_len : 1); 
+  if (!payload) return -1; 
+  if (pread_all(fd, payload, h.payload_len, chunk->offset + sizeof(h) + h.name_len) || 
+      crc32(crc32(0, Z_NULL, 0), payload, h.payload_len) != h.crc32) 
+  {
+    free(payload); 
+    return -1; 
+  }
+
+  *data = payload; 
+  return h.payload_len; 
+}
@@ -0,0 +1,108 @@
+#ifndef _RNO_G_ICE_CONTAINER_H
+#define _RNO_G_ICE_CONTAINER_H
+
+/** Run containers: one big append-only file instead of lots of little ones. 
+ *
+ * A container holds chunks, each of which is what would otherwise have been a file in the
+ * run directory (a complete, independently compressed gzip file, or an index sidecar), tagged 
+ * with its stream type and its name relative to the run directory, so the usual per-file layout 
+ * can be recreated exactly (see rno-g-container-extract). 
+ *
+ * Layout: 
+ *   file header (magic, version) 
+ *   chunk: chunk header, name (not NUL-terminated), payload 
+ *   chunk ... 
+ *   footer: one ice_container_footer_entry_t per chunk, then an ice_container_trailer_t 
+ *
+ * The footer is rewritten after every chunk (each new chunk goes where the old footer was). 
+ * If the footer is missing or bad (e.g. we died while appending), readers fall back to 
+ * scanning the chunks from the start, stopping at the first one that doesn't check out 
+ * (the payloads have crc32s), and ice_container_open on an existing file truncates it back to the 
+ * last good chunk and carries on from there. 
+ *
+ * Everything is little-endian. 
+ **/ 
+
+#include <stdint.h> 
+#include <stddef.h> 
+#include <sys/types.h> 
+
+#define ICE_CONTAINER_MAGIC         0x434f4e52  /* "RNOC" */ 
+#define ICE_CONTAINER_CHUNK_MAGIC   0x4b484352  /* "RCHK" */ 
+#define ICE_CONTAINER_FOOTER_MAGIC  0x544f4652  /* "RFOT" */ 
+#define ICE_CONTAINER_VERSION 1 
+
+typedef enum 
+{
+  ICE_CONTAINER_WF = 0, 
+  ICE_CONTAINER_HD = 1, 
+  ICE_CONTAINER_DS = 2, 
+  ICE_CONTAINER_IDX = 3, 
+  ICE_CONTAINER_OTHER = 4 
+} ice_container_stream_t; 
+
+typedef struct ice_container_file_header 
+{
+  uint32_t magic; 
+  uint32_t version; 
+} ice_container_file_header_t; 
+
+typedef struct ice_container_chunk_header 
+{
+  uint32_t magic; 
+  uint16_t stream; 
+  uint16_t name_len; 
+  uint32_t first_event;  // first event (or daqstatus) number in the chunk, if that makes sense 
+  uint32_t crc32;        // of the payload 
+  uint64_t payload_len; 
+} ice_container_chunk_header_t; 
+
+typedef struct ice_container_footer_entry
+{
+  uint64_t offset;      // of the chunk header 
+  uint64_t payload_len; 
+  uint16_t stream; 
+  uint16_t name_len; 
+  uint32_t first_event; 
+} ice_container_footer_entry_t; 
+
+typedef struct ice_container_trailer 
+{
+  uint64_t footer_offset; 
+  uint32_t nchunks; 
+  uint32_t crc32;       // of the footer entries 
+  uint32_t magic; 
+  uint32_t version; 
+} ice_container_trailer_t; 
+
+const char * ice_container_stream_name(int stream); 
+
+/** Writing **/ 
+
+struct ice_container; 
+typedef struct ice_container ice_container_t; 
+
+/* Open a container for appending, creating it if necessary. If it already exists, it is checked, and 
+ * anything after the last good chunk is dropped. Returns NULL on failure. */ 
+ice_container_t * ice_container_open(const char * path); 
+
+/* Append a chunk and rewrite the footer. Returns 0 on success. */ 
+int ice_container_append(ice_container_t * c, int stream, uint32_t first_event, const char * name, const void * data, size_t len); 
+
+/* Bytes in the container, including the footer */ 
+uint64_t ice_container_size(const ice_container_t * c); 
+
+int ice_container_close(ice_container_t * c); 
+
+
+/** Reading **/ 
+
+/* Get the chunk list, from the footer if it is good, otherwise by scanning. *chunks is allocated and should be freed. 
+ * Returns the number of chunks or -1 if path isn't a container (or we ran out of memory). If recovered is not NULL, it is set if the footer couldn't be used. */ 
+int ice_container_list(const char * path, ice_container_footer_entry_t ** chunks, int * recovered); 
+
+/* Read one chunk (as listed by ice_container_list) from an open container. name is filled with a NUL-terminated name 
+ * (size name_size), and *data with the payload (free it). Returns the payload length, or -1 if the chunk is bad. */ 
+ssize_t ice_container_read_chunk(int fd, const ice_container_footer_entry_t * chunk, char * name, int name_size, void ** data); 
+
+#endif
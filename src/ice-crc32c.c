@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include "ice-crc32c.h" 
+#include <string.h> 
+#include <pthread.h> 
+
+#if defined(__aarch64__) 
+#include <arm_acle.h> 
+#include <sys/auxv.h> 
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7) 
+#endif
+#endif
+
+#define POLY 0x82f63b78  // reflected Castagnoli 
+
+static uint32_t table[8][256]; 
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char * p, size_t len) 
+{
+  crc = ~crc; 
+
+  //byte at a time until aligned 
+  while (len && ((uintptr_t) p & 7)) 
+  {
+    crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8); 
+    len--; 
+  }
+
+  while (len >= 8) 
+  {
+    uint64_t word; 
+    memcpy(&word, p, 8); 
+    word ^= crc;   // (little-endian) 
+    crc = table[7][word & 0xff] ^ 
+          table[6][(word >> 8) & 0xff] ^ 
+          table[5][(word >> 16) & 0xff] ^ 
+          table[4][(word >> 24) & 0xff] ^ 
+          table[3][(word >> 32) & 0xff] ^ 
+          table[2][(word >> 40) & 0xff] ^ 
+          table[1][(word >> 48) & 0xff] ^ 
+          table[0][word >> 56]; 
+    p += 8; 
+    len -= 8; 
+  }
+
+  while (len--) crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8); 
+  return ~crc; 
+}
+
+#if defined(__x86_64__) 
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char * p, size_t len) 
+{
+  uint64_t c = ~crc; 
+  while (len && ((uintptr_t) p & 7)) 
+  {
+    c = __builtin_ia32_crc32qi(c, *p++); 
+    len--; 
+  }
+  while (len >= 8) 
+  {
+    uint64_t word; 
+    memcpy(&word, p, 8); 
+    c = __builtin_ia32_crc32di(c, word); 
+    p += 8; 
+    len -= 8; 
+  }
+  while (len--) c = __builtin_ia32_crc32qi(c, *p++); 
+  return ~(uint32_t) c; 
+}
+#define HW_NAME "sse4.2" 
+static int have_hw(void) { return __builtin_cpu_supports("sse4.2"); } 
+
+#elif defined(__aarch64__) 
+__attribute__((target("+crc")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char * p, size_t len) 
+{
+  uint32_t c = ~crc; 
+  while (len && ((uintptr_t) p & 7)) 
+  {
+    c = __crc32cb(c, *p++); 
+    len--; 
+  }
+  while (len >= 8) 
+  {
+    uint64_t word; 
+    memcpy(&word, p, 8); 
+    c = __crc32cd(c, word); 
+    p += 8; 
+    len -= 8; 
+  }
+  while (len--) c = __crc32cb(c, *p++); 
+  return ~c; 
+}
+#define HW_NAME "armv8" 
+static int have_hw(void) { return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0; } 
+
+#else 
+#define HW_NAME "sw" 
+#define crc32c_hw crc32c_sw 
+static int have_hw(void) { return 0; } 
+#endif
+
+
+static uint32_t (*impl)(uint32_t, const unsigned char *, size_t) = 0; 
+static pthread_once_t impl_once = PTHREAD_ONCE_INIT; 
+
+static void choose_impl(void) 
+{
+  for (int i = 0; i < 256; i++) 
+  {
+    uint32_t crc = i; 
+    for (int k = 0; k < 8; k++) crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1; 
+    table[0][i] = crc; 
+  }
+  for (int i = 0; i < 256; i++) 
+  {
+    for (int t = 1; t < 8; t++) table[t][i] = (table[t-1][i] >> 8) ^ table[0][table[t-1][i] & 0xff]; 
+  }
+
+  impl = have_hw() ? crc32c_hw : crc32c_sw; 
+}
+
+uint32_t ice_crc32c(uint32_t crc, const void * buf, size_t len) 
+{
+  pthread_once(&impl_once, choose_impl); 
+  return impl(crc, buf, len); 
+}
+
+const char * ice_crc32c_impl(void) 
+{
+  pthread_once(&impl_once, choose_impl); 
+  return impl == crc32c_sw ? "sw" : HW_NAME; 
+}
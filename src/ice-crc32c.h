@@ -0,0 +1,19 @@
+#ifndef _RNO_G_ICE_CRC32C_H
+#define _RNO_G_ICE_CRC32C_H
+
+/** CRC32C (Castagnoli), as used for the output checksums in the manifest. 
+ *
+ * Uses the CRC instructions on x86 (SSE4.2) and ARMv8 when the CPU has them, and a 
+ * table-driven (slicing-by-8) version otherwise (e.g. on the BeagleBone's Cortex-A8). 
+ * Like zlib's crc32, start with crc = 0 and feed the previous value back in to continue. 
+ **/ 
+
+#include <stddef.h> 
+#include <stdint.h> 
+
+uint32_t ice_crc32c(uint32_t crc, const void * buf, size_t len); 
+
+/* Which implementation is being used ("sse4.2", "armv8" or "sw") */ 
+const char * ice_crc32c_impl(void); 
+
+#endif
@@ -0,0 +1,60 @@
+#include "ice-dsaux.h"
+#include <stdlib.h>
+#include <string.h>
+
+FILE * ice_dsaux_create(const char * path, int station, int run) 
+{
+  FILE * f = fopen(path, "w"); 
+  if (!f) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    return NULL; 
+  }
+
+  ice_dsaux_header_t hdr = {.magic = ICE_DSAUX_MAGIC, .version = ICE_DSAUX_VERSION, 
+                              .record_size = sizeof(ice_dsaux_record_t), .station = station, .run = run}; 
+  if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 || fflush(f)) 
+  {
+    fprintf(stderr,"Could not write to %s\n", path); 
+    fclose(f); 
+    return NULL; 
+  }
+  return f; 
+}
+
+int ice_dsaux_append(FILE * f, const ice_dsaux_record_t * record) 
+{
+  return fwrite(record, sizeof(*record), 1, f) == 1 ? 0 : -1; 
+}
+
+int ice_dsaux_load(const char * path, ice_dsaux_header_t * hdr, ice_dsaux_record_t ** records) 
+{
+  *records = NULL; 
+  FILE * f = fopen(path,"r"); 
+  if (!f) return -1; 
+
+  ice_dsaux_header_t h; 
+  if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != ICE_DSAUX_MAGIC || h.record_size < sizeof(ice_dsaux_record_t)) 
+  {
+    fprintf(stderr,"%s is not a daqstatus aux stream (or is from the future)\n", path); 
+    fclose(f); 
+    return -1; 
+  }
+  if (hdr) *hdr = h; 
+
+  fseek(f, 0, SEEK_END); 
+  long n = (ftell(f) - (long) sizeof(h)) / h.record_size; 
+  fseek(f, sizeof(h), SEEK_SET); 
+
+  *records = calloc(n ? n : 1, sizeof(ice_dsaux_record_t)); 
+  char * record = malloc(h.record_size); 
+  int nread = 0; 
+  while (nread < n && fread(record, h.record_size, 1, f) == 1) 
+  {
+    //later versions may have larger records, but will keep the start the same 
+    memcpy(&(*records)[nread++], record, sizeof(ice_dsaux_record_t)); 
+  }
+  free(record); 
+  fclose(f); 
+  return nread; 
+}
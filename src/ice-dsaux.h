@@ -0,0 +1,53 @@
+#ifndef _RNO_G_ICE_DSAUX_H
+#define _RNO_G_ICE_DSAUX_H
+
+/** The daqstatus aux stream.
+ *
+ * rno_g_daqstatus_t belongs to librno-g, so things about how rno-g-acq itself got the daqstatus go next to it instead: 
+ * every daqstatus written gets a record in aux/daqstatus-aux.dat of its run, with the same when. For now that's the
+ * RADIANT scaler polling interval in effect (which changes with radiant.servo.adaptive_polling) and running totals
+ * of the RADIANT scaler reads, RADIANT UART commands and the monitor thread's CPU time, so the cost of polling can be
+ * compared between settings.
+ *
+ * Same layout as the soft trigger log (see ice-softlog.h): a small header followed by fixed-size records, not compressed, 
+ * little-endian.
+ **/ 
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define ICE_DSAUX_NAME "aux/daqstatus-aux.dat"
+#define ICE_DSAUX_MAGIC 0x58554144  /* "DAUX" */
+#define ICE_DSAUX_VERSION 1
+
+typedef struct ice_dsaux_header
+{
+  uint32_t magic; 
+  uint16_t version; 
+  uint16_t record_size; 
+  uint32_t station; 
+  uint32_t run; 
+} ice_dsaux_header_t; 
+
+/* The totals count from the start of rno-g-acq, so take differences */ 
+typedef struct ice_dsaux_record
+{
+  double when;                          // the daqstatus's when, to match them up 
+  float radiant_scaler_interval;        // seconds between RADIANT scaler reads at the time 
+  uint32_t radiant_scaler_reads;        // total RADIANT scaler reads 
+  uint32_t radiant_scaler_retries;      // of which had to be redone because the two reads disagreed 
+  uint32_t radiant_uart_commands;       // total RADIANT UART commands (each libradiant call counts as one) 
+  uint64_t mon_cpu_ns;                  // total CPU time of the monitor thread 
+} ice_dsaux_record_t; 
+
+/* Open a new aux stream for writing (writes the header) */ 
+FILE * ice_dsaux_create(const char * path, int station, int run); 
+
+/* Append a record. Returns 0 on success. Not flushed. */ 
+int ice_dsaux_append(FILE * f, const ice_dsaux_record_t * record); 
+
+/* Read a whole aux stream. *records is allocated and should be freed. hdr may be NULL. Returns the number of
+ * records, or -1 if the file can't be read. A truncated last record is ignored. */ 
+int ice_dsaux_load(const char * path, ice_dsaux_header_t * hdr, ice_dsaux_record_t ** records); 
+
+#endif
@@ -0,0 +1,203 @@
+#include "ice-dshist.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ROUND8(x) (((x) + 7) & ~7)
+#define HEADER_SIZE ROUND8(sizeof(ice_dshist_header_t))
+#define SLOT_SIZE ROUND8(sizeof(ice_dshist_slot_t) + sizeof(rno_g_daqstatus_t))
+#define MAX_READ_TRIES 1000
+
+struct ice_dshist
+{
+  int fd; 
+  size_t size; 
+  ice_dshist_header_t * hdr; 
+}; 
+
+static ice_dshist_slot_t * get_slot(const ice_dshist_t * h, uint64_t i) 
+{
+  return (ice_dshist_slot_t*) ((char*) h->hdr + HEADER_SIZE + (i % h->hdr->nslots) * SLOT_SIZE); 
+}
+
+static rno_g_daqstatus_t * slot_ds(ice_dshist_slot_t * slot) 
+{
+  return (rno_g_daqstatus_t*) (slot + 1); 
+}
+
+static int header_ok(const ice_dshist_header_t * hdr, size_t file_size) 
+{
+  return hdr->magic == ICE_DSHIST_MAGIC && hdr->version == ICE_DSHIST_VERSION && 
+         hdr->header_size == HEADER_SIZE && hdr->ds_size == sizeof(rno_g_daqstatus_t) && 
+         hdr->slot_size == SLOT_SIZE && hdr->nslots > 0 && HEADER_SIZE + (size_t) hdr->nslots * SLOT_SIZE == file_size; 
+}
+
+ice_dshist_t * ice_dshist_create(const char * path, int nslots) 
+{
+  if (nslots < 1) nslots = 1; 
+  size_t size = HEADER_SIZE + (size_t) nslots * SLOT_SIZE; 
+
+  int fd = open(path, O_CREAT | O_RDWR, 0644); 
+  if (fd < 0) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    return NULL; 
+  }
+
+  //keep what's there if it fits, otherwise start over (truncating to 0 first zeroes everything) 
+  ice_dshist_header_t old; 
+  struct stat st; 
+  int keep = !fstat(fd, &st) && (size_t) st.st_size == size && 
+             pread(fd, &old, sizeof(old), 0) == sizeof(old) && header_ok(&old, size); 
+  if (!keep && (ftruncate(fd, 0) || ftruncate(fd, size))) 
+  {
+    fprintf(stderr,"Could not resize %s\n", path); 
+    close(fd); 
+    return NULL; 
+  }
+
+  void * map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); 
+  if (map == MAP_FAILED) 
+  {
+    fprintf(stderr,"Could not mmap %s\n", path); 
+    close(fd); 
+    return NULL; 
+  }
+
+  ice_dshist_t * h = calloc(1, sizeof(ice_dshist_t)); 
+  h->fd = fd; 
+  h->size = size; 
+  h->hdr = map; 
+
+  if (!keep) 
+  {
+    h->hdr->header_size = HEADER_SIZE; 
+    h->hdr->ds_size = sizeof(rno_g_daqstatus_t); 
+    h->hdr->slot_size = SLOT_SIZE; 
+    h->hdr->nslots = nslots; 
+    h->hdr->nwritten = 0; 
+    h->hdr->version = ICE_DSHIST_VERSION; 
+    __atomic_store_n(&h->hdr->magic, ICE_DSHIST_MAGIC, __ATOMIC_RELEASE); 
+  }
+  else
+  {
+    //if the last writer died in the middle of a slot, that slot is no good 
+    for (int i = 0; i < nslots; i++) 
+    {
+      ice_dshist_slot_t * slot = get_slot(h, i); 
+      if (slot->seq & 1) 
+      {
+        slot->index = UINT64_MAX; 
+        __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE); 
+      }
+    }
+  }
+  h->hdr->writer_pid = getpid(); 
+  return h; 
+}
+
+void ice_dshist_append(ice_dshist_t * h, const rno_g_daqstatus_t * ds) 
+{
+  struct timespec now; 
+  clock_gettime(CLOCK_REALTIME, &now); 
+
+  uint64_t i = h->hdr->nwritten; 
+  ice_dshist_slot_t * slot = get_slot(h, i); 
+  uint32_t seq = slot->seq; 
+  __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED); 
+  __atomic_thread_fence(__ATOMIC_RELEASE); 
+  slot->index = i; 
+  slot->write_time_ns = now.tv_sec * 1000000000ull + now.tv_nsec; 
+  memcpy(slot_ds(slot), ds, sizeof(*ds)); 
+  __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE); 
+  __atomic_store_n(&h->hdr->nwritten, i + 1, __ATOMIC_RELEASE); 
+}
+
+ice_dshist_t * ice_dshist_open(const char * path) 
+{
+  int fd = open(path, O_RDONLY); 
+  if (fd < 0) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    return NULL; 
+  }
+
+  struct stat st; 
+  ice_dshist_header_t hdr; 
+  if (fstat(fd, &st) || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || !header_ok(&hdr, st.st_size)) 
+  {
+    fprintf(stderr,"%s is not a daqstatus history (or is from a different version)\n", path); 
+    close(fd); 
+    return NULL; 
+  }
+
+  void * map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0); 
+  if (map == MAP_FAILED) 
+  {
+    close(fd); 
+    return NULL; 
+  }
+
+  ice_dshist_t * h = calloc(1, sizeof(ice_dshist_t)); 
+  h->fd = fd; 
+  h->size = st.st_size; 
+  h->hdr = map; 
+  return h; 
+}
+
+int ice_dshist_nslots(const ice_dshist_t * h) 
+{
+  return h->hdr->nslots; 
+}
+
+int ice_dshist_read(const ice_dshist_t * h, int n, rno_g_daqstatus_t * ds, uint64_t * times) 
+{
+  uint64_t nwritten = __atomic_load_n(&h->hdr->nwritten, __ATOMIC_ACQUIRE); 
+  if ((uint64_t) n > nwritten) n = nwritten; 
+  if ((uint32_t) n > h->hdr->nslots) n = h->hdr->nslots; 
+
+  int got = 0; 
+  for (uint64_t i = nwritten - n; i < nwritten; i++) 
+  {
+    ice_dshist_slot_t * slot = get_slot(h, i); 
+    for (int tries = 0; tries < MAX_READ_TRIES; tries++) 
+    {
+      uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE); 
+      if (seq & 1) 
+      {
+        sched_yield(); 
+        continue; 
+      }
+
+      uint64_t index = slot->index; 
+      uint64_t t = slot->write_time_ns; 
+      memcpy(&ds[got], slot_ds(slot), sizeof(*ds)); 
+      __atomic_thread_fence(__ATOMIC_ACQUIRE); 
+      if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) continue; 
+
+      //if it's been overwritten by a newer one, skip it (we'll get the newer one on the next read) 
+      if (index == i) 
+      {
+        if (times) times[got] = t; 
+        got++; 
+      }
+      break; 
+    }
+  }
+  return got; 
+}
+
+int ice_dshist_close(ice_dshist_t * h) 
+{
+  if (!h) return 0; 
+  munmap(h->hdr, h->size); 
+  close(h->fd); 
+  free(h); 
+  return 0; 
+}
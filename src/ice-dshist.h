@@ -0,0 +1,63 @@
+#ifndef _RNO_G_ICE_DSHIST_H
+#define _RNO_G_ICE_DSHIST_H
+
+/** The shared daqstatus history (runtime.status_history_file, /rno-g/run/daqstatus-history.dat by default).
+ *
+ * Like the shared daqstatus (ice-dsshm.h), but a ring of the last nslots of them (enough for
+ * runtime.status_history_seconds at output.daqstatus_interval), so looking at recent trends doesn't mean
+ * decompressing daqstatus files from the SD card. rno-g-status-trends prints them.
+ *
+ * The file is an ice_dshist_header_t, then (at header_size) nslots slots of slot_size bytes, each an
+ * ice_dshist_slot_t followed by an rno_g_daqstatus_t. Status number i (counting from 0 since the ring was created) 
+ * goes in slot i % nslots. There's one writer, and each slot has its own seqlock (odd seq while being written), 
+ * and says which status it holds, so a reader can tell if it got overwritten while reading. The header's
+ * nwritten is only updated after a slot is complete. ice_dshist_read does all of this.
+ **/ 
+
+#include <stdint.h>
+#include "rno-g.h"
+
+#define ICE_DSHIST_MAGIC 0x54534844 /* "DHST" */
+#define ICE_DSHIST_VERSION 1
+
+typedef struct ice_dshist_header
+{
+  uint32_t magic; 
+  uint16_t version; 
+  uint16_t header_size; 
+  uint32_t ds_size; 
+  uint32_t slot_size; 
+  uint32_t nslots; 
+  uint32_t writer_pid; 
+  uint64_t nwritten;       // the number of statuses ever written 
+} ice_dshist_header_t; 
+
+typedef struct ice_dshist_slot
+{
+  uint32_t seq;            // odd while being written 
+  uint32_t reserved; 
+  uint64_t index;          // which status this is 
+  uint64_t write_time_ns;  // CLOCK_REALTIME 
+} ice_dshist_slot_t; 
+
+struct ice_dshist; 
+typedef struct ice_dshist ice_dshist_t; 
+
+/* For the writer (rno-g-acq). Keeps what's already there if it's the same size, otherwise starts over */ 
+ice_dshist_t * ice_dshist_create(const char * path, int nslots); 
+
+/* Add a status. Only one thread should do this. */ 
+void ice_dshist_append(ice_dshist_t * h, const rno_g_daqstatus_t * ds); 
+
+/* For readers */ 
+ice_dshist_t * ice_dshist_open(const char * path); 
+int ice_dshist_nslots(const ice_dshist_t * h); 
+
+/* Copy out (up to) the last n statuses, oldest first, without locking. times (may be NULL) gets when each was
+ * written (CLOCK_REALTIME ns). Returns how many were copied (which may be fewer than n if the ring hasn't filled
+ * up yet, or if the writer lapped us). */ 
+int ice_dshist_read(const ice_dshist_t * h, int n, rno_g_daqstatus_t * ds, uint64_t * times); 
+
+int ice_dshist_close(ice_dshist_t * h); 
+
+#endif
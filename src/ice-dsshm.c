@@ -0,0 +1,172 @@
+#include "ice-dsshm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HEADER_SIZE ((sizeof(ice_dsshm_header_t) + 7) & ~7)
+#define FILE_SIZE (HEADER_SIZE + sizeof(rno_g_daqstatus_t))
+#define MAX_READ_TRIES 1000
+
+struct ice_dsshm
+{
+  int fd; 
+  int writer; 
+  size_t size; 
+  ice_dsshm_header_t * hdr; 
+  rno_g_daqstatus_t * ds; 
+}; 
+
+static int header_ok(const ice_dsshm_header_t * hdr) 
+{
+  return hdr->magic == ICE_DSSHM_MAGIC && hdr->version == ICE_DSSHM_VERSION && 
+         hdr->header_size == HEADER_SIZE && hdr->ds_size == sizeof(rno_g_daqstatus_t); 
+}
+
+ice_dsshm_t * ice_dsshm_create(const char * path, rno_g_daqstatus_t * last, int * have_last) 
+{
+  *have_last = 0; 
+  memset(last, 0, sizeof(*last)); 
+
+  int fd = open(path, O_CREAT | O_RDWR, 0755); 
+  if (fd < 0) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    return NULL; 
+  }
+
+  struct stat st; 
+  fstat(fd, &st); 
+
+  //what was there before? 
+  if (st.st_size == sizeof(rno_g_daqstatus_t)) // from before there was a header 
+  {
+    *have_last = pread(fd, last, sizeof(*last), 0) == sizeof(*last); 
+  }
+  else if (st.st_size == (off_t) FILE_SIZE) 
+  {
+    ice_dsshm_header_t hdr; 
+    if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && header_ok(&hdr) && !(hdr.seq & 1)) 
+    {
+      *have_last = pread(fd, last, sizeof(*last), HEADER_SIZE) == sizeof(*last); 
+    }
+  }
+  if (!*have_last) memset(last, 0, sizeof(*last)); 
+
+  if (st.st_size != (off_t) FILE_SIZE && ftruncate(fd, FILE_SIZE)) 
+  {
+    fprintf(stderr,"Could not resize %s\n", path); 
+    close(fd); 
+    return NULL; 
+  }
+
+  void * map = mmap(0, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); 
+  if (map == MAP_FAILED) 
+  {
+    fprintf(stderr,"Could not mmap %s\n", path); 
+    close(fd); 
+    return NULL; 
+  }
+
+  ice_dsshm_t * shm = calloc(1, sizeof(ice_dsshm_t)); 
+  shm->fd = fd; 
+  shm->writer = 1; 
+  shm->size = FILE_SIZE; 
+  shm->hdr = map; 
+  shm->ds = (rno_g_daqstatus_t*) ((char*) map + HEADER_SIZE); 
+
+  //a reader that catches us here sees an odd seq (or a bad header) and tries again 
+  uint32_t seq = header_ok(shm->hdr) ? shm->hdr->seq : 0; 
+  __atomic_store_n(&shm->hdr->seq, seq | 1, __ATOMIC_RELAXED); 
+  __atomic_thread_fence(__ATOMIC_RELEASE); 
+  shm->hdr->magic = ICE_DSSHM_MAGIC; 
+  shm->hdr->version = ICE_DSSHM_VERSION; 
+  shm->hdr->header_size = HEADER_SIZE; 
+  shm->hdr->ds_size = sizeof(rno_g_daqstatus_t); 
+  shm->hdr->writer_pid = getpid(); 
+  memcpy(shm->ds, last, sizeof(*last)); 
+  __atomic_store_n(&shm->hdr->seq, (seq | 1) + 1, __ATOMIC_RELEASE); 
+
+  return shm; 
+}
+
+void ice_dsshm_publish(ice_dsshm_t * shm, const rno_g_daqstatus_t * ds) 
+{
+  struct timespec now; 
+  clock_gettime(CLOCK_REALTIME, &now); 
+
+  uint32_t seq = shm->hdr->seq; 
+  __atomic_store_n(&shm->hdr->seq, seq + 1, __ATOMIC_RELAXED); 
+  __atomic_thread_fence(__ATOMIC_RELEASE); 
+  memcpy(shm->ds, ds, sizeof(*ds)); 
+  shm->hdr->nupdates++; 
+  shm->hdr->update_time_ns = now.tv_sec * 1000000000ull + now.tv_nsec; 
+  __atomic_store_n(&shm->hdr->seq, seq + 2, __ATOMIC_RELEASE); 
+}
+
+ice_dsshm_t * ice_dsshm_open(const char * path) 
+{
+  int fd = open(path, O_RDONLY); 
+  if (fd < 0) return NULL; 
+
+  struct stat st; 
+  if (fstat(fd, &st) || st.st_size != (off_t) FILE_SIZE) 
+  {
+    fprintf(stderr,"%s is not a shared daqstatus (or is from a different version)\n", path); 
+    close(fd); 
+    return NULL; 
+  }
+
+  void * map = mmap(0, FILE_SIZE, PROT_READ, MAP_SHARED, fd, 0); 
+  if (map == MAP_FAILED) 
+  {
+    close(fd); 
+    return NULL; 
+  }
+
+  ice_dsshm_t * shm = calloc(1, sizeof(ice_dsshm_t)); 
+  shm->fd = fd; 
+  shm->size = FILE_SIZE; 
+  shm->hdr = map; 
+  shm->ds = (rno_g_daqstatus_t*) ((char*) map + HEADER_SIZE); 
+  return shm; 
+}
+
+int ice_dsshm_read(const ice_dsshm_t * shm, rno_g_daqstatus_t * ds, uint64_t * nupdates, uint64_t * update_time_ns) 
+{
+  for (int i = 0; i < MAX_READ_TRIES; i++) 
+  {
+    uint32_t seq = __atomic_load_n(&shm->hdr->seq, __ATOMIC_ACQUIRE); 
+    if (seq & 1 || !header_ok(shm->hdr)) 
+    {
+      sched_yield(); 
+      continue; 
+    }
+
+    memcpy(ds, shm->ds, sizeof(*ds)); 
+    uint64_t n = shm->hdr->nupdates; 
+    uint64_t t = shm->hdr->update_time_ns; 
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); 
+    if (__atomic_load_n(&shm->hdr->seq, __ATOMIC_RELAXED) != seq) continue; 
+
+    if (nupdates) *nupdates = n; 
+    if (update_time_ns) *update_time_ns = t; 
+    return 0; 
+  }
+  return -1; 
+}
+
+int ice_dsshm_close(ice_dsshm_t * shm) 
+{
+  if (!shm) return 0; 
+  if (shm->writer) msync(shm->hdr, shm->size, MS_SYNC); 
+  munmap(shm->hdr, shm->size); 
+  close(shm->fd); 
+  free(shm); 
+  return 0; 
+}
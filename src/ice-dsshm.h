@@ -0,0 +1,57 @@
+#ifndef _RNO_G_ICE_DSSHM_H
+#define _RNO_G_ICE_DSSHM_H
+
+/** The shared daqstatus (runtime.status_shmem_file, /rno-g/run/daqstatus.dat by default).
+ *
+ * rno-g-acq publishes the latest daqstatus here (and reads the thresholds back from it at startup, if asked to).
+ * Anyone can mmap it and look, as often as they like, without bothering acq.
+ *
+ * The file is an ice_dsshm_header_t followed (at header_size) by an rno_g_daqstatus_t (of ds_size bytes).
+ * There is only one writer, which does a seqlock: seq is incremented (to odd) before the daqstatus changes and
+ * incremented again (to even) after. So a reader copies the daqstatus out between two reads of seq, and if seq
+ * was odd or changed, tries again. ice_dsshm_read does exactly this.
+ *
+ * Files from before the header existed (just an rno_g_daqstatus_t) are still understood when creating.
+ **/ 
+
+#include <stdint.h>
+#include "rno-g.h"
+
+#define ICE_DSSHM_MAGIC 0x4d485344 /* "DSHM" */
+#define ICE_DSSHM_VERSION 1
+
+typedef struct ice_dsshm_header
+{
+  uint32_t magic; 
+  uint16_t version; 
+  uint16_t header_size; 
+  uint32_t ds_size; 
+  uint32_t writer_pid; 
+  uint32_t seq;               // odd while the daqstatus is being written 
+  uint32_t reserved; 
+  uint64_t nupdates;          // how many times it's been published 
+  uint64_t update_time_ns;    // CLOCK_REALTIME of the last publish 
+} ice_dsshm_header_t; 
+
+struct ice_dsshm; 
+typedef struct ice_dsshm ice_dsshm_t; 
+
+/* For the writer (rno-g-acq). Creates (or takes over) path. If it already had a daqstatus in it (from a previous
+ * acq), that's copied to last and have_last is set, otherwise last is zeroed. */ 
+ice_dsshm_t * ice_dsshm_create(const char * path, rno_g_daqstatus_t * last, int * have_last); 
+
+/* Publish a new daqstatus. Only one thread should do this. */ 
+void ice_dsshm_publish(ice_dsshm_t * shm, const rno_g_daqstatus_t * ds); 
+
+/* For readers. Opens path read-only, returns NULL if it isn't a shared daqstatus (of our version and size). */ 
+ice_dsshm_t * ice_dsshm_open(const char * path); 
+
+/* Get a consistent copy of the latest daqstatus, without locking (so this never holds up the writer).
+ * nupdates and update_time_ns may be NULL. Returns 0 on success, or -1 if it couldn't get a consistent read
+ * (the writer died in the middle of a write, most likely). */ 
+int ice_dsshm_read(const ice_dsshm_t * shm, rno_g_daqstatus_t * ds, uint64_t * nupdates, uint64_t * update_time_ns); 
+
+/* The writer's copy also gets synced to disk, so the thresholds are there next time */ 
+int ice_dsshm_close(ice_dsshm_t * shm); 
+
+#endif
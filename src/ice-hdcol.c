@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include "ice-hdcol.h" 
+#include "ice-common.h" 
+#include <stdlib.h> 
+#include <string.h> 
+#include <unistd.h> 
+#include <fcntl.h> 
+#include <sys/mman.h> 
+#include <sys/stat.h> 
+
+static const char * column_names[ICE_HDCOL_NCOLUMNS] = 
+{
+  "event_number.u32", 
+  "trigger_number.u32", 
+  "trigger_type.u32", 
+  "readout_time.f64", 
+  "pps_count.u32", 
+  "sys_clk.u32" 
+}; 
+
+static const char * tmp_suffix = ".tmp"; 
+
+const char * ice_hdcol_name(int column) 
+{
+  return column_names[column]; 
+}
+
+int ice_hdcol_width(int column) 
+{
+  return column == ICE_HDCOL_READOUT_TIME ? sizeof(double) : sizeof(uint32_t); 
+}
+
+struct ice_hdcol
+{
+  char * dir; 
+  FILE * f[ICE_HDCOL_NCOLUMNS]; 
+}; 
+
+ice_hdcol_t * ice_hdcol_open(const char * dir) 
+{
+  if (mkdir_if_needed(dir)) 
+  {
+    fprintf(stderr,"Could not make %s\n", dir); 
+    return NULL; 
+  }
+
+  ice_hdcol_t * c = calloc(sizeof(ice_hdcol_t),1); 
+  c->dir = strdup(dir); 
+  for (int i = 0; i < ICE_HDCOL_NCOLUMNS; i++) 
+  {
+    char * path = 0; 
+    asprintf(&path,"%s/%s%s", dir, column_names[i], tmp_suffix); 
+    c->f[i] = fopen(path,"w"); 
+    if (!c->f[i]) 
+    {
+      fprintf(stderr,"Could not open %s\n", path); 
+      free(path); 
+      ice_hdcol_close(c, NULL); 
+      return NULL; 
+    }
+    free(path); 
+  }
+
+  return c; 
+}
+
+int ice_hdcol_append(ice_hdcol_t * c, const rno_g_header_t * hd) 
+{
+  uint32_t event_number = hd->event_number; 
+  uint32_t trigger_number = hd->trigger_number; 
+  uint32_t trigger_type = hd->trigger_type; 
+  double readout_time = hd->readout_time_secs + 1e-9 * hd->readout_time_nsecs; 
+  uint32_t pps_count = hd->pps_count; 
+  uint32_t sys_clk = hd->sys_clk; 
+
+  int ok = 1; 
+  ok = ok && fwrite(&event_number, sizeof(event_number), 1, c->f[ICE_HDCOL_EVENT_NUMBER]); 
+  ok = ok && fwrite(&trigger_number, sizeof(trigger_number), 1, c->f[ICE_HDCOL_TRIGGER_NUMBER]); 
+  ok = ok && fwrite(&trigger_type, sizeof(trigger_type), 1, c->f[ICE_HDCOL_TRIGGER_TYPE]); 
+  ok = ok && fwrite(&readout_time, sizeof(readout_time), 1, c->f[ICE_HDCOL_READOUT_TIME]); 
+  ok = ok && fwrite(&pps_count, sizeof(pps_count), 1, c->f[ICE_HDCOL_PPS_COUNT]); 
+  ok = ok && fwrite(&sys_clk, sizeof(sys_clk), 1, c->f[ICE_HDCOL_SYS_CLK]); 
+  return ok ? 0 : -1; 
+}
+
+int ice_hdcol_flush(ice_hdcol_t * c) 
+{
+  int ret = 0; 
+  for (int i = 0; i < ICE_HDCOL_NCOLUMNS; i++) 
+  {
+    if (c->f[i]) ret = fflush(c->f[i]) || ret; 
+  }
+  return ret; 
+}
+
+int ice_hdcol_close(ice_hdcol_t * c, int (*file_list)(const char * path)) 
+{
+  int ret = 0; 
+  for (int i = 0; i < ICE_HDCOL_NCOLUMNS; i++) 
+  {
+    if (!c->f[i]) continue; 
+    ret = fclose(c->f[i]) || ret; 
+
+    char * tmp_path = 0; 
+    char * path = 0; 
+    asprintf(&path,"%s/%s", c->dir, column_names[i]); 
+    asprintf(&tmp_path,"%s%s", path, tmp_suffix); 
+    ret = rename(tmp_path, path) || ret; 
+    if (file_list) file_list(path); 
+    free(path); 
+    free(tmp_path); 
+  }
+  free(c->dir); 
+  free(c); 
+  return ret; 
+}
+
+
+int ice_hdcol_map(const char * dir, ice_hdcol_view_t * v) 
+{
+  memset(v, 0, sizeof(*v)); 
+  v->nrows = (size_t) -1; 
+
+  for (int i = 0; i < ICE_HDCOL_NCOLUMNS; i++) 
+  {
+    char * path = 0; 
+    asprintf(&path,"%s/%s", dir, column_names[i]); 
+    int fd = open(path, O_RDONLY | O_CLOEXEC); 
+    if (fd < 0) // maybe the run is still going 
+    {
+      char * tmp_path = 0; 
+      asprintf(&tmp_path,"%s%s", path, tmp_suffix); 
+      fd = open(tmp_path, O_RDONLY | O_CLOEXEC); 
+      free(tmp_path); 
+    }
+    free(path); 
+
+    struct stat st; 
+    if (fd < 0 || fstat(fd, &st)) 
+    {
+      if (fd >= 0) close(fd); 
+      ice_hdcol_unmap(v); 
+      return -1; 
+    }
+
+    size_t rows = st.st_size / ice_hdcol_width(i); 
+    if (rows < v->nrows) v->nrows = rows; 
+
+    if (st.st_size) 
+    {
+      void * p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0); 
+      if (p == MAP_FAILED) 
+      {
+        close(fd); 
+        ice_hdcol_unmap(v); 
+        return -1; 
+      }
+      madvise(p, st.st_size, MADV_SEQUENTIAL); 
+      v->columns[i] = p; 
+      v->map_sizes[i] = st.st_size; 
+    }
+    close(fd); 
+  }
+
+  return 0; 
+}
+
+void ice_hdcol_unmap(ice_hdcol_view_t * v) 
+{
+  for (int i = 0; i < ICE_HDCOL_NCOLUMNS; i++) 
+  {
+    if (v->columns[i]) munmap((void*) v->columns[i], v->map_sizes[i]); 
+    v->columns[i] = 0; 
+    v->map_sizes[i] = 0; 
+  }
+  v->nrows = 0; 
+}
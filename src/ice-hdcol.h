@@ -0,0 +1,78 @@
+#ifndef _RNO_G_ICE_HDCOL_H
+#define _RNO_G_ICE_HDCOL_H
+
+/** Columnar header store. 
+ *
+ * Alongside the usual header files, the writer keeps a few header fields for the whole run as 
+ * plain fixed-width arrays, one file per column (in the hdcol/ directory of the run), so that 
+ * things like trigger rates, trigger type breakdowns and event number gaps can be had without 
+ * decompressing all the headers. The files are raw little-endian arrays (no header), so they 
+ * can just be mmapped (see ice_hdcol_map), and are named after the column and its type, e.g. 
+ * hdcol/event_number.u32. They have a .tmp suffix while the run is going. 
+ *
+ * A column may be a bit longer than the others (if we died in the middle of a row). The number 
+ * of rows is that of the shortest column. 
+ *
+ * Only fields that every event has, whatever triggered it, are kept. Whether the flower (low threshold) 
+ * triggered is already in trigger_type. The flower's own per-event words (its trigger time and counters) 
+ * only mean something for flower triggers, and their layout follows librno-g and the flower firmware. 
+ * Putting them here would give the column files a second format to keep in step, for no query 
+ * rno-g-header-query does. Anything that needs them should read the header files. 
+ **/ 
+
+#include <stddef.h> 
+#include <stdint.h> 
+#include <stdio.h> 
+#include "rno-g.h" 
+
+typedef enum 
+{
+  ICE_HDCOL_EVENT_NUMBER,    // u32 
+  ICE_HDCOL_TRIGGER_NUMBER,  // u32 
+  ICE_HDCOL_TRIGGER_TYPE,    // u32 
+  ICE_HDCOL_READOUT_TIME,    // f64, seconds since the epoch 
+  ICE_HDCOL_PPS_COUNT,       // u32 
+  ICE_HDCOL_SYS_CLK,         // u32 
+  ICE_HDCOL_NCOLUMNS 
+} ice_hdcol_column_t; 
+
+/* the file name of a column (e.g. "event_number.u32") */ 
+const char * ice_hdcol_name(int column); 
+
+/* width of a column, in bytes */ 
+int ice_hdcol_width(int column); 
+
+
+/** Writing **/ 
+
+struct ice_hdcol; 
+typedef struct ice_hdcol ice_hdcol_t; 
+
+/* Start the columns in dir (which is created if necessary). Returns NULL on failure. */ 
+ice_hdcol_t * ice_hdcol_open(const char * dir); 
+
+/* Add a row */ 
+int ice_hdcol_append(ice_hdcol_t * c, const rno_g_header_t * hd); 
+
+/* Push buffered rows out to the files, so readers can see them */ 
+int ice_hdcol_flush(ice_hdcol_t * c); 
+
+/* Close everything and strip the .tmp suffixes. If file_list is not NULL, it's called with each final path. */ 
+int ice_hdcol_close(ice_hdcol_t * c, int (*file_list)(const char * path)); 
+
+
+/** Reading **/ 
+
+typedef struct ice_hdcol_view 
+{
+  size_t nrows; 
+  const void * columns[ICE_HDCOL_NCOLUMNS]; 
+  size_t map_sizes[ICE_HDCOL_NCOLUMNS]; 
+} ice_hdcol_view_t; 
+
+/* mmap the columns in dir (finished, or still being written). Returns 0 on success. */ 
+int ice_hdcol_map(const char * dir, ice_hdcol_view_t * v); 
+
+void ice_hdcol_unmap(ice_hdcol_view_t * v); 
+
+#endif
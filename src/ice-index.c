@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+#include "ice-index.h" 
+#include <stdlib.h> 
+#include <string.h> 
+#include <unistd.h> 
+#include <fcntl.h> 
+#include <errno.h> 
+#include <zlib.h> 
+
+#define INFLATE_BUF_SIZE (64 << 10) 
+
+static const char * tmp_suffix = ".tmp"; 
+
+char * ice_index_path(const char * data_path) 
+{
+  char * path = 0; 
+  int len = strlen(data_path); 
+  int tmplen = strlen(tmp_suffix); 
+
+  if (len > tmplen && !strcmp(data_path + len - tmplen, tmp_suffix)) 
+  {
+    asprintf(&path, "%.*s.idx%s", len - tmplen, data_path, tmp_suffix); 
+  }
+  else
+  {
+    asprintf(&path, "%s.idx", data_path); 
+  }
+  return path; 
+}
+
+FILE * ice_index_create(const char * idx_path) 
+{
+  FILE * f = fopen(idx_path, "w"); 
+  if (!f) 
+  {
+    fprintf(stderr,"Could not open %s\n", idx_path); 
+    return NULL; 
+  }
+
+  ice_index_write_header(f); 
+  return f; 
+}
+
+int ice_index_write_header(FILE * idx) 
+{
+  ice_index_header_t hdr = {.magic = ICE_INDEX_MAGIC, .version = ICE_INDEX_VERSION, .entry_size = sizeof(ice_index_entry_t)}; 
+  return fwrite(&hdr, sizeof(hdr), 1, idx) == 1 ? 0 : -1; 
+}
+
+int ice_index_append(FILE * idx, const ice_index_entry_t * entry) 
+{
+  if (fwrite(entry, sizeof(*entry), 1, idx) != 1) return -1; 
+  return fflush(idx); 
+}
+
+int ice_index_load(const char * idx_path, ice_index_entry_t ** entries) 
+{
+  *entries = NULL; 
+  FILE * f = fopen(idx_path,"r"); 
+  if (!f) return -1; 
+
+  ice_index_header_t hdr; 
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != ICE_INDEX_MAGIC || hdr.entry_size < sizeof(ice_index_entry_t)) 
+  {
+    fprintf(stderr,"%s is not an index file (or is from the future)\n", idx_path); 
+    fclose(f); 
+    return -1; 
+  }
+
+  fseek(f, 0, SEEK_END); 
+  long n = (ftell(f) - (long) sizeof(hdr)) / hdr.entry_size; 
+  fseek(f, sizeof(hdr), SEEK_SET); 
+
+  *entries = calloc(n ? n : 1, sizeof(ice_index_entry_t)); 
+  char * entry = malloc(hdr.entry_size); 
+  if (!*entries || !entry) 
+  {
+    fprintf(stderr,"Could not allocate the entries of %s\n", idx_path); 
+    free(*entries); 
+    *entries = 0; 
+    free(entry); 
+    fclose(f); 
+    return -1; 
+  }
+  int nread = 0; 
+  while (nread < n && fread(entry, hdr.entry_size, 1, f) == 1) 
+  {
+    //later versions may have larger entries, but will keep the start the same
+    memcpy(&(*entries)[nread++], entry, sizeof(ice_index_entry_t)); 
+  }
+  free(entry); 
+  fclose(f); 
+  return nread; 
+}
+
+int ice_index_find(const ice_index_entry_t * entries, int nentries, uint32_t event_number) 
+{
+  int lo = 0; 
+  int hi = nentries - 1; 
+  int found = -1; 
+  while (lo <= hi) 
+  {
+    int mid = (lo + hi) / 2; 
+    if (entries[mid].event_number <= event_number) 
+    {
+      found = mid; 
+      lo = mid + 1; 
+    }
+    else
+    {
+      hi = mid - 1; 
+    }
+  }
+  return found; 
+}
+
+
+/* the read side: a stdio stream that inflates raw deflate data from a file descriptor */ 
+typedef struct inflate_cookie
+{
+  z_stream z; 
+  int fd; 
+  int done; 
+  int raw;  // still in the raw deflate data we started in (rather than a following gzip member) 
+  unsigned skip; // input bytes to skip (the gzip trailer after the raw part) 
+  unsigned char in[INFLATE_BUF_SIZE]; 
+} inflate_cookie_t; 
+
+static ssize_t inflate_read(void * cookie, char * buf, size_t size) 
+{
+  inflate_cookie_t * c = cookie; 
+  if (c->done) return 0; 
+
+  c->z.next_out = (unsigned char*) buf; 
+  c->z.avail_out = size; 
+
+  while (c->z.avail_out) 
+  {
+    if (!c->z.avail_in) 
+    {
+      ssize_t n = read(c->fd, c->in, sizeof(c->in)); 
+      if (n < 0 && errno == EINTR) continue; 
+      if (n <= 0) // end of file (e.g. an unfinished file). Whatever we have is all there is 
+      {
+        c->done = 1; 
+        break; 
+      }
+      c->z.next_in = c->in; 
+      c->z.avail_in = n; 
+    }
+
+    if (c->skip) 
+    {
+      unsigned nskip = c->skip < c->z.avail_in ? c->skip : c->z.avail_in; 
+      c->z.next_in += nskip; 
+      c->z.avail_in -= nskip; 
+      c->skip -= nskip; 
+      continue; 
+    }
+
+    int ret = inflate(&c->z, Z_NO_FLUSH); 
+    if (ret == Z_STREAM_END) 
+    {
+      // there may be more gzip members after this one (e.g. compacted files, see rno-g-compact-run), so keep going. 
+      // If we started in the middle of a member, its trailer still needs skipping 
+      if (c->raw) c->skip = 8; 
+      c->raw = 0; 
+      inflateReset2(&c->z, 15 + 16); 
+      continue; 
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) 
+    {
+      //corrupt data, stop here
+      c->done = 1; 
+      break; 
+    }
+  }
+
+  return size - c->z.avail_out; 
+}
+
+static int inflate_close(void * cookie) 
+{
+  inflate_cookie_t * c = cookie; 
+  inflateEnd(&c->z); 
+  close(c->fd); 
+  free(c); 
+  return 0; 
+}
+
+FILE * ice_index_open_at(const char * data_path, const ice_index_entry_t * entry) 
+{
+  int fd = open(data_path, O_RDONLY | O_CLOEXEC); 
+  if (fd < 0) 
+  {
+    fprintf(stderr,"Could not open %s\n", data_path); 
+    return NULL; 
+  }
+
+  if (lseek(fd, entry->compressed_offset, SEEK_SET) != (off_t) entry->compressed_offset) 
+  {
+    fprintf(stderr,"Could not seek to %llu in %s\n", (unsigned long long) entry->compressed_offset, data_path); 
+    close(fd); 
+    return NULL; 
+  }
+
+  inflate_cookie_t * c = calloc(sizeof(inflate_cookie_t),1); 
+  if (!c) 
+  {
+    close(fd); 
+    return NULL; 
+  }
+  c->fd = fd; 
+  c->raw = 1; 
+
+  // after a full flush there's no header and no history, so this is just raw deflate 
+  if (inflateInit2(&c->z, -15) != Z_OK) 
+  {
+    close(fd); 
+    free(c); 
+    return NULL; 
+  }
+
+  cookie_io_functions_t funcs = { .read = inflate_read, .write = NULL, .seek = NULL, .close = inflate_close }; 
+  FILE * f = fopencookie(c, "r", funcs); 
+  if (!f) inflate_close(c); 
+  return f; 
+}
+
+FILE * ice_index_seek(const char * data_path, uint32_t event_number, ice_index_entry_t * entry) 
+{
+  char * idx_path = ice_index_path(data_path); 
+  ice_index_entry_t * entries = 0; 
+  int n = ice_index_load(idx_path, &entries); 
+  free(idx_path); 
+
+  int i = ice_index_find(entries, n, event_number); 
+  FILE * f = NULL; 
+  if (i >= 0) 
+  {
+    f = ice_index_open_at(data_path, &entries[i]); 
+    if (f && entry) *entry = entries[i]; 
+  }
+
+  free(entries); 
+  return f; 
+}
@@ -0,0 +1,72 @@
+#ifndef _RNO_G_ICE_INDEX_H
+#define _RNO_G_ICE_INDEX_H
+
+/** Random-access index sidecars for compressed output files. 
+ *
+ * Every so often, the writer does a full flush of the deflate stream (after which 
+ * decompression can start from scratch) and notes down where that happened in a small 
+ * binary sidecar file (named like the data file with .idx appended). To get to an event, 
+ * look up the last flush point before it, seek there and decompress from that point on,
+ * rather than decompressing the whole file from the start. 
+ *
+ * The sidecar is a small header followed by fixed-size entries in file order (so event 
+ * numbers are increasing). Everything is little-endian (i.e. whatever the BBB does). 
+ **/ 
+
+#include <stdio.h> 
+#include <stdint.h> 
+
+#define ICE_INDEX_MAGIC 0x58444952  /* "RIDX" */ 
+#define ICE_INDEX_VERSION 1 
+
+typedef struct ice_index_header
+{
+  uint32_t magic; 
+  uint16_t version; 
+  uint16_t entry_size; 
+} ice_index_header_t; 
+
+typedef struct ice_index_entry 
+{
+  uint32_t event_number;         // the first event after the flush point 
+  uint32_t record_index;         // which record in the file that is 
+  uint32_t time_secs;            // readout time of that event
+  uint32_t time_nsecs; 
+  uint64_t compressed_offset;    // where in the (compressed) file to start inflating (raw deflate, no header) 
+  uint64_t uncompressed_offset;  // how much uncompressed data precedes it 
+  uint32_t crc32;                // crc32 of all uncompressed data preceding it (i.e. what the gzip trailer would have) 
+  uint32_t reserved; 
+} ice_index_entry_t; 
+
+
+/* The sidecar name for a data file (path + .idx, but keeping a .tmp suffix at the end). Free the result. */ 
+char * ice_index_path(const char * data_path); 
+
+/* Open a new sidecar for writing (writes the header) */ 
+FILE * ice_index_create(const char * idx_path); 
+
+/* Write the header to an already open (empty) stream, e.g. an open_memstream. Returns 0 on success. */ 
+int ice_index_write_header(FILE * idx); 
+
+/* Append an entry (and flush, so it's there even if we die). Returns 0 on success. */ 
+int ice_index_append(FILE * idx, const ice_index_entry_t * entry); 
+
+/* Read all entries of a sidecar. *entries is allocated and should be freed. 
+ * Returns the number of entries, or -1 if the file can't be read. A truncated last entry is ignored. */ 
+int ice_index_load(const char * idx_path, ice_index_entry_t ** entries); 
+
+/* Find the last entry at or before event_number. Returns its index, or -1 if there isn't one. */ 
+int ice_index_find(const ice_index_entry_t * entries, int nentries, uint32_t event_number); 
+
+/* Open data_path at the flush point described by entry, returning a stream of uncompressed data starting there. 
+ * The stream carries on through any further gzip members, and ends at the end of the file (or at the first 
+ * thing that doesn't decompress, e.g. the unfinished end of a file that is still being written). 
+ * Wrap it in an RNO_G_RAW handle to use the usual librno-g readers. */ 
+FILE * ice_index_open_at(const char * data_path, const ice_index_entry_t * entry); 
+
+/* Convenience: open data_path at the last flush point at or before event_number, using its sidecar. 
+ * If entry is not NULL, it's filled with the flush point used. Returns NULL if that's not possible. 
+ * Records still need to be read (and skipped) until the event number matches. */ 
+FILE * ice_index_seek(const char * data_path, uint32_t event_number, ice_index_entry_t * entry); 
+
+#endif
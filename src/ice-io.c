@@ -0,0 +1,74 @@
+#define _GNU_SOURCE
+#include "ice-io.h" 
+#include <stdio.h> 
+#include <string.h> 
+#include <fcntl.h> 
+#include <unistd.h> 
+#include <errno.h> 
+#include <sys/stat.h> 
+
+
+int ice_io_open(ice_io_file_t * f, const char * path, const ice_io_policy_t * policy) 
+{
+  memset(f,0,sizeof(*f)); 
+  if (policy) f->policy = *policy; 
+
+  f->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644); 
+  if (f->fd < 0) 
+  {
+    fprintf(stderr,"Could not open %s (%s)\n", path, strerror(errno)); 
+    return -1; 
+  }
+
+  // keep the size so the file still looks right to anybody reading it while we write 
+  if (f->policy.preallocate_kB > 0 && 
+      fallocate(f->fd, FALLOC_FL_KEEP_SIZE, 0, ((off_t) f->policy.preallocate_kB) << 10))
+  {
+    //not all filesystems support this, so no big deal 
+    if (errno != EOPNOTSUPP) fprintf(stderr,"Could not preallocate %s (%s)\n", path, strerror(errno)); 
+  }
+
+  return f->fd; 
+}
+
+int ice_io_writeback_due(const ice_io_file_t * f, off_t written) 
+{
+  if (f->fd < 0 || f->policy.writeback_kB <= 0) return 0; 
+  return written - f->synced >= (((off_t) f->policy.writeback_kB) << 10); 
+}
+
+int ice_io_wrote(ice_io_file_t * f, off_t written) 
+{
+  if (!ice_io_writeback_due(f, written)) return 0; 
+
+  //this just starts the writeout, it doesn't wait for it
+  int ret = sync_file_range(f->fd, f->synced, written - f->synced, SYNC_FILE_RANGE_WRITE); 
+  f->synced = written; 
+  return ret; 
+}
+
+int ice_io_close(ice_io_file_t * f) 
+{
+  if (f->fd < 0) return -1; 
+
+  //get rid of whatever preallocation we didn't use 
+  if (f->policy.preallocate_kB > 0) 
+  {
+    struct stat st; 
+    if (!fstat(f->fd,&st) && ftruncate(f->fd, st.st_size)) 
+    {
+      fprintf(stderr,"Could not trim preallocation (%s)\n", strerror(errno)); 
+    }
+  }
+
+  if (f->policy.drop_cache_on_close) 
+  {
+    //pages have to be clean to be dropped
+    sync_file_range(f->fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER); 
+    posix_fadvise(f->fd, 0, 0, POSIX_FADV_DONTNEED); 
+  }
+
+  int ret = close(f->fd); 
+  f->fd = -1; 
+  return ret; 
+}
@@ -0,0 +1,52 @@
+#ifndef _RNO_G_ICE_IO_H
+#define _RNO_G_ICE_IO_H
+
+/** I/O policy for output files. 
+ *
+ * SD cards and eMMC have awful latency spikes when the kernel decides to flush a large
+ * batch of dirty pages at once, and on a 512 MB board the page cache of files we'll never
+ * read again crowds out things we care about. So output files can: 
+ *
+ *   - be preallocated (with fallocate) when opened, to avoid fragmenting and metadata updates
+ *   - have write-behind kicked off (with sync_file_range) every so often, so dirty pages trickle out
+ *     instead of piling up
+ *   - have their pages dropped from the page cache (with posix_fadvise) when closed. 
+ *
+ * All of these are optional (a zero setting disables them). 
+ **/ 
+
+#include <sys/types.h> 
+
+typedef struct ice_io_policy
+{
+  int preallocate_kB;       // preallocate this much when opening (0 to not)
+  int writeback_kB;         // start write-behind every time this much is written (0 to not) 
+  int drop_cache_on_close;  // drop the file from the page cache when closing
+} ice_io_policy_t; 
+
+
+/* Keeps track of an output file opened with the policy */ 
+typedef struct ice_io_file
+{
+  int fd; 
+  off_t synced; //how far write-behind has been started 
+  ice_io_policy_t policy; 
+} ice_io_file_t; 
+
+
+/* Create (or truncate) path for writing, applying the policy. Returns the fd, or -1 on failure. */ 
+int ice_io_open(ice_io_file_t * f, const char * path, const ice_io_policy_t * policy); 
+
+/* Returns 1 if it's time to start write-behind, given that written bytes have been written so far. */ 
+int ice_io_writeback_due(const ice_io_file_t * f, off_t written); 
+
+/* Should be called after writing to the file (written is the total number of bytes written so far), 
+ * will start write-behind if it's time. */ 
+int ice_io_wrote(ice_io_file_t * f, off_t written); 
+
+/* Trims any leftover preallocation, drops the page cache if asked to and closes the fd. 
+ * Note that this may block until the file is on disk if dropping the cache, so it's best not 
+ * to call this from anything latency-sensitive */ 
+int ice_io_close(ice_io_file_t * f); 
+
+#endif
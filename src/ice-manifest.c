@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+#include "ice-manifest.h" 
+#include "ice-crc32c.h" 
+#include <stdio.h> 
+#include <stdlib.h> 
+#include <string.h> 
+#include <unistd.h> 
+#include <fcntl.h> 
+#include <errno.h> 
+#include <sys/file.h> 
+
+#define HEADER_LINE "# name size crc32c first_event last_event\n" 
+
+char * ice_manifest_path(const char * run_dir) 
+{
+  char * path = 0; 
+  asprintf(&path, "%s/%s", run_dir, ICE_MANIFEST_NAME); 
+  return path; 
+}
+
+int ice_manifest_create(const char * run_dir) 
+{
+  char * path = ice_manifest_path(run_dir); 
+  FILE * f = fopen(path, "w"); 
+  if (!f) 
+  {
+    fprintf(stderr,"Could not create %s\n", path); 
+    free(path); 
+    return -1; 
+  }
+  fputs(HEADER_LINE, f); 
+  free(path); 
+  return fclose(f); 
+}
+
+void ice_manifest_set_name(ice_manifest_entry_t * entry, const char * run_dir, const char * path) 
+{
+  int prefix_len = strlen(run_dir); 
+  if (!strncmp(path, run_dir, prefix_len)) path += prefix_len; 
+  while (*path == '/') path++; 
+  snprintf(entry->name, sizeof(entry->name), "%s", path); 
+}
+
+int ice_manifest_checksum_file(const char * path, uint64_t * size, uint32_t * crc32c) 
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC); 
+  if (fd < 0) return -1; 
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); 
+
+  static __thread char buf[256 << 10]; 
+  uint64_t total = 0; 
+  uint32_t crc = 0; 
+  while (1) 
+  {
+    ssize_t n = read(fd, buf, sizeof(buf)); 
+    if (n < 0 && errno == EINTR) continue; 
+    if (n < 0) 
+    {
+      close(fd); 
+      return -1; 
+    }
+    if (!n) break; 
+    crc = ice_crc32c(crc, buf, n); 
+    total += n; 
+  }
+  close(fd); 
+  *size = total; 
+  *crc32c = crc; 
+  return 0; 
+}
+
+int ice_manifest_entry_for_file(const char * run_dir, const char * path, ice_manifest_entry_t * entry) 
+{
+  memset(entry, 0, sizeof(*entry)); 
+  ice_manifest_set_name(entry, run_dir, path); 
+  return ice_manifest_checksum_file(path, &entry->size, &entry->crc32c); 
+}
+
+static void write_entry(FILE * f, const ice_manifest_entry_t * e) 
+{
+  if (e->have_events) 
+    fprintf(f, "%s %llu %08x %u %u\n", e->name, (unsigned long long) e->size, e->crc32c, e->first_event, e->last_event); 
+  else
+    fprintf(f, "%s %llu %08x - -\n", e->name, (unsigned long long) e->size, e->crc32c); 
+}
+
+int ice_manifest_append(const char * run_dir, const ice_manifest_entry_t * entry) 
+{
+  char * path = ice_manifest_path(run_dir); 
+  FILE * f = fopen(path, "a"); 
+  if (!f) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    free(path); 
+    return -1; 
+  }
+  flock(fileno(f), LOCK_EX); 
+  write_entry(f, entry); 
+  fflush(f); 
+  flock(fileno(f), LOCK_UN); 
+  free(path); 
+  return fclose(f); 
+}
+
+int ice_manifest_load(const char * run_dir, ice_manifest_entry_t ** entries) 
+{
+  char * path = ice_manifest_path(run_dir); 
+  FILE * f = fopen(path, "r"); 
+  free(path); 
+  if (!f) return -1; 
+  flock(fileno(f), LOCK_SH); 
+
+  int n = 0, cap = 0; 
+  *entries = 0; 
+  char * line = 0; 
+  size_t line_size = 0; 
+  while (getline(&line, &line_size, f) > 0) 
+  {
+    if (line[0] == '#' || line[0] == '\n') continue; 
+
+    ice_manifest_entry_t e = {0}; 
+    unsigned long long size; 
+    char first[16], last[16]; 
+    if (sscanf(line, "%255s %llu %x %15s %15s", e.name, &size, &e.crc32c, first, last) != 5) 
+    {
+      fprintf(stderr,"Skipping bad manifest line: %s", line); 
+      continue; 
+    }
+    e.size = size; 
+    if (strcmp(first,"-") && strcmp(last,"-")) 
+    {
+      e.have_events = 1; 
+      e.first_event = strtoul(first, 0, 10); 
+      e.last_event = strtoul(last, 0, 10); 
+    }
+
+    if (n == cap) 
+    {
+      cap = cap ? 2 * cap : 64; 
+      *entries = realloc(*entries, cap * sizeof(ice_manifest_entry_t)); 
+    }
+    (*entries)[n++] = e; 
+  }
+  free(line); 
+  fclose(f); 
+  return n; 
+}
+
+int ice_manifest_rewrite(const char * run_dir, const ice_manifest_entry_t * entries, int n) 
+{
+  char * path = ice_manifest_path(run_dir); 
+  char * tmp_path = 0; 
+  asprintf(&tmp_path, "%s.rewrite.tmp", path); 
+
+  //hold the lock on the old one so nobody appends in the meantime 
+  int lock_fd = open(path, O_RDONLY | O_CLOEXEC); 
+  if (lock_fd >= 0) flock(lock_fd, LOCK_EX); 
+
+  int ret = -1; 
+  FILE * f = fopen(tmp_path, "w"); 
+  if (f) 
+  {
+    fputs(HEADER_LINE, f); 
+    for (int i = 0; i < n; i++) write_entry(f, &entries[i]); 
+    ret = fclose(f); 
+    if (!ret) ret = rename(tmp_path, path); 
+  }
+  if (ret) 
+  {
+    fprintf(stderr,"Could not rewrite %s\n", path); 
+    unlink(tmp_path); 
+  }
+
+  if (lock_fd >= 0) close(lock_fd); 
+  free(tmp_path); 
+  free(path); 
+  return ret; 
+}
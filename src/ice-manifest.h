@@ -0,0 +1,59 @@
+#ifndef _RNO_G_ICE_MANIFEST_H
+#define _RNO_G_ICE_MANIFEST_H
+
+/** The run manifest: aux/acq-manifest.txt, next to aux/acq-file-list.txt. 
+ *
+ * For each finished output file, this has its name (relative to the run directory), its size, the CRC32C 
+ * of its (compressed) contents (see ice-crc32c.h) and the range of event numbers in it. The writer 
+ * computes the checksum as the data goes out, so nothing has to be read back. rno-g-verify-run checks
+ * a run directory (here or after transfer) against it. 
+ *
+ * It's plain text, one file per line:
+ *
+ *   name size crc32c first_event last_event
+ *
+ * with the crc in hex, and "-" for the event numbers if they aren't known (e.g. for daqstatus files). Lines
+ * starting with # are comments. 
+ **/ 
+
+#include <stdint.h> 
+
+#define ICE_MANIFEST_NAME "aux/acq-manifest.txt" 
+
+typedef struct ice_manifest_entry
+{
+  char name[256]; 
+  uint64_t size; 
+  uint32_t crc32c; 
+  int have_events; 
+  uint32_t first_event; 
+  uint32_t last_event; 
+} ice_manifest_entry_t; 
+
+/* Path of the manifest for run_dir (should be freed) */ 
+char * ice_manifest_path(const char * run_dir); 
+
+/* Start a new (empty) manifest for run_dir. Returns 0 on success. */ 
+int ice_manifest_create(const char * run_dir); 
+
+/* Fill in entry for the file at path (name relative to run_dir if path is inside it) by reading it back. 
+ * The event range is left unknown. Returns 0 on success. */ 
+int ice_manifest_entry_for_file(const char * run_dir, const char * path, ice_manifest_entry_t * entry); 
+
+/* Set entry->name to path relative to run_dir */ 
+void ice_manifest_set_name(ice_manifest_entry_t * entry, const char * run_dir, const char * path); 
+
+/* Append an entry (under an exclusive flock, so it can be called from anywhere). Returns 0 on success */ 
+int ice_manifest_append(const char * run_dir, const ice_manifest_entry_t * entry); 
+
+/* Load all the entries of run_dir's manifest into *entries (which should be freed). Returns the number of entries, 
+ * or -1 if there's no manifest */ 
+int ice_manifest_load(const char * run_dir, ice_manifest_entry_t ** entries); 
+
+/* Replace run_dir's manifest with these entries (atomically, under the lock) */ 
+int ice_manifest_rewrite(const char * run_dir, const ice_manifest_entry_t * entries, int n); 
+
+/* Compute the size and CRC32C of a file. Returns 0 on success */ 
+int ice_manifest_checksum_file(const char * path, uint64_t * size, uint32_t * crc32c); 
+
+#endif
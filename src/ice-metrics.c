@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+#include "ice-metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define REQUEST_WAIT_MS 100
+#define SEND_TIMEOUT_S 1
+
+struct ice_metrics
+{
+  char * socket_path; 
+  int unix_fd; 
+  int tcp_fd; 
+  int quit_pipe[2]; 
+  pthread_t thread; 
+  ice_metrics_render_fn_t render; 
+  ice_metrics_tick_fn_t tick; 
+  double tick_interval; 
+  void * arg; 
+}; 
+
+static double now_mono() 
+{
+  struct timespec now; 
+  clock_gettime(CLOCK_MONOTONIC, &now); 
+  return now.tv_sec + 1e-9 * now.tv_nsec; 
+}
+
+static int listen_unix(const char * path) 
+{
+  struct sockaddr_un addr = {.sun_family = AF_UNIX}; 
+  if (strlen(path) >= sizeof(addr.sun_path)) 
+  {
+    fprintf(stderr,"Metrics socket path %s is too long\n", path); 
+    return -1; 
+  }
+  strcpy(addr.sun_path, path); 
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0); 
+  if (fd < 0) return -1; 
+  unlink(path); 
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(fd, 4)) 
+  {
+    fprintf(stderr,"Could not listen on %s\n", path); 
+    close(fd); 
+    return -1; 
+  }
+  return fd; 
+}
+
+static int listen_tcp(int port) 
+{
+  struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)}; 
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0); 
+  if (fd < 0) return -1; 
+  int one = 1; 
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)); 
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(fd, 4)) 
+  {
+    fprintf(stderr,"Could not listen on 127.0.0.1:%d\n", port); 
+    close(fd); 
+    return -1; 
+  }
+  return fd; 
+}
+
+static void send_all(int fd, const char * buf, size_t len) 
+{
+  while (len) 
+  {
+    ssize_t n = send(fd, buf, len, MSG_NOSIGNAL); 
+    if (n <= 0) return; // client went away (or stopped reading), not our problem 
+    buf += n; 
+    len -= n; 
+  }
+}
+
+static void serve(ice_metrics_t * m, int fd) 
+{
+  //give the client a moment to say what it wants; if it says nothing, it just gets the text 
+  char req[1024]; 
+  ssize_t nreq = 0; 
+  struct pollfd pfd = {.fd = fd, .events = POLLIN}; 
+  if (poll(&pfd, 1, REQUEST_WAIT_MS) > 0) nreq = recv(fd, req, sizeof(req) - 1, MSG_DONTWAIT); 
+  int http = nreq > 4 && (!strncmp(req, "GET ", 4) || !strncmp(req, "HEAD ", 5)); 
+
+  struct timeval tv = {.tv_sec = SEND_TIMEOUT_S}; 
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)); 
+
+  char * body = 0; 
+  size_t len = 0; 
+  FILE * f = open_memstream(&body, &len); 
+  if (!f) return; 
+  m->render(f, m->arg); 
+  fclose(f); 
+
+  if (http) 
+  {
+    char hdr[256]; 
+    int nhdr = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", len); 
+    send_all(fd, hdr, nhdr); 
+    if (strncmp(req, "HEAD ", 5)) send_all(fd, body, len); 
+  }
+  else
+  {
+    send_all(fd, body, len); 
+  }
+  free(body); 
+}
+
+static void * metrics_thread(void * v) 
+{
+  ice_metrics_t * m = v; 
+
+  //we're the least important thing around 
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19); 
+
+  struct pollfd fds[3] = { {.fd = m->quit_pipe[0], .events = POLLIN}, 
+                           {.fd = m->unix_fd, .events = POLLIN}, 
+                           {.fd = m->tcp_fd, .events = POLLIN} }; // poll ignores negative fds 
+
+  double next_tick = now_mono(); 
+  while (1) 
+  {
+    int timeout = -1; 
+    if (m->tick) 
+    {
+      double now = now_mono(); 
+      if (now >= next_tick) 
+      {
+        m->tick(now, m->arg); 
+        next_tick += m->tick_interval; 
+        if (next_tick < now) next_tick = now + m->tick_interval; // we were held up for a while 
+      }
+      timeout = ceil(1e3 * (next_tick - now)); 
+    }
+
+    if (poll(fds, 3, timeout) <= 0) continue; 
+    if (fds[0].revents) break; 
+
+    for (int i = 1; i < 3; i++) 
+    {
+      if (!(fds[i].revents & POLLIN)) continue; 
+      int c = accept4(fds[i].fd, 0, 0, SOCK_CLOEXEC); 
+      if (c < 0) continue; 
+      serve(m, c); 
+      close(c); 
+    }
+  }
+
+  return 0; 
+}
+
+ice_metrics_t * ice_metrics_start(const char * socket_path, int port, ice_metrics_render_fn_t render, 
+                                  ice_metrics_tick_fn_t tick, double tick_interval, void * arg) 
+{
+  ice_metrics_t * m = calloc(1, sizeof(ice_metrics_t)); 
+  m->unix_fd = socket_path && *socket_path ? listen_unix(socket_path) : -1; 
+  m->tcp_fd = port > 0 ? listen_tcp(port) : -1; 
+  if (m->unix_fd < 0 && m->tcp_fd < 0) 
+  {
+    free(m); 
+    return NULL; 
+  }
+  if (m->unix_fd >= 0) m->socket_path = strdup(socket_path); 
+
+  m->render = render; 
+  m->tick = tick_interval > 0 ? tick : 0; 
+  m->tick_interval = tick_interval; 
+  m->arg = arg; 
+
+  if (pipe2(m->quit_pipe, O_CLOEXEC) || pthread_create(&m->thread, NULL, metrics_thread, m)) 
+  {
+    fprintf(stderr,"Could not start the metrics thread\n"); 
+    if (m->unix_fd >= 0) close(m->unix_fd); 
+    if (m->tcp_fd >= 0) close(m->tcp_fd); 
+    free(m->socket_path); 
+    free(m); 
+    return NULL; 
+  }
+  return m; 
+}
+
+void ice_metrics_stop(ice_metrics_t * m) 
+{
+  if (!m) return; 
+  char c = 0; 
+  if (write(m->quit_pipe[1], &c, 1) == 1) pthread_join(m->thread, 0); 
+  close(m->quit_pipe[0]); 
+  close(m->quit_pipe[1]); 
+  if (m->unix_fd >= 0) 
+  {
+    close(m->unix_fd); 
+    unlink(m->socket_path); 
+  }
+  if (m->tcp_fd >= 0) close(m->tcp_fd); 
+  free(m->socket_path); 
+  free(m); 
+}
+
+void ice_metrics_describe(FILE * f, const char * name, const char * type, const char * help) 
+{
+  fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type); 
+}
+
+void ice_metrics_sample(FILE * f, const char * name, const char * labels, double value) 
+{
+  if (labels) fprintf(f, "%s{%s} %.15g\n", name, labels, value); 
+  else fprintf(f, "%s %.15g\n", name, value); 
+}
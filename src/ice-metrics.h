@@ -0,0 +1,40 @@
+#ifndef _RNO_G_ICE_METRICS_H
+#define _RNO_G_ICE_METRICS_H
+
+/** A local metrics endpoint, in the Prometheus text exposition format.
+ *
+ * A background thread (at the lowest priority, so it never gets in the way of the DAQ) listens on a unix socket
+ * (and optionally a localhost TCP port). Whenever someone connects, the render callback writes out the current
+ * metrics and the connection is closed. If the client sent an HTTP request (as curl --unix-socket or Prometheus
+ * itself would), it gets an HTTP response, otherwise (e.g. nc -U, socat) just the text.
+ *
+ * The callbacks run in the metrics thread, so they should only look at things that are safe to read from
+ * any thread (atomics, seqlocks, ...) and never take locks the DAQ threads hold.
+ **/ 
+
+#include <stdio.h>
+
+struct ice_metrics; 
+typedef struct ice_metrics ice_metrics_t; 
+
+/* Writes the metrics (with ice_metrics_describe and ice_metrics_sample) */ 
+typedef void (*ice_metrics_render_fn_t)(FILE * f, void * arg); 
+
+/* Called every tick_interval seconds from the metrics thread, e.g. to turn counters into rates */ 
+typedef void (*ice_metrics_tick_fn_t)(double now, void * arg); 
+
+/* Start serving on socket_path (replacing anything already there) and, if port > 0, on 127.0.0.1:port.
+ * tick may be NULL. Returns NULL if neither could be set up. */ 
+ice_metrics_t * ice_metrics_start(const char * socket_path, int port, ice_metrics_render_fn_t render, 
+                                  ice_metrics_tick_fn_t tick, double tick_interval, void * arg); 
+
+/* Stop the thread and remove the socket */ 
+void ice_metrics_stop(ice_metrics_t * m); 
+
+/* The # HELP and # TYPE lines (type is "counter" or "gauge") */ 
+void ice_metrics_describe(FILE * f, const char * name, const char * type, const char * help); 
+
+/* A sample. labels (may be NULL) is the inside of the braces, e.g. channel="3" */ 
+void ice_metrics_sample(FILE * f, const char * name, const char * labels, double value); 
+
+#endif
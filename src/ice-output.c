@@ -0,0 +1,375 @@
+#define _GNU_SOURCE
+#include "ice-output.h" 
+#include "ice-uring.h" 
+#include "ice-crc32c.h" 
+#include <stdlib.h> 
+#include <string.h> 
+#include <unistd.h> 
+#include <errno.h> 
+#include <zlib.h> 
+
+#define OUTPUT_BUF_SIZE (64 << 10) 
+
+// with io_uring, this many buffers can be in flight at once (per file) 
+#define OUTPUT_NBUFS 4 
+
+//user data for sync_file_range completions, so we can tell them from writes 
+#define SYNC_USER_DATA  ((uint64_t) -1) 
+
+struct ice_output
+{
+  z_stream z; 
+  FILE * stream; 
+  ice_io_file_t io; 
+  ice_uring_t * ring; 
+
+  int nbufs; 
+  unsigned char * bufs[OUTPUT_NBUFS]; 
+  uint64_t buf_off[OUTPUT_NBUFS];  // where each buffer is going 
+  unsigned buf_len[OUTPUT_NBUFS];  
+  int busy[OUTPUT_NBUFS];          // in flight 
+  int cur;                         // the buffer deflate is filling 
+
+  uint64_t offset;  // file offset of the start of the current buffer
+  uint64_t uncompressed; 
+  uint32_t crc32c;  // of the compressed bytes emitted so far 
+  int error; 
+
+  //in memory mode, compressed data accumulates here instead 
+  int in_memory; 
+  unsigned char * mem; 
+  size_t mem_cap; 
+}; 
+
+
+// plain blocking write of everything 
+static int write_all(int fd, const unsigned char * buf, size_t len, uint64_t off) 
+{
+  while (len) 
+  {
+    ssize_t n = pwrite(fd, buf, len, off); 
+    if (n < 0) 
+    {
+      if (errno == EINTR) continue; 
+      return -errno; 
+    }
+    buf += n; 
+    len -= n; 
+    off += n; 
+  }
+  return 0; 
+}
+
+static void reaped(void * ctx, uint64_t user_data, int res) 
+{
+  ice_output_t * o = ctx; 
+  if (user_data == SYNC_USER_DATA) return; // don't really care how write-behind went 
+
+  int i = user_data; 
+  o->busy[i] = 0; 
+
+  if (res == (int) o->buf_len[i]) return; 
+
+  //short write or an error. Try to finish the job the old-fashioned way (which will tell us what's wrong) 
+  unsigned done = res > 0 ? res : 0; 
+  int ret = write_all(o->io.fd, o->bufs[i] + done, o->buf_len[i] - done, o->buf_off[i] + done); 
+  if (ret) 
+  {
+    if (!o->error) fprintf(stderr,"Problem writing output (%s)\n", strerror(-ret)); 
+    o->error = ret; 
+  }
+}
+
+// send out the first len bytes of the current buffer, and switch to a free one 
+static int emit(ice_output_t * o, unsigned len) 
+{
+  if (!len) return 0; 
+  int i = o->cur; 
+  o->buf_off[i] = o->offset; 
+  o->buf_len[i] = len; 
+  o->offset += len; 
+  o->crc32c = ice_crc32c(o->crc32c, o->bufs[i], len); 
+
+  if (o->in_memory) 
+  {
+    if (o->offset > o->mem_cap) 
+    {
+      size_t new_cap = o->mem_cap ? 2 * o->mem_cap : 4 * OUTPUT_BUF_SIZE; 
+      while (new_cap < o->offset) new_cap *= 2; 
+      unsigned char * new_mem = realloc(o->mem, new_cap); 
+      if (!new_mem) 
+      {
+        if (!o->error) fprintf(stderr,"Could not grow in-memory output to %zu bytes\n", new_cap); 
+        o->error = -ENOMEM; 
+        o->offset -= len; 
+        return o->error; 
+      }
+      o->mem = new_mem; 
+      o->mem_cap = new_cap; 
+    }
+    memcpy(o->mem + o->buf_off[i], o->bufs[i], len); 
+    return o->error; 
+  }
+
+  if (o->ring) 
+  {
+    if (!ice_uring_write(o->ring, o->io.fd, o->bufs[i], len, o->buf_off[i], i)) 
+    {
+      o->busy[i] = 1; 
+
+      if (ice_io_writeback_due(&o->io, o->offset) && 
+          !ice_uring_sync_range(o->ring, o->io.fd, o->io.synced, o->offset - o->io.synced, SYNC_USER_DATA)) 
+      {
+        o->io.synced = o->offset; 
+      }
+
+      //pick up whatever's done, then find a free buffer, waiting if the disk is that far behind 
+      ice_uring_reap(o->ring, 0, reaped, o); 
+      while (1) 
+      {
+        for (int j = 0; j < o->nbufs; j++) 
+        {
+          if (!o->busy[j]) 
+          {
+            o->cur = j; 
+            return o->error; 
+          }
+        }
+        ice_uring_reap(o->ring, 1, reaped, o); 
+      }
+    }
+    //couldn't submit, so just write it ourselves 
+  }
+
+  int ret = write_all(o->io.fd, o->bufs[i], len, o->buf_off[i]); 
+  if (ret) 
+  {
+    if (!o->error) fprintf(stderr,"Problem writing output (%s)\n", strerror(-ret)); 
+    o->error = ret; 
+  }
+  ice_io_wrote(&o->io, o->offset); 
+  return o->error; 
+}
+
+static int deflate_into(ice_output_t * o, const void * data, size_t len, int flush) 
+{
+  o->z.next_in = (unsigned char*) data; 
+  o->z.avail_in = len; 
+
+  while (1) 
+  {
+    o->z.next_out = o->bufs[o->cur] + (OUTPUT_BUF_SIZE - o->z.avail_out); 
+    int ret = deflate(&o->z, flush); 
+    if (ret == Z_STREAM_ERROR) return -1; 
+
+    if (!o->z.avail_out) 
+    {
+      emit(o, OUTPUT_BUF_SIZE); 
+      o->z.avail_out = OUTPUT_BUF_SIZE; 
+      continue; 
+    }
+
+    //nothing more to do (Z_BUF_ERROR just means no progress was possible) 
+    if (ret == Z_STREAM_END || ret == Z_BUF_ERROR) break; 
+
+    //everything consumed, and since there's still room in the output, everything flushed 
+    if (flush != Z_FINISH && !o->z.avail_in) break; 
+  }
+
+  o->uncompressed += len; 
+  return 0; 
+}
+
+static ssize_t stream_write(void * cookie, const char * buf, size_t size) 
+{
+  ice_output_t * o = cookie; 
+  if (o->error || deflate_into(o, buf, size, Z_NO_FLUSH)) return -1; 
+  return size; 
+}
+
+static int stream_close(void * cookie) 
+{
+  //the real work happens in ice_output_close 
+  (void) cookie; 
+  return 0; 
+}
+
+
+/* give up on a half set up output, not leaving a file behind */ 
+static ice_output_t * output_init_failed(ice_output_t * o, const char * path) 
+{
+  int on_disk = !o->in_memory; 
+  ice_output_close(o); 
+  if (on_disk) unlink(path); 
+  return NULL; 
+}
+
+static ice_output_t * output_init(ice_output_t * o, const char * path, int level, int strategy) 
+{
+  if (deflateInit2(&o->z, level, Z_DEFLATED, 15 + 16, 8, strategy) != Z_OK) // +16 for a gzip wrapper 
+  {
+    fprintf(stderr,"Could not initialize compression for %s\n", path); 
+    ice_io_close(&o->io); 
+    if (!o->in_memory) unlink(path); 
+    free(o); 
+    return NULL; 
+  }
+
+  if (!o->in_memory) 
+  {
+    o->ring = ice_uring_init(2 * OUTPUT_NBUFS); // room for sync_file_range too 
+    if (!o->ring) return output_init_failed(o, path); 
+  }
+  o->nbufs = o->ring ? OUTPUT_NBUFS : 1; 
+  for (int i = 0; i < o->nbufs; i++) 
+  {
+    o->bufs[i] = malloc(OUTPUT_BUF_SIZE); 
+    if (!o->bufs[i]) 
+    {
+      o->nbufs = i; 
+      return output_init_failed(o, path); 
+    }
+  }
+  o->z.avail_out = OUTPUT_BUF_SIZE; 
+
+  cookie_io_functions_t funcs = { .read = NULL, .write = stream_write, .seek = NULL, .close = stream_close }; 
+  o->stream = fopencookie(o, "w", funcs); 
+  if (!o->stream) return output_init_failed(o, path); 
+
+  return o; 
+}
+
+int ice_output_async_available() 
+{
+  static int available = -1; 
+  int known = __atomic_load_n(&available, __ATOMIC_RELAXED); 
+  if (known >= 0) return known; 
+
+  ice_uring_t * r = ice_uring_init(2 * OUTPUT_NBUFS); 
+  known = r != NULL; 
+  if (r) ice_uring_destroy(r); 
+  __atomic_store_n(&available, known, __ATOMIC_RELAXED); 
+  return known; 
+}
+
+ice_output_t * ice_output_open(const char * path, int level, int strategy, const ice_io_policy_t * policy) 
+{
+  ice_output_t * o = calloc(sizeof(ice_output_t),1); 
+  if (!o) return NULL; 
+
+  if (ice_io_open(&o->io, path, policy) < 0) 
+  {
+    free(o); 
+    return NULL; 
+  }
+
+  return output_init(o, path, level, strategy); 
+}
+
+ice_output_t * ice_output_open_memory(int level, int strategy) 
+{
+  ice_output_t * o = calloc(sizeof(ice_output_t),1); 
+  if (!o) return NULL; 
+  o->io.fd = -1; 
+  o->in_memory = 1; 
+  return output_init(o, "(memory)", level, strategy); 
+}
+
+FILE * ice_output_stream(ice_output_t * o) 
+{
+  return o->stream; 
+}
+
+int ice_output_is_async(const ice_output_t * o) 
+{
+  return o->ring != NULL; 
+}
+
+uint64_t ice_output_compressed_size(const ice_output_t * o) 
+{
+  return o->offset + (OUTPUT_BUF_SIZE - o->z.avail_out); 
+}
+
+uint64_t ice_output_uncompressed_size(const ice_output_t * o) 
+{
+  return o->uncompressed; 
+}
+
+uint32_t ice_output_crc32c(const ice_output_t * o) 
+{
+  return o->crc32c; 
+}
+
+int ice_output_full_flush(ice_output_t * o, uint64_t * compressed_offset, uint64_t * uncompressed_offset, uint32_t * crc) 
+{
+  //get everything stdio is holding into the compressor first
+  if (fflush(o->stream) || o->error) return -1; 
+  if (deflate_into(o, NULL, 0, Z_FULL_FLUSH)) return -1; 
+
+  if (compressed_offset) *compressed_offset = ice_output_compressed_size(o); 
+  if (uncompressed_offset) *uncompressed_offset = o->uncompressed; 
+  if (crc) *crc = o->z.adler; //with a gzip wrapper, this is the running crc32 
+  return 0; 
+}
+
+static int output_finish(ice_output_t * o, void ** data, size_t * len, ice_output_summary_t * summary) 
+{
+  if (o->stream) 
+  {
+    fflush(o->stream); 
+    fclose(o->stream); 
+  }
+
+  if (o->nbufs) 
+  {
+    deflate_into(o, NULL, 0, Z_FINISH); 
+    emit(o, OUTPUT_BUF_SIZE - o->z.avail_out); 
+  }
+
+  if (o->ring) 
+  {
+    while (ice_uring_inflight(o->ring)) ice_uring_reap(o->ring, 1, reaped, o); 
+    ice_uring_destroy(o->ring); 
+  }
+
+  deflateEnd(&o->z); 
+  ice_io_close(&o->io); 
+
+  for (int i = 0; i < o->nbufs; i++) free(o->bufs[i]); 
+  int ret = o->error; 
+
+  if (summary) 
+  {
+    summary->compressed_size = o->offset; 
+    summary->uncompressed_size = o->uncompressed; 
+    summary->crc32c = o->crc32c; 
+  }
+
+  if (data) 
+  {
+    *data = o->mem; 
+    *len = o->offset; 
+  }
+  else
+  {
+    free(o->mem); 
+  }
+
+  free(o); 
+  return ret; 
+}
+
+int ice_output_close(ice_output_t * o) 
+{
+  return output_finish(o, NULL, NULL, NULL); 
+}
+
+int ice_output_close_summary(ice_output_t * o, ice_output_summary_t * summary) 
+{
+  return output_finish(o, NULL, NULL, summary); 
+}
+
+int ice_output_close_memory(ice_output_t * o, void ** data, size_t * len) 
+{
+  return output_finish(o, data, len, NULL); 
+}
@@ -0,0 +1,82 @@
+#ifndef _RNO_G_ICE_OUTPUT_H
+#define _RNO_G_ICE_OUTPUT_H
+
+/** Compressed output files. 
+ *
+ * This does the gzip compression ourselves (rather than with gzopen), so that we're the ones 
+ * who hand the compressed bytes to the kernel. That lets the compressed data go out 
+ * asynchronously through io_uring, so the writer thread doesn't have to wait on storage. 
+ * It's only used for that (output.io.use_io_uring), and for in-memory output (containers): 
+ * otherwise files are written with zlib's gz functions as usual (see ice-writer.c), which 
+ * is also what to fall back to if io_uring isn't available. 
+ *
+ * The data going in comes through a stdio stream (see ice_output_stream), which can be 
+ * used with an RNO_G_RAW rno_g_file_handle_t, so all the usual librno-g writers work.
+ * The output is a normal gzip file. 
+ *
+ * The I/O policy (see ice-io.h) is applied to files (write-behind goes through the ring too). 
+ **/ 
+
+#include <stdio.h> 
+#include <stdint.h> 
+#include "ice-io.h" 
+
+struct ice_output; 
+typedef struct ice_output ice_output_t; 
+
+/* What went into a file, filled in by ice_output_close_summary */ 
+typedef struct ice_output_summary
+{
+  uint64_t compressed_size; 
+  uint64_t uncompressed_size; 
+  uint32_t crc32c;  // of the whole compressed file (see ice-crc32c.h) 
+} ice_output_summary_t; 
+
+/* Whether io_uring can be set up here (checked once) */ 
+int ice_output_async_available(); 
+
+/* Open path for writing gzip-compressed data through io_uring (level and strategy as for zlib, e.g. Z_DEFAULT_COMPRESSION 
+ * and Z_DEFAULT_STRATEGY). policy may be NULL. Returns NULL on failure (including io_uring not being available), 
+ * without leaving a file behind. */ 
+ice_output_t * ice_output_open(const char * path, int level, int strategy, const ice_io_policy_t * policy); 
+
+/* Like ice_output_open, but the compressed data is kept in memory (see ice_output_close_memory) rather than 
+ * going to a file. Used for the container format (see ice-container.h), where finished files are appended
+ * to a bigger file as a whole. */ 
+ice_output_t * ice_output_open_memory(int level, int strategy); 
+
+/* The stream to write uncompressed data into */ 
+FILE * ice_output_stream(ice_output_t * o); 
+
+/* Whether compressed data is going out through io_uring */ 
+int ice_output_is_async(const ice_output_t * o); 
+
+/* Compressed bytes produced so far (i.e. the size of the file once everything has been written) */ 
+uint64_t ice_output_compressed_size(const ice_output_t * o); 
+
+/* Uncompressed bytes that have gone into the compressor so far */ 
+uint64_t ice_output_uncompressed_size(const ice_output_t * o); 
+
+/* CRC32C of the compressed bytes that have been handed off so far. This is kept up to date as the data goes out, 
+ * so the checksum of a finished file costs nothing extra to get (see ice_output_close_summary). */ 
+uint32_t ice_output_crc32c(const ice_output_t * o); 
+
+/* Do a full flush of the compressor, so that decompression can start from scratch (as raw deflate) 
+ * at the current compressed offset. Any of the out pointers may be NULL; they get the compressed offset 
+ * of the flush point, the uncompressed bytes before it and their crc32. Returns 0 on success. 
+ * Don't do this too often, since it costs some compression. */ 
+int ice_output_full_flush(ice_output_t * o, uint64_t * compressed_offset, uint64_t * uncompressed_offset, uint32_t * crc); 
+
+/* Finish the gzip stream, wait for all outstanding writes, apply the closing I/O policy and close the file
+ * (including the stream). Returns 0 if everything was written successfully. 
+ * This may block for a while, so it's best done away from anything latency-sensitive. */ 
+int ice_output_close(ice_output_t * o); 
+
+/* Like ice_output_close, but also fills in summary (final size and checksum) */ 
+int ice_output_close_summary(ice_output_t * o, ice_output_summary_t * summary); 
+
+/* Like ice_output_close, but for an in-memory output: *data gets the complete gzip data (which should be freed) and *len 
+ * its length. */ 
+int ice_output_close_memory(ice_output_t * o, void ** data, size_t * len); 
+
+#endif
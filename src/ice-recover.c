@@ -0,0 +1,475 @@
+#define _GNU_SOURCE
+#include "ice-recover.h" 
+#include "ice-index.h" 
+#include "ice-hdcol.h" 
+#include "ice-container.h" 
+#include "ice-manifest.h" 
+#include "rno-g.h" 
+#include <stdio.h> 
+#include <stdlib.h> 
+#include <string.h> 
+#include <unistd.h> 
+#include <fcntl.h> 
+#include <dirent.h> 
+#include <sys/file.h> 
+#include <sys/stat.h> 
+#include <zlib.h> 
+
+static const char * tmp_suffix = ".tmp"; 
+#define TMP_SUFFIX_LEN 4 
+
+// our gzip headers never have names or extra fields 
+#define GZIP_HEADER_LEN 10 
+
+enum { REC_WF, REC_HD, REC_DS, REC_UNKNOWN }; 
+
+static int stream_type(const char * path) 
+{
+  if (strstr(path, ".wf.dat.gz")) return REC_WF; 
+  if (strstr(path, ".hd.dat.gz")) return REC_HD; 
+  if (strstr(path, ".ds.dat.gz")) return REC_DS; 
+  return REC_UNKNOWN; 
+}
+
+static int ends_with(const char * s, const char * suffix) 
+{
+  int len = strlen(s); 
+  int slen = strlen(suffix); 
+  return len >= slen && !strcmp(s + len - slen, suffix); 
+}
+
+/* How many bytes of buf are complete records of the given type */ 
+static size_t complete_records(int type, void * buf, size_t len, int * nrecords) 
+{
+  *nrecords = 0; 
+  if (!len) return 0; 
+
+  FILE * f = fmemopen(buf, len, "r"); 
+  if (!f) return 0; 
+
+  rno_g_file_handle_t h = { .type = RNO_G_RAW }; 
+  h.handle.raw = f; 
+
+  static rno_g_waveform_t wf; 
+  static rno_g_header_t hd; 
+  static rno_g_daqstatus_t ds; 
+
+  size_t good = 0; 
+  while (1) 
+  {
+    int ret = type == REC_WF ? rno_g_waveform_read(h, &wf) : 
+              type == REC_HD ? rno_g_header_read(h, &hd) : 
+                               rno_g_daqstatus_read(h, &ds); 
+    if (ret <= 0) break; 
+    long pos = ftell(f); 
+    if (pos <= 0 || (size_t) pos > len) break; 
+    good = pos; 
+    (*nrecords)++; 
+  }
+
+  fclose(f); 
+  return good; 
+}
+
+/* Everything the stream has to give, in memory */ 
+static void * slurp(FILE * f, size_t * len) 
+{
+  size_t cap = 1 << 20; 
+  char * buf = malloc(cap); 
+  *len = 0; 
+  while (buf) 
+  {
+    size_t n = fread(buf + *len, 1, cap - *len, f); 
+    *len += n; 
+    if (*len < cap) break; 
+    cap *= 2; 
+    char * new_buf = realloc(buf, cap); 
+    if (!new_buf) free(buf); 
+    buf = new_buf; 
+  }
+  return buf; 
+}
+
+static int write_all(int fd, const void * buf, size_t len, off_t off) 
+{
+  const char * p = buf; 
+  while (len) 
+  {
+    ssize_t n = pwrite(fd, p, len, off); 
+    if (n <= 0) return -1; 
+    p += n; 
+    len -= n; 
+    off += n; 
+  }
+  return 0; 
+}
+
+/* Replace everything in the file after entry->compressed_offset with a deflate tail containing data, and 
+ * a proper gzip trailer. Since the data before the flush point ends on a byte boundary and doesn't refer to anything 
+ * after it, the new blocks can just follow. */ 
+static int rewrite_tail(const char * path, const ice_index_entry_t * entry, const void * data, size_t len) 
+{
+  z_stream z = {0}; 
+  if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return -1; 
+
+  size_t cap = deflateBound(&z, len) + 8; 
+  unsigned char * out = malloc(cap); 
+  if (!out) 
+  {
+    deflateEnd(&z); 
+    return -1; 
+  }
+
+  z.next_in = (unsigned char*) data; 
+  z.avail_in = len; 
+  z.next_out = out; 
+  z.avail_out = cap - 8; 
+  int ret = deflate(&z, Z_FINISH); 
+  size_t outlen = z.total_out; 
+  deflateEnd(&z); 
+  if (ret != Z_STREAM_END) 
+  {
+    free(out); 
+    return -1; 
+  }
+
+  uint32_t crc = crc32_combine(entry->crc32, crc32(crc32(0, Z_NULL, 0), data, len), len); 
+  uint32_t isize = entry->uncompressed_offset + len; 
+  for (int i = 0; i < 4; i++) 
+  {
+    out[outlen + i] = crc >> (8 * i); 
+    out[outlen + 4 + i] = isize >> (8 * i); 
+  }
+  outlen += 8; 
+
+  int fd = open(path, O_WRONLY | O_CLOEXEC); 
+  ret = fd < 0 || 
+        ftruncate(fd, entry->compressed_offset) || 
+        write_all(fd, out, outlen, entry->compressed_offset) || 
+        fsync(fd); 
+  if (fd >= 0) close(fd); 
+  free(out); 
+  return ret ? -1 : 0; 
+}
+
+int ice_recover_file(const char * tmp_path, char ** final_path, ice_recover_stats_t * stats) 
+{
+  int type = stream_type(tmp_path); 
+  if (type == REC_UNKNOWN || !ends_with(tmp_path, tmp_suffix)) return -1; 
+
+  struct stat st; 
+  if (stat(tmp_path, &st)) return -1; 
+
+  int len = strlen(tmp_path); 
+  char * path = strndup(tmp_path, len - TMP_SUFFIX_LEN); 
+  char * idx_tmp_path = ice_index_path(tmp_path); 
+
+  //start from the last flush point that made it to disk, or the beginning 
+  ice_index_entry_t start = { .compressed_offset = GZIP_HEADER_LEN }; 
+  ice_index_entry_t * entries = 0; 
+  int nentries = ice_index_load(idx_tmp_path, &entries); 
+  int nkept_entries = 0; 
+  for (int i = 0; i < nentries; i++) 
+  {
+    if (entries[i].compressed_offset > (uint64_t) st.st_size) break; 
+    start = entries[i]; 
+    nkept_entries = i + 1; 
+  }
+
+  int ret = -1; 
+  if (st.st_size < GZIP_HEADER_LEN) 
+  {
+    //nothing was ever written, write an empty file 
+    static const unsigned char empty_header[GZIP_HEADER_LEN] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3}; 
+    int fd = open(tmp_path, O_WRONLY | O_CLOEXEC); 
+    ret = fd < 0 || write_all(fd, empty_header, GZIP_HEADER_LEN, 0); 
+    if (fd >= 0) close(fd); 
+    start.compressed_offset = GZIP_HEADER_LEN; 
+    if (!ret) ret = rewrite_tail(tmp_path, &start, "", 0); 
+  }
+  else
+  {
+    FILE * f = ice_index_open_at(tmp_path, &start); 
+    size_t tail_len = 0; 
+    void * tail = f ? slurp(f, &tail_len) : NULL; 
+    if (f) fclose(f); 
+
+    if (tail) 
+    {
+      int nrecords; 
+      size_t good = complete_records(type, tail, tail_len, &nrecords); 
+      ret = rewrite_tail(tmp_path, &start, tail, good); 
+      if (stats) 
+      {
+        stats->bytes_kept += start.compressed_offset; 
+        stats->bytes_redone += good; 
+      }
+      free(tail); 
+    }
+  }
+
+  if (!ret) ret = rename(tmp_path, path); 
+
+  //the index: keep what's still good 
+  if (nentries >= 0) 
+  {
+    if (!ret) 
+    {
+      char * idx_path = ice_index_path(path); 
+      FILE * idx = ice_index_create(idx_path); 
+      for (int i = 0; idx && i < nkept_entries; i++) ice_index_append(idx, &entries[i]); 
+      if (idx) fclose(idx); 
+      free(idx_path); 
+    }
+    unlink(idx_tmp_path); 
+  }
+
+  free(entries); 
+  free(idx_tmp_path); 
+
+  if (stats) 
+  {
+    if (ret) stats->nfailed++; 
+    else stats->nrecovered++; 
+  }
+
+  if (!ret && final_path) *final_path = path; 
+  else free(path); 
+  return ret; 
+}
+
+
+/** The file list **/ 
+
+/* Is path (a file in the run directory) in the list? The writer lists files by whatever path it had for the run 
+ * (e.g. with a doubled slash), which needn't be ours, so entries are matched by inode. Entries that don't stat from 
+ * here (relative to wherever the writer was) are matched by their basename. */ 
+static int in_file_list(const char * list_path, const char * path) 
+{
+  struct stat want; 
+  if (stat(path, &want)) return 0; 
+  const char * base = strrchr(path, '/'); 
+  base = base ? base + 1 : path; 
+
+  FILE * f = fopen(list_path,"r"); 
+  if (!f) return 0; 
+  char * line = 0; 
+  size_t size = 0; 
+  ssize_t len; 
+  int found = 0; 
+  while (!found && (len = getline(&line, &size, f)) > 0) 
+  {
+    if (line[len-1] == '\n') line[len-1] = 0; 
+    struct stat st; 
+    if (!stat(line, &st)) found = st.st_dev == want.st_dev && st.st_ino == want.st_ino; 
+    else
+    {
+      const char * line_base = strrchr(line, '/'); 
+      found = !strcmp(line_base ? line_base + 1 : line, base); 
+    }
+  }
+  free(line); 
+  fclose(f); 
+  return found; 
+}
+
+static void add_to_list(const char * list_path, const char * path) 
+{
+  FILE * f = fopen(list_path, "a"); 
+  if (!f) 
+  {
+    fprintf(stderr,"Could not open %s\n", list_path); 
+    return; 
+  }
+  flock(fileno(f), LOCK_EX); 
+  fprintf(f, "%s\n", path); 
+  fflush(f); 
+  flock(fileno(f), LOCK_UN); 
+  fclose(f); 
+}
+
+
+static int recover_stream_dir(const char * run_dir, const char * list_path, const char * subdir, int verbose, ice_recover_stats_t * stats) 
+{
+  char * dir = 0; 
+  asprintf(&dir, "%s/%s", run_dir, subdir); 
+  DIR * d = opendir(dir); 
+  if (!d) 
+  {
+    free(dir); 
+    return 0; 
+  }
+
+  //collect first, since we're going to be renaming things 
+  char ** names = 0; 
+  int n = 0, cap = 0; 
+  struct dirent * ent; 
+  while ((ent = readdir(d))) 
+  {
+    if (!ends_with(ent->d_name, ".dat.gz.tmp")) continue; 
+    if (n == cap) 
+    {
+      cap = cap ? 2 * cap : 16; 
+      names = realloc(names, cap * sizeof(char*)); 
+    }
+    names[n++] = strdup(ent->d_name); 
+  }
+  closedir(d); 
+
+  int ret = 0; 
+  for (int i = 0; i < n; i++) 
+  {
+    char * path = 0; 
+    asprintf(&path, "%s/%s", dir, names[i]); 
+
+    if (!strncmp(names[i], "spare.", strlen("spare."))) // never used 
+    {
+      char * idx_path = ice_index_path(path); 
+      unlink(path); 
+      unlink(idx_path); 
+      free(idx_path); 
+      if (verbose) printf("  removed unused %s\n", path); 
+      if (stats) stats->nremoved++; 
+    }
+    else
+    {
+      char * final_path = 0; 
+      if (ice_recover_file(path, &final_path, stats)) 
+      {
+        fprintf(stderr,"Could not recover %s\n", path); 
+        ret = 1; 
+      }
+      else
+      {
+        if (verbose) printf("  recovered %s\n", final_path); 
+        ice_manifest_entry_t entry; 
+        if (!ice_manifest_entry_for_file(run_dir, final_path, &entry)) ice_manifest_append(run_dir, &entry); 
+        add_to_list(list_path, final_path); 
+        char * idx_path = ice_index_path(final_path); 
+        if (!access(idx_path, F_OK)) add_to_list(list_path, idx_path); 
+        free(idx_path); 
+        free(final_path); 
+      }
+    }
+    free(path); 
+    free(names[i]); 
+  }
+
+  free(names); 
+  free(dir); 
+  return ret; 
+}
+
+static void recover_hdcol(const char * run_dir, const char * list_path, int verbose) 
+{
+  char * dir = 0; 
+  asprintf(&dir, "%s/hdcol", run_dir); 
+
+  //cut all the columns back to the shortest one 
+  size_t nrows = (size_t) -1; 
+  int ntmp = 0; 
+  for (int i = 0; i < ICE_HDCOL_NCOLUMNS; i++) 
+  {
+    char * path = 0; 
+    asprintf(&path, "%s/%s%s", dir, ice_hdcol_name(i), tmp_suffix); 
+    struct stat st; 
+    if (!stat(path, &st)) 
+    {
+      ntmp++; 
+      if ((size_t) st.st_size / ice_hdcol_width(i) < nrows) nrows = st.st_size / ice_hdcol_width(i); 
+    }
+    free(path); 
+  }
+
+  for (int i = 0; ntmp && i < ICE_HDCOL_NCOLUMNS; i++) 
+  {
+    char * path = 0; 
+    char * tmp_path = 0; 
+    asprintf(&path, "%s/%s", dir, ice_hdcol_name(i)); 
+    asprintf(&tmp_path, "%s%s", path, tmp_suffix); 
+    if (!truncate(tmp_path, nrows * ice_hdcol_width(i)) && !rename(tmp_path, path)) 
+    {
+      add_to_list(list_path, path); 
+    }
+    free(path); 
+    free(tmp_path); 
+  }
+
+  if (ntmp && verbose) printf("  recovered header columns (%zu rows)\n", nrows); 
+  free(dir); 
+}
+
+static void recover_containers(const char * run_dir, const char * list_path, int verbose) 
+{
+  char * dir = 0; 
+  asprintf(&dir, "%s/container", run_dir); 
+  DIR * d = opendir(dir); 
+  if (d) 
+  {
+    struct dirent * ent; 
+    while ((ent = readdir(d))) 
+    {
+      if (!ends_with(ent->d_name, ".rnoc")) continue; 
+      char * path = 0; 
+      asprintf(&path, "%s/%s", dir, ent->d_name); 
+      if (!in_file_list(list_path, path)) // it was never closed 
+      {
+        ice_container_t * c = ice_container_open(path); // this takes care of it 
+        if (c) 
+        {
+          ice_container_close(c); 
+          add_to_list(list_path, path); 
+          if (verbose) printf("  recovered %s\n", path); 
+        }
+      }
+      free(path); 
+    }
+    closedir(d); 
+  }
+  free(dir); 
+}
+
+int ice_recover_run(const char * run_dir, int verbose, ice_recover_stats_t * stats) 
+{
+  ice_recover_stats_t local_stats = {0}; 
+  if (!stats) stats = &local_stats; 
+
+  //rno-g-compact-run holds this while it works on a run, so we don't both go renaming and deleting things at once 
+  int run_fd = open(run_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC); 
+  if (run_fd >= 0 && flock(run_fd, LOCK_EX | LOCK_NB)) 
+  {
+    fprintf(stderr,"%s is locked (being compacted?), waiting for it\n", run_dir); 
+    flock(run_fd, LOCK_EX); 
+  }
+
+  char * list_path = 0; 
+  asprintf(&list_path, "%s/aux/acq-file-list.txt", run_dir); 
+
+  int ret = 0; 
+  const char * subdirs[] = {"waveforms","header","daqstatus"}; 
+  for (unsigned i = 0; i < sizeof(subdirs) / sizeof(*subdirs); i++) 
+  {
+    ret = recover_stream_dir(run_dir, list_path, subdirs[i], verbose, stats) || ret; 
+  }
+  recover_hdcol(run_dir, list_path, verbose); 
+  recover_containers(run_dir, list_path, verbose); 
+
+  //note it down in the runinfo 
+  if (stats->nrecovered || stats->nfailed) 
+  {
+    char * runinfo_path = 0; 
+    asprintf(&runinfo_path, "%s/aux/runinfo.txt", run_dir); 
+    FILE * runinfo = fopen(runinfo_path, "a"); 
+    if (runinfo) 
+    {
+      fprintf(runinfo, "RECOVERED-FILES = %d\n", stats->nrecovered); 
+      if (stats->nfailed) fprintf(runinfo, "UNRECOVERABLE-FILES = %d\n", stats->nfailed); 
+      fclose(runinfo); 
+    }
+    free(runinfo_path); 
+  }
+
+  free(list_path); 
+  if (run_fd >= 0) close(run_fd); 
+  return ret; 
+}
@@ -0,0 +1,33 @@
+#ifndef _RNO_G_ICE_RECOVER_H
+#define _RNO_G_ICE_RECOVER_H
+
+/** Recovering what's left of a run after rno-g-acq died without closing its files (watchdog, power...). 
+ *
+ * For each leftover waveform/header/daqstatus .tmp file, the gzip stream is cut back to its last complete 
+ * record, finished properly, renamed, and added to the run's aux/acq-file-list.txt (and manifest,
+ * see ice-manifest.h). With an index sidecar (see ice-index.h), only what comes after the last index entry 
+ * needs to be decompressed (and recompressed), the rest is kept as is. Without one, the whole file is decompressed. 
+ *
+ * Index sidecars, header columns (ice-hdcol.h) and containers (ice-container.h) get tidied up too,
+ * and unused spares are deleted. 
+ **/ 
+
+typedef struct ice_recover_stats 
+{
+  int nrecovered;           // files recovered 
+  int nfailed;              // .tmp files we couldn't do anything with 
+  int nremoved;             // unused spares removed 
+  long long bytes_kept;      // compressed bytes kept as is 
+  long long bytes_redone;    // uncompressed bytes decompressed and recompressed 
+} ice_recover_stats_t; 
+
+/* Recover a run directory. Returns 0 if nothing went wrong. stats may be NULL. 
+ * If verbose, says what it's doing on stdout. The run directory is flocked while we're at it, so if 
+ * rno-g-compact-run is working on the run, this waits for it to finish first. */ 
+int ice_recover_run(const char * run_dir, int verbose, ice_recover_stats_t * stats); 
+
+/* Recover a single waveform/header/daqstatus .tmp file (the stream type is taken from the name). On success, the final 
+ * name (that should be freed) is returned via final_path, if not NULL. Returns 0 on success. */ 
+int ice_recover_file(const char * tmp_path, char ** final_path, ice_recover_stats_t * stats); 
+
+#endif
@@ -0,0 +1,248 @@
+#include "ice-sched.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#define ICE_SCHED_MAX_TASKS 16
+
+typedef struct ice_sched_task
+{
+  const char * name; 
+  double period; 
+  double jitter_budget; 
+  ice_sched_fn_t fn; 
+  void * arg; 
+  int scheduled; 
+  double next; 
+  double last; // last deadline run (0 if never) 
+  int next_set; // set_next was called while running 
+  ice_sched_stats_t stats; 
+} ice_sched_task_t; 
+
+struct ice_sched
+{
+  int ntasks; 
+  ice_sched_task_t tasks[ICE_SCHED_MAX_TASKS]; 
+  int timer_fd; 
+  int wake_fd; 
+  int nwakeups; 
+  int nidle_wakeups; 
+}; 
+
+static struct timespec to_timespec(double t) 
+{
+  struct timespec ts; 
+  ts.tv_sec = floor(t); 
+  ts.tv_nsec = (t - ts.tv_sec) * 1e9; 
+  if (ts.tv_nsec >= 1000000000) 
+  {
+    ts.tv_sec++; 
+    ts.tv_nsec -= 1000000000; 
+  }
+  return ts; 
+}
+
+double ice_sched_now() 
+{
+  struct timespec now; 
+  clock_gettime(CLOCK_MONOTONIC, &now); 
+  return now.tv_sec + 1e-9 * now.tv_nsec; 
+}
+
+ice_sched_t * ice_sched_init() 
+{
+  ice_sched_t * s = calloc(sizeof(ice_sched_t), 1); 
+  if (!s) return 0; 
+
+  s->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC); 
+  s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); 
+  if (s->timer_fd < 0 || s->wake_fd < 0) 
+  {
+    fprintf(stderr,"Can't create timerfd/eventfd for scheduler\n"); 
+    if (s->timer_fd >= 0) close(s->timer_fd); 
+    if (s->wake_fd >= 0) close(s->wake_fd); 
+    free(s); 
+    return 0; 
+  }
+  return s; 
+}
+
+void ice_sched_destroy(ice_sched_t * s) 
+{
+  if (!s) return; 
+  close(s->timer_fd); 
+  close(s->wake_fd); 
+  free(s); 
+}
+
+int ice_sched_add(ice_sched_t * s, const char * name, double period, double jitter_budget, ice_sched_fn_t fn, void * arg) 
+{
+  if (s->ntasks >= ICE_SCHED_MAX_TASKS) 
+  {
+    fprintf(stderr,"Too many scheduler tasks, can't add %s\n", name); 
+    return -1; 
+  }
+
+  int id = s->ntasks++; 
+  ice_sched_task_t * t = &s->tasks[id]; 
+  memset(t, 0, sizeof(*t)); 
+  t->name = name; 
+  t->jitter_budget = jitter_budget; 
+  t->fn = fn; 
+  t->arg = arg; 
+  ice_sched_set_period(s, id, period); 
+  return id; 
+}
+
+void ice_sched_set_period(ice_sched_t * s, int task, double period) 
+{
+  if (task < 0 || task >= s->ntasks) return; 
+  ice_sched_task_t * t = &s->tasks[task]; 
+
+  if (period <= 0) 
+  {
+    t->period = 0; 
+    t->scheduled = 0; 
+    return; 
+  }
+
+  if (t->scheduled && t->period == period) return; 
+
+  double now = ice_sched_now(); 
+  t->next = t->scheduled && t->last > 0 && t->last + period > now ? t->last + period : now; 
+  t->period = period; 
+  t->scheduled = 1; 
+}
+
+void ice_sched_set_next(ice_sched_t * s, int task, double when) 
+{
+  if (task < 0 || task >= s->ntasks) return; 
+  ice_sched_task_t * t = &s->tasks[task]; 
+  t->next = when; 
+  t->scheduled = 1; 
+  t->next_set = 1; 
+}
+
+/* Pick the next deadline after running one at deadline */ 
+static void reschedule(ice_sched_task_t * t, double deadline, double now) 
+{
+  if (t->next_set || !t->scheduled) return; 
+  if (t->period <= 0) 
+  {
+    t->scheduled = 0; 
+    return; 
+  }
+
+  t->next = deadline + t->period; 
+  if (t->next <= now) 
+  {
+    int nmissed = floor((now - t->next) / t->period) + 1; 
+    t->stats.nmissed += nmissed; 
+    t->next += nmissed * t->period; 
+  }
+}
+
+int ice_sched_run(ice_sched_t * s, double max_sleep) 
+{
+  double now = ice_sched_now(); 
+
+  //find the earliest deadline 
+  double wake_at = max_sleep >= 0 ? now + max_sleep : INFINITY; 
+  for (int i = 0; i < s->ntasks; i++) 
+  {
+    if (s->tasks[i].scheduled && s->tasks[i].next < wake_at) wake_at = s->tasks[i].next; 
+  }
+
+  if (wake_at > now) 
+  {
+    struct itimerspec its = {0}; 
+    if (isfinite(wake_at)) its.it_value = to_timespec(wake_at); 
+    timerfd_settime(s->timer_fd, TFD_TIMER_ABSTIME, &its, 0); 
+
+    struct pollfd pfds[2] = { {.fd = s->timer_fd, .events = POLLIN}, {.fd = s->wake_fd, .events = POLLIN} }; 
+    poll(pfds, 2, -1); 
+
+    //drain both (they're non-blocking, so it's fine if there's nothing there) 
+    uint64_t val; 
+    if (read(s->timer_fd, &val, sizeof(val)) < 0) val = 0; 
+    if (read(s->wake_fd, &val, sizeof(val)) < 0) val = 0; 
+    now = ice_sched_now(); 
+  }
+  s->nwakeups++; 
+
+  //run everything that's due, earliest first. Each task runs at most once per call, so a task that's 
+  //slower than its period can't starve the others 
+  int ran[ICE_SCHED_MAX_TASKS] = {0}; 
+  int nrun = 0; 
+  while (1) 
+  {
+    int which = -1; 
+    for (int i = 0; i < s->ntasks; i++) 
+    {
+      ice_sched_task_t * t = &s->tasks[i]; 
+      if (ran[i] || !t->scheduled || t->next > now) continue; 
+      if (which < 0 || t->next < s->tasks[which].next) which = i; 
+    }
+    if (which < 0) break; 
+
+    ice_sched_task_t * t = &s->tasks[which]; 
+    double deadline = t->next; 
+    double lateness = now - deadline; 
+    t->stats.nruns++; 
+    t->stats.total_lateness += lateness; 
+    if (lateness > t->stats.max_lateness) t->stats.max_lateness = lateness; 
+    if (lateness > t->jitter_budget) t->stats.nlate++; 
+
+    t->next_set = 0; 
+    t->last = deadline; 
+    t->fn(t->arg, deadline, now); 
+    ran[which] = 1; 
+    nrun++; 
+
+    now = ice_sched_now(); 
+    reschedule(t, deadline, now); 
+  }
+
+  if (!nrun) s->nidle_wakeups++; 
+  return nrun; 
+}
+
+void ice_sched_wake(ice_sched_t * s) 
+{
+  uint64_t one = 1; 
+  if (write(s->wake_fd, &one, sizeof(one)) < 0) 
+  {
+    //only fails if the counter would overflow, in which case we're already awake 
+  }
+}
+
+void ice_sched_get_stats(ice_sched_t * s, int task, ice_sched_stats_t * stats) 
+{
+  if (task < 0 || task >= s->ntasks) 
+  {
+    memset(stats, 0, sizeof(*stats)); 
+    return; 
+  }
+  *stats = s->tasks[task].stats; 
+}
+
+void ice_sched_print_stats(FILE * f, ice_sched_t * s, int reset) 
+{
+  fprintf(f,"  scheduler: %d wakeups (%d idle)\n", s->nwakeups, s->nidle_wakeups); 
+  for (int i = 0; i < s->ntasks; i++) 
+  {
+    ice_sched_task_t * t = &s->tasks[i]; 
+    if (!t->stats.nruns && !t->scheduled) continue; 
+    fprintf(f,"    %-16s %6d runs, lateness mean %.3f ms / max %.3f ms, %d over %.0f ms budget, %d missed\n", 
+        t->name, t->stats.nruns, t->stats.nruns ? 1e3 * t->stats.total_lateness / t->stats.nruns : 0., 
+        1e3 * t->stats.max_lateness, t->stats.nlate, 1e3 * t->jitter_budget, t->stats.nmissed); 
+    if (reset) memset(&t->stats, 0, sizeof(t->stats)); 
+  }
+  if (reset) s->nwakeups = s->nidle_wakeups = 0; 
+}
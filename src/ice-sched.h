@@ -0,0 +1,65 @@
+#ifndef _RNO_G_ICE_SCHED_H
+#define _RNO_G_ICE_SCHED_H
+
+/** A small deadline scheduler, for the monitor thread.
+ *
+ * Each task has a period (or picks its own next deadline each time it runs) and a jitter budget.
+ * ice_sched_run sleeps (on a timerfd, armed for the absolute time of the earliest deadline) until
+ * something is due, runs whatever is, and reschedules it. Periodic tasks stay on their grid
+ * (deadline + period) rather than drifting by however late they ran; if a task falls more than
+ * a period behind, the missed runs are skipped and counted.
+ *
+ * We also keep track of how late each task runs, and how often that's more than its jitter budget.
+ *
+ * Times are CLOCK_MONOTONIC seconds, as doubles. Only one thread should use a scheduler, except
+ * for ice_sched_wake.
+ **/ 
+
+#include <stdio.h>
+
+struct ice_sched; 
+typedef struct ice_sched ice_sched_t; 
+
+/* A task. deadline is when it was meant to run, now is when it actually is */ 
+typedef void (*ice_sched_fn_t)(void * arg, double deadline, double now); 
+
+typedef struct ice_sched_stats
+{
+  int nruns; 
+  int nlate;              // runs later than the jitter budget 
+  int nmissed;            // periods skipped entirely because we were too far behind 
+  double total_lateness;  // seconds 
+  double max_lateness;    // seconds 
+} ice_sched_stats_t; 
+
+ice_sched_t * ice_sched_init(); 
+void ice_sched_destroy(ice_sched_t * s); 
+
+/* Add a task, returning its id (or -1). If period > 0, it first runs right away, otherwise it doesn't
+ * run until given a period or a deadline. */ 
+int ice_sched_add(ice_sched_t * s, const char * name, double period, double jitter_budget, ice_sched_fn_t fn, void * arg); 
+
+/* Change a task's period. A period <= 0 stops it. A stopped task that gets a period runs right away; 
+ * otherwise the next run is a new period after the last one (or right away, if that's already past). */ 
+void ice_sched_set_period(ice_sched_t * s, int task, double period); 
+
+/* Set the next deadline of a task explicitly. For tasks without a period (e.g. randomized intervals), 
+ * call this from the task itself. */ 
+void ice_sched_set_next(ice_sched_t * s, int task, double when); 
+
+/* Sleep until the next deadline (but not more than max_sleep seconds, or until woken), then run
+ * everything due, in deadline order. Returns the number of tasks run. */ 
+int ice_sched_run(ice_sched_t * s, double max_sleep); 
+
+/* Wake up ice_sched_run early (from any thread, e.g. to quit) */ 
+void ice_sched_wake(ice_sched_t * s); 
+
+/* The current time, on the scheduler's clock */ 
+double ice_sched_now(); 
+
+void ice_sched_get_stats(ice_sched_t * s, int task, ice_sched_stats_t * stats); 
+
+/* Print the stats of every task (and the number of wakeups that ran nothing), optionally resetting them */ 
+void ice_sched_print_stats(FILE * f, ice_sched_t * s, int reset); 
+
+#endif
@@ -0,0 +1,215 @@
+#include "ice-servo.h"
+#include "ice-servolog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static float clamp(float val, float min, float max) 
+{
+  if (val < min) return min; 
+  if (val > max) return max; 
+  return val; 
+}
+
+/* The reading from ago updates back (0 is the latest) */ 
+static float * radiant_servo_reading(const ice_radiant_servo_t * st, int ago) 
+{
+  int i = st->head - 1 - ago; 
+  if (i < 0) i += st->max_periods; 
+  return st->scaler_v + i * RNO_G_NUM_RADIANT_CHANNELS; 
+}
+
+/* Redo the running sums from the ring (when the windows change) */ 
+static void recompute_radiant_servo_sums(ice_radiant_servo_t * st) 
+{
+  memset(st->scaler_sum, 0, sizeof(st->scaler_sum)); 
+  for (int j = 0; j < NUM_SERVO_PERIODS; j++) 
+  {
+    int n = st->nscaler_periods_per_servo_period[j]; 
+    if (n > st->nperiods_populated) n = st->nperiods_populated; 
+    for (int i = 0; i < n; i++) 
+    {
+      const float * v = radiant_servo_reading(st, i); 
+      for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) st->scaler_sum[j][chan] += v[chan]; 
+    }
+  }
+}
+
+int ice_radiant_servo_setup(ice_radiant_servo_t * st, const acq_config_t * cfg) 
+{
+  int max_periods = 0; 
+  for (int i = 0; i < NUM_SERVO_PERIODS; i++) 
+  {
+    if (cfg->radiant.servo.nscaler_periods_per_servo_period[i] > max_periods) 
+    {
+      max_periods = cfg->radiant.servo.nscaler_periods_per_servo_period[i]; 
+    }
+  }
+
+  if (st->max_periods < max_periods) 
+  {
+    if (st->scaler_v) free(st->scaler_v); 
+    memset(st, 0, sizeof(*st)); 
+    st->scaler_v = calloc(max_periods * RNO_G_NUM_RADIANT_CHANNELS, sizeof(*st->scaler_v)); 
+    if (!st->scaler_v) return -1; 
+    st->max_periods = max_periods; 
+  }
+
+  memcpy(st->nscaler_periods_per_servo_period, cfg->radiant.servo.nscaler_periods_per_servo_period, sizeof(int) * NUM_SERVO_PERIODS); 
+  memcpy(st->period_weights, cfg->radiant.servo.period_weights, sizeof(float) * NUM_SERVO_PERIODS); 
+
+  //the windows may have changed 
+  recompute_radiant_servo_sums(st); 
+
+  st->min_thresh = cfg->radiant.thresholds.min * 16777215/2.5; 
+  st->max_thresh = cfg->radiant.thresholds.max * 16777215/2.5; 
+  st->max_change = cfg->radiant.servo.max_thresh_change * 16777215/2.5; 
+  return 0; 
+}
+
+void ice_radiant_servo_update(ice_radiant_servo_t * st, const acq_config_t * cfg, const rno_g_daqstatus_t * ds) 
+{
+  if (!st->max_periods) return; 
+
+  //calculate adjusted scalers 
+  float adjusted_scaler[RNO_G_NUM_RADIANT_CHANNELS]; 
+  float period = ds->radiant_scaler_period?:1; 
+  for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) 
+  {
+    adjusted_scaler[chan] = ds->radiant_scalers[chan] * (1 + ds->radiant_prescalers[chan]) / period; 
+  }
+
+  //the readings falling out of each window go first, since the oldest one in the ring is about to be overwritten 
+  for (int j = 0; j < NUM_SERVO_PERIODS; j++) 
+  {
+    int n = st->nscaler_periods_per_servo_period[j]; 
+    if (n <= 0 || st->nperiods_populated < n) continue; 
+    const float * expired = radiant_servo_reading(st, n - 1); 
+    for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) st->scaler_sum[j][chan] -= expired[chan]; 
+  }
+
+  //put in rolling window 
+  memcpy(st->scaler_v + st->head * RNO_G_NUM_RADIANT_CHANNELS, adjusted_scaler, sizeof(adjusted_scaler)); 
+  if (++st->head == st->max_periods) st->head = 0; 
+  if (st->nperiods_populated < st->max_periods) st->nperiods_populated++; 
+
+  memcpy(st->last_value, st->value, sizeof(st->value)); 
+  memset(st->value, 0, sizeof(st->value)); 
+  for (int j = 0; j < NUM_SERVO_PERIODS; j++) 
+  {
+    int n = st->nscaler_periods_per_servo_period[j]; 
+    if (n <= 0) continue; 
+    for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) st->scaler_sum[j][chan] += adjusted_scaler[chan]; 
+    if (!st->period_weights[j]) continue; 
+    float w = st->period_weights[j] / (n < st->nperiods_populated ? n : st->nperiods_populated); 
+    for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) st->value[chan] += w * st->scaler_sum[j][chan]; 
+  }
+
+  for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) 
+  {
+    if (cfg->radiant.servo.use_log) 
+    {
+      st->value[chan] = log10(cfg->radiant.servo.log_offset + st->value[chan]); 
+    }
+
+    st->last_error[chan] = st->error[chan]; 
+    st->error[chan] = (st->value[chan] - cfg->radiant.servo.scaler_goals[chan]); 
+    st->sum_error[chan] += st->error[chan]; 
+    if (fabs(st->sum_error[chan]) > cfg->radiant.servo.max_sum_err) 
+    {
+      st->sum_error[chan] = st->sum_error[chan] < 0 ? -cfg->radiant.servo.max_sum_err: cfg->radiant.servo.max_sum_err; 
+    }
+
+  }
+  st->nsum++; 
+}
+
+void ice_radiant_servo_step(const ice_radiant_servo_t * st, const acq_config_t * cfg, uint32_t mask, 
+                            uint32_t * thresholds, uint32_t * flags) 
+{
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+  {
+    if (0 == (mask & (1u << ch))) continue; 
+    uint32_t f = 0; 
+
+    double dthreshold = cfg->radiant.servo.P * st->error[ch] + 
+                        cfg->radiant.servo.I * st->sum_error[ch] + 
+                        cfg->radiant.servo.D * (st->error[ch] - st->last_error[ch]); 
+
+    if (st->max_thresh && fabs(dthreshold) > st->max_change) 
+    {
+      dthreshold = (dthreshold < 0)  ? -st->max_change : st->max_change; 
+      f |= ICE_SERVOLOG_RATE_LIMITED; 
+    }
+
+    thresholds[ch] -= dthreshold; 
+    if (thresholds[ch] < st->min_thresh) 
+    {
+      thresholds[ch] = st->min_thresh; 
+      f |= ICE_SERVOLOG_CLAMPED_LOW; 
+    }
+    if (thresholds[ch] > st->max_thresh) 
+    {
+      thresholds[ch] = st->max_thresh; 
+      f |= ICE_SERVOLOG_CLAMPED_HIGH; 
+    }
+    if (flags) flags[ch] = f; 
+  }
+}
+
+void ice_radiant_servo_free(ice_radiant_servo_t * st) 
+{
+  if (st->scaler_v) free(st->scaler_v); 
+  st->scaler_v = 0; 
+  st->max_periods = 0; 
+}
+
+void ice_flower_servo_setup(ice_flower_servo_t * st, const uint8_t * servo_thresholds) 
+{
+  memset(st, 0, sizeof(*st)); 
+  for (int i = 0; i < RNO_G_NUM_LT_CHANNELS; i++) st->float_thresh[i] = servo_thresholds[i]; 
+}
+
+void ice_flower_servo_update(ice_flower_servo_t * st, const acq_config_t * cfg, const rno_g_daqstatus_t * ds, float fast_factor) 
+{
+  float sw = cfg->lt.servo.slow_scaler_weight; 
+  float fw = cfg->lt.servo.fast_scaler_weight; 
+
+  const rno_g_lt_scaler_group_t * fast = &ds->lt_scalers.s_100Hz; 
+  const rno_g_lt_scaler_group_t * slow = &ds->lt_scalers.s_1Hz; 
+  const rno_g_lt_scaler_group_t * slow_gated = &ds->lt_scalers.s_1Hz_gated; 
+
+  int sub = cfg->lt.servo.subtract_gated; 
+
+  for (int i = 0; i < RNO_G_NUM_LT_CHANNELS; i++) 
+  {
+    float val =  fw * fast_factor*fast->servo_per_chan[i]+ sw *(slow->servo_per_chan[i]-sub*slow_gated->servo_per_chan[i]); 
+    st->last_value[i] = st->value[i]; 
+    st->value[i] = val; 
+    st->last_error[i] = st->error[i]; 
+    st->error[i] = (val-cfg->lt.servo.scaler_goals[i]); 
+    st->sum_error[i] += st->error[i]; 
+  }
+}
+
+void ice_flower_servo_step(ice_flower_servo_t * st, const acq_config_t * cfg, 
+                           uint8_t * servo_thresholds, uint8_t * trigger_thresholds, uint32_t * flags) 
+{
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+  {
+    double d_servo_threshold = cfg->lt.servo.P * st->error[ch] + 
+                               cfg->lt.servo.I * st->sum_error[ch] + 
+                               cfg->lt.servo.D * (st->error[ch] - st->last_error[ch]); 
+
+    float servo_thresh = st->float_thresh[ch] + d_servo_threshold; 
+    st->float_thresh[ch] = clamp(servo_thresh,4,120); 
+    servo_thresholds[ch] = st->float_thresh[ch]; 
+    float trig_thresh = (st->float_thresh[ch] - cfg->lt.servo.servo_thresh_offset) / cfg->lt.servo.servo_thresh_frac; 
+    trigger_thresholds[ch] = clamp(trig_thresh, 4, 120); 
+
+    if (flags) flags[ch] = (servo_thresh < 4 ? ICE_SERVOLOG_CLAMPED_LOW : 0) |
+                           (servo_thresh > 120 ? ICE_SERVOLOG_CLAMPED_HIGH : 0) |
+                           (trig_thresh < 4 ? ICE_SERVOLOG_TRIG_CLAMPED_LOW : 0) |
+                           (trig_thresh > 120 ? ICE_SERVOLOG_TRIG_CLAMPED_HIGH : 0); 
+  }
+}
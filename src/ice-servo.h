@@ -0,0 +1,77 @@
+#ifndef _RNO_G_ICE_SERVO_H
+#define _RNO_G_ICE_SERVO_H
+
+/** The threshold servos.
+ *
+ * This is the math of the RADIANT and flower threshold servos, without any of the hardware, so that
+ * rno-g-acq and rno-g-servo-sim run exactly the same thing. Each servo has: 
+ *
+ *  _setup:  (re)configure from an acq config (call again when the config changes) 
+ *  _update: feed it a daqstatus with new scalers, which updates value, error and sum_error
+ *  _step:   a PID step, which moves the thresholds passed in, and sets the flags (ICE_SERVOLOG_RATE_LIMITED etc., 
+ *           see ice-servolog.h) for each channel it touched
+ *
+ * None of these take any locks; the config should not change underneath them.
+ **/ 
+
+#include "ice-config.h"
+#include "rno-g.h"
+
+/* RADIANT servo state.
+ *
+ * The scaler history is a ring of max_periods scaler readings, stored time-major (all channels of a reading next to each
+ * other), and we keep a running sum over the last nscaler_periods_per_servo_period[j] readings for each period j, 
+ * so an update is the same amount of work no matter how long the windows are. The sums are doubles so that adding
+ * and subtracting for months doesn't drift. */ 
+typedef struct ice_radiant_servo
+{
+  int max_periods; 
+  int nperiods_populated; // capped at max_periods 
+  int head; // where the next reading goes in the ring 
+  float period_weights[NUM_SERVO_PERIODS]; 
+  int nscaler_periods_per_servo_period[NUM_SERVO_PERIODS]; 
+  float * scaler_v; // [max_periods][RNO_G_NUM_RADIANT_CHANNELS] 
+  double scaler_sum[NUM_SERVO_PERIODS][RNO_G_NUM_RADIANT_CHANNELS]; 
+  float value[RNO_G_NUM_RADIANT_CHANNELS]; 
+  float last_value[RNO_G_NUM_RADIANT_CHANNELS]; 
+  float error[RNO_G_NUM_RADIANT_CHANNELS]; 
+  float last_error[RNO_G_NUM_RADIANT_CHANNELS]; 
+  float sum_error[RNO_G_NUM_RADIANT_CHANNELS]; 
+  int nsum; 
+
+  //threshold limits, in DAC counts 
+  uint32_t min_thresh; 
+  uint32_t max_thresh; 
+  uint32_t max_change; 
+} ice_radiant_servo_t; 
+
+typedef struct ice_flower_servo
+{
+  float value[RNO_G_NUM_LT_CHANNELS]; 
+  float last_value[RNO_G_NUM_LT_CHANNELS]; 
+  float error[RNO_G_NUM_LT_CHANNELS]; 
+  float last_error[RNO_G_NUM_LT_CHANNELS]; 
+  float sum_error[RNO_G_NUM_LT_CHANNELS]; 
+  float float_thresh[RNO_G_NUM_LT_CHANNELS]; // the servo thresholds, before rounding 
+} ice_flower_servo_t; 
+
+/* Keeps the scaler history if the windows still fit, otherwise starts over. Returns 0 on success */ 
+int ice_radiant_servo_setup(ice_radiant_servo_t * st, const acq_config_t * cfg); 
+void ice_radiant_servo_update(ice_radiant_servo_t * st, const acq_config_t * cfg, const rno_g_daqstatus_t * ds); 
+
+/* Steps the channels in mask. thresholds is RNO_G_NUM_RADIANT_CHANNELS long, so is flags (if not NULL) */ 
+void ice_radiant_servo_step(const ice_radiant_servo_t * st, const acq_config_t * cfg, uint32_t mask, 
+                            uint32_t * thresholds, uint32_t * flags); 
+void ice_radiant_servo_free(ice_radiant_servo_t * st); 
+
+/* Starts over from the current servo thresholds */ 
+void ice_flower_servo_setup(ice_flower_servo_t * st, const uint8_t * servo_thresholds); 
+
+/* fast_factor is what the 100 Hz scalers are multiplied by to get to Hz, which depends on the firmware */ 
+void ice_flower_servo_update(ice_flower_servo_t * st, const acq_config_t * cfg, const rno_g_daqstatus_t * ds, float fast_factor); 
+
+/* Steps all channels, each array is RNO_G_NUM_LT_CHANNELS long (flags may be NULL) */ 
+void ice_flower_servo_step(ice_flower_servo_t * st, const acq_config_t * cfg, 
+                           uint8_t * servo_thresholds, uint8_t * trigger_thresholds, uint32_t * flags); 
+
+#endif
@@ -0,0 +1,180 @@
+#include "ice-servolog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <zlib.h>
+
+#define NFIELDS 5
+
+struct ice_servolog
+{
+  gzFile f; 
+  uint64_t last_time_ms; 
+  int64_t prev[ICE_SERVOLOG_NUM_BOARDS][ICE_SERVOLOG_MAX_CHANNELS][NFIELDS]; 
+}; 
+
+static int64_t to_fixed(float x) 
+{
+  if (!isfinite(x)) return 0; 
+  return llround((double) x * ICE_SERVOLOG_SCALE); 
+}
+
+static int put_varint(uint8_t * buf, uint64_t v) 
+{
+  int n = 0; 
+  while (v >= 0x80) 
+  {
+    buf[n++] = (v & 0x7f) | 0x80; 
+    v >>= 7; 
+  }
+  buf[n++] = v; 
+  return n; 
+}
+
+static uint64_t zigzag(int64_t v) 
+{
+  return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63); 
+}
+
+static int64_t unzigzag(uint64_t v) 
+{
+  return (int64_t) (v >> 1) ^ -(int64_t) (v & 1); 
+}
+
+static int get_varint(gzFile f, uint64_t * v) 
+{
+  *v = 0; 
+  for (int shift = 0; shift < 64; shift += 7) 
+  {
+    int c = gzgetc(f); 
+    if (c < 0) return -1; 
+    *v |= (uint64_t) (c & 0x7f) << shift; 
+    if (!(c & 0x80)) return 0; 
+  }
+  return -1; 
+}
+
+
+ice_servolog_t * ice_servolog_create(const char * path, int station, int run) 
+{
+  gzFile f = gzopen(path, "wb6"); 
+  if (!f) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    return NULL; 
+  }
+
+  struct timespec now; 
+  clock_gettime(CLOCK_REALTIME, &now); 
+  ice_servolog_header_t hdr = {.magic = ICE_SERVOLOG_MAGIC, .version = ICE_SERVOLOG_VERSION, .scale = ICE_SERVOLOG_SCALE, 
+                               .station = station, .run = run, .start_time_ms = now.tv_sec * 1000ull + now.tv_nsec / 1000000}; 
+  if (gzwrite(f, &hdr, sizeof(hdr)) != sizeof(hdr)) 
+  {
+    fprintf(stderr,"Could not write to %s\n", path); 
+    gzclose(f); 
+    return NULL; 
+  }
+
+  ice_servolog_t * log = calloc(1, sizeof(ice_servolog_t)); 
+  log->f = f; 
+  log->last_time_ms = hdr.start_time_ms; 
+  return log; 
+}
+
+int ice_servolog_write(ice_servolog_t * log, const ice_servolog_step_t * step) 
+{
+  if (step->board < 0 || step->board >= ICE_SERVOLOG_NUM_BOARDS) return -1; 
+
+  uint8_t buf[3 * 10 + ICE_SERVOLOG_MAX_CHANNELS * (NFIELDS + 1) * 10]; 
+  int n = 0; 
+  n += put_varint(buf + n, step->board); 
+  n += put_varint(buf + n, step->time_ms > log->last_time_ms ? step->time_ms - log->last_time_ms : 0); 
+  n += put_varint(buf + n, step->mask); 
+  if (step->time_ms > log->last_time_ms) log->last_time_ms = step->time_ms; 
+
+  for (int ch = 0; ch < ICE_SERVOLOG_MAX_CHANNELS; ch++) 
+  {
+    if (!(step->mask & (1u << ch))) continue; 
+    const ice_servolog_channel_t * c = &step->ch[ch]; 
+    int64_t fields[NFIELDS] = { to_fixed(c->value), to_fixed(c->error), to_fixed(c->sum_error), c->threshold, c->trigger_threshold }; 
+    int64_t * prev = log->prev[step->board][ch]; 
+    for (int i = 0; i < NFIELDS; i++) 
+    {
+      n += put_varint(buf + n, zigzag(fields[i] - prev[i])); 
+      prev[i] = fields[i]; 
+    }
+    n += put_varint(buf + n, c->flags); 
+  }
+
+  return gzwrite(log->f, buf, n) == n ? 0 : -1; 
+}
+
+int ice_servolog_flush(ice_servolog_t * log) 
+{
+  return gzflush(log->f, Z_SYNC_FLUSH) == Z_OK ? 0 : -1; 
+}
+
+ice_servolog_t * ice_servolog_open(const char * path, ice_servolog_header_t * hdr) 
+{
+  gzFile f = gzopen(path, "rb"); 
+  if (!f) return NULL; 
+
+  ice_servolog_header_t h; 
+  if (gzread(f, &h, sizeof(h)) != sizeof(h) || h.magic != ICE_SERVOLOG_MAGIC || h.version > ICE_SERVOLOG_VERSION) 
+  {
+    fprintf(stderr,"%s is not a servo history (or is from the future)\n", path); 
+    gzclose(f); 
+    return NULL; 
+  }
+  if (hdr) *hdr = h; 
+
+  ice_servolog_t * log = calloc(1, sizeof(ice_servolog_t)); 
+  log->f = f; 
+  log->last_time_ms = h.start_time_ms; 
+  return log; 
+}
+
+int ice_servolog_read(ice_servolog_t * log, ice_servolog_step_t * step) 
+{
+  uint64_t board, dt, mask; 
+  if (get_varint(log->f, &board) || get_varint(log->f, &dt) || get_varint(log->f, &mask)) return 1; 
+  if (board >= ICE_SERVOLOG_NUM_BOARDS) return 1; 
+
+  memset(step, 0, sizeof(*step)); 
+  step->board = board; 
+  step->time_ms = log->last_time_ms += dt; 
+  step->mask = mask; 
+
+  for (int ch = 0; ch < ICE_SERVOLOG_MAX_CHANNELS; ch++) 
+  {
+    if (!(mask & (1u << ch))) continue; 
+    int64_t * prev = log->prev[board][ch]; 
+    for (int i = 0; i < NFIELDS; i++) 
+    {
+      uint64_t v; 
+      if (get_varint(log->f, &v)) return 1; 
+      prev[i] += unzigzag(v); 
+    }
+    uint64_t flags; 
+    if (get_varint(log->f, &flags)) return 1; 
+
+    ice_servolog_channel_t * c = &step->ch[ch]; 
+    c->value = (double) prev[0] / ICE_SERVOLOG_SCALE; 
+    c->error = (double) prev[1] / ICE_SERVOLOG_SCALE; 
+    c->sum_error = (double) prev[2] / ICE_SERVOLOG_SCALE; 
+    c->threshold = prev[3]; 
+    c->trigger_threshold = prev[4]; 
+    c->flags = flags; 
+  }
+  return 0; 
+}
+
+int ice_servolog_close(ice_servolog_t * log) 
+{
+  if (!log) return 0; 
+  int ret = gzclose(log->f) == Z_OK ? 0 : -1; 
+  free(log); 
+  return ret; 
+}
@@ -0,0 +1,95 @@
+#ifndef _RNO_G_ICE_SERVOLOG_H
+#define _RNO_G_ICE_SERVOLOG_H
+
+/** The servo history.
+ *
+ * Every threshold servo step (RADIANT or flower) gets a record in aux/servo-history.dat.gz of its run, with what
+ * the servo saw (value, error, sum_error) and what it did (the thresholds it set, and whether they were
+ * clamped or rate limited) for each channel, so the PID parameters can be tuned from real data.
+ *
+ * There are a lot of steps (two every second or so), so to keep it small, value, error and sum_error are stored in
+ * fixed point (in units of 1/ICE_SERVOLOG_SCALE), and everything is stored as the zigzag varint-encoded difference
+ * from the same channel of the previous step of the same board, with the time as a varint number of ms since
+ * the previous step. Things mostly don't change much, so it's mostly single bytes, and gzip takes care of the rest.
+ *
+ * After the header (not compressed, well, apart from the gzip), each step is: 
+ *   varint board
+ *   varint ms since the previous step (of either board), or since start_time for the first
+ *   varint channel mask (only the channels that were servoed) 
+ *   for each channel in the mask: zigzag varint differences of value, error, sum_error, threshold, 
+ *   trigger_threshold, and then the flags as a varint
+ *
+ * Use ice_servolog_open/ice_servolog_read to read it back.
+ **/ 
+
+#include <stdint.h>
+
+#define ICE_SERVOLOG_NAME "aux/servo-history.dat.gz"
+#define ICE_SERVOLOG_MAGIC 0x4f565352  /* "RSVO" */
+#define ICE_SERVOLOG_VERSION 1
+#define ICE_SERVOLOG_SCALE 1000
+#define ICE_SERVOLOG_MAX_CHANNELS 24
+
+typedef enum
+{
+  ICE_SERVOLOG_RADIANT = 0, 
+  ICE_SERVOLOG_LT = 1, 
+  ICE_SERVOLOG_NUM_BOARDS
+} ice_servolog_board_t; 
+
+//clamp flags 
+#define ICE_SERVOLOG_RATE_LIMITED 0x1        // the threshold change was limited (RADIANT max_thresh_change)
+#define ICE_SERVOLOG_CLAMPED_LOW 0x2         // the threshold hit its minimum
+#define ICE_SERVOLOG_CLAMPED_HIGH 0x4        // the threshold hit its maximum
+#define ICE_SERVOLOG_TRIG_CLAMPED_LOW 0x8    // the trigger threshold hit its minimum (flower)
+#define ICE_SERVOLOG_TRIG_CLAMPED_HIGH 0x10  // the trigger threshold hit its maximum (flower)
+
+typedef struct ice_servolog_header
+{
+  uint32_t magic; 
+  uint16_t version; 
+  uint16_t scale; 
+  uint32_t station; 
+  uint32_t run; 
+  uint64_t start_time_ms; // since the epoch 
+} ice_servolog_header_t; 
+
+typedef struct ice_servolog_channel
+{
+  float value; 
+  float error; 
+  float sum_error; 
+  uint32_t threshold;          // the RADIANT threshold, or the flower servo threshold 
+  uint32_t trigger_threshold;  // the flower trigger threshold (0 for the RADIANT) 
+  uint32_t flags; 
+} ice_servolog_channel_t; 
+
+typedef struct ice_servolog_step
+{
+  int board; 
+  uint64_t time_ms; // since the epoch 
+  uint32_t mask; 
+  ice_servolog_channel_t ch[ICE_SERVOLOG_MAX_CHANNELS]; 
+} ice_servolog_step_t; 
+
+struct ice_servolog; 
+typedef struct ice_servolog ice_servolog_t; 
+
+/* Start a new history at path */ 
+ice_servolog_t * ice_servolog_create(const char * path, int station, int run); 
+
+/* Add a step. Only the channels in mask need to be filled in. Returns 0 on success */ 
+int ice_servolog_write(ice_servolog_t * log, const ice_servolog_step_t * step); 
+
+/* Flush what we have so far to disk (so it can be read even if we die), which costs a little compression */ 
+int ice_servolog_flush(ice_servolog_t * log); 
+
+/* Open a history to read. hdr may be NULL */ 
+ice_servolog_t * ice_servolog_open(const char * path, ice_servolog_header_t * hdr); 
+
+/* Read the next step. Returns 0 on success, 1 at the end (or at a truncated step) */ 
+int ice_servolog_read(ice_servolog_t * log, ice_servolog_step_t * step); 
+
+int ice_servolog_close(ice_servolog_t * log); 
+
+#endif
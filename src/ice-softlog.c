@@ -0,0 +1,60 @@
+#include "ice-softlog.h"
+#include <stdlib.h>
+#include <string.h>
+
+FILE * ice_softlog_create(const char * path, int station, int run) 
+{
+  FILE * f = fopen(path, "w"); 
+  if (!f) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    return NULL; 
+  }
+
+  ice_softlog_header_t hdr = {.magic = ICE_SOFTLOG_MAGIC, .version = ICE_SOFTLOG_VERSION, 
+                              .record_size = sizeof(ice_softlog_record_t), .station = station, .run = run}; 
+  if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 || fflush(f)) 
+  {
+    fprintf(stderr,"Could not write to %s\n", path); 
+    fclose(f); 
+    return NULL; 
+  }
+  return f; 
+}
+
+int ice_softlog_append(FILE * f, const ice_softlog_record_t * record) 
+{
+  return fwrite(record, sizeof(*record), 1, f) == 1 ? 0 : -1; 
+}
+
+int ice_softlog_load(const char * path, ice_softlog_header_t * hdr, ice_softlog_record_t ** records) 
+{
+  *records = NULL; 
+  FILE * f = fopen(path,"r"); 
+  if (!f) return -1; 
+
+  ice_softlog_header_t h; 
+  if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != ICE_SOFTLOG_MAGIC || h.record_size < sizeof(ice_softlog_record_t)) 
+  {
+    fprintf(stderr,"%s is not a soft trigger log (or is from the future)\n", path); 
+    fclose(f); 
+    return -1; 
+  }
+  if (hdr) *hdr = h; 
+
+  fseek(f, 0, SEEK_END); 
+  long n = (ftell(f) - (long) sizeof(h)) / h.record_size; 
+  fseek(f, sizeof(h), SEEK_SET); 
+
+  *records = calloc(n ? n : 1, sizeof(ice_softlog_record_t)); 
+  char * record = malloc(h.record_size); 
+  int nread = 0; 
+  while (nread < n && fread(record, h.record_size, 1, f) == 1) 
+  {
+    //later versions may have larger records, but will keep the start the same 
+    memcpy(&(*records)[nread++], record, sizeof(ice_softlog_record_t)); 
+  }
+  free(record); 
+  fclose(f); 
+  return nread; 
+}
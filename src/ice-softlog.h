@@ -0,0 +1,47 @@
+#ifndef _RNO_G_ICE_SOFTLOG_H
+#define _RNO_G_ICE_SOFTLOG_H
+
+/** The soft trigger log.
+ *
+ * Every soft trigger rno-g-acq issues gets a record in aux/soft-triggers.dat of its run: when it was meant
+ * to go out (according to the configured interval or exponential distribution), how late it actually went
+ * out, and how long issuing it took. That way the timing of the forced triggers can be checked from the data.
+ *
+ * The file is a small header followed by fixed-size records in the order the triggers were issued. It isn't
+ * compressed, so it can be read while it's still being written. Everything is little-endian.
+ **/ 
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define ICE_SOFTLOG_NAME "aux/soft-triggers.dat"
+#define ICE_SOFTLOG_MAGIC 0x54575352  /* "RSWT" */
+#define ICE_SOFTLOG_VERSION 1
+
+typedef struct ice_softlog_header
+{
+  uint32_t magic; 
+  uint16_t version; 
+  uint16_t record_size; 
+  uint32_t station; 
+  uint32_t run; 
+} ice_softlog_header_t; 
+
+typedef struct ice_softlog_record
+{
+  uint64_t requested_ns; // when the trigger was scheduled for, ns since the epoch (CLOCK_REALTIME) 
+  int32_t delay_ns;      // how much later than that we started issuing it 
+  uint32_t duration_ns;  // how long issuing it took (waiting for the UART and the command itself) 
+} ice_softlog_record_t; 
+
+/* Open a new log for writing (writes the header) */ 
+FILE * ice_softlog_create(const char * path, int station, int run); 
+
+/* Append a record. Returns 0 on success. Not flushed, so do that every so often. */ 
+int ice_softlog_append(FILE * f, const ice_softlog_record_t * record); 
+
+/* Read a whole log. *records is allocated and should be freed. hdr may be NULL. Returns the number of
+ * records, or -1 if the file can't be read. A truncated last record is ignored. */ 
+int ice_softlog_load(const char * path, ice_softlog_header_t * hdr, ice_softlog_record_t ** records); 
+
+#endif
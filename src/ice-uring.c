@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include "ice-uring.h" 
+#include <stdlib.h> 
+#include <stdio.h> 
+#include <string.h> 
+#include <unistd.h> 
+#include <errno.h> 
+#include <fcntl.h> 
+#include <sys/mman.h> 
+#include <sys/syscall.h> 
+
+#ifdef __NR_io_uring_setup 
+#include <linux/io_uring.h> 
+
+struct ice_uring
+{
+  int fd; 
+
+  //submission ring 
+  void * sq_ptr; 
+  size_t sq_size; 
+  unsigned * sq_head; 
+  unsigned * sq_tail; 
+  unsigned * sq_mask; 
+  unsigned * sq_array; 
+  struct io_uring_sqe * sqes; 
+  size_t sqes_size; 
+
+  //completion ring 
+  void * cq_ptr; 
+  size_t cq_size; 
+  unsigned * cq_head; 
+  unsigned * cq_tail; 
+  unsigned * cq_mask; 
+  struct io_uring_cqe * cqes; 
+
+  unsigned entries; 
+  unsigned inflight; 
+}; 
+
+
+ice_uring_t * ice_uring_init(unsigned entries) 
+{
+  struct io_uring_params p; 
+  memset(&p,0,sizeof(p)); 
+
+  int fd = syscall(__NR_io_uring_setup, entries, &p); 
+  if (fd < 0) 
+  {
+    fprintf(stderr,"io_uring not available (%s)\n", strerror(errno)); 
+    return NULL; 
+  }
+
+  ice_uring_t * r = calloc(sizeof(ice_uring_t),1); 
+  if (!r) 
+  {
+    close(fd); 
+    return NULL; 
+  }
+  r->fd = fd; 
+  r->entries = p.sq_entries; 
+
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned); 
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe); 
+
+  //newer kernels map both rings at once
+  int single_mmap = p.features & IORING_FEAT_SINGLE_MMAP; 
+  if (single_mmap) 
+  {
+    if (r->cq_size > r->sq_size) r->sq_size = r->cq_size; 
+    r->cq_size = r->sq_size; 
+  }
+
+  r->sq_ptr = mmap(0, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING); 
+  if (r->sq_ptr == MAP_FAILED) goto fail_sq; 
+
+  if (single_mmap) 
+  {
+    r->cq_ptr = r->sq_ptr; 
+  }
+  else
+  {
+    r->cq_ptr = mmap(0, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING); 
+    if (r->cq_ptr == MAP_FAILED) goto fail_cq; 
+  }
+
+  r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe); 
+  r->sqes = mmap(0, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES); 
+  if (r->sqes == MAP_FAILED) goto fail_sqes; 
+
+  r->sq_head = (unsigned*) ((char*) r->sq_ptr + p.sq_off.head); 
+  r->sq_tail = (unsigned*) ((char*) r->sq_ptr + p.sq_off.tail); 
+  r->sq_mask = (unsigned*) ((char*) r->sq_ptr + p.sq_off.ring_mask); 
+  r->sq_array = (unsigned*) ((char*) r->sq_ptr + p.sq_off.array); 
+
+  r->cq_head = (unsigned*) ((char*) r->cq_ptr + p.cq_off.head); 
+  r->cq_tail = (unsigned*) ((char*) r->cq_ptr + p.cq_off.tail); 
+  r->cq_mask = (unsigned*) ((char*) r->cq_ptr + p.cq_off.ring_mask); 
+  r->cqes = (struct io_uring_cqe*) ((char*) r->cq_ptr + p.cq_off.cqes); 
+
+  return r; 
+
+fail_sqes: 
+  if (!single_mmap) munmap(r->cq_ptr, r->cq_size); 
+fail_cq: 
+  munmap(r->sq_ptr, r->sq_size); 
+fail_sq: 
+  fprintf(stderr,"Could not map io_uring (%s)\n", strerror(errno)); 
+  close(fd); 
+  free(r); 
+  return NULL; 
+}
+
+static int submit(ice_uring_t * r, const struct io_uring_sqe * sqe) 
+{
+  //there's always room if the caller keeps track of what's in flight, but just in case 
+  if (r->inflight >= r->entries) return -EBUSY; 
+
+  unsigned tail = *r->sq_tail; 
+  unsigned idx = tail & *r->sq_mask; 
+  memcpy(&r->sqes[idx], sqe, sizeof(*sqe)); 
+  r->sq_array[idx] = idx; 
+  __atomic_store_n(r->sq_tail, tail+1, __ATOMIC_RELEASE); 
+
+  int ret = syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0); 
+  if (ret < 0) 
+  {
+    //take it back 
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE); 
+    return -errno; 
+  }
+  r->inflight++; 
+  return 0; 
+}
+
+int ice_uring_write(ice_uring_t * r, int fd, const void * buf, unsigned len, uint64_t off, uint64_t user_data) 
+{
+  struct io_uring_sqe sqe; 
+  memset(&sqe,0,sizeof(sqe)); 
+  sqe.opcode = IORING_OP_WRITE; 
+  sqe.fd = fd; 
+  sqe.addr = (uint64_t) (uintptr_t) buf; 
+  sqe.len = len; 
+  sqe.off = off; 
+  sqe.user_data = user_data; 
+  return submit(r, &sqe); 
+}
+
+int ice_uring_sync_range(ice_uring_t * r, int fd, uint64_t off, unsigned len, uint64_t user_data) 
+{
+  struct io_uring_sqe sqe; 
+  memset(&sqe,0,sizeof(sqe)); 
+  sqe.opcode = IORING_OP_SYNC_FILE_RANGE; 
+  sqe.fd = fd; 
+  sqe.off = off; 
+  sqe.len = len; 
+  sqe.sync_range_flags = SYNC_FILE_RANGE_WRITE; 
+  sqe.user_data = user_data; 
+  return submit(r, &sqe); 
+}
+
+unsigned ice_uring_inflight(const ice_uring_t * r) 
+{
+  return r->inflight; 
+}
+
+int ice_uring_reap(ice_uring_t * r, int wait, void (*cb)(void * ctx, uint64_t user_data, int res), void * ctx) 
+{
+  int nreaped = 0; 
+
+  while (1) 
+  {
+    unsigned head = *r->cq_head; 
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE); 
+
+    if (head == tail) 
+    {
+      if (!wait || nreaped || !r->inflight) break; 
+      if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) 
+      {
+        fprintf(stderr,"Waiting on io_uring failed (%s)\n", strerror(errno)); 
+        break; 
+      }
+      continue; 
+    }
+
+    const struct io_uring_cqe * cqe = &r->cqes[head & *r->cq_mask]; 
+    uint64_t user_data = cqe->user_data; 
+    int res = cqe->res; 
+    __atomic_store_n(r->cq_head, head+1, __ATOMIC_RELEASE); 
+    r->inflight--; 
+    nreaped++; 
+    if (cb) cb(ctx, user_data, res); 
+  }
+
+  return nreaped; 
+}
+
+void ice_uring_destroy(ice_uring_t * r) 
+{
+  if (!r) return; 
+  munmap(r->sqes, r->sqes_size); 
+  if (r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_size); 
+  munmap(r->sq_ptr, r->sq_size); 
+  close(r->fd); 
+  free(r); 
+}
+
+#else 
+
+//built against headers without io_uring, so it's never available 
+
+ice_uring_t * ice_uring_init(unsigned entries) 
+{
+  (void) entries; 
+  return NULL; 
+}
+
+int ice_uring_write(ice_uring_t * r, int fd, const void * buf, unsigned len, uint64_t off, uint64_t user_data) 
+{
+  (void) r; (void) fd; (void) buf; (void) len; (void) off; (void) user_data; 
+  return -ENOSYS; 
+}
+
+int ice_uring_sync_range(ice_uring_t * r, int fd, uint64_t off, unsigned len, uint64_t user_data) 
+{
+  (void) r; (void) fd; (void) off; (void) len; (void) user_data; 
+  return -ENOSYS; 
+}
+
+unsigned ice_uring_inflight(const ice_uring_t * r) 
+{
+  (void) r; 
+  return 0; 
+}
+
+int ice_uring_reap(ice_uring_t * r, int wait, void (*cb)(void * ctx, uint64_t user_data, int res), void * ctx) 
+{
+  (void) r; (void) wait; (void) cb; (void) ctx; 
+  return 0; 
+}
+
+void ice_uring_destroy(ice_uring_t * r) 
+{
+  (void) r; 
+}
+
+#endif
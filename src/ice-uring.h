@@ -0,0 +1,41 @@
+#ifndef _RNO_G_ICE_URING_H
+#define _RNO_G_ICE_URING_H
+
+/** A very small io_uring wrapper, so we don't need liburing. 
+ *
+ * Only supports what the output code needs: positioned writes and sync_file_range, 
+ * submitted one at a time, with completions reaped either without blocking or by waiting. 
+ *
+ * A ring is not thread safe, so use one per thread (or per thing that moves between threads). 
+ *
+ * If the kernel (or the headers we were built against) doesn't support io_uring, 
+ * ice_uring_init returns NULL and the caller should fall back to plain writes.
+ **/ 
+
+#include <stdint.h> 
+
+struct ice_uring; 
+typedef struct ice_uring ice_uring_t; 
+
+/* Set up a ring with room for (at least) entries submissions. Returns NULL if io_uring isn't available */ 
+ice_uring_t * ice_uring_init(unsigned entries); 
+
+/* Queue a write of len bytes from buf to fd at offset off. buf must stay valid until the completion is reaped. 
+ * Returns 0 on success */ 
+int ice_uring_write(ice_uring_t * r, int fd, const void * buf, unsigned len, uint64_t off, uint64_t user_data); 
+
+/* Queue a sync_file_range(SYNC_FILE_RANGE_WRITE) of fd from off to off+len. Returns 0 on success */ 
+int ice_uring_sync_range(ice_uring_t * r, int fd, uint64_t off, unsigned len, uint64_t user_data); 
+
+/* Number of submissions that haven't been reaped yet */ 
+unsigned ice_uring_inflight(const ice_uring_t * r); 
+
+/* Reap completions, calling cb for each (res is what the corresponding syscall would return, or -errno).
+ * If wait is set, blocks until at least one completion is available (if anything is in flight).
+ * Returns the number of completions reaped. */ 
+int ice_uring_reap(ice_uring_t * r, int wait, void (*cb)(void * ctx, uint64_t user_data, int res), void * ctx); 
+
+/* Tear down the ring. Anything still in flight should be reaped first! */ 
+void ice_uring_destroy(ice_uring_t * r); 
+
+#endif
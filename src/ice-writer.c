@@ -0,0 +1,845 @@
+#define _GNU_SOURCE
+#include "ice-writer.h"
+#include "ice-buf.h"
+#include "ice-common.h"
+#include "ice-output.h"
+#include "ice-index.h"
+#include "ice-container.h"
+#include "ice-manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <zlib.h>
+
+static const char * tmp_suffix = ".tmp"; 
+static const int tmp_suffix_len = 4; 
+
+enum { OUT_WF, OUT_HD, OUT_DS, NUM_OUT_STREAMS }; 
+static const char * out_stream_dirs[NUM_OUT_STREAMS] = {"waveforms","header","daqstatus"}; 
+static const char * out_stream_exts[NUM_OUT_STREAMS] = {"wf","hd","ds"}; 
+
+
+/* In-memory index sidecar, for container mode. Lives on the heap since open_memstream holds on to its address */ 
+typedef struct mem_file
+{
+  char * buf; 
+  size_t len; 
+} mem_file_t; 
+
+/* Normally (without io_uring), zlib compresses and writes a file itself, through a gzFile on a dup of our fd (so
+ * we can still apply the I/O policy to it, see ice-io.h). If it's indexed, records go through a stdio stream that 
+ * keeps the crc32 and size of what went in (which the sidecar needs, and zlib doesn't tell us). On the heap, since 
+ * that stream holds on to its address. */ 
+typedef struct gz_file
+{
+  gzFile gz; 
+  ice_io_file_t io; 
+  FILE * tap; 
+  uint64_t uncompressed; 
+  uint32_t crc32; 
+} gz_file_t; 
+
+/* An output file: the rno-g handle we write through, which goes either to zlib (gz, the usual way), or into 
+ * our own compressor (out, see ice-output.h) with io_uring or in container mode, and possibly its index 
+ * sidecar (see ice-index.h).
+ *
+ * In container mode (see ice-container.h), nothing goes to disk until the file is closed, when it (and its
+ * sidecar) get appended to the run container. The path is then just the name it would have had. */ 
+typedef struct output_file
+{
+  rno_g_file_handle_t h; 
+  ice_output_t * out; 
+  gz_file_t * gz; 
+  char * path; 
+  FILE * idx; 
+  int idx_failed; // gave up on the index: no more entries, and it's deleted when the file is closed 
+  int nrecords; 
+  uint32_t first_event; // of the records so far (if nrecords) 
+  uint32_t last_event; 
+  int in_container; 
+  mem_file_t * idx_mem; 
+} output_file_t; 
+
+typedef enum
+{
+  FIN_CLOSE,      //close f, rename it (strip the tmp suffix) and add to file list (or add it to the container) 
+  FIN_RENAME,     //rename f.path (and its index) to new_path 
+  FIN_OPEN_SPARE, //open a new spare for stream 
+  FIN_DRAIN,      //get rid of the spares, close the container, and set fin_drained 
+  FIN_QUIT        //same, but exit 
+} fin_op_t; 
+
+typedef struct fin_buffer_item
+{
+  fin_op_t op; 
+  int stream; 
+  output_file_t f; 
+  char * new_path; 
+} fin_buffer_item_t; 
+
+typedef struct spare_file
+{
+  volatile int ready; // set by the fin thread, cleared by the writing thread 
+  volatile int failed; // same, if it couldn't be opened (so the writing thread asks again) 
+  output_file_t f; 
+} spare_file_t; 
+
+struct ice_writer
+{
+  acq_config_t cfg; // the writing thread's copy of the config (don't use its strings) 
+  char * dir; 
+  ice_writer_list_fn_t add_to_file_list; 
+  int compress_harder; 
+
+  //only touched by the writing thread 
+  output_file_t out[NUM_OUT_STREAMS]; 
+  int file_size[NUM_OUT_STREAMS]; 
+  int file_N[NUM_OUT_STREAMS]; 
+  time_t file_time[NUM_OUT_STREAMS]; 
+  int ds_i; 
+  int spare_pending[NUM_OUT_STREAMS]; 
+  ice_writer_stats_t stats; 
+
+  //updated by the fin thread, read by anyone 
+  ice_writer_totals_t totals; 
+
+  //the fin thread, with its own copy of the config, taken from new_cfg (under new_cfg_lock) before each request 
+  pthread_t fin; 
+  acq_config_t fin_cfg; 
+  acq_config_t new_cfg; 
+  pthread_mutex_t new_cfg_lock; 
+  ice_buf_t * fin_buffer; 
+  ice_buf_wait_group_t * fin_wait; 
+  spare_file_t spares[NUM_OUT_STREAMS]; 
+  volatile int fin_drained; 
+  ice_buf_wait_group_t * drain_wait; // woken by the fin thread once drained 
+
+  //the run container (only used in container mode, and only by the fin thread) 
+  ice_container_t * container; 
+  char * container_path; 
+  time_t container_open_time; 
+  int container_N; 
+}; 
+
+
+static void add_to_file_list(ice_writer_t * w, const char * path) 
+{
+  if (w->add_to_file_list) w->add_to_file_list(path); 
+}
+
+/* Forget about an output file (after handing it to the fin thread, or failing to open it), so nothing 
+ * gets written through a stale handle. Writes are dropped until the next successful open. */ 
+static void clear_output(output_file_t * f) 
+{
+  memset(f, 0, sizeof(*f)); 
+}
+
+static int is_open(const output_file_t * f) 
+{
+  return f->out || f->gz; 
+}
+
+
+/** The gz files */ 
+
+static ssize_t tap_write(void * cookie, const char * buf, size_t size) 
+{
+  gz_file_t * g = cookie; 
+  if (!size) return 0; 
+  int n = gzwrite(g->gz, buf, size); 
+  if (n <= 0) return -1; 
+  g->crc32 = crc32(g->crc32, (const unsigned char*) buf, n); 
+  g->uncompressed += n; 
+  return n; 
+}
+
+static int tap_close(void * cookie) 
+{
+  //the real work happens in gz_close 
+  (void) cookie; 
+  return 0; 
+}
+
+static gz_file_t * gz_open(const char * path, int gz_level, int gz_strategy, const ice_io_policy_t * policy, int tapped) 
+{
+  gz_file_t * g = calloc(sizeof(gz_file_t),1); 
+  if (!g) return NULL; 
+  if (ice_io_open(&g->io, path, policy) < 0) 
+  {
+    free(g); 
+    return NULL; 
+  }
+
+  //zlib gets its own fd, since it will close it, while we still need ours in ice_io_close
+  int fd = dup(g->io.fd); 
+  g->gz = fd < 0 ? NULL : gzdopen(fd, "w"); 
+  if (!g->gz && fd >= 0) close(fd); 
+  if (g->gz) gzsetparams(g->gz, gz_level, gz_strategy); 
+
+  if (g->gz && tapped) 
+  {
+    g->crc32 = crc32(0, Z_NULL, 0); 
+    cookie_io_functions_t funcs = { .read = NULL, .write = tap_write, .seek = NULL, .close = tap_close }; 
+    g->tap = fopencookie(g, "w", funcs); 
+  }
+
+  if (!g->gz || (tapped && !g->tap)) 
+  {
+    if (g->gz) gzclose(g->gz); 
+    ice_io_close(&g->io); 
+    unlink(path); 
+    free(g); 
+    return NULL; 
+  }
+  return g; 
+}
+
+/* after writing a record: start write-behind if it's time */ 
+static void gz_wrote(gz_file_t * g) 
+{
+  ice_io_wrote(&g->io, lseek(g->io.fd, 0, SEEK_CUR)); // zlib's fd is a dup, so shares the offset 
+}
+
+/* like ice_output_full_flush */ 
+static int gz_full_flush(gz_file_t * g, uint64_t * compressed_offset, uint64_t * uncompressed_offset, uint32_t * crc) 
+{
+  if (fflush(g->tap) || gzflush(g->gz, Z_FULL_FLUSH) != Z_OK) return -1; 
+  off_t offset = gzoffset(g->gz); 
+  if (offset < 0) return -1; 
+  *compressed_offset = offset; 
+  *uncompressed_offset = g->uncompressed; 
+  *crc = g->crc32; 
+  return 0; 
+}
+
+/* Finish and close the file. If summary isn't NULL it's filled in; the crc32c of the compressed file comes from 
+ * reading it back (before the page cache is dropped), since zlib wrote it. */ 
+static int gz_close(gz_file_t * g, const char * path, ice_output_summary_t * summary) 
+{
+  int ret = 0; 
+  if (g->tap) ret = fclose(g->tap) != 0; 
+  uint64_t uncompressed = g->tap ? g->uncompressed : (uint64_t) gztell(g->gz); 
+  ret = (gzclose(g->gz) != Z_OK) || ret; 
+
+  if (summary) 
+  {
+    summary->uncompressed_size = uncompressed; 
+    if (ice_manifest_checksum_file(path, &summary->compressed_size, &summary->crc32c)) 
+    {
+      summary->compressed_size = 0; 
+      summary->crc32c = 0; 
+      ret = 1; 
+    }
+  }
+
+  ret = ice_io_close(&g->io) || ret; 
+  free(g); 
+  return ret; 
+}
+
+
+/** Output files */ 
+
+/* io_uring if asked for (and we can have it), otherwise zlib as usual */ 
+static int use_uring(const acq_config_t * cfg) 
+{
+  return cfg->output.io.use_io_uring && ice_output_async_available(); 
+}
+
+/* (cfg is the calling thread's copy) */ 
+static int open_output(const acq_config_t * cfg, output_file_t * f, const char * path, int gz_level, int gz_strategy, int indexed) 
+{
+  ice_io_policy_t policy = { .preallocate_kB = cfg->output.io.preallocate_kB, 
+                             .writeback_kB = cfg->output.io.writeback_kB, 
+                             .drop_cache_on_close = cfg->output.io.drop_cache_on_close }; 
+
+  f->path = 0; 
+  f->idx = 0; 
+  f->idx_mem = 0; 
+  f->idx_failed = 0; 
+  f->nrecords = 0; 
+  f->in_container = cfg->output.container.enable; 
+  f->out = 0; 
+  f->gz = 0; 
+  if (f->in_container) f->out = ice_output_open_memory(gz_level, gz_strategy); 
+  else if (use_uring(cfg)) f->out = ice_output_open(path, gz_level, gz_strategy, &policy); 
+  if (!f->out && !f->in_container) f->gz = gz_open(path, gz_level, gz_strategy, &policy, indexed); 
+  if (!is_open(f)) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    clear_output(f); 
+    return -1; 
+  }
+
+  if (f->gz && !f->gz->tap) 
+  {
+    f->h.type = RNO_G_GZIP; 
+    f->h.handle.gz = f->gz->gz; 
+  }
+  else
+  {
+    f->h.type = RNO_G_RAW; 
+    f->h.handle.raw = f->gz ? f->gz->tap : ice_output_stream(f->out); 
+  }
+  f->path = strdup(path); 
+
+  if (indexed && f->in_container) 
+  {
+    f->idx_mem = calloc(sizeof(mem_file_t),1); 
+    f->idx = f->idx_mem ? open_memstream(&f->idx_mem->buf, &f->idx_mem->len) : 0; 
+    if (f->idx) ice_index_write_header(f->idx); 
+    else
+    {
+      fprintf(stderr,"Could not make an index for %s\n", path); 
+      free(f->idx_mem); 
+      f->idx_mem = 0; 
+    }
+  }
+  else if (indexed) 
+  {
+    char * idx_path = ice_index_path(path); 
+    f->idx = ice_index_create(idx_path); 
+    free(idx_path); 
+  }
+  return 0; 
+}
+
+static int open_stream_output(ice_writer_t * w, const acq_config_t * cfg, output_file_t * f, const char * path, int stream) 
+{
+  int indexed = stream != OUT_DS && cfg->output.index_interval > 0; 
+  //short on space, so squeeze harder. Since spares are opened ahead of time, this kicks in a file late. 
+  int harder = w->compress_harder; 
+  return stream == OUT_WF ? open_output(cfg, f, path, harder ? cfg->output.degrade.waveform_compression_level : 3, Z_FILTERED, indexed) : 
+                            open_output(cfg, f, path, harder ? Z_BEST_COMPRESSION : Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY, indexed); 
+}
+
+/* Called before writing each record. Keeps track of the event range (for the manifest), and every
+ * index_interval records, adds a full flush point to the file and notes it down in the sidecar. */ 
+static void index_output(ice_writer_t * w, output_file_t * f, const rno_g_header_t * hd) 
+{
+  if (!f->nrecords) f->first_event = hd->event_number; 
+  f->last_event = hd->event_number; 
+  int record = f->nrecords++; 
+  int interval = w->cfg.output.index_interval; 
+  if (!f->idx || f->idx_failed || interval <= 0 || record % interval) return; 
+
+  ice_index_entry_t entry = { .event_number = hd->event_number, .record_index = record, 
+                              .time_secs = hd->readout_time_secs, .time_nsecs = hd->readout_time_nsecs }; 
+
+  if ((f->gz ? gz_full_flush(f->gz, &entry.compressed_offset, &entry.uncompressed_offset, &entry.crc32) : 
+               ice_output_full_flush(f->out, &entry.compressed_offset, &entry.uncompressed_offset, &entry.crc32)) ||
+      ice_index_append(f->idx, &entry)) 
+  {
+    //it's left open until the file is closed, since the fin thread may still be renaming it (if this was a spare) 
+    fprintf(stderr,"Problem indexing %s, giving up on its index\n", f->path); 
+    f->idx_failed = 1; 
+  }
+}
+
+/* rename an output file, along with its sidecar if it has one */ 
+static int rename_output(const output_file_t * f, const char * new_path) 
+{
+  if (f->in_container) return 0; // nothing on disk yet 
+
+  int ret = rename(f->path, new_path); 
+  if (f->idx) 
+  {
+    char * old_idx = ice_index_path(f->path); 
+    char * new_idx = ice_index_path(new_path); 
+    ret = rename(old_idx, new_idx) || ret; 
+    free(old_idx); 
+    free(new_idx); 
+  }
+  return ret; 
+}
+
+
+/* (fin thread) */ 
+static void add_to_totals(ice_writer_t * w, uint64_t compressed, uint64_t uncompressed) 
+{
+  __atomic_fetch_add(&w->totals.nfiles, 1, __ATOMIC_RELAXED); 
+  __atomic_fetch_add(&w->totals.compressed_bytes, compressed, __ATOMIC_RELAXED); 
+  __atomic_fetch_add(&w->totals.uncompressed_bytes, uncompressed, __ATOMIC_RELAXED); 
+}
+
+
+/** The run container (fin thread only) */ 
+
+static void close_container(ice_writer_t * w) 
+{
+  if (!w->container) return; 
+  ice_container_close(w->container); 
+  add_to_file_list(w, w->container_path); 
+  free(w->container_path); 
+  w->container = 0; 
+  w->container_path = 0; 
+}
+
+/* Append a finished file to the container (opening or rotating it as necessary). path is the name
+ * the file would have had (a tmp_suffix is ignored) */ 
+static int add_to_container(ice_writer_t * w, int stream, const char * path, const void * data, size_t len) 
+{
+  time_t now = time(0); 
+  int seconds_per_file = w->fin_cfg.output.container.seconds_per_file; 
+  if (w->container && seconds_per_file > 0 && now - w->container_open_time >= seconds_per_file) 
+  {
+    close_container(w); 
+  }
+
+  if (!w->container) 
+  {
+    char * dir = 0; 
+    asprintf(&dir, "%s/container", w->dir); 
+    mkdir_if_needed(dir); 
+    asprintf(&w->container_path, "%s/%03d.rnoc", dir, w->container_N++); 
+    free(dir); 
+    w->container = ice_container_open(w->container_path); 
+    w->container_open_time = now; 
+    if (!w->container) 
+    {
+      free(w->container_path); 
+      w->container_path = 0; 
+      return -1; 
+    }
+  }
+
+  //name relative to the run directory, without the tmp suffix 
+  int prefix_len = strlen(w->dir); 
+  if (!strncmp(path, w->dir, prefix_len)) path += prefix_len; 
+  while (*path == '/') path++; 
+  char * name = strdup(path); 
+  int namelen = strlen(name); 
+  if (namelen > tmp_suffix_len && !strcmp(name + namelen - tmp_suffix_len, tmp_suffix)) name[namelen - tmp_suffix_len] = 0; 
+
+  const char * base = strrchr(name,'/'); 
+  uint32_t first_event = strtoul(base ? base + 1 : name, 0, 10); 
+
+  int ret = ice_container_append(w->container, stream, first_event, name, data, len); 
+  free(name); 
+  return ret; 
+}
+
+/* close an in-container output file, adding it (and its index) to the container. These don't go in the manifest, 
+ * since each chunk of the container has its own checksum. */ 
+static int do_close_container(ice_writer_t * w, output_file_t * f, int stream) 
+{
+  void * data = 0; 
+  size_t len = 0; 
+  uint64_t uncompressed = ice_output_uncompressed_size(f->out); 
+  int ret = ice_output_close_memory(f->out, &data, &len); 
+  add_to_totals(w, len, uncompressed); 
+  ret = add_to_container(w, stream, f->path, data, len) || ret; 
+  free(data); 
+
+  if (f->idx) 
+  {
+    fclose(f->idx); 
+    if (!f->idx_failed) 
+    {
+      char * idx_path = ice_index_path(f->path); 
+      ret = add_to_container(w, ICE_CONTAINER_IDX, idx_path, f->idx_mem->buf, f->idx_mem->len) || ret; 
+      free(idx_path); 
+    }
+    free(f->idx_mem->buf); 
+  }
+  free(f->idx_mem); 
+  free(f->path); 
+  f->path = 0; 
+  f->idx = 0; 
+  f->idx_mem = 0; 
+  return ret; 
+}
+
+static int do_close(ice_writer_t * w, output_file_t * f, int stream) 
+{
+  if (f->in_container) return do_close_container(w, f, stream); 
+
+  ice_output_summary_t summary; 
+  int ret = f->gz ? gz_close(f->gz, f->path, &summary) : ice_output_close_summary(f->out, &summary); 
+  add_to_totals(w, summary.compressed_size, summary.uncompressed_size); 
+  char * path = f->path; 
+  int pathlen = strlen(path); 
+
+  if (f->idx) fclose(f->idx); 
+
+  //a sidecar we gave up on doesn't go anywhere (by now any renaming of it is done, see index_output) 
+  if (f->idx && f->idx_failed) 
+  {
+    char * idx_path = ice_index_path(path); 
+    unlink(idx_path); 
+    free(idx_path); 
+    f->idx = 0; 
+  }
+
+  ice_manifest_entry_t entry = { .size = summary.compressed_size, .crc32c = summary.crc32c, .have_events = f->nrecords > 0, 
+                                 .first_event = f->first_event, .last_event = f->last_event }; 
+
+  if (!strcasecmp(path + pathlen - tmp_suffix_len, tmp_suffix)) 
+  {
+    char * final_path = strdup(path); 
+    final_path[pathlen-tmp_suffix_len] = 0; 
+    rename_output(f,final_path); 
+    ice_manifest_set_name(&entry, w->dir, final_path); 
+    if (!ret) ice_manifest_append(w->dir, &entry); 
+    add_to_file_list(w, final_path); 
+    if (f->idx) 
+    {
+      char * idx_path = ice_index_path(final_path); 
+      add_to_file_list(w, idx_path); 
+      free(idx_path); 
+    }
+    free(final_path); 
+  }
+  else
+  {
+    ice_manifest_set_name(&entry, w->dir, path); 
+    if (!ret) ice_manifest_append(w->dir, &entry); 
+    add_to_file_list(w, path); 
+  }
+  free(path); 
+  f->path = 0; 
+  f->idx = 0; 
+  return ret; 
+}
+
+
+/** The fin thread */ 
+
+/* throw away the spares */ 
+static void discard_spares(ice_writer_t * w) 
+{
+  for (int i = 0; i < NUM_OUT_STREAMS; i++) 
+  {
+    spare_file_t * spare = &w->spares[i]; 
+    spare->failed = 0; 
+    if (!spare->ready) continue; 
+    if (spare->f.gz) gz_close(spare->f.gz, spare->f.path, NULL); 
+    else ice_output_close(spare->f.out); 
+    if (spare->f.in_container) 
+    {
+      if (spare->f.idx) fclose(spare->f.idx); 
+      if (spare->f.idx_mem) free(spare->f.idx_mem->buf); 
+      free(spare->f.idx_mem); 
+    }
+    else
+    {
+      unlink(spare->f.path); 
+      if (spare->f.idx) 
+      {
+        fclose(spare->f.idx); 
+        char * idx_path = ice_index_path(spare->f.path); 
+        unlink(idx_path); 
+        free(idx_path); 
+      }
+    }
+    free(spare->f.path); 
+    spare->ready = 0; 
+  }
+}
+
+static void * fin_thread(void * v) 
+{
+  ice_writer_t * w = v; 
+  fin_buffer_item_t item; 
+
+  while (1) 
+  {
+    if (!ice_buf_wait_group_wait(w->fin_wait, -1)) continue; 
+    ice_buf_pop(w->fin_buffer, &item); 
+
+    pthread_mutex_lock(&w->new_cfg_lock); 
+    memcpy(&w->fin_cfg, &w->new_cfg, sizeof(w->fin_cfg)); 
+    pthread_mutex_unlock(&w->new_cfg_lock); 
+
+    switch (item.op) 
+    {
+      case FIN_CLOSE: 
+        do_close(w, &item.f, item.stream); 
+        break; 
+
+      case FIN_RENAME: 
+        if (rename_output(&item.f, item.new_path)) 
+        {
+          fprintf(stderr,"Could not rename %s to %s\n", item.f.path, item.new_path); 
+        }
+        free(item.f.path); 
+        free(item.new_path); 
+        break; 
+
+      case FIN_OPEN_SPARE: 
+      {
+        spare_file_t * spare = &w->spares[item.stream]; 
+        if (spare->ready) break; // still have one 
+        char * path = 0; 
+        asprintf(&path, "%s/%s/spare.%s.dat.gz%s", w->dir, out_stream_dirs[item.stream], out_stream_exts[item.stream], tmp_suffix); 
+        int failed = open_stream_output(w, &w->fin_cfg, &spare->f, path, item.stream); 
+        free(path); 
+        __sync_synchronize(); 
+        if (failed) spare->failed = 1; 
+        else spare->ready = 1; 
+        break; 
+      }
+
+      case FIN_DRAIN: 
+        discard_spares(w); 
+        close_container(w); 
+        w->container_N = 0; 
+        __sync_synchronize(); 
+        w->fin_drained = 1; 
+        ice_buf_wait_group_wake(w->drain_wait); 
+        break; 
+
+      case FIN_QUIT: 
+        discard_spares(w); 
+        close_container(w); 
+        return 0; 
+    }
+  }
+
+  return 0; 
+}
+
+static void fin_request(ice_writer_t * w, fin_op_t op, int stream, const output_file_t * f, char * new_path) 
+{
+  fin_buffer_item_t item = {.op = op, .stream = stream, .new_path = new_path}; 
+  if (f) item.f = *f; 
+  ice_buf_push(w->fin_buffer, &item); 
+}
+
+static void request_spares(ice_writer_t * w) 
+{
+  for (int i = 0; i < NUM_OUT_STREAMS; i++) 
+  {
+    fin_request(w, FIN_OPEN_SPARE, i, 0, 0); 
+    w->spare_pending[i] = 1; 
+  }
+}
+
+/* Switch stream over to a new file called path (which should end with tmp_suffix), handing the
+ * old one (if any) to the fin thread.  */ 
+static void rotate_output(ice_writer_t * w, int stream, const char * path) 
+{
+  struct timespec rotation_start, rotation_end; 
+  clock_gettime(CLOCK_MONOTONIC, &rotation_start); 
+
+  output_file_t * f = &w->out[stream]; 
+  if (f->path) fin_request(w, FIN_CLOSE, stream, f, 0); 
+  clear_output(f); // the fin thread has it now 
+
+  spare_file_t * spare = &w->spares[stream]; 
+  if (spare->ready) 
+  {
+    *f = spare->f; 
+    fin_request(w, FIN_RENAME, stream, &spare->f, strdup(path)); 
+    f->path = strdup(path); 
+    __sync_synchronize(); 
+    spare->ready = 0; 
+    w->spare_pending[stream] = 0; 
+  }
+  else if (open_stream_output(w, &w->cfg, f, path, stream)) // the fin thread is behind (or couldn't open one), do it ourselves 
+  {
+    //nothing to write to; records get dropped until the next try (at the next record) works 
+    w->stats.nfailed_opens++; 
+  }
+
+  //if the fin thread couldn't open a spare (e.g. the disk was briefly full), ask again 
+  if (spare->failed) 
+  {
+    spare->failed = 0; 
+    w->spare_pending[stream] = 0; 
+  }
+
+  if (!w->spare_pending[stream]) 
+  {
+    fin_request(w, FIN_OPEN_SPARE, stream, 0, 0); 
+    w->spare_pending[stream] = 1; 
+  }
+
+  w->file_size[stream] = 0; 
+  w->file_N[stream] = 0; 
+  w->file_time[stream] = time(0); 
+
+  clock_gettime(CLOCK_MONOTONIC, &rotation_end); 
+  double stall = timespec_difference(&rotation_end, &rotation_start); 
+  w->stats.nrotations++; 
+  w->stats.total_stall += stall; 
+  if (stall > w->stats.max_stall) w->stats.max_stall = stall; 
+}
+
+/* Is it time for a new file for this stream? (Always, if we don't have one, e.g. because opening it failed) */ 
+static int need_rotation(ice_writer_t * w, int stream, int max_N) 
+{
+  const acq_config_t * cfg = &w->cfg; 
+  return !is_open(&w->out[stream]) ||
+         (cfg->output.max_kB_per_file > 0  &&  w->file_size[stream] >= cfg->output.max_kB_per_file) ||
+         (max_N > 0 && w->file_N[stream] >= max_N) ||
+         (cfg->output.max_seconds_per_file > 0 && time(0) - w->file_time[stream] >= cfg->output.max_seconds_per_file); 
+}
+
+
+/* (before the fin thread is started, or after it's stopped) */ 
+static void free_writer(ice_writer_t * w) 
+{
+  if (w->fin_wait) ice_buf_wait_group_destroy(w->fin_wait); 
+  if (w->drain_wait) ice_buf_wait_group_destroy(w->drain_wait); 
+  if (w->fin_buffer) ice_buf_destroy(w->fin_buffer); 
+  pthread_mutex_destroy(&w->new_cfg_lock); 
+  free(w->dir); 
+  free(w); 
+}
+
+ice_writer_t * ice_writer_open(const acq_config_t * cfg, const char * run_dir, ice_writer_list_fn_t add_to_file_list) 
+{
+  ice_writer_t * w = calloc(1, sizeof(ice_writer_t)); 
+  if (!w) return NULL; 
+  memcpy(&w->cfg, cfg, sizeof(*cfg)); 
+  memcpy(&w->new_cfg, cfg, sizeof(*cfg)); 
+  pthread_mutex_init(&w->new_cfg_lock, NULL); 
+  w->dir = strdup(run_dir); 
+  w->add_to_file_list = add_to_file_list; 
+
+  //start up the fin thread, and ask it for the first spares 
+  w->fin_buffer = ice_buf_init(64, sizeof(fin_buffer_item_t)); 
+  w->fin_wait = ice_buf_wait_group_init(); 
+  w->drain_wait = ice_buf_wait_group_init(); 
+  if (!w->dir || !w->fin_buffer || !w->fin_wait || !w->drain_wait) 
+  {
+    fprintf(stderr,"Could not set up the output writer\n"); 
+    free_writer(w); 
+    return NULL; 
+  }
+  ice_buf_wait_group_add(w->fin_wait, w->fin_buffer); 
+  if (pthread_create(&w->fin, NULL, fin_thread, w)) 
+  {
+    fprintf(stderr,"Could not start the output writer's fin thread\n"); 
+    free_writer(w); 
+    return NULL; 
+  }
+  request_spares(w); 
+  return w; 
+}
+
+void ice_writer_set_config(ice_writer_t * w, const acq_config_t * cfg) 
+{
+  memcpy(&w->cfg, cfg, sizeof(*cfg)); 
+  pthread_mutex_lock(&w->new_cfg_lock); 
+  memcpy(&w->new_cfg, cfg, sizeof(*cfg)); 
+  pthread_mutex_unlock(&w->new_cfg_lock); 
+}
+
+int ice_writer_event(ice_writer_t * w, const rno_g_header_t * hd, const rno_g_waveform_t * wf, int write_waveform) 
+{
+  int rotated = 0; 
+  if (need_rotation(w, OUT_WF, w->cfg.output.max_events_per_file) || !is_open(&w->out[OUT_HD])) 
+  {
+    char path[strlen(w->dir) + 64]; 
+    sprintf(path, "%s/waveforms/%06u.wf.dat.gz%s", w->dir, hd->event_number, tmp_suffix); 
+    rotate_output(w, OUT_WF, path); 
+    sprintf(path, "%s/header/%06u.hd.dat.gz%s", w->dir, hd->event_number, tmp_suffix); 
+    rotate_output(w, OUT_HD, path); 
+    rotated = 1; 
+  }
+
+  //the header and waveform files rotate together, so the waveform counts go for both 
+  if (write_waveform && !is_open(&w->out[OUT_WF])) 
+  {
+    w->stats.ndropped++; 
+  }
+  else if (write_waveform) 
+  {
+    index_output(w, &w->out[OUT_WF], hd); 
+    w->file_size[OUT_WF] += rno_g_waveform_write(w->out[OUT_WF].h, wf); 
+    if (w->out[OUT_WF].gz) gz_wrote(w->out[OUT_WF].gz); 
+  }
+
+  if (!is_open(&w->out[OUT_HD])) 
+  {
+    w->stats.ndropped++; 
+  }
+  else
+  {
+    index_output(w, &w->out[OUT_HD], hd); 
+    rno_g_header_write(w->out[OUT_HD].h, hd); 
+    if (w->out[OUT_HD].gz) gz_wrote(w->out[OUT_HD].gz); 
+  }
+  w->file_N[OUT_WF]++; 
+  return rotated; 
+}
+
+int ice_writer_daqstatus(ice_writer_t * w, const rno_g_daqstatus_t * ds) 
+{
+  if (need_rotation(w, OUT_DS, w->cfg.output.max_daqstatuses_per_file)) 
+  {
+    char path[strlen(w->dir) + 64]; 
+    sprintf(path, "%s/daqstatus/%05d.ds.dat.gz%s", w->dir, w->ds_i, tmp_suffix); 
+    rotate_output(w, OUT_DS, path); 
+  }
+
+  if (!is_open(&w->out[OUT_DS])) 
+  {
+    w->stats.ndropped++; 
+    return -1; 
+  }
+
+  w->file_size[OUT_DS] += rno_g_daqstatus_write(w->out[OUT_DS].h, ds); 
+  if (w->out[OUT_DS].gz) gz_wrote(w->out[OUT_DS].gz); 
+  w->file_N[OUT_DS]++; 
+  w->ds_i++; 
+  return 0; 
+}
+
+void ice_writer_set_compress_harder(ice_writer_t * w, int harder) 
+{
+  w->compress_harder = harder; 
+}
+
+void ice_writer_drain(ice_writer_t * w) 
+{
+  for (int i = 0; i < NUM_OUT_STREAMS; i++) 
+  {
+    if (w->out[i].path) fin_request(w, FIN_CLOSE, i, &w->out[i], 0); 
+    clear_output(&w->out[i]); 
+    w->spare_pending[i] = 0; 
+  }
+
+  w->fin_drained = 0; 
+  fin_request(w, FIN_DRAIN, 0, 0, 0); 
+  while (!w->fin_drained) ice_buf_wait_group_wait(w->drain_wait, -1); 
+  w->ds_i = 0; 
+}
+
+void ice_writer_set_dir(ice_writer_t * w, const char * run_dir) 
+{
+  free(w->dir); 
+  w->dir = strdup(run_dir); 
+  request_spares(w); 
+}
+
+void ice_writer_get_stats(ice_writer_t * w, ice_writer_stats_t * stats, int reset) 
+{
+  *stats = w->stats; 
+  if (reset) memset(&w->stats, 0, sizeof(w->stats)); 
+}
+
+void ice_writer_get_totals(const ice_writer_t * w, ice_writer_totals_t * totals) 
+{
+  totals->nfiles = __atomic_load_n(&w->totals.nfiles, __ATOMIC_RELAXED); 
+  totals->compressed_bytes = __atomic_load_n(&w->totals.compressed_bytes, __ATOMIC_RELAXED); 
+  totals->uncompressed_bytes = __atomic_load_n(&w->totals.uncompressed_bytes, __ATOMIC_RELAXED); 
+}
+
+void ice_writer_close(ice_writer_t * w) 
+{
+  for (int i = 0; i < NUM_OUT_STREAMS; i++) 
+  {
+    if (w->out[i].path) fin_request(w, FIN_CLOSE, i, &w->out[i], 0); 
+  }
+  fin_request(w, FIN_QUIT, 0, 0, 0); 
+  pthread_join(w->fin, 0); 
+  free_writer(w); 
+}
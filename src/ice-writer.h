@@ -0,0 +1,79 @@
+#ifndef _RNO_G_ICE_WRITER_H
+#define _RNO_G_ICE_WRITER_H
+
+/** The output side of rno-g-acq: the waveform, header and daqstatus files of a run. 
+ *
+ * Events and daqstatuses go into gzip files (written by zlib, or by ice-output.h with io_uring) that are rotated 
+ * according to the output config (max_events_per_file etc.), with index sidecars (ice-index.h), manifest entries (ice-manifest.h), 
+ * or run containers (ice-container.h), as configured. 
+ *
+ * Closing an output file (which flushes the rest of the gzip stream), renaming it and adding it to the file 
+ * list, as well as opening the next file, can take quite a while on an SD card, and events pile up in the 
+ * meantime. So that's handed off to a background thread (the fin thread), which also keeps a spare file open 
+ * for each stream. Rotating then just swaps handles. The spare is renamed to its proper name (which depends on 
+ * the first event number in it) by the fin thread. 
+ *
+ * rno-g-acq's write thread drives this, and so does rno-g-writer-bench, to measure how fast it can go. 
+ * Only one thread should call these. 
+ **/ 
+
+#include "ice-config.h" 
+#include "rno-g.h" 
+
+struct ice_writer; 
+typedef struct ice_writer ice_writer_t; 
+
+/* Called with the path of each finished file (from the fin thread) */ 
+typedef int (*ice_writer_list_fn_t)(const char * path); 
+
+typedef struct ice_writer_stats
+{
+  int nrotations;           // files rotated 
+  double total_stall;       // seconds spent rotating 
+  double max_stall;         // longest single rotation, seconds 
+  int nfailed_opens;        // output files we couldn't open 
+  int ndropped;             // records dropped because their file couldn't be opened 
+} ice_writer_stats_t; 
+
+typedef struct ice_writer_totals
+{
+  uint64_t nfiles;              // output files finished (including ones in a container) 
+  uint64_t compressed_bytes;    // their sizes 
+  uint64_t uncompressed_bytes;  // and what went into them 
+} ice_writer_totals_t; 
+
+/* Start writing into run_dir (which should already have its waveforms/header/daqstatus subdirectories), with the output 
+ * settings in cfg (which is copied, so hold whatever lock protects it; its strings aren't used). add_to_file_list may 
+ * be NULL. Returns NULL if the writer (or its fin thread) can't be set up. */ 
+ice_writer_t * ice_writer_open(const acq_config_t * cfg, const char * run_dir, ice_writer_list_fn_t add_to_file_list); 
+
+/* Take a new copy of the config (e.g. after it's been reread). Changes apply from the next file on. */ 
+void ice_writer_set_config(ice_writer_t * w, const acq_config_t * cfg); 
+
+/* Write an event. The waveform is only written if write_waveform. Returns 1 if the header file was rotated first, 
+ * 0 otherwise. */ 
+int ice_writer_event(ice_writer_t * w, const rno_g_header_t * hd, const rno_g_waveform_t * wf, int write_waveform); 
+
+/* Write a daqstatus. Returns -1 if it was dropped (since its file couldn't be opened) */ 
+int ice_writer_daqstatus(ice_writer_t * w, const rno_g_daqstatus_t * ds); 
+
+/* Compress harder (from the next file on), e.g. when short on space */ 
+void ice_writer_set_compress_harder(ice_writer_t * w, int harder); 
+
+/* Finish all the files (and the container, if any), and wait for that to be done. Writing again starts new files. */ 
+void ice_writer_drain(ice_writer_t * w); 
+
+/* Switch to a new run directory (after ice_writer_drain) */ 
+void ice_writer_set_dir(ice_writer_t * w, const char * run_dir); 
+
+/* Rotation statistics, optionally resetting them afterwards */ 
+void ice_writer_get_stats(ice_writer_t * w, ice_writer_stats_t * stats, int reset); 
+
+/* Totals since ice_writer_open over all the files that have been finished. Unlike the other functions, this can be 
+ * called from any thread (while w is open). */ 
+void ice_writer_get_totals(const ice_writer_t * w, ice_writer_totals_t * totals); 
+
+/* Finish everything and stop the fin thread */ 
+void ice_writer_close(ice_writer_t * w); 
+
+#endif
@@ -6,16 +6,21 @@
  *
  *  This is a multi-threaded design, with the following responsibilities:
  *
- *   - main thread:  sets things up, listens for signals, terminates. 
+ *   - main thread:  sets things up, listens for signals, rolls over runs (if enabled), terminates. 
  *   - acq  thread:  records data from the digitizer boards and puts in the write queue 
  *   - out  thread:  processes things from the write queue, eventually writing them out
  *   - mon thread:   monitors the scalers and adjusts thresholds 
+ *   - sw thread:    issues soft triggers, on time 
+ *   - fin thread:   closes, renames and lists finished output files and opens spare ones, 
+ *                   so that file rotation doesn't stall the out thread
  *
  *    The BBB is single-threaded, so in practice only one thread is happening at once anyway, 
  *    but this design is simpler to understand. 
  *
  *    A SIGUSR1 will cause the main thread to reread the configuration, potentially changing
  *    various things. Not all things take effect on such an update (e.g. output_dir or runfile) .
+ *    With runtime.watch_config, the same happens (within a fraction of a second) whenever the config file 
+ *    changes or a new one-time config shows up in acq.cfg.once, as long as it parses. 
  *
  *
  *    Because of the multiple threads, we need to be careful about locking. 
@@ -25,12 +30,24 @@
  *      cfg_lock: Locks the global acq configuration 
    *       * readers hold this when using the config for something, but should release sometimes
  *         * will be held as a write lock when th econfig is being updated (from a signal telling us to reread) 
+ *         * the mon thread works from its own copy, taken when the config changes, so it doesn't hold this while 
+ *           talking to the boards (which is slow) 
  *
  *      radiant_lock:  
  *          * the acq thread and the mon thread are readers for this. The  acq thread only uses SPI and the mon thread only uses UART so it should be fine. 
- *          * the write lock must be held when configuring the radiant (e.g. the trigger options, 
- *             not just the thresholds changed). In practice this may be completely redundant with the cfg lock 
- *             and be removed. 
+ *          * the write lock must be held when setting up the radiant from scratch (starting the LABs, pedestals...).
+ *            Config changes at runtime are just register writes over the UART, so they take the read lock
+ *            and radiant_uart_lock, like the mon thread (see radiant_reconfigure).
+ *
+ *      flower_lock: like radiant_lock, but for the flower (the mon thread, and runtime config changes, are readers while they talk to it, 
+ *        and take flower_bus_lock too, so they don't talk over each other) 
+ *
+ *    a mutex, radiant_uart_lock, held by whoever is talking to the RADIANT over the UART (the mon and sw threads), 
+ *      it inherits priority, so the (SCHED_FIFO) sw thread isn't held up behind a preempted mon thread, and the mon 
+ *      thread drops it between retries so a due soft trigger can get in,
+ *
+ *    and a mutex, run_lock, held by the write thread while it switches to a new run (output_dir, the 
+ *    file list...). Anyone else writing into the run directory should hold it. Take the cfg_lock first. 
  *      
  *    
  */ 
@@ -47,6 +64,7 @@
 #include <unistd.h> 
 #include <sys/mman.h>
 #include <sys/file.h> 
+#include <sys/stat.h> 
 #include <sys/types.h> 
 #include <sys/sendfile.h> 
 #include <zlib.h>
@@ -64,6 +82,19 @@
 #include "ice-buf.h"
 #include "ice-common.h"
 #include "ice-version.h"
+#include "ice-writer.h"
+#include "ice-hdcol.h"
+#include "ice-recover.h"
+#include "ice-manifest.h"
+#include "ice-sched.h"
+#include "ice-softlog.h"
+#include "ice-servolog.h"
+#include "ice-servo.h"
+#include "ice-dsshm.h"
+#include "ice-dshist.h"
+#include "ice-metrics.h"
+#include "ice-dsaux.h"
+#include "ice-cfgwatch.h"
 
 /////// TYPES //////////
 
@@ -78,6 +109,7 @@ typedef struct acq_buffer_item
 typedef struct mon_buffer_item 
 {
   rno_g_daqstatus_t ds; 
+  ice_dsaux_record_t aux; 
 } mon_buffer_item_t; 
 
 
@@ -91,6 +123,9 @@ typedef struct mon_buffer_item
 static acq_config_t cfg; 
 char * cfgpath = NULL; 
 
+/* The directory the config was found in (where we look for one-time configs) */ 
+static char * cfg_dir = NULL; 
+
 /*read-write lock for the config */ 
 static pthread_rwlock_t cfg_lock; 
 
@@ -100,19 +135,36 @@ static pthread_rwlock_t radiant_lock;
 /*read-write lock for cofiguring the flower */ 
 static pthread_rwlock_t flower_lock; 
 
-/**read-write lock for the daq status */ 
-static pthread_rwlock_t ds_lock; 
-
 static pthread_t the_acq_thread; 
 static pthread_t the_mon_thread; 
 static pthread_t the_wri_thread; 
+static pthread_t the_sw_thread; 
 
 /** This counts how many times the config has been read */ 
 static volatile int config_counter;  
 
-/** This is the current run number */ 
+/** This is the current run number (of what the write thread is writing) */ 
 static int run_number = -1; 
 
+/** The run the acq thread is stamping events with. Normally the same as run_number, but at a rollover 
+ * (see roll_over_run) this changes first, and the write thread follows once it's done with the old run. */ 
+static volatile int acq_run_number = -1; 
+static struct timespec precise_rollover_time; 
+
+/** Held by the write thread while it switches output_dir (and the file list) over to a new run */ 
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER; 
+
+/* Held while using the RADIANT UART from the mon and sw threads, so the soft triggers don't get mixed up with scaler reads.
+ * Priority-inheriting, set up in initial_setup */ 
+static pthread_mutex_t radiant_uart_lock; 
+
+/* Held (after flower_lock) while the mon thread or a runtime config change talk to the flower, so a reapply doesn't 
+ * interleave with the scaler reads and threshold writes */ 
+static pthread_mutex_t flower_bus_lock = PTHREAD_MUTEX_INITIALIZER; 
+
+/* RADIANT UART commands issued by the mon and sw threads (for the daqstatus aux stream), counted under radiant_uart_lock */ 
+static uint32_t radiant_uart_commands = 0; 
+
 /** This is the station number */ 
 static int station_number = -1; 
 
@@ -124,6 +176,10 @@ static char * output_dir = NULL;
 static volatile int quit = 0; 
 static volatile int cfg_reread = 0; 
 
+/** How much we've given up because the output partition is filling (set by the main thread, see update_degradation) */ 
+enum { DEGRADE_NONE, DEGRADE_COMPRESS, DEGRADE_DROP_FORCED, DEGRADE_HEADERS_ONLY, NUM_DEGRADE_TIERS }; 
+static volatile int degrade_tier = DEGRADE_NONE; 
+
 
 /** radiant handle*/ 
 static radiant_dev_t * radiant = 0; 
@@ -132,6 +188,22 @@ static uint32_t radiant_trig_chan = 0;
 /** flower handle */ 
 static flower_dev_t * flower = 0; 
 
+/** Firmware versions and the sample rate, for the runinfo. Read once at startup (see read_hw_info), so starting 
+ * the output of a new run doesn't have to talk to the boards while the other threads are using them. */ 
+typedef struct fw_version 
+{
+  uint8_t major, minor, rev, mon, day; 
+  uint16_t year; 
+} fw_version_t; 
+
+static struct 
+{
+  fw_version_t radiant; 
+  fw_version_t radiant_bm; 
+  uint16_t radiant_sample_rate; 
+  fw_version_t flower; // all zero with no flower 
+} hw_info; 
+
 uint8_t flower_codes[RNO_G_NUM_LT_CHANNELS]; 
 
 /** radiant pedestals*/ 
@@ -141,12 +213,33 @@ static rno_g_pedestal_t * pedestals = 0;
 static int pedestal_fd; 
 
 
-/** Shared daq status */ 
+/** The daq status (mostly the mon thread's; what's in the shared file is a copy, see shared_ds) */ 
 static rno_g_daqstatus_t * ds = 0; 
 
 
-//File descriptor for daqstatus shared mem file
-static int shared_ds_fd; 
+//The shared daqstatus file (see ice-dsshm.h). Only the write thread publishes to it. 
+static ice_dsshm_t * shared_ds = 0; 
+
+//and the recent history of them (see ice-dshist.h), also only written by the write thread 
+static ice_dshist_t * shared_ds_history = 0; 
+
+/* The metrics endpoint (see ice-metrics.h), and what it reports. Each counter has just one thread writing it 
+ * (with relaxed atomics), so the metrics thread can read them without holding anyone up. */ 
+static ice_metrics_t * metrics = 0; 
+static struct 
+{
+  uint64_t events_acquired;     // acq thread 
+  uint64_t acq_live_ns;         // acq thread, time spent ready for a trigger 
+  uint64_t events_written;      // wri thread 
+  uint64_t waveforms_dropped;   // wri thread 
+  uint64_t daqstatus_written;   // wri thread 
+  ice_writer_totals_t files;    // wri thread (copied from the writer every second) 
+  float output_free_MB;         // main thread 
+  float runfile_free_MB;        // main thread 
+} metrics_counters; 
+
+#define METRICS_TICK_INTERVAL 10 // seconds, how often the rates are updated 
+
 
 /** calib handle */ 
 static rno_g_cal_dev_t * calpulser = 0;  
@@ -157,6 +250,21 @@ static ice_buf_t *acq_buffer;
 //mon ring buffer 
 static ice_buf_t *mon_buffer; 
 
+//the write thread sleeps on this until there is something in either ring buffer 
+static ice_buf_wait_group_t *wri_wait; 
+
+/* The mon and sw threads' schedulers, so others (please_stop, read_config) can wake them up. They are made in
+ * initial_setup, before the threads, and only destroyed in teardown after they're joined, so a wake never finds one gone. */ 
+static ice_sched_t * volatile mon_sched; 
+static ice_sched_t * volatile sw_sched; 
+
+/* Soft trigger log records, from the sw thread to the write thread */ 
+static ice_buf_t * sw_log_buffer; 
+static FILE * sw_log = 0; 
+
+/* The daqstatus aux stream (see ice-dsaux.h), written by the write thread */ 
+static FILE * ds_aux = 0; 
+
 static FILE * file_list = 0; 
 static int file_list_fd = 0; 
 
@@ -169,8 +277,10 @@ static double output_partition_free = 0;
 ///// PROTOTYPES  /////  
 
 static int radiant_configure();
+static int radiant_reconfigure(uint32_t changes); 
 static int flower_configure();
-static int flower_update_pps_offset(); 
+static int flower_reconfigure(uint32_t changes); 
+static int flower_update_pps_offset(float wanted_delay); 
 static int calpulser_configure(); 
 static int teardown(); 
 static int please_stop(); 
@@ -186,6 +296,21 @@ static uint32_t delay_clock_estimate = 10000000;
 
 ///// Implementations /////
 
+/* Remember which directory a config came from (for a one-time config, the one the acq.cfg.once directory is in) */ 
+static void set_cfg_dir(const char * found, int one_time) 
+{
+  char * dir = strdup(found); 
+  for (int up = one_time ? 2 : 1; up > 0; up--) 
+  {
+    char * slash = strrchr(dir, '/'); 
+    if (!slash) strcpy(dir, "."); 
+    else if (slash == dir) slash[1] = 0; 
+    else *slash = 0; 
+  }
+  free(cfg_dir); 
+  cfg_dir = dir; 
+}
+
 /** This, unsurprisingly, reads the config file.
  **  It will hold a write lock on the config .
  the config is checked in 3 places, in order: 
@@ -196,16 +321,45 @@ static uint32_t delay_clock_estimate = 10000000;
    The first time this is called  the cfg will be default-inited before reading. 
 
    The config can be read multiple times during the run, as some settings can be changed. 
-   A SIGUSR1 signal will force a read of the config. 
+   A SIGUSR1 signal will force a read of the config, as will changing it if runtime.watch_config is set (see update_cfg_watch). 
  
+   With once_only, only a one-time config (from acq.cfg.once in the directory the config came from) is used. 
+
+   On a reread, a config that doesn't parse is ignored (returning -1), so nothing changes. 
  */ 
-static void read_config() 
+static int read_config(int once_only) 
 {
-  static int config_counter; 
   int first_time = !config_counter; 
 
-  //Acquire a 
+  //try to load the same cfgpath each time, if possible. 
+  char * found_config = 0; 
+  char * renamed_cfg = 0; 
+  FILE * fptr = once_only ? find_config("acq.cfg", cfg_dir, &found_config, &renamed_cfg) 
+                          : find_config("acq.cfg", cfgpath, &found_config, &renamed_cfg); 
+
+  if (once_only && (!fptr || !renamed_cfg)) 
+  {
+    printf("No one-time config to use after all\n"); 
+    if (fptr) fclose(fptr); 
+    free(found_config); 
+    return -1; 
+  }
+
+  //make sure it parses before we touch anything 
+  if (!first_time && fptr && check_acq_config(fptr)) 
+  {
+    fprintf(stderr,"!!! %s doesn't parse, keeping the current config\n", found_config); 
+    fclose(fptr); 
+    free(found_config); 
+    free(renamed_cfg); 
+    return -1; 
+  }
+
+  //Acquire a write lock (and keep track of how long we had to wait for it, since readers shouldn't hold it for long)
+  struct timespec wait_start, wait_end; 
+  clock_gettime(CLOCK_MONOTONIC, &wait_start); 
   pthread_rwlock_wrlock(&cfg_lock); 
+  clock_gettime(CLOCK_MONOTONIC, &wait_end); 
 
   acq_config_t old_cfg; 
   if (first_time)  
@@ -214,16 +368,10 @@ static void read_config()
   }
   else
   {
-    printf("Rereading config..."); 
+    printf("Rereading config (waited %.3f ms for the lock)...", 1e3 * timespec_difference(&wait_end, &wait_start)); 
     memcpy(&old_cfg,&cfg,sizeof(cfg)); 
   }
 
-  //try to load the same cfgpath each time, if possible. 
-  char * found_config = 0; 
-  char * renamed_cfg = 0; 
-  FILE * fptr =  find_config("acq.cfg", cfgpath, &found_config, &renamed_cfg) ; 
-
-
   if (!fptr) 
   {
     if (first_time) 
@@ -234,6 +382,7 @@ static void read_config()
   else
   {
     printf("Using%s config file %s\n", renamed_cfg ? " one-time": "", found_config); 
+    set_cfg_dir(found_config, renamed_cfg != 0); 
 
     // try to use the config again the next reread if not onetime? 
     if (!renamed_cfg) cfgpath = found_config; 
@@ -253,11 +402,13 @@ static void read_config()
     char * ofname; 
     time_t now; 
     time(&now); 
+    pthread_mutex_lock(&run_lock); 
     asprintf(&ofname,"%s/cfg/acq.%d.%lu.cfg", output_dir, config_counter,now); 
     FILE * of = fopen(ofname,"w"); 
     dump_acq_config(of, &cfg); 
     fclose(of); 
     add_to_file_list(ofname); 
+    pthread_mutex_unlock(&run_lock); 
     free(ofname); 
   }
 
@@ -266,26 +417,75 @@ static void read_config()
   //release the write lock 
   pthread_rwlock_unlock(&cfg_lock); 
 
+  //let the mon and sw threads pick up the new intervals 
+  if (mon_sched) ice_sched_wake(mon_sched); 
+  if (sw_sched) ice_sched_wake(sw_sched); 
 
-  //apply new configuration to radiant/flower if they have changed
+
+  //apply new configuration to radiant/flower/calpulser, but only the parts that changed. 
+  //(Comparing whole sections doesn't work: the strings in them are reallocated on every read, so they always differ.) 
   if (!first_time) 
   {
-    if (memcmp(&old_cfg.radiant, &cfg.radiant, sizeof(cfg.radiant)))
+    uint32_t changes = acq_config_changes(&old_cfg, &cfg, stdout); 
+    if (!changes) 
     {
-      radiant_configure(); 
+      printf("Nothing to reapply to the hardware\n"); 
+      return 0; 
     }
 
-    if (memcmp(&old_cfg.lt, &cfg.lt, sizeof(cfg.lt)))
-    {
-      flower_configure(); 
-    }
+    struct timespec apply_start, apply_end; 
+    clock_gettime(CLOCK_MONOTONIC, &apply_start); 
+    radiant_reconfigure(changes); 
+    flower_reconfigure(changes); 
+    if (changes & ACQ_CFG_CALIB) calpulser_configure(); 
+    clock_gettime(CLOCK_MONOTONIC, &apply_end); 
 
-    if (memcpy(&old_cfg.calib, &cfg.calib, sizeof(cfg.calib)))
+    printf("Reapplied"); 
+    for (int i = 0; i < ACQ_CFG_NUM_CHANGE_TYPES; i++) 
     {
-      calpulser_configure(); 
+      if (changes & (1u << i)) printf(" %s", acq_config_change_name(1u << i)); 
     }
+    printf(" in %.3f ms (without pausing acquisition)\n", 1e3 * timespec_difference(&apply_end, &apply_start)); 
+  }
+
+  return 0; 
+}
+
+/* Watching the config (see ice-cfgwatch.h). Only the main thread touches these. */ 
+static ice_cfgwatch_t * cfg_watch = 0; 
+static int cfg_watch_debounce_ms = 0; 
+
+/* (Re)points the config watcher at wherever the config now comes from, or stops it if it's been turned off */ 
+static void update_cfg_watch() 
+{
+  if (!cfg.runtime.watch_config) 
+  {
+    if (cfg_watch) printf("No longer watching the config\n"); 
+    ice_cfgwatch_close(cfg_watch); 
+    cfg_watch = 0; 
+    return; 
+  }
+
+  const char * dir = cfg_dir ?: "/rno-g/cfg"; 
+  char * file = 0; 
+  char * once_dir = 0; 
+  struct stat st; 
+  //only watch the config file if we know which one it is. Without one (no config was found, or we started on a 
+  //one-time config), a reload goes looking through the directories again, and would use up a one-time config 
+  if (cfgpath && !stat(cfgpath, &st) && S_ISREG(st.st_mode)) file = strdup(cfgpath); 
+  asprintf(&once_dir, "%s/acq.cfg.once", dir); 
+
+  if (!ice_cfgwatch_is_watching(cfg_watch, file, once_dir) || cfg_watch_debounce_ms != cfg.runtime.watch_config_debounce_ms) 
+  {
+    ice_cfgwatch_close(cfg_watch); 
+    cfg_watch_debounce_ms = cfg.runtime.watch_config_debounce_ms; 
+    cfg_watch = ice_cfgwatch_open(file, once_dir, 1e-3 * cfg_watch_debounce_ms); 
+    if (cfg_watch) printf("Watching %s%s%s/ for config changes\n", file ?: "", file ? " and " : "", once_dir); 
+    else fprintf(stderr,"Could not watch the config, only a SIGUSR1 will reload it\n"); 
   }
 
+  free(file); 
+  free(once_dir); 
 }
 
 int add_to_file_list(const char *path) 
@@ -308,21 +508,20 @@ void feed_watchdog(time_t * now)
 }
 
 
-/** This configures the radiant. It holds the radiant write lock (and acquires the config read lock)*/ 
-int radiant_configure() 
+/* The pieces of the RADIANT configuration, so a config reread only redoes what changed.
+ * These expect the caller to hold the cfg read lock and to have the RADIANT to itself (see radiant_configure and
+ * radiant_reconfigure). */ 
+static void radiant_apply_pps() 
 {
-
-  pthread_rwlock_wrlock(&radiant_lock); 
-  pthread_rwlock_rdlock(&cfg_lock);
-
-
-
   radiant_pps_config_t pps_cfg = {.pps_holdoff = cfg.radiant.pps.pps_holdoff,
                                   .enable_sync_out= cfg.radiant.pps.sync_out,
                                   .use_internal_pps = cfg.radiant.pps.use_internal}; 
 
   radiant_set_pps_config(radiant,pps_cfg); 
+}
 
+static void radiant_apply_delays() 
+{
   uint16_t sampling_rate=radiant_get_sample_rate(radiant);
 
   int maybe_rf0_clock_delay = round(cfg.radiant.trigger.RF[0].readout_delay*sampling_rate/(128.*1000));
@@ -337,37 +536,41 @@ int radiant_configure()
 
   radiant_set_delay_settings(radiant,rf0_clock_delay,rf1_clock_delay,
                       cfg.radiant.trigger.RF[0].readout_delay_mask,cfg.radiant.trigger.RF[1].readout_delay_mask);
+}
 
+static void radiant_apply_scalers() 
+{
   radiant_set_scaler_period(radiant, cfg.radiant.scalers.use_pps ? 0 : cfg.radiant.scalers.period); 
 
   for (int i = 0; i < RNO_G_NUM_RADIANT_CHANNELS; i++)
   {
     radiant_set_prescaler(radiant,i, cfg.radiant.scalers.prescal_m1[i]); 
   }
+}
 
+static int radiant_apply_trigger() 
+{
   uint32_t global_mask = 
     ((!!cfg.radiant.trigger.RF[0].enabled) * cfg.radiant.trigger.RF[0].mask) |
     ((!!cfg.radiant.trigger.RF[1].enabled) * cfg.radiant.trigger.RF[1].mask);
 
   int ret = radiant_set_global_trigger_mask(radiant, global_mask); 
 
-  radiant_trig_chan = 0; 
-
   ret += radiant_configure_rf_trigger(radiant, RADIANT_TRIG_A, 
       cfg.radiant.trigger.RF[0].enabled ? cfg.radiant.trigger.RF[0].mask  : 0, 
       cfg.radiant.trigger.RF[0].num_coincidences, cfg.radiant.trigger.RF[0].window); 
 
-  if (cfg.radiant.trigger.RF[0].enabled) radiant_trig_chan |= cfg.radiant.trigger.RF[0].mask; 
-
   ret += radiant_configure_rf_trigger(radiant, RADIANT_TRIG_B, 
       cfg.radiant.trigger.RF[1].enabled ? cfg.radiant.trigger.RF[1].mask  : 0, 
       cfg.radiant.trigger.RF[1].num_coincidences, cfg.radiant.trigger.RF[1].window); 
 
-  if (cfg.radiant.trigger.RF[1].enabled) radiant_trig_chan |= cfg.radiant.trigger.RF[1].mask; 
-
+  //the mon thread reads this without a lock, so only store it once 
+  radiant_trig_chan = global_mask; 
+  return ret; 
+}
 
-  //make sure the labs are started before setting enables 
-  radiant_labs_start(radiant); 
+static void radiant_apply_trigger_enables() 
+{
   int enables = RADIANT_TRIG_EN; 
 
   if (cfg.radiant.trigger.output_enabled)
@@ -395,13 +598,53 @@ int radiant_configure()
   }
 
   radiant_trigger_enable(radiant,enables,0); 
+}
+
+/** This configures the radiant from scratch (at startup, or after the LABs were stopped). It holds the radiant write lock (and acquires the config read lock)*/ 
+int radiant_configure() 
+{
+
+  pthread_rwlock_wrlock(&radiant_lock); 
+  pthread_rwlock_rdlock(&cfg_lock); 
+
+  radiant_apply_pps(); 
+  radiant_apply_delays(); 
+  radiant_apply_scalers(); 
+  radiant_apply_trigger(); 
 
+  //make sure the labs are started before setting enables 
+  radiant_labs_start(radiant); 
+  radiant_apply_trigger_enables(); 
 
   pthread_rwlock_unlock(&cfg_lock);
   pthread_rwlock_unlock(&radiant_lock); 
   return 0; 
 }
 
+/** This applies a runtime config change (changes is from acq_config_changes) to the radiant. The LABs are already
+ * running, so this is just register writes over the UART: it only takes the radiant read lock (and the uart lock), 
+ * so the acq thread keeps going. */ 
+static int radiant_reconfigure(uint32_t changes) 
+{
+  if (!(changes & ACQ_CFG_RADIANT_ANY)) return 0; 
+
+  pthread_rwlock_rdlock(&radiant_lock); 
+  pthread_mutex_lock(&radiant_uart_lock); 
+  pthread_rwlock_rdlock(&cfg_lock); 
+
+  int ret = 0; 
+  if (changes & ACQ_CFG_RADIANT_PPS) radiant_apply_pps(); 
+  if (changes & ACQ_CFG_RADIANT_DELAYS) radiant_apply_delays(); 
+  if (changes & ACQ_CFG_RADIANT_SCALERS) radiant_apply_scalers(); 
+  if (changes & ACQ_CFG_RADIANT_TRIGGER) ret = radiant_apply_trigger(); 
+  if (changes & ACQ_CFG_RADIANT_TRIGGER_ENABLES) radiant_apply_trigger_enables(); 
+
+  pthread_rwlock_unlock(&cfg_lock); 
+  pthread_mutex_unlock(&radiant_uart_lock); 
+  pthread_rwlock_unlock(&radiant_lock); 
+  return ret; 
+}
+
 static void set_calpulser_atten(float atten) 
 {
     if (atten < 0) atten = 0; 
@@ -496,19 +739,35 @@ int write_gain_codes(char * buf)
 }
 
 
-/** this configures the flower trigger. It holds the flower write lock (and acquires the config read lock)*/ 
-int flower_configure() 
+/* The pieces of the flower configuration, like the radiant_apply_* ones. The caller holds the cfg read lock and the flower lock. */ 
+static int flower_apply_trigger() 
 {
-  if (!flower) return -1; 
-
-  pthread_rwlock_wrlock(&flower_lock); 
-  pthread_rwlock_rdlock(&cfg_lock); 
   rno_g_lt_simple_trigger_config_t ltcfg; 
   ltcfg.window = cfg.lt.trigger.window; 
   ltcfg.vpp_mode = cfg.lt.trigger.vpp; 
   ltcfg.num_coinc =cfg.lt.trigger.enable_rf_trigger ?  cfg.lt.trigger.min_coincidence-1 : 4; 
-  int ret = flower_configure_trigger(flower, ltcfg); 
+  return flower_configure_trigger(flower, ltcfg); 
+}
+
+static void flower_apply_gains() 
+{
+  if (!cfg.lt.gain.auto_gain) 
+  {
+    flower_set_gains(flower, cfg.lt.gain.fixed_gain_codes); 
+    memcpy(flower_codes, cfg.lt.gain.fixed_gain_codes, sizeof(flower_codes)); 
+  }
+}
+
+static void flower_apply_pps_delay() 
+{
+  if (cfg.lt.trigger.enable_pps_trigger_sys_out || cfg.lt.trigger.enable_pps_trigger_sma_out) 
+  {
+    flower_update_pps_offset(cfg.lt.trigger.pps_trigger_delay); 
+  }
+}
 
+static void flower_apply_trigger_enables() 
+{
   flower_trigger_enables_t trig_enables = {
     .enable_coinc=cfg.lt.trigger.enable_rf_trigger, 
     .enable_pps = 0, 
@@ -522,25 +781,43 @@ int flower_configure()
     .enable_pps_auxout=cfg.lt.trigger.enable_pps_trigger_sma_out
   };
 
+  flower_set_trigger_enables(flower,trig_enables);
+  flower_set_trigout_enables(flower,trigout_enables);
+}
 
-  
-
-  if (!cfg.lt.gain.auto_gain) 
-  {
-    flower_set_gains(flower, cfg.lt.gain.fixed_gain_codes); 
-    memcpy(flower_codes, cfg.lt.gain.fixed_gain_codes, sizeof(flower_codes));
-  }
+/** this configures the flower trigger. It holds the flower write lock (and acquires the config read lock)*/ 
+int flower_configure() 
+{
+  if (!flower) return -1; 
 
-if (cfg.lt.trigger.enable_pps_trigger_sys_out || cfg.lt.trigger.enable_pps_trigger_sma_out)
-  {
-    flower_update_pps_offset(); 
-  }
+  pthread_rwlock_wrlock(&flower_lock); 
+  pthread_rwlock_rdlock(&cfg_lock); 
+  int ret = flower_apply_trigger(); 
+  flower_apply_gains(); 
+  flower_apply_pps_delay(); 
+  flower_apply_trigger_enables(); 
+  pthread_rwlock_unlock(&cfg_lock); 
+  pthread_rwlock_unlock(&flower_lock); 
 
-  flower_set_trigger_enables(flower,trig_enables);
-  flower_set_trigout_enables(flower,trigout_enables);
+  return ret; 
+}
 
+/** Applies a runtime config change to the flower, only redoing what changed. Like the mon thread, this only needs
+ * the flower read lock (and flower_bus_lock), so the acq thread isn't held up. */ 
+static int flower_reconfigure(uint32_t changes) 
+{
+  if (!flower || !(changes & ACQ_CFG_LT_ANY)) return 0; 
 
+  pthread_rwlock_rdlock(&flower_lock); 
+  pthread_mutex_lock(&flower_bus_lock); 
+  pthread_rwlock_rdlock(&cfg_lock); 
+  int ret = 0; 
+  if (changes & ACQ_CFG_LT_TRIGGER) ret = flower_apply_trigger(); 
+  if (changes & ACQ_CFG_LT_GAINS) flower_apply_gains(); 
+  if (changes & ACQ_CFG_LT_PPS_DELAY) flower_apply_pps_delay(); 
+  if (changes & ACQ_CFG_LT_TRIGGER_ENABLES) flower_apply_trigger_enables(); 
   pthread_rwlock_unlock(&cfg_lock); 
+  pthread_mutex_unlock(&flower_bus_lock); 
   pthread_rwlock_unlock(&flower_lock); 
 
   return ret; 
@@ -656,6 +933,46 @@ static int do_bias_scan()
 }
  
 
+/* Take pedestals (into the pedestal file, if we have one). The labs should be stopped. Returns 0 on success. */ 
+static int take_pedestals() 
+{
+  if (cfg.radiant.pedestals.apply_attenuation) 
+  {
+     for (int ichan = 0; ichan < RNO_G_NUM_RADIANT_CHANNELS; ichan++) 
+     {
+       radiant_set_attenuator(radiant, ichan, RADIANT_ATTEN_SIG, clamp(cfg.radiant.pedestals.attenuation,0,31.75)*4); 
+     }
+  }
+
+  //in case we didn't get mmaped 
+  if (!pedestals) 
+  {
+    pedestals = calloc(sizeof(rno_g_pedestal_t), 1); 
+  }
+
+  int ret = radiant_compute_pedestals(radiant, 0xffffff, 
+                                      cfg.radiant.pedestals.ntriggers_per_computation,
+                                      pedestals); 
+
+  pedestals->station = station_number; 
+
+  //if we have a pedestal file, let's flush it 
+  if (cfg.radiant.pedestals.pedestal_file) 
+  {
+    msync(pedestals, sizeof(rno_g_pedestal_t), MS_SYNC); 
+  }
+
+  //TODO: there's no way we can restore, is there? 
+  if (cfg.radiant.pedestals.apply_attenuation) 
+  {
+     for (int ichan = 0; ichan < RNO_G_NUM_RADIANT_CHANNELS; ichan++) 
+     {
+       radiant_set_attenuator(radiant, ichan, RADIANT_ATTEN_SIG, 0); 
+     }
+  }
+  return ret; 
+}
+
 /* Initial radiant config, including potential pedestal taking and even bias scans! 
  *
  * this happens before threads start while holding config lock. 
@@ -752,42 +1069,7 @@ int radiant_initial_setup()
 
   if (cfg.radiant.pedestals.compute_at_start) 
   {
-
-    if (cfg.radiant.pedestals.apply_attenuation) 
-    {
-       for (int ichan = 0; ichan < RNO_G_NUM_RADIANT_CHANNELS; ichan++) 
-       {
-         radiant_set_attenuator(radiant, ichan, RADIANT_ATTEN_SIG, clamp(cfg.radiant.pedestals.attenuation,0,31.75)*4); 
-       }
-    }
-
-    //in case we didn't get mmaped 
-    if (!pedestals) 
-    {
-      pedestals = calloc(sizeof(rno_g_pedestal_t), 1); 
-    }
-
-    have_peds = !radiant_compute_pedestals(radiant, 0xffffff, 
-                                            cfg.radiant.pedestals.ntriggers_per_computation,
-                                            pedestals); 
-
-    pedestals->station = station_number; 
-
-    //if we have a pedestal file, let's flush it 
-    if (cfg.radiant.pedestals.pedestal_file) 
-    {
-      msync(pedestals, sizeof(rno_g_pedestal_t), MS_SYNC); 
-    }
-
-    //TODO: there's no way we can restore, is there? 
-    if (cfg.radiant.pedestals.apply_attenuation) 
-    {
-       for (int ichan = 0; ichan < RNO_G_NUM_RADIANT_CHANNELS; ichan++) 
-       {
-         radiant_set_attenuator(radiant, ichan, RADIANT_ATTEN_SIG, 0); 
-       }
-    }
-
+    have_peds = !take_pedestals(); 
   }
 
 
@@ -852,17 +1134,25 @@ void * acq_thread(void* v)
     // wait for the RADIANT to trigger
     //TODO handle clear flag, though we don't really want one
     
-    if (radiant_poll_trigger_ready(radiant, cfg.radiant.readout.poll_ms)) 
+    //time spent in here is time we could have taken a trigger (for the metrics' livetime) 
+    struct timespec poll_start, poll_end; 
+    clock_gettime(CLOCK_MONOTONIC, &poll_start); 
+    int ready = radiant_poll_trigger_ready(radiant, cfg.radiant.readout.poll_ms); 
+    clock_gettime(CLOCK_MONOTONIC, &poll_end); 
+    __atomic_fetch_add(&metrics_counters.acq_live_ns, (uint64_t) (1e9 * timespec_difference(&poll_end, &poll_start)), __ATOMIC_RELAXED); 
+
+    if (ready) 
     {
       // Get a buffer , and fill it
       acq_buffer_item_t * mem = ice_buf_getmem(acq_buffer); 
       radiant_read_event(radiant, &mem->hd, &mem->wf);
       if (flower) flower_fill_header(flower, &mem->hd); 
-      mem->hd.run_number = run_number;
-      mem->wf.run_number = run_number;
+      mem->hd.run_number = acq_run_number;
+      mem->wf.run_number = acq_run_number;
       mem->hd.station_number = station_number;
       mem->wf.station= station_number;
       ice_buf_commit(acq_buffer); 
+      __atomic_fetch_add(&metrics_counters.events_acquired, 1, __ATOMIC_RELAXED); 
     }
 
 
@@ -878,426 +1168,514 @@ void * acq_thread(void* v)
 }
 
 
-typedef struct flower_servo_state
+/* What the flower's 100 Hz servo scalers need to be multiplied by to be in Hz, which depends on the firmware */ 
+static float flower_fast_factor() 
 {
-  float value[RNO_G_NUM_LT_CHANNELS]; 
-  float last_value[RNO_G_NUM_LT_CHANNELS]; 
-  float error[RNO_G_NUM_LT_CHANNELS]; 
-  float last_error[RNO_G_NUM_LT_CHANNELS]; 
-  float sum_error[RNO_G_NUM_LT_CHANNELS]; 
-} flower_servo_state_t; 
+  static float fast_factor = 0; 
+  if (!fast_factor) 
+  {
+
+    uint8_t rev, major, minor; 
+    flower_get_fwversion(flower, &major,&minor,&rev,0,0,0); 
 
+    if (!major && !minor && rev < 6) fast_factor = 1000; 
+    else fast_factor = 100; 
+  }
+  return fast_factor; 
+}
 
-typedef struct radiant_servo_state
+static struct drand48_data sw_rand; 
+double calc_next_sw_trig(double now)
 {
-  int max_periods; 
-  int nperiods_populated; 
-  float period_weights[NUM_SERVO_PERIODS]; 
-  int nscaler_periods_per_servo_period[NUM_SERVO_PERIODS]; 
-  float * scaler_v[RNO_G_NUM_RADIANT_CHANNELS]; 
-  float * scaler_v_mem; 
-  float value[RNO_G_NUM_RADIANT_CHANNELS]; 
-  float last_value[RNO_G_NUM_RADIANT_CHANNELS]; 
-  float error[RNO_G_NUM_RADIANT_CHANNELS]; 
-  float last_error[RNO_G_NUM_RADIANT_CHANNELS]; 
-  float sum_error[RNO_G_NUM_RADIANT_CHANNELS]; 
-  int nsum; 
+  if (!cfg.radiant.trigger.soft.enabled) return 0; 
+
+  double interval = cfg.radiant.trigger.soft.interval; 
+  double  u; 
+  if (cfg.radiant.trigger.soft.interval_jitter) 
+  {
+    drand48_r(&sw_rand,&u); 
+    interval += 2*cfg.radiant.trigger.soft.interval_jitter*(u-0.5); 
+  }
+
+  if (cfg.radiant.trigger.soft.use_exponential_distribution) 
+  {
+    drand48_r(&sw_rand,&u); 
+    return  now-log(u)*interval; 
+  }
+  else return now+interval; 
+}
 
-} radiant_servo_state_t; 
 
-static void update_radiant_servo_state(radiant_servo_state_t * st, const rno_g_daqstatus_t * ds) 
+/** This is the monitor thread 
+ *  This is responsible for force triggers and servoing. 
+ *
+ *  Everything it does is a task in a deadline scheduler (see ice-sched.h), so it sleeps until the next thing 
+ *  is due rather than polling. Soft triggers are done by the sw thread. 
+ * */ 
+
+enum 
+{
+  MON_RADIANT_SCALERS, 
+  MON_RADIANT_SERVO, 
+  MON_LT_SCALERS, 
+  MON_LT_SERVO, 
+  MON_DAQSTATUS, 
+  MON_SWEEP, 
+  MON_STATS, 
+  NUM_MON_TASKS
+}; 
+
+typedef struct mon_state
 {
+  acq_config_t cfg; // our own copy of the config, so we don't hold cfg_lock while talking to the boards (don't use its strings) 
+  ice_sched_t * sched; 
+  int tasks[NUM_MON_TASKS]; 
+  ice_radiant_servo_t rad_servo; 
+  ice_flower_servo_t flwr_servo; 
+  float sweep_atten; 
+  ice_servolog_t * servo_log; 
+  int servo_log_run; 
+  double servo_log_flush_time; 
+
+  //adaptive RADIANT scaler polling (radiant.servo.adaptive_polling) 
+  double rad_scaler_interval; // the one in effect 
+  int rad_rate_mean_valid; 
+  float rad_rate_mean[RNO_G_NUM_RADIANT_CHANNELS]; // running average of each channel's rate 
+  float rad_last_step; // the biggest threshold change in the last servo step, in V 
+  uint32_t rad_scaler_reads; 
+  uint32_t rad_scaler_retries; 
+} mon_state_t; 
+
+/* Note down a servo step in the servo history of the current run (see ice-servolog.h), starting a new one if the 
+ * run has changed. */ 
+static void log_servo_step(mon_state_t * st, ice_servolog_step_t * step) 
+{
+  if (!st->cfg.output.servo_history) return; 
 
-  int idx = (st->nperiods_populated++) % st->max_periods; 
-  int max_idxs = st->nperiods_populated < st->max_periods ? st->nperiods_populated : st->max_periods; 
+  struct timespec now; 
+  clock_gettime(CLOCK_REALTIME, &now); 
+  step->time_ms = now.tv_sec * 1000ull + now.tv_nsec / 1000000; 
 
-  for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) 
+  pthread_mutex_lock(&run_lock); 
+  if (st->servo_log && st->servo_log_run != run_number) 
   {
+    ice_servolog_close(st->servo_log); 
+    st->servo_log = 0; 
+  }
+  if (!st->servo_log && file_list) // (no file list yet means the write thread hasn't set up the run directory) 
+  {
+    char path[strlen(output_dir) + sizeof(ICE_SERVOLOG_NAME) + 2]; 
+    sprintf(path, "%s/%s", output_dir, ICE_SERVOLOG_NAME); 
+    st->servo_log = ice_servolog_create(path, station_number, run_number); 
+    st->servo_log_run = run_number; 
+    if (st->servo_log) add_to_file_list(path); 
+  }
+  pthread_mutex_unlock(&run_lock); 
 
+  if (!st->servo_log) return; 
+  ice_servolog_write(st->servo_log, step); 
 
-    //calculate adjusted scaler
-    float adjusted_scaler = ds->radiant_scalers[chan] * (1 + ds->radiant_prescalers[chan]) / (ds->radiant_scaler_period?:1); 
-
-    //put in rolling window
-    st->scaler_v[chan][idx] = adjusted_scaler; 
+  //make sure it's on disk every so often 
+  double nowf = ice_sched_now(); 
+  if (nowf - st->servo_log_flush_time > 60) 
+  {
+    ice_servolog_flush(st->servo_log); 
+    st->servo_log_flush_time = nowf; 
+  }
+}
 
+/* Adaptive scaler polling: after each reading, double the interval (up to max_interval) if the trigger channels' rates 
+ * are all close to their running averages (within rate_tolerance, plus 3 sigma of counting noise) and the last servo step 
+ * didn't move anything by more than thresh_tolerance, otherwise go back to scaler_update_interval. The servo steps at 
+ * the same interval (and right after the reading, when it changes). */ 
+static void adapt_radiant_scaler_interval(mon_state_t * st) 
+{
+  const acq_config_t * c = &st->cfg; 
+  uint32_t mask = radiant_trig_chan ?: (1u << RNO_G_NUM_RADIANT_CHANNELS) - 1; 
+  float period = ds->radiant_scaler_period ?: 1; 
+  int steady = st->rad_rate_mean_valid; 
 
-    st->last_value[chan] = st->value[chan]; 
-    st->value[chan] = 0; 
-    for (int j = 0; j < NUM_SERVO_PERIODS; j++) 
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+  {
+    float rate = ds->radiant_scalers[ch] * (1 + ds->radiant_prescalers[ch]) / period; 
+    float * mean = &st->rad_rate_mean[ch]; 
+    if (!st->rad_rate_mean_valid) *mean = rate; 
+    if ((mask & (1u << ch)) && fabs(rate - *mean) > c->radiant.servo.adaptive_polling.rate_tolerance * *mean + 3 * sqrt(*mean / period)) 
     {
-      if (!st->period_weights[j]) continue; 
-      int nthis = 0; 
-      float sumthis = 0;
-      for (int i = 0; i < max_idxs; i++) 
-      {
-        if (i < st->nscaler_periods_per_servo_period[j])
-        {
-          sumthis += st->scaler_v[chan][(st->nperiods_populated-1-i) % st->max_periods ]; 
-          nthis++; 
-        }
-      }
-      st->value[chan] += st->period_weights[j]*sumthis/nthis; 
+      steady = 0; 
     }
+    *mean += 0.25 * (rate - *mean); 
+  }
+  st->rad_rate_mean_valid = 1; 
 
-    if (cfg.radiant.servo.use_log)
-    {
-      st->value[chan] = log10(cfg.radiant.servo.log_offset + st->value[chan]);
-    }
+  int servoing = c->radiant.servo.enable && c->radiant.servo.servo_interval; 
+  if (servoing && st->rad_last_step > c->radiant.servo.adaptive_polling.thresh_tolerance) steady = 0; 
 
-    st->last_error[chan] = st->error[chan]; 
-    st->error[chan] = (st->value[chan] - cfg.radiant.servo.scaler_goals[chan]); 
-    st->sum_error[chan] += st->error[chan]; 
-    if (fabs(st->sum_error[chan]) > cfg.radiant.servo.max_sum_err)
-    {
-      st->sum_error[chan] = st->sum_error[chan] < 0 ? -cfg.radiant.servo.max_sum_err: cfg.radiant.servo.max_sum_err; 
-    }
+  double min_interval = c->radiant.servo.scaler_update_interval; 
+  double max_interval = c->radiant.servo.adaptive_polling.max_interval > min_interval ? c->radiant.servo.adaptive_polling.max_interval : min_interval; 
+  double interval = steady ? st->rad_scaler_interval * 2 : min_interval; 
+  if (interval > max_interval) interval = max_interval; 
+  if (interval == st->rad_scaler_interval) return; 
 
+  st->rad_scaler_interval = interval; 
+  ice_sched_set_period(st->sched, st->tasks[MON_RADIANT_SCALERS], interval); 
+  if (servoing) 
+  {
+    ice_sched_set_period(st->sched, st->tasks[MON_RADIANT_SERVO], interval); 
+    ice_sched_set_next(st->sched, st->tasks[MON_RADIANT_SERVO], ice_sched_now()); 
   }
-  st->nsum++; 
-
-  return; 
 }
 
-static void setup_flower_servo_state(flower_servo_state_t * st)
+static void mon_radiant_scalers(void * v, double deadline, double now) 
 {
-  memset(st, 0, sizeof(flower_servo_state_t)); 
-}
+  (void) deadline; 
+  (void) now; 
+  mon_state_t * st = v; 
+  pthread_rwlock_rdlock(&radiant_lock); // not while the RADIANT is being set up 
+  while (1) 
+  {
+    //read twice and make sure equal
+    static rno_g_daqstatus_t ds0 = {0}; 
+    memcpy(&ds0, ds, sizeof(ds0)); // copy the flower stuff so it doesn't get overwritten
+    static uint16_t scaler_check[RNO_G_NUM_RADIANT_CHANNELS]= {0}; 
+    pthread_mutex_lock(&radiant_uart_lock); // taken for each try, so a soft trigger can go in between 
+    int ok = radiant_read_daqstatus(radiant, &ds0)+ radiant_get_scalers(radiant,0,RNO_G_NUM_RADIANT_CHANNELS-1, scaler_check); 
+    __atomic_fetch_add(&radiant_uart_commands, 2, __ATOMIC_RELAXED); 
+    pthread_mutex_unlock(&radiant_uart_lock); 
+    st->rad_scaler_reads++; 
 
-static void update_flower_servo_state(flower_servo_state_t *st, const rno_g_daqstatus_t * ds) 
-{
+    if (ok) fprintf(stderr,"Problem reading daqstatus\n"); 
 
-  float sw = cfg.lt.servo.slow_scaler_weight; 
-  float fw = cfg.lt.servo.fast_scaler_weight; 
+    if (!memcmp(ds0.radiant_scalers, scaler_check, sizeof(ds0.radiant_scalers)))
+    {
+        memcpy(ds, &ds0, sizeof(ds0));
+        break; 
+    }
 
+    printf("WARNING: Unequal sequential DAQStatus, trying again\n"); 
+    st->rad_scaler_retries++; 
+  }
+  pthread_rwlock_unlock(&radiant_lock); 
 
-  const rno_g_lt_scaler_group_t * fast = &ds->lt_scalers.s_100Hz;
-  const rno_g_lt_scaler_group_t * slow = &ds->lt_scalers.s_1Hz;
-  const rno_g_lt_scaler_group_t * slow_gated = &ds->lt_scalers.s_1Hz_gated;
-
-  int sub = cfg.lt.servo.subtract_gated; 
-  static float fast_factor = 0; 
-  if (!fast_factor) 
-  {
-
-    uint8_t rev, major, minor; 
-    flower_get_fwversion(flower, &major,&minor,&rev,0,0,0); 
+  //update the running averages for the radiant 
+  ice_radiant_servo_update(&st->rad_servo, &st->cfg, ds); 
 
-    if (!major && !minor && rev < 6) fast_factor = 1000; 
-    else fast_factor = 100; 
-  }
-  
-  for (int i = 0; i < RNO_G_NUM_LT_CHANNELS; i++)
-  {
+  if (st->cfg.radiant.servo.adaptive_polling.enable) adapt_radiant_scaler_interval(st); 
+}
 
-    float val =  fw * fast_factor*fast->servo_per_chan[i]+ sw *(slow->servo_per_chan[i]-sub*slow_gated->servo_per_chan[i]);
-    st->last_value[i] = st->value[i]; 
-    st->value[i] = val; 
-    st->last_error[i] = st->error[i]; 
-    st->error[i] = (val-cfg.lt.servo.scaler_goals[i]); 
-    st->sum_error[i] += st->error[i]; 
-  } 
+static void mon_radiant_servo(void * v, double deadline, double now) 
+{
+  (void) deadline; 
+  (void) now; 
+  mon_state_t * st = v; 
+  ice_servolog_step_t step = {.board = ICE_SERVOLOG_RADIANT, .mask = radiant_trig_chan}; //only servo channels that are part of the trigger 
+  uint32_t flags[RNO_G_NUM_RADIANT_CHANNELS]; 
+  uint32_t old_thresholds[RNO_G_NUM_RADIANT_CHANNELS]; 
+  memcpy(old_thresholds, ds->radiant_thresholds, sizeof(old_thresholds)); 
+  ice_radiant_servo_step(&st->rad_servo, &st->cfg, step.mask, ds->radiant_thresholds, flags); 
+  st->rad_last_step = 0; 
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+  {
+    if (!(step.mask & (1u << ch))) continue; 
+    float change = fabs((double) ds->radiant_thresholds[ch] - old_thresholds[ch]) * 2.5 / 16777215; 
+    if (change > st->rad_last_step) st->rad_last_step = change; 
+    step.ch[ch] = (ice_servolog_channel_t) { .value = st->rad_servo.value[ch], .error = st->rad_servo.error[ch], 
+                                             .sum_error = st->rad_servo.sum_error[ch], 
+                                             .threshold = ds->radiant_thresholds[ch], .flags = flags[ch] }; 
+  }
+
+  //set the thresholds
+  pthread_rwlock_rdlock(&radiant_lock); 
+  pthread_mutex_lock(&radiant_uart_lock); 
+  radiant_set_trigger_thresholds(radiant, 0, RNO_G_NUM_RADIANT_CHANNELS-1, ds->radiant_thresholds); 
+  __atomic_fetch_add(&radiant_uart_commands, 1, __ATOMIC_RELAXED); 
+  pthread_mutex_unlock(&radiant_uart_lock); 
+  pthread_rwlock_unlock(&radiant_lock); 
+  log_servo_step(st, &step); 
 }
 
-static void setup_radiant_servo_state(radiant_servo_state_t * state) 
+static void mon_lt_scalers(void * v, double deadline, double now) 
 {
-  int max_periods = 0; 
-  for (int i = 0; i < NUM_SERVO_PERIODS; i++) 
-  {
-    if (cfg.radiant.servo.nscaler_periods_per_servo_period[i] > max_periods) 
+  (void) deadline; 
+  (void) now; 
+  mon_state_t * st = v; 
+  const acq_config_t * c = &st->cfg; 
+  pthread_rwlock_rdlock(&flower_lock); // not while the flower is being set up 
+  pthread_mutex_lock(&flower_bus_lock); // nor while it's being reconfigured 
+  flower_fill_daqstatus(flower, ds); 
+
+  ice_flower_servo_update(&st->flwr_servo, c, ds, flower_fast_factor()); 
+  //if cycle counter is in the right realm, use it... 
+  if (ds->lt_scalers.cycle_counter > 100e6 && ds->lt_scalers.cycle_counter < 136e6) 
+  {
+    delay_clock_estimate =  ds->lt_scalers.cycle_counter/ 11.8;  //118 MHz clock vs. 10 MHz clock
+    //if we have the pps trigger out and it's not 0, let's update our estimate
+    if ((c->lt.trigger.enable_pps_trigger_sys_out || c->lt.trigger.enable_pps_trigger_sma_out) 
+        && c->lt.trigger.pps_trigger_delay)
     {
-      max_periods = cfg.radiant.servo.nscaler_periods_per_servo_period[i]; 
+      flower_update_pps_offset(c->lt.trigger.pps_trigger_delay); 
     }
   }
+  pthread_mutex_unlock(&flower_bus_lock); 
+  pthread_rwlock_unlock(&flower_lock); 
+}
 
+static void mon_lt_servo(void * v, double deadline, double now) 
+{
+  (void) deadline; 
+  (void) now; 
+  mon_state_t * st = v; 
+  ice_servolog_step_t step = {.board = ICE_SERVOLOG_LT, .mask = (1u << RNO_G_NUM_LT_CHANNELS) - 1}; 
+  uint32_t flags[RNO_G_NUM_LT_CHANNELS]; 
+  ice_flower_servo_step(&st->flwr_servo, &st->cfg, ds->lt_servo_thresholds, ds->lt_trigger_thresholds, flags); 
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+  {
+    step.ch[ch] = (ice_servolog_channel_t) { .value = st->flwr_servo.value[ch], .error = st->flwr_servo.error[ch], 
+                                             .sum_error = st->flwr_servo.sum_error[ch], 
+                                             .threshold = ds->lt_servo_thresholds[ch], .trigger_threshold = ds->lt_trigger_thresholds[ch], 
+                                             .flags = flags[ch] }; 
+  }
+
+  pthread_rwlock_rdlock(&flower_lock); 
+  pthread_mutex_lock(&flower_bus_lock); 
+  flower_set_thresholds(flower,  ds->lt_trigger_thresholds, ds->lt_servo_thresholds, 0xf); 
+  pthread_mutex_unlock(&flower_bus_lock); 
+  pthread_rwlock_unlock(&flower_lock); 
+  log_servo_step(st, &step); 
+}
 
-  if (state->max_periods < max_periods)
-  {
+static void mon_daqstatus(void * v, double deadline, double now) 
+{
+  (void) deadline; 
+  (void) now; 
+  //make sure the station is set correctly 
+  ds->station = station_number; 
 
-    if (state->scaler_v_mem) 
-    {
-      free(state->scaler_v_mem); 
-      memset(state,0, sizeof(*state)); 
-    }
-    state->scaler_v_mem = malloc(sizeof(int) * max_periods * RNO_G_NUM_RADIANT_CHANNELS); 
-    state->max_periods = max_periods; 
-    for (int i = 0; i < RNO_G_NUM_RADIANT_CHANNELS; i++) 
-    {
-      state->scaler_v[i]  = state->scaler_v_mem + max_periods * i; 
-    }
+  // fill in calpulser info 
+  if (!calpulser)  // just zero 
+  {
+    memset(&ds->cal,0,sizeof(ds->cal)); 
+  }
+  else
+  {
+    rno_g_cal_fill_info(calpulser, &ds->cal);
   }
 
+  //and how we got it 
+  mon_state_t * st = v; 
+  struct timespec cpu; 
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu); 
+  ice_dsaux_record_t aux = { .when = ds->when, .radiant_scaler_interval = st->rad_scaler_interval, 
+                             .radiant_scaler_reads = st->rad_scaler_reads, .radiant_scaler_retries = st->rad_scaler_retries, 
+                             .radiant_uart_commands = __atomic_load_n(&radiant_uart_commands, __ATOMIC_RELAXED), 
+                             .mon_cpu_ns = cpu.tv_sec * 1000000000ull + cpu.tv_nsec }; 
 
-  memcpy(state->nscaler_periods_per_servo_period, cfg.radiant.servo.nscaler_periods_per_servo_period, sizeof(int) * NUM_SERVO_PERIODS); 
-  memcpy(state->period_weights, cfg.radiant.servo.period_weights, sizeof(float) * NUM_SERVO_PERIODS); 
-
-
+  mon_buffer_item_t * mem = ice_buf_getmem(mon_buffer); 
+  memcpy(&mem->ds,ds, sizeof(rno_g_daqstatus_t)); 
+  mem->aux = aux; 
+  ice_buf_commit(mon_buffer); 
 }
 
-static struct drand48_data sw_rand; 
-double calc_next_sw_trig(float now)
+static void mon_sweep(void * v, double deadline, double now) 
 {
-  if (!cfg.radiant.trigger.soft.enabled) return 0; 
-
-  double interval = cfg.radiant.trigger.soft.interval; 
-  double  u; 
-  if (cfg.radiant.trigger.soft.interval_jitter) 
+  (void) deadline; 
+  (void) now; 
+  mon_state_t * st = v; 
+  const acq_config_t * c = &st->cfg; 
+  if (c->calib.sweep.stop_atten < c->calib.sweep.start_atten) 
   {
-    drand48_r(&sw_rand,&u); 
-    interval += 2*cfg.radiant.trigger.soft.interval_jitter*(u-0.5); 
+    st->sweep_atten -= fabs(c->calib.sweep.atten_step); 
+    if (st->sweep_atten < c->calib.sweep.stop_atten) st->sweep_atten = c->calib.sweep.start_atten; 
   }
-
-  if (cfg.radiant.trigger.soft.use_exponential_distribution) 
+  else
   {
-    drand48_r(&sw_rand,&u); 
-    return  now-log(u)*interval; 
+    st->sweep_atten += fabs(c->calib.sweep.atten_step); 
+    if (st->sweep_atten > c->calib.sweep.stop_atten) st->sweep_atten = c->calib.sweep.start_atten; 
   }
-  else return now+interval; 
+  set_calpulser_atten(st->sweep_atten);
 }
 
+static void mon_stats(void * v, double deadline, double now) 
+{
+  (void) deadline; 
+  (void) now; 
+  mon_state_t * st = v; 
+  printf("-------monitor tasks-----------\n"); 
+  ice_sched_print_stats(stdout, st->sched, 1); 
+}
+
+/* (Re)schedule the tasks from the config */ 
+static void mon_schedule(mon_state_t * st) 
+{
+  ice_sched_t * s = st->sched; 
+  int * t = st->tasks; 
+  const acq_config_t * c = &st->cfg; 
+
+  //the servos step whenever the scalers are updated (servo_interval just turns them on or off). 
+  //Adaptive polling starts over from the shortest interval. 
+  st->rad_scaler_interval = c->radiant.servo.scaler_update_interval; 
+  st->rad_rate_mean_valid = 0; 
+  ice_sched_set_period(s, t[MON_RADIANT_SCALERS], st->rad_scaler_interval); 
+  ice_sched_set_period(s, t[MON_RADIANT_SERVO], c->radiant.servo.enable && c->radiant.servo.servo_interval ? 
+                                                 st->rad_scaler_interval : 0); 
+  ice_sched_set_period(s, t[MON_LT_SCALERS], flower ? c->lt.servo.scaler_update_interval : 0); 
+  ice_sched_set_period(s, t[MON_LT_SERVO], flower && c->lt.servo.enable && c->lt.servo.servo_interval ? 
+                                            c->lt.servo.scaler_update_interval : 0); 
+  ice_sched_set_period(s, t[MON_DAQSTATUS], c->output.daqstatus_interval); 
+  ice_sched_set_period(s, t[MON_SWEEP], c->calib.sweep.enable ? c->calib.sweep.step_time : 0); 
+  ice_sched_set_period(s, t[MON_STATS], c->output.print_interval); 
+}
 
-/** This is the monitor thread 
- *  This is responsible for force triggers and servoing. 
- *
- * */ 
 static void * mon_thread(void* v) 
 {
   (void) v;
 
-  //start time
-  struct timespec start; 
-  clock_gettime(CLOCK_MONOTONIC, &start); 
-
-
   //initial configuration of the calpulser 
   calpulser_configure(); 
 
-  float sweep_atten = cfg.calib.sweep.start_atten; 
-
-  float sweep_time = 0; 
-  if (cfg.calib.sweep.enable) 
-  {
-    set_calpulser_atten(sweep_atten); 
-    sweep_time = start.tv_sec + 1e-9*start.tv_nsec; 
-  }
+  static mon_state_t st; // (it's big, with the config in it) 
+  st.sched = mon_sched; 
 
-  //last monitor time 
-  double last_scalers_radiant = 0;
-  double last_scalers_lt = 0;
+  // (soft triggers have their own thread, see sw_thread) 
+  st.tasks[MON_RADIANT_SCALERS] = ice_sched_add(st.sched, "radiant-scalers", 0, 50e-3, mon_radiant_scalers, &st); 
+  st.tasks[MON_RADIANT_SERVO] = ice_sched_add(st.sched, "radiant-servo", 0, 100e-3, mon_radiant_servo, &st); 
+  st.tasks[MON_LT_SCALERS] = ice_sched_add(st.sched, "lt-scalers", 0, 50e-3, mon_lt_scalers, &st); 
+  st.tasks[MON_LT_SERVO] = ice_sched_add(st.sched, "lt-servo", 0, 100e-3, mon_lt_servo, &st); 
+  st.tasks[MON_DAQSTATUS] = ice_sched_add(st.sched, "daqstatus", 0, 100e-3, mon_daqstatus, &st); 
+  st.tasks[MON_SWEEP] = ice_sched_add(st.sched, "calpulser-sweep", 0, 1, mon_sweep, &st); 
+  st.tasks[MON_STATS] = ice_sched_add(st.sched, "stats", 0, 1, mon_stats, &st); 
 
-  //last srevo time
-  double last_servo_radiant = 0;
-  double last_servo_lt = 0;
-  
-
-  //last output time 
-  double last_daqstatus_out = 0; 
-  static int last_cfg_counter = -1; 
-
-  double next_sw_trig = -1; 
-  radiant_servo_state_t rad_servo_state = {0}; 
-  flower_servo_state_t flwr_servo_state = {0}; 
-  float flower_float_thresh[RNO_G_NUM_LT_CHANNELS]; 
-  for (int i = 0; i < RNO_G_NUM_LT_CHANNELS; i++) flower_float_thresh[i] = ds->lt_servo_thresholds[i];
-  uint32_t min_rad_thresh = 0; 
-  uint32_t max_rad_thresh = 0; 
-  uint32_t max_rad_change = 0;
+  int last_cfg_counter = -1; 
   while(!quit) 
   {
-    struct timespec now; 
-    clock_gettime(CLOCK_MONOTONIC, &now); 
-    double nowf = now.tv_sec + 1e-9 * now.tv_nsec; 
-
-    //figure out how long it's been since we got statuses and sent a sw trig
-    float diff_scalers_radiant = nowf - last_scalers_radiant;
-    float diff_scalers_lt = nowf - last_scalers_lt; 
-    float diff_servo_radiant = nowf - last_servo_radiant; 
-    float diff_servo_lt = nowf - last_servo_lt;
-    float diff_last_daqstatus_out = nowf - last_daqstatus_out; 
-    float diff_sweep = nowf - sweep_time; 
-
-
-    //re set up the RADIANT 
+    //take a new copy of the config if it changed, and re set up the servos 
     if (config_counter > last_cfg_counter) 
     {
+      pthread_rwlock_rdlock(&cfg_lock);
+      int first = last_cfg_counter < 0; 
       last_cfg_counter = config_counter; 
-      setup_radiant_servo_state(&rad_servo_state); 
-      setup_flower_servo_state(&flwr_servo_state); 
-      min_rad_thresh = cfg.radiant.thresholds.min * 16777215/2.5; 
-      max_rad_thresh = cfg.radiant.thresholds.max * 16777215/2.5; 
-      max_rad_change = cfg.radiant.servo.max_thresh_change * 16777215/2.5; 
-      for (int i = 0; i < RNO_G_NUM_LT_CHANNELS; i++) flower_float_thresh[i] = ds->lt_servo_thresholds[i];
-    }
-
-    //Hold the config read lock to avoid values getting take from underneath us
-    pthread_rwlock_rdlock(&cfg_lock);
-
-    if (next_sw_trig < 0)
-    {
-      next_sw_trig = calc_next_sw_trig(nowf); 
-    }
-    //do we need to send a soft trigger? 
-    if (cfg.radiant.trigger.soft.enabled && nowf > next_sw_trig) 
-    {
-      radiant_soft_trigger(radiant); 
-      next_sw_trig = calc_next_sw_trig(nowf); 
-    }
-
+      memcpy(&st.cfg, &cfg, sizeof(cfg)); 
+      pthread_rwlock_unlock(&cfg_lock); 
 
-    //do we need radiant scalers? 
-    if (cfg.radiant.servo.scaler_update_interval && cfg.radiant.servo.scaler_update_interval < diff_scalers_radiant)  
-    {
-      while (1) 
+      if (ice_radiant_servo_setup(&st.rad_servo, &st.cfg)) fprintf(stderr,"Could not set up the RADIANT servo\n"); 
+      ice_flower_servo_setup(&st.flwr_servo, ds->lt_servo_thresholds); 
+      mon_schedule(&st); 
+      if (first) 
       {
-        //read twice and make sure equal
-        static rno_g_daqstatus_t ds0 = {0}; 
-        memcpy(&ds0, ds, sizeof(ds0)); // copy the flower stuff so it doesn't get overwritten
-        static uint16_t scaler_check[RNO_G_NUM_RADIANT_CHANNELS]= {0}; 
-        int ok = radiant_read_daqstatus(radiant, &ds0)+ radiant_get_scalers(radiant,0,RNO_G_NUM_RADIANT_CHANNELS-1, scaler_check); 
-
-        if (ok) fprintf(stderr,"Problem reading daqstatus\n"); 
-
-        if (!memcmp(ds0.radiant_scalers, scaler_check, sizeof(ds0.radiant_scalers)))
+        st.sweep_atten = st.cfg.calib.sweep.start_atten; 
+        if (st.cfg.calib.sweep.enable) 
         {
-            memcpy(ds, &ds0, sizeof(ds0));
-            break; 
+          set_calpulser_atten(st.sweep_atten); 
+          //the first sweep step is a step_time in 
+          ice_sched_set_next(st.sched, st.tasks[MON_SWEEP], ice_sched_now() + st.cfg.calib.sweep.step_time); 
         }
-
-        printf("WARNING: Unequal sequential DAQStatus, trying again\n"); 
       }
-
-      //update the running averages for the radiant 
-      update_radiant_servo_state(&rad_servo_state, ds); 
-      last_scalers_radiant = nowf; 
     }
 
-    // do we need to servo radiant? 
-    if (cfg.radiant.servo.enable && cfg.radiant.servo.servo_interval
-        && cfg.radiant.servo.scaler_update_interval < diff_servo_radiant)  
-    {
-      for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
-      {
-         //only servo channels that are part of the trigger? 
-        if ( 0 == (radiant_trig_chan & (1 << ch))) continue; 
-
-         double dthreshold = cfg.radiant.servo.P * rad_servo_state.error[ch] + 
-                             cfg.radiant.servo.I * rad_servo_state.sum_error[ch] + 
-                             cfg.radiant.servo.D * (rad_servo_state.error[ch] - rad_servo_state.last_error[ch]); 
+    //sleep until the next thing is due. We get woken up to quit or for a new config, so the maximum is just in case. 
+    ice_sched_run(st.sched, 10); 
+  }
 
-         if (max_rad_thresh && fabs(dthreshold) > max_rad_change)
-         {
-           dthreshold = (dthreshold < 0)  ? -max_rad_change : max_rad_change; 
-         }
+  ice_servolog_close(st.servo_log); 
 
-         ds->radiant_thresholds[ch] -= dthreshold; 
-         if (ds->radiant_thresholds[ch] < min_rad_thresh)  ds->radiant_thresholds[ch] = min_rad_thresh; 
-         if (ds->radiant_thresholds[ch] > max_rad_thresh)  ds->radiant_thresholds[ch] = max_rad_thresh; 
-      }
+  //mostly to suppress warnings
+  ice_radiant_servo_free(&st.rad_servo); 
 
-      //set the thresholds
+  return 0; 
+}
 
-      radiant_set_trigger_thresholds(radiant, 0, RNO_G_NUM_RADIANT_CHANNELS-1, ds->radiant_thresholds); 
-      last_servo_radiant = nowf; 
-    }
+/** This is the soft trigger thread 
+ *
+ * Soft triggers get their own thread (at real-time priority, if we're allowed), so they go out on time rather than 
+ * whenever the mon thread gets around to them. It sleeps until the absolute time of the next trigger (see ice-sched.h), 
+ * and each trigger is scheduled from when the last one was meant to go out, not when it did, so the intervals follow 
+ * the configured distribution. Every trigger is logged (see ice-softlog.h) through sw_log_buffer, which the write 
+ * thread drains into the run directory. 
+ */ 
 
+static int sw_task; 
 
-    // do we need LT scalers? 
-    if (cfg.lt.servo.scaler_update_interval && cfg.lt.servo.scaler_update_interval < diff_scalers_lt && flower)   
-    {
-      flower_fill_daqstatus(flower, ds); 
-
-      update_flower_servo_state(&flwr_servo_state, ds); 
-      //if cycle counter is in the right realm, use it... 
-      if (ds->lt_scalers.cycle_counter > 100e6 && ds->lt_scalers.cycle_counter < 136e6) 
-      {
-        delay_clock_estimate =  ds->lt_scalers.cycle_counter/ 11.8;  //118 MHz clock vs. 10 MHz clock
-        //if we have the pps trigger out and it's not 0, let's update our estimate
-        if ((cfg.lt.trigger.enable_pps_trigger_sys_out || cfg.lt.trigger.enable_pps_trigger_sma_out) 
-            && cfg.lt.trigger.pps_trigger_delay)
-        {
-          flower_update_pps_offset(); 
-        }
-      }
-      last_scalers_lt = nowf; 
-    }
+static void sw_trigger(void * v, double deadline, double now) 
+{
+  ice_sched_t * s = v; 
 
-    // do we need to servo LT? 
+  pthread_rwlock_rdlock(&cfg_lock);
+  int enabled = cfg.radiant.trigger.soft.enabled; 
+  pthread_rwlock_unlock(&cfg_lock);
+  if (!enabled) return; 
 
-    if (cfg.lt.servo.enable && cfg.lt.servo.servo_interval
-        && cfg.lt.servo.scaler_update_interval < diff_servo_lt && flower)  
-    {
-      for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
-      {
-         double d_servo_threshold = cfg.lt.servo.P * flwr_servo_state.error[ch] + 
-                                    cfg.lt.servo.I * flwr_servo_state.sum_error[ch] + 
-                                    cfg.lt.servo.D * (flwr_servo_state.error[ch] - flwr_servo_state.last_error[ch]); 
-
-         
-         flower_float_thresh[ch] = clamp(flower_float_thresh[ch] + d_servo_threshold,4,120); 
-         ds->lt_servo_thresholds[ch] = flower_float_thresh[ch]; 
-         ds->lt_trigger_thresholds[ch] = clamp( (flower_float_thresh[ch] - cfg.lt.servo.servo_thresh_offset) / cfg.lt.servo.servo_thresh_frac, 4, 120);
-      }
+  struct timespec real; 
+  clock_gettime(CLOCK_REALTIME, &real); 
 
-      flower_set_thresholds(flower,  ds->lt_trigger_thresholds, ds->lt_servo_thresholds, 0xf); 
-      last_servo_lt = nowf; 
-    }
-    
-
-    //do we need to write out the DAQ status? 
+  pthread_rwlock_rdlock(&radiant_lock); // not while the RADIANT is being set up 
+  pthread_mutex_lock(&radiant_uart_lock); 
+  radiant_soft_trigger(radiant); 
+  __atomic_fetch_add(&radiant_uart_commands, 1, __ATOMIC_RELAXED); 
+  pthread_mutex_unlock(&radiant_uart_lock); 
+  pthread_rwlock_unlock(&radiant_lock); 
+  double end = ice_sched_now(); 
+
+  //(these saturate after a couple of seconds, which is late enough to not matter how late) 
+  double delay = now - deadline; 
+  double duration = end - now; 
+  ice_softlog_record_t rec; 
+  rec.delay_ns = delay < 2 ? delay * 1e9 : INT32_MAX; 
+  rec.duration_ns = duration < 4 ? duration * 1e9 : UINT32_MAX; 
+  rec.requested_ns = real.tv_sec * 1000000000ull + real.tv_nsec - (int64_t) (delay * 1e9); 
+  if (ice_buf_occupancy(sw_log_buffer) < ice_buf_capacity(sw_log_buffer)) ice_buf_push(sw_log_buffer, &rec); 
+
+  //the next one, from when this was meant to go out (unless we're so far behind that would be in the past already) 
+  pthread_rwlock_rdlock(&cfg_lock);
+  double next = calc_next_sw_trig(deadline); 
+  if (next < end) next = calc_next_sw_trig(end); 
+  pthread_rwlock_unlock(&cfg_lock);
+  ice_sched_set_next(s, sw_task, next); 
+}
 
-    if (cfg.output.daqstatus_interval && cfg.output.daqstatus_interval < diff_last_daqstatus_out)  
-    {
-      //make sure the station is set correctly 
-      ds->station = station_number; 
+static void * sw_thread(void * v) 
+{
+  (void) v; 
 
-      // fill in calpulser info 
-      if (!calpulser)  // just zero 
-      {
-        memset(&ds->cal,0,sizeof(ds->cal)); 
-      }
-      else
-      {
-        rno_g_cal_fill_info(calpulser, &ds->cal);
-      }
- 
-      mon_buffer_item_t * mem = ice_buf_getmem(mon_buffer); 
-      memcpy(&mem->ds,ds, sizeof(rno_g_daqstatus_t)); 
-      ice_buf_commit(mon_buffer); 
-      last_daqstatus_out = nowf; 
-    }
+  struct sched_param param = { .sched_priority = sched_get_priority_min(SCHED_FIFO) + 10 }; 
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) 
+  {
+    fprintf(stderr,"Couldn't make the soft trigger thread real-time, soft triggers may be a bit late\n"); 
+  }
 
+  ice_sched_t * s = sw_sched; 
+  sw_task = ice_sched_add(s, "soft-trigger", 0, 1e-3, sw_trigger, s); 
 
-    //do we need to change the calpulser attenuation? 
-    if (cfg.calib.sweep.enable && diff_sweep  > cfg.calib.sweep.step_time)
+  int last_cfg_counter = -1; 
+  //the soft trigger settings we're scheduling with. Only a change to these re-arms it, otherwise every config 
+  //reload would push the next soft trigger back (and with frequent reloads, it might never come) 
+  int enabled = -1, exponential = 0; 
+  float interval = 0, jitter = 0; 
+  while (!quit) 
+  {
+    if (config_counter > last_cfg_counter) 
     {
-      if (cfg.calib.sweep.stop_atten < cfg.calib.sweep.start_atten) 
-      {
-        sweep_atten -= fabs(cfg.calib.sweep.atten_step); 
-        if (sweep_atten < cfg.calib.sweep.stop_atten) sweep_atten = cfg.calib.sweep.start_atten; 
-      }
-      else
+      pthread_rwlock_rdlock(&cfg_lock);
+      last_cfg_counter = config_counter; 
+      if (cfg.radiant.trigger.soft.enabled != enabled ||
+          cfg.radiant.trigger.soft.use_exponential_distribution != exponential ||
+          cfg.radiant.trigger.soft.interval != interval ||
+          cfg.radiant.trigger.soft.interval_jitter != jitter) 
       {
-        sweep_atten += fabs(cfg.calib.sweep.atten_step); 
-        if (sweep_atten > cfg.calib.sweep.stop_atten) sweep_atten = cfg.calib.sweep.start_atten; 
+        enabled = cfg.radiant.trigger.soft.enabled; 
+        exponential = cfg.radiant.trigger.soft.use_exponential_distribution; 
+        interval = cfg.radiant.trigger.soft.interval; 
+        jitter = cfg.radiant.trigger.soft.interval_jitter; 
+        if (enabled) ice_sched_set_next(s, sw_task, calc_next_sw_trig(ice_sched_now())); 
+        else ice_sched_set_period(s, sw_task, 0); 
       }
-      set_calpulser_atten(sweep_atten);
-      sweep_time = nowf; 
+      pthread_rwlock_unlock(&cfg_lock);
     }
 
-    //release cfg lock
-    pthread_rwlock_unlock(&cfg_lock); 
-
-    float sleep_amt = 0.1; //maximum sleep amount
-    
-    //sleep less if we need to send a soft trigger sooner
-    if ( cfg.radiant.trigger.soft.enabled  && next_sw_trig - nowf < sleep_amt) sleep_amt = (next_sw_trig - nowf)*3./4; 
-
-    usleep(sleep_amt *1e6); 
+    //woken up to quit or for a new config
+    ice_sched_run(s, 10); 
   }
 
-  //mostly to suppress warnings
-  if (rad_servo_state.scaler_v_mem) free(rad_servo_state.scaler_v_mem);
-
+  ice_sched_print_stats(stdout, s, 0); 
   return 0; 
 }
 
@@ -1331,84 +1709,39 @@ static int make_dirs_for_output(const char * prefix)
   return 0; 
 }
 
-const char * tmp_suffix = ".tmp"; 
-const int tmp_suffix_len = 4; 
 
 
-int do_close(rno_g_file_handle_t h, char *path)  
+/* Set up the output directory of a run (the directories, file list, manifest, runinfo, comment, gain codes, config 
+ * and pedestals). Returns the columnar header store, if we're keeping one. The cfg read lock should be held; for the 
+ * first run, the main thread holds it for us, and we let it go once the config is written out. */ 
+static ice_hdcol_t * start_run_output(char * bigbuf, int bigbuflen, int first) 
 {
-  int ret = rno_g_close_handle(&h);   
-  int pathlen = strlen(path); 
-  
-
-  if (!strcasecmp(path + pathlen - tmp_suffix_len, tmp_suffix))
-  {
-    char * final_path = strdup(path);  
-    final_path[pathlen-tmp_suffix_len] = 0; 
-    rename(path,final_path); 
-    add_to_file_list(final_path); 
-    free(final_path); 
-  }
-  else
-  {
-    add_to_file_list(path); 
-  }
-  free(path); 
-  return ret; 
-}
-
-
-static void * wri_thread(void* v) 
-{
-  (void) v; 
-  time_t start_time = time(0); 
-  time_t last_print_out = start_time; 
-
-  int wf_file_size = 0; 
-  int ds_file_size = 0; 
-
-  int wf_file_N = 0; 
-  int ds_file_N = 0; 
-
-
-  acq_buffer_item_t acq_item;
-  mon_buffer_item_t mon_item;
-
-  char * wf_file_name = NULL; 
-  char * hd_file_name = NULL; 
-  char * ds_file_name = NULL; 
-
-  rno_g_file_handle_t wf_handle = {0};
-  rno_g_file_handle_t hd_handle = {0};
-  rno_g_file_handle_t ds_handle = {0};
-
-  time_t wf_file_time = 0; 
-  time_t ds_file_time = 0; 
-
-  int bigbuflen = strlen(cfg.output.base_dir)+512+1; 
-  char * bigbuf = calloc(bigbuflen,1); 
-
-  if (!bigbuf) 
-  {
-    fail("Could not allocate buffer... that's not good!"); 
-    return 0; 
-  }
-
-  int num_events = 0; 
-  int num_events_this_cycle = 0; 
-
-  int ds_i = 0; 
-
   //let's make the output directories
   mkdir_if_needed(output_dir); 
 
   make_dirs_for_output(output_dir); 
 
+  //the columnar header store (see ice-hdcol.h) 
+  ice_hdcol_t * hdcol = 0; 
+  if (cfg.output.header_columns) 
+  {
+    snprintf(bigbuf,bigbuflen,"%s/hdcol", output_dir); 
+    hdcol = ice_hdcol_open(bigbuf); 
+  }
+
   //open the file list 
   sprintf(bigbuf,"%s/aux/acq-file-list.txt", output_dir); 
   file_list = fopen(bigbuf, "w"); 
+  if (file_list) file_list_fd = fileno(file_list); 
   add_to_file_list(bigbuf); 
 
+  //and the manifest (checksums of the data files, see ice-manifest.h) 
+  if (!ice_manifest_create(output_dir)) 
+  {
+    snprintf(bigbuf,bigbuflen,"%s/%s", output_dir, ICE_MANIFEST_NAME); 
+    add_to_file_list(bigbuf); 
+  }
+
   //open the run info and start filling it in
   sprintf(bigbuf,"%s/aux/runinfo.txt", output_dir); 
   runinfo = fopen(bigbuf,"w"); 
@@ -1423,27 +1756,23 @@ static void * wri_thread(void* v)
     fprintf(runinfo, "RNO-G-ICE-SOFTWARE-GIT-HASH = %s\n", get_ice_software_git_hash()); 
     fprintf(runinfo, "FREE-SPACE-MB-OUTPUT-PARTITION = %f\n", output_partition_free); 
     fprintf(runinfo, "FREE-SPACE-MB-RUNFILE-PARTITION = %f\n", runfile_partition_free); 
+    //tells the copy script to hold this run back until it's compacted (see rno-g-compact-run) 
+    if (cfg.output.compact_previous_run) fprintf(runinfo, "COMPACT-TARGET-KB = %d\n", cfg.output.compact_target_kB); 
     
-    //write down radiant info to runinfo 
-    uint8_t fwmajor, fwminor, fwrev, fwyear, fwmon, fwday; 
-    radiant_get_fw_version(radiant, DEST_FPGA,  &fwmajor, &fwminor, &fwrev, &fwyear, &fwmon, &fwday); 
-    fprintf(runinfo, "RADIANT-FWVER = %02u.%02u.%02u\n", fwmajor, fwminor, fwrev); 
-    fprintf(runinfo, "RADIANT-FWDATE = 20%02u-%02u.%02u\n", fwyear, fwmon, fwday); 
-
-    radiant_get_fw_version(radiant, DEST_MANAGER,  &fwmajor, &fwminor, &fwrev, &fwyear, &fwmon, &fwday); 
-    fprintf(runinfo, "RADIANT-BM-FWVER = %02u.%02u.%02u\n", fwmajor, fwminor, fwrev); 
-    fprintf(runinfo, "RADIANT-BM-FWDATE = 20%02u-%02u.%02u\n", fwyear, fwmon, fwday); 
-
-    uint16_t sample_rate= radiant_get_sample_rate(radiant); 
-    fprintf(runinfo, "RADIANT-SAMPLERATE = %u\n", sample_rate); 
+    //write down radiant info to runinfo (read at startup, see read_hw_info) 
+    fprintf(runinfo, "RADIANT-FWVER = %02u.%02u.%02u\n", hw_info.radiant.major, hw_info.radiant.minor, hw_info.radiant.rev); 
+    fprintf(runinfo, "RADIANT-FWDATE = 20%02u-%02u.%02u\n", hw_info.radiant.year, hw_info.radiant.mon, hw_info.radiant.day); 
+
+    fprintf(runinfo, "RADIANT-BM-FWVER = %02u.%02u.%02u\n", hw_info.radiant_bm.major, hw_info.radiant_bm.minor, hw_info.radiant_bm.rev); 
+    fprintf(runinfo, "RADIANT-BM-FWDATE = 20%02u-%02u.%02u\n", hw_info.radiant_bm.year, hw_info.radiant_bm.mon, hw_info.radiant_bm.day); 
+
+    fprintf(runinfo, "RADIANT-SAMPLERATE = %u\n", hw_info.radiant_sample_rate); 
    
 
-    uint16_t flower_fwyear;
     if (flower) 
     {
-      flower_get_fwversion(flower, &fwmajor, &fwminor, &fwrev, &flower_fwyear, &fwmon, &fwday); 
-      fprintf(runinfo, "FLOWER-FWVER = %02u.%02u.%02u\n", fwmajor, fwminor, fwrev); 
-      fprintf(runinfo, "FLOWER-FWDATE = %02u-%02u.%02u\n", flower_fwyear, fwmon, fwday); 
+      fprintf(runinfo, "FLOWER-FWVER = %02u.%02u.%02u\n", hw_info.flower.major, hw_info.flower.minor, hw_info.flower.rev); 
+      fprintf(runinfo, "FLOWER-FWDATE = %02u-%02u.%02u\n", hw_info.flower.year, hw_info.flower.mon, hw_info.flower.day); 
     }
     else
     {
@@ -1457,6 +1786,16 @@ static void * wri_thread(void* v)
     fprintf(stderr,"Yikes, couldn't write to %s\n", bigbuf); 
   }
 
+  //the soft trigger log (see ice-softlog.h) 
+  snprintf(bigbuf,bigbuflen,"%s/%s", output_dir, ICE_SOFTLOG_NAME); 
+  sw_log = ice_softlog_create(bigbuf, station_number, run_number); 
+  if (sw_log) add_to_file_list(bigbuf); 
+
+  //and the daqstatus aux stream (see ice-dsaux.h) 
+  snprintf(bigbuf,bigbuflen,"%s/%s", output_dir, ICE_DSAUX_NAME); 
+  ds_aux = ice_dsaux_create(bigbuf, station_number, run_number); 
+  if (ds_aux) add_to_file_list(bigbuf); 
+
   //save comment 
   sprintf(bigbuf,"%s/aux/comment.txt",output_dir); 
   FILE * fcomment = fopen(bigbuf,"w"); 
@@ -1490,8 +1829,8 @@ static void * wri_thread(void* v)
     add_to_file_list(bigbuf); 
   }
 
-  //now we can release the cfg lock, for a bit 
-  pthread_rwlock_unlock(&cfg_lock); 
+  //now we can release the cfg lock, for a bit (after the first run, roll_over_output takes care of it) 
+  if (first) pthread_rwlock_unlock(&cfg_lock); 
 
   //if we have pedestals, write them out 
   if (pedestals) 
@@ -1511,10 +1850,148 @@ static void * wri_thread(void* v)
     {
       add_to_file_list(bigbuf); 
     }
+    did_bias_scan = 0; // only goes with the first run 
   }
 
+  return hdcol;
+}
+
+/* merge the small files of a finished run, in the background (see rno-g-compact-run). With force, the run is 
+ * compacted even without a RUN-END-TIME (for a run that died, once it's been recovered) */ 
+static void compact_run_in_background(int run, int force) 
+{
+  char * cmd = 0; 
+  asprintf(&cmd, "/rno-g/bin/rno-g-compact-run %s-s %d %s/run%d/ >> %s/run%d/aux/compact-log.txt 2>&1 &", 
+      force ? "-f " : "", cfg.output.compact_target_kB, cfg.output.base_dir, run, cfg.output.base_dir, run); 
+  system(cmd); 
+  free(cmd); 
+}
+
+/* Finish off the runinfo and file list of a run */ 
+static void finish_run_output(const struct timespec * stop_time) 
+{
+  struct timespec end_time; 
+  clock_gettime(CLOCK_REALTIME, &end_time); 
+  if (runinfo) 
+  {
+    fprintf(runinfo,"RUN-STOP-TIME = %ld.%09ld\n", stop_time->tv_sec, stop_time->tv_nsec); 
+    fprintf(runinfo,"RUN-END-TIME = %ld.%09ld\n", end_time.tv_sec, end_time.tv_nsec); 
+    fclose(runinfo);
+    runinfo = 0; 
+  }
+  if (sw_log) fclose(sw_log); 
+  sw_log = 0; 
+  if (ds_aux) fclose(ds_aux); 
+  ds_aux = 0; 
+  if (file_list) fclose(file_list); 
+  file_list = 0; 
+}
 
 
+/* Move the write thread over to the next run (acq_run_number): finish the open files and wait for the fin thread 
+ * to be done with them (and to get rid of the spares, which are in the old directories), then finish off the old 
+ * run and set up the new one. Returns the new columnar header store. */ 
+static ice_hdcol_t * roll_over_output(ice_writer_t * writer, ice_hdcol_t * hdcol, char * bigbuf, int bigbuflen) 
+{
+  if (hdcol) ice_hdcol_close(hdcol, add_to_file_list); 
+  ice_writer_drain(writer); 
+
+  int old_run = run_number; 
+  pthread_rwlock_rdlock(&cfg_lock); // always before run_lock 
+  pthread_mutex_lock(&run_lock); 
+  finish_run_output(&precise_rollover_time); 
+  run_number = acq_run_number; 
+  free(output_dir); 
+  asprintf(&output_dir, "%s/run%d/", cfg.output.base_dir, run_number); 
+  precise_start_time = precise_rollover_time; 
+  precise_acq_time = precise_rollover_time; 
+  hdcol = start_run_output(bigbuf, bigbuflen, 0); 
+  pthread_mutex_unlock(&run_lock); 
+  pthread_rwlock_unlock(&cfg_lock); 
+
+  ice_writer_set_dir(writer, output_dir); 
+
+  if (cfg.output.compact_previous_run) compact_run_in_background(old_run, 0); 
+  printf("Now writing run %d\n", run_number); 
+  return hdcol; 
+}
+
+typedef struct sw_log_stats
+{
+  int n; 
+  double total_delay; 
+  double max_delay; 
+} sw_log_stats_t; 
+
+/* Move the soft trigger records from the sw thread into the log */ 
+static void drain_sw_log(sw_log_stats_t * st) 
+{
+  ice_softlog_record_t rec; 
+  int n = 0; 
+  while (ice_buf_occupancy(sw_log_buffer)) 
+  {
+    ice_buf_pop(sw_log_buffer, &rec); 
+    if (sw_log) ice_softlog_append(sw_log, &rec); 
+    st->n++; 
+    st->total_delay += rec.delay_ns * 1e-9; 
+    if (rec.delay_ns * 1e-9 > st->max_delay) st->max_delay = rec.delay_ns * 1e-9; 
+    n++; 
+  }
+  if (n && sw_log) fflush(sw_log); 
+}
+
+static void write_run_totals(int num_events, int num_waveforms_dropped, const sw_log_stats_t * sw) 
+{
+  if (!runinfo) return; 
+  fprintf(runinfo, "TOTAL-NUMBER-OF-EVENTS-WRITTEN = %d\n", num_events);
+  if (num_waveforms_dropped) fprintf(runinfo, "WAVEFORMS-DROPPED-FOR-DISK-SPACE = %d\n", num_waveforms_dropped);
+  fprintf(runinfo, "SOFT-TRIGGERS-ISSUED = %d\n", sw->n); 
+  if (sw->n) 
+  {
+    fprintf(runinfo, "SOFT-TRIGGER-MEAN-DELAY-MS = %f\n", 1e3 * sw->total_delay / sw->n); 
+    fprintf(runinfo, "SOFT-TRIGGER-MAX-DELAY-MS = %f\n", 1e3 * sw->max_delay); 
+  }
+}
+
+static void * wri_thread(void* v) 
+{
+  (void) v; 
+  time_t start_time = time(0); 
+  time_t last_print_out = start_time; 
+  time_t last_totals = start_time; 
+
+  acq_buffer_item_t acq_item;
+  mon_buffer_item_t mon_item;
+  int have_mon_item = 0; // (for the printout: the mon thread's own ds isn't ours to read) 
+
+  int bigbuflen = strlen(cfg.output.base_dir)+512+1; 
+  char * bigbuf = calloc(bigbuflen,1); 
+
+  if (!bigbuf) 
+  {
+    fail("Could not allocate buffer... that's not good!"); 
+    return 0; 
+  }
+
+  int num_events = 0; 
+  int num_events_this_cycle = 0; 
+  int num_waveforms_dropped = 0; 
+  int num_idle_wakeups_this_cycle = 0; 
+  sw_log_stats_t sw_stats = {0}; 
+
+  ice_hdcol_t * hdcol = start_run_output(bigbuf, bigbuflen, 1); 
+
+  //this starts up the fin thread, which does the slow parts of file rotation. It works from its own copy of the config. 
+  pthread_rwlock_rdlock(&cfg_lock); 
+  int writer_cfg_counter = config_counter; 
+  ice_writer_t * writer = ice_writer_open(&cfg, output_dir, add_to_file_list); 
+  pthread_rwlock_unlock(&cfg_lock); 
+  if (!writer) 
+  {
+    fail("Could not start the output writer"); 
+    return 0; 
+  }
+
   while (1) 
   {
     time_t now; 
@@ -1523,19 +2000,51 @@ static void * wri_thread(void* v)
     int have_data = 0; 
     int have_status = 0; 
 
+    //check for a rollover before looking at the buffer, so that if there's a new run, we know we've seen everything from the old one
+    int next_run = acq_run_number; 
+    __sync_synchronize(); 
+
     int acq_occupancy = ice_buf_occupancy(acq_buffer); 
     if (acq_occupancy)
     {
       ice_buf_pop(acq_buffer, &acq_item); 
+      have_data = 1; 
+    }
+
+    drain_sw_log(&sw_stats); 
+
+    //hand the writer a new copy of the config if it changed 
+    if (config_counter != writer_cfg_counter) 
+    {
+      pthread_rwlock_rdlock(&cfg_lock); 
+      writer_cfg_counter = config_counter; 
+      ice_writer_set_config(writer, &cfg); 
+      pthread_rwlock_unlock(&cfg_lock); 
+    }
+
+    // on to the next run once we get its first event (or run out of events from this one) 
+    if (next_run != run_number && (have_data ? acq_item.hd.run_number == (uint32_t) next_run : !quit)) 
+    {
+      write_run_totals(num_events, num_waveforms_dropped, &sw_stats); 
+      hdcol = roll_over_output(writer, hdcol, bigbuf, bigbuflen); 
+      start_time = now; 
+      num_events = 0; 
+      num_waveforms_dropped = 0; 
+      memset(&sw_stats, 0, sizeof(sw_stats)); 
+    }
+
+    if (have_data) 
+    {
       num_events++; 
       num_events_this_cycle++; 
-      have_data = 1; 
+      __atomic_fetch_add(&metrics_counters.events_written, 1, __ATOMIC_RELAXED); 
     }
 
     if (ice_buf_occupancy(mon_buffer))
     {
       ice_buf_pop(mon_buffer, &mon_item); 
       have_status = 1; 
+      have_mon_item = 1; 
     }
 
 
@@ -1545,11 +2054,30 @@ static void * wri_thread(void* v)
       printf("  total events written: %d\n", num_events); 
       printf("  write rate:  %g Hz\n", (num_events == 0) ? 0. :  ((float) num_events_this_cycle) / (now - last_print_out)); 
       printf("  write buffer occupancy: %d/%d\n", acq_occupancy , cfg.runtime.acq_buf_size); 
+      printf("  idle wakeups: %g Hz\n", ((float) num_idle_wakeups_this_cycle) / (now - last_print_out)); 
+      ice_writer_stats_t rotation_stats; 
+      ice_writer_get_stats(writer, &rotation_stats, 1); 
+      printf("  max file rotation stall: %g ms\n", rotation_stats.max_stall * 1e3); 
+      if (rotation_stats.nfailed_opens) printf("  !!! could not open %d output files, %d records dropped\n", rotation_stats.nfailed_opens, rotation_stats.ndropped); 
+      if (degrade_tier) printf("  degradation tier: %d (%d waveforms dropped)\n", degrade_tier, num_waveforms_dropped); 
+      if (sw_stats.n) printf("  soft triggers: %d, delay mean %g ms / max %g ms\n", sw_stats.n, 1e3 * sw_stats.total_delay / sw_stats.n, 1e3 * sw_stats.max_delay); 
       num_events_this_cycle = 0; 
-      rno_g_daqstatus_dump(stdout, ds); 
+      num_idle_wakeups_this_cycle = 0; 
+      if (have_mon_item) rno_g_daqstatus_dump(stdout, &mon_item.ds); // the latest one we got 
       last_print_out = now; 
     }
 
+    //the file totals, for the metrics 
+    if (metrics && now != last_totals) 
+    {
+      ice_writer_totals_t totals; 
+      ice_writer_get_totals(writer, &totals); 
+      __atomic_store_n(&metrics_counters.files.nfiles, totals.nfiles, __ATOMIC_RELAXED); 
+      __atomic_store_n(&metrics_counters.files.compressed_bytes, totals.compressed_bytes, __ATOMIC_RELAXED); 
+      __atomic_store_n(&metrics_counters.files.uncompressed_bytes, totals.uncompressed_bytes, __ATOMIC_RELAXED); 
+      last_totals = now; 
+    }
+
     //feed the watchdog in the write thread, since it might wait longer at the end
     if (now - last_watchdog > 10) 
     {
@@ -1560,14 +2088,17 @@ static void * wri_thread(void* v)
     {
       if (quit) 
       {
-      if (wf_file_name) do_close(wf_handle, wf_file_name); 
-      if (hd_file_name) do_close(hd_handle, hd_file_name); 
-      if (ds_file_name) do_close(ds_handle, ds_file_name); 
+        if (hdcol) ice_hdcol_close(hdcol, add_to_file_list); 
+        ice_writer_close(writer); 
         break; 
       }
 
-      //no data, so sleep a bit 
-      usleep(50000); 
+      //no data, so sleep until there is some (or we're told to quit). 
+      //Don't sleep too long, we still need to feed the watchdog and print things out.  
+      if (!ice_buf_wait_group_wait(wri_wait, 1)) 
+      {
+        num_idle_wakeups_this_cycle++; 
+      }
     }
 
     else
@@ -1576,80 +2107,181 @@ static void * wri_thread(void* v)
 
       if (have_data) 
       {
-        if ( !wf_file_name || 
-             (cfg.output.max_kB_per_file > 0  &&  wf_file_size >= cfg.output.max_kB_per_file) ||
-             (cfg.output.max_events_per_file > 0 && wf_file_N >= cfg.output.max_events_per_file) ||
-             (cfg.output.max_seconds_per_file > 0 && now - wf_file_time >= cfg.output.max_seconds_per_file ) )
+        //short on space, so squeeze harder (from the next file on) 
+        ice_writer_set_compress_harder(writer, degrade_tier >= DEGRADE_COMPRESS); 
+
+        //if we're short on space, waveforms go first (forced triggers, then everything) 
+        int tier = degrade_tier; 
+        int drop_wf = tier >= DEGRADE_HEADERS_ONLY || 
+                      (tier >= DEGRADE_DROP_FORCED && (acq_item.hd.trigger_type & (RNO_G_TRIGGER_SOFT | RNO_G_TRIGGER_PPS))); 
+        if (drop_wf) 
         {
-          if (wf_file_name) do_close(wf_handle, wf_file_name); 
-
-           snprintf(bigbuf,bigbuflen,"%s/waveforms/%06u.wf.dat.gz%s", output_dir, acq_item.hd.event_number, tmp_suffix ); 
-           wf_handle.type = RNO_G_GZIP; 
-           wf_handle.handle.gz = gzopen(bigbuf,"w"); 
-           gzsetparams(wf_handle.handle.gz,3,Z_FILTERED); 
-
-           wf_file_name = strdup(bigbuf); 
-           wf_file_size = 0; 
-           wf_file_N = 0; 
-           wf_file_time = now; 
-
-
-           if (hd_file_name) do_close(hd_handle, hd_file_name); 
-           snprintf(bigbuf,bigbuflen,"%s/header/%06u.hd.dat.gz%s", output_dir, acq_item.hd.event_number, tmp_suffix ); 
-           hd_handle.type = RNO_G_GZIP; 
-           hd_handle.handle.gz = gzopen(bigbuf,"w"); 
-           hd_file_name = strdup(bigbuf); 
+          num_waveforms_dropped++; 
+          __atomic_fetch_add(&metrics_counters.waveforms_dropped, 1, __ATOMIC_RELAXED); 
         }
 
-        wf_file_size += rno_g_waveform_write(wf_handle, &acq_item.wf); 
-        rno_g_header_write(hd_handle, &acq_item.hd); 
-        wf_file_N++; 
+        //the header file rotated, so the header columns catch up too 
+        if (ice_writer_event(writer, &acq_item.hd, &acq_item.wf, !drop_wf) && hdcol) ice_hdcol_flush(hdcol); 
+        if (hdcol) ice_hdcol_append(hdcol, &acq_item.hd); 
       }
 
       if (have_status) 
       {
-        if ( !ds_file_name || 
-             (cfg.output.max_kB_per_file > 0  &&  ds_file_size >= cfg.output.max_kB_per_file) ||
-             (cfg.output.max_daqstatuses_per_file > 0 && ds_file_N >= cfg.output.max_daqstatuses_per_file) ||
-             (cfg.output.max_seconds_per_file > 0 && now - ds_file_time >= cfg.output.max_seconds_per_file ) )
-       
-        {
+        if (shared_ds) ice_dsshm_publish(shared_ds, &mon_item.ds); 
+        if (shared_ds_history) ice_dshist_append(shared_ds_history, &mon_item.ds); 
 
-      
-          if (ds_file_name) do_close(ds_handle, ds_file_name); 
-          snprintf(bigbuf,bigbuflen,"%s/daqstatus/%05d.ds.dat.gz%s", output_dir, ds_i, tmp_suffix ); 
-          ds_handle.type = RNO_G_GZIP; 
-          ds_handle.handle.gz = gzopen(bigbuf,"w"); 
-          ds_file_name = strdup(bigbuf); 
-          ds_file_size = 0; 
-          ds_file_N = 0; 
-          ds_file_time = now; 
+        ice_writer_daqstatus(writer, &mon_item.ds); 
+        if (ds_aux) 
+        {
+          ice_dsaux_append(ds_aux, &mon_item.aux); 
+          fflush(ds_aux); 
         }
+        __atomic_fetch_add(&metrics_counters.daqstatus_written, 1, __ATOMIC_RELAXED); 
+      }
+    }
+  }
 
-        memcpy(ds, &mon_item.ds, sizeof(rno_g_daqstatus_t)); 
+  drain_sw_log(&sw_stats); 
+  write_run_totals(num_events, num_waveforms_dropped, &sw_stats); 
 
-        if (shared_ds_fd) msync(ds, sizeof(rno_g_daqstatus_t), MS_ASYNC); 
+  return 0; 
+}
 
 
-        ds_file_size+= rno_g_daqstatus_write(ds_handle, &mon_item.ds); 
-        ds_file_N++; 
-        ds_i++; 
-      }
-    }
+/** The metrics (see ice-metrics.h). 
+ *
+ * These run in the metrics thread and only look at metrics_counters, the buffer occupancies and the shared 
+ * daqstatus (which has its own seqlock), so they never need any of our locks. 
+ **/ 
 
-    if ((int) ice_buf_occupancy(acq_buffer) < cfg.runtime.acq_buf_size /3)
-    {
-      usleep(25000); 
-    }
+//only touched by the metrics thread 
+static struct 
+{
+  double last_time; 
+  uint64_t last_events; 
+  uint64_t last_live_ns; 
+  double write_rate; 
+  double livetime; 
+} metrics_rates = { .write_rate = NAN, .livetime = NAN }; 
+
+static void metrics_tick(double now, void * arg) 
+{
+  (void) arg; 
+  uint64_t events = __atomic_load_n(&metrics_counters.events_written, __ATOMIC_RELAXED); 
+  uint64_t live_ns = __atomic_load_n(&metrics_counters.acq_live_ns, __ATOMIC_RELAXED); 
 
+  if (metrics_rates.last_time > 0) 
+  {
+    double dt = now - metrics_rates.last_time; 
+    metrics_rates.write_rate = (events - metrics_rates.last_events) / dt; 
+    metrics_rates.livetime = 1e-9 * (live_ns - metrics_rates.last_live_ns) / dt; 
+    if (metrics_rates.livetime > 1) metrics_rates.livetime = 1; // a poll can straddle two ticks 
   }
 
-  if (runinfo)
+  metrics_rates.last_time = now; 
+  metrics_rates.last_events = events; 
+  metrics_rates.last_live_ns = live_ns; 
+}
+
+static void metrics_one(FILE * f, const char * name, const char * type, const char * help, double value) 
+{
+  ice_metrics_describe(f, name, type, help); 
+  ice_metrics_sample(f, name, 0, value); 
+}
+
+#define METRICS_COUNTER(name, help, field) metrics_one(f, name, "counter", help, __atomic_load_n(&metrics_counters.field, __ATOMIC_RELAXED))
+
+static void metrics_render(FILE * f, void * arg) 
+{
+  (void) arg; 
+  char labels[64]; 
+
+  ice_metrics_describe(f, "rno_g_acq_info", "gauge", "Which station and run this is"); 
+  snprintf(labels, sizeof(labels), "station=\"%d\",run=\"%d\"", station_number, run_number); 
+  ice_metrics_sample(f, "rno_g_acq_info", labels, 1); 
+
+  METRICS_COUNTER("rno_g_acq_events_acquired_total", "Events read out from the RADIANT", events_acquired); 
+  METRICS_COUNTER("rno_g_acq_events_written_total", "Events written out", events_written); 
+  METRICS_COUNTER("rno_g_acq_waveforms_dropped_total", "Waveforms not written to save disk space", waveforms_dropped); 
+  METRICS_COUNTER("rno_g_acq_daqstatus_written_total", "Daqstatuses written out", daqstatus_written); 
+  METRICS_COUNTER("rno_g_acq_files_written_total", "Output files finished", files.nfiles); 
+  METRICS_COUNTER("rno_g_acq_bytes_written_total", "Compressed size of the finished output files", files.compressed_bytes); 
+  METRICS_COUNTER("rno_g_acq_bytes_uncompressed_total", "What went into the finished output files, before compression", files.uncompressed_bytes); 
+  metrics_one(f, "rno_g_acq_live_seconds_total", "counter", "Time the acquisition thread has spent ready for a trigger", 
+              1e-9 * __atomic_load_n(&metrics_counters.acq_live_ns, __ATOMIC_RELAXED)); 
+
+  uint64_t compressed = __atomic_load_n(&metrics_counters.files.compressed_bytes, __ATOMIC_RELAXED); 
+  uint64_t uncompressed = __atomic_load_n(&metrics_counters.files.uncompressed_bytes, __ATOMIC_RELAXED); 
+  metrics_one(f, "rno_g_acq_compression_ratio", "gauge", "Uncompressed over compressed size of the finished output files", 
+              compressed ? (double) uncompressed / compressed : NAN); 
+  metrics_one(f, "rno_g_acq_write_rate_hz", "gauge", "Events written per second (over the last 10 s)", metrics_rates.write_rate); 
+  metrics_one(f, "rno_g_acq_livetime_fraction", "gauge", "Fraction of the time the acquisition thread was ready for a trigger (over the last 10 s)", metrics_rates.livetime); 
+  metrics_one(f, "rno_g_acq_degrade_tier", "gauge", "How much output is being given up for disk space (0 is none)", degrade_tier); 
+
+  ice_metrics_describe(f, "rno_g_acq_buffer_occupancy", "gauge", "Items waiting in the ring buffers"); 
+  ice_metrics_sample(f, "rno_g_acq_buffer_occupancy", "buffer=\"acq\"", ice_buf_occupancy(acq_buffer)); 
+  ice_metrics_sample(f, "rno_g_acq_buffer_occupancy", "buffer=\"mon\"", ice_buf_occupancy(mon_buffer)); 
+  ice_metrics_describe(f, "rno_g_acq_buffer_capacity", "gauge", "Size of the ring buffers"); 
+  ice_metrics_sample(f, "rno_g_acq_buffer_capacity", "buffer=\"acq\"", ice_buf_capacity(acq_buffer)); 
+  ice_metrics_sample(f, "rno_g_acq_buffer_capacity", "buffer=\"mon\"", ice_buf_capacity(mon_buffer)); 
+
+  float output_free, runfile_free; 
+  __atomic_load(&metrics_counters.output_free_MB, &output_free, __ATOMIC_RELAXED); 
+  __atomic_load(&metrics_counters.runfile_free_MB, &runfile_free, __ATOMIC_RELAXED); 
+  ice_metrics_describe(f, "rno_g_acq_free_space_megabytes", "gauge", "Free space on the output and runfile partitions"); 
+  ice_metrics_sample(f, "rno_g_acq_free_space_megabytes", "partition=\"output\"", output_free); 
+  ice_metrics_sample(f, "rno_g_acq_free_space_megabytes", "partition=\"runfile\"", runfile_free); 
+
+  //the rest comes from the latest daqstatus the write thread published 
+  rno_g_daqstatus_t st; 
+  uint64_t update_time_ns; 
+  if (!shared_ds || ice_dsshm_read(shared_ds, &st, 0, &update_time_ns) || !update_time_ns) return; 
+
+  struct timespec now; 
+  clock_gettime(CLOCK_REALTIME, &now); 
+  metrics_one(f, "rno_g_daqstatus_age_seconds", "gauge", "How long ago the latest daqstatus was published", 
+              now.tv_sec - 1e-9 * update_time_ns + 1e-9 * now.tv_nsec); 
+
+  float period = st.radiant_scaler_period ?: 1; 
+  ice_metrics_describe(f, "rno_g_radiant_scaler_rate_hz", "gauge", "RADIANT trigger scaler rate (prescaling undone)"); 
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
   {
-    fprintf(runinfo, "TOTAL-NUMBER-OF-EVENTS-WRITTEN = %d\n", num_events);
+    snprintf(labels, sizeof(labels), "channel=\"%d\"", ch); 
+    ice_metrics_sample(f, "rno_g_radiant_scaler_rate_hz", labels, st.radiant_scalers[ch] * (1 + st.radiant_prescalers[ch]) / period); 
+  }
+  ice_metrics_describe(f, "rno_g_radiant_threshold_volts", "gauge", "RADIANT trigger thresholds"); 
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+  {
+    snprintf(labels, sizeof(labels), "channel=\"%d\"", ch); 
+    ice_metrics_sample(f, "rno_g_radiant_threshold_volts", labels, st.radiant_thresholds[ch] * 2.5 / 16777215); 
   }
 
-  return 0; 
+  if (!flower) return; 
+
+  ice_metrics_describe(f, "rno_g_flower_servo_rate_hz", "gauge", "Flower servo scalers (1 Hz)"); 
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+  {
+    snprintf(labels, sizeof(labels), "channel=\"%d\"", ch); 
+    ice_metrics_sample(f, "rno_g_flower_servo_rate_hz", labels, st.lt_scalers.s_1Hz.servo_per_chan[ch]); 
+  }
+  ice_metrics_describe(f, "rno_g_flower_trigger_rate_hz", "gauge", "Flower trigger scalers (1 Hz)"); 
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+  {
+    snprintf(labels, sizeof(labels), "channel=\"%d\"", ch); 
+    ice_metrics_sample(f, "rno_g_flower_trigger_rate_hz", labels, st.lt_scalers.s_1Hz.trig_per_chan[ch]); 
+  }
+  ice_metrics_describe(f, "rno_g_flower_servo_threshold", "gauge", "Flower servo thresholds (ADC counts)"); 
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+  {
+    snprintf(labels, sizeof(labels), "channel=\"%d\"", ch); 
+    ice_metrics_sample(f, "rno_g_flower_servo_threshold", labels, st.lt_servo_thresholds[ch]); 
+  }
+  ice_metrics_describe(f, "rno_g_flower_trigger_threshold", "gauge", "Flower trigger thresholds (ADC counts)"); 
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+  {
+    snprintf(labels, sizeof(labels), "channel=\"%d\"", ch); 
+    ice_metrics_sample(f, "rno_g_flower_trigger_threshold", labels, st.lt_trigger_thresholds[ch]); 
+  }
 }
 
 
@@ -1675,11 +2307,56 @@ void fail(const char * why)
   please_stop(); 
 }
 
+/* Write the next run number to the runfile (atomically). Returns 0 on success */ 
+static int update_runfile(int next_run) 
+{
+  char * tmp_run_file = 0;
+  asprintf(&tmp_run_file, "%s.tmp", cfg.output.runfile); 
+  FILE * frun = fopen(tmp_run_file,"w"); 
+  int ret = 0; 
+  if (!frun) 
+  {
+    fprintf(stderr,"Could not open temporary run file: %s\n", tmp_run_file); 
+    ret = 1; 
+  }
+  else if ( 0 > fprintf(frun,"%d\n", next_run) || 0 != fclose(frun))
+  {
+    fprintf(stderr,"Problem writing temporary run file %s\n", tmp_run_file); 
+    ret = 1; 
+  }
+  else if (rename(tmp_run_file, cfg.output.runfile))
+  {
+    fprintf(stderr,"Problem moving %s to %s\n", tmp_run_file, cfg.output.runfile); 
+    ret = 1; 
+  }
+  free(tmp_run_file); 
+  return ret; 
+}
+
+/* Reads what goes in hw_info. Only called before the other threads are started. */ 
+static void read_hw_info() 
+{
+  uint8_t year; 
+  radiant_get_fw_version(radiant, DEST_FPGA, &hw_info.radiant.major, &hw_info.radiant.minor, &hw_info.radiant.rev, 
+                         &year, &hw_info.radiant.mon, &hw_info.radiant.day); 
+  hw_info.radiant.year = year; 
+  radiant_get_fw_version(radiant, DEST_MANAGER, &hw_info.radiant_bm.major, &hw_info.radiant_bm.minor, &hw_info.radiant_bm.rev, 
+                         &year, &hw_info.radiant_bm.mon, &hw_info.radiant_bm.day); 
+  hw_info.radiant_bm.year = year; 
+  hw_info.radiant_sample_rate = radiant_get_sample_rate(radiant); 
+
+  if (flower) 
+  {
+    flower_get_fwversion(flower, &hw_info.flower.major, &hw_info.flower.minor, &hw_info.flower.rev, 
+                         &hw_info.flower.year, &hw_info.flower.mon, &hw_info.flower.day); 
+  }
+}
+
 static int initial_setup() 
 {
   /** Initialize config lock and try to read the config */ 
   pthread_rwlock_init(&cfg_lock,NULL); 
-  read_config(); 
+  read_config(0); 
 
   // Check that there is sufficient free space before proceeding any farther; 
 
@@ -1763,6 +2440,27 @@ static int initial_setup()
     }
   }
 
+  //pick up the pieces if previous runs didn't end cleanly (see ice-recover.h) 
+  for (int i = 1; i <= cfg.output.recover_previous_runs && i <= run_number; i++) 
+  {
+    char * prev_dir = 0; 
+    asprintf(&prev_dir, "%s/run%d/", cfg.output.base_dir, run_number - i); 
+    if (!access(prev_dir, F_OK)) 
+    {
+      ice_recover_stats_t recovered = {0}; 
+      ice_recover_run(prev_dir, 0, &recovered); 
+      if (recovered.nrecovered || recovered.nfailed) 
+      {
+        fprintf(stderr,"Recovered %d files (%d unrecoverable) in %s\n", recovered.nrecovered, recovered.nfailed, prev_dir); 
+      }
+    }
+    free(prev_dir); 
+  }
+
+  //merge the small files of the previous run in the background, if asked to (see rno-g-compact-run). It's not ours, 
+  //so it's finished whether or not it got a RUN-END-TIME (and it's been recovered above, if that was needed) 
+  if (cfg.output.compact_previous_run && run_number > 0) compact_run_in_background(run_number - 1, 1); 
+
   //make sure calpulser is turned off (in case we didn't exit cleanly!) since we don't want it on during pedestal taking and such 
   rno_g_cal_disable_no_handle(cfg.calib.gpio); 
 
@@ -1770,37 +2468,31 @@ static int initial_setup()
   int need_to_copy_lt_thresholds = 1; 
   //open the shared status file, if it's there. 
   //need to do this before opening the radiant/flower since we need to laod thresholds, potentially 
+  ds = calloc(sizeof(rno_g_daqstatus_t),1); 
   if (cfg.runtime.status_shmem_file && *cfg.runtime.status_shmem_file) 
   {
-    shared_ds_fd = open(cfg.runtime.status_shmem_file, O_CREAT | O_RDWR,0755);
+    int have_last = 0; 
+    shared_ds = ice_dsshm_create(cfg.runtime.status_shmem_file, ds, &have_last); 
 
-    if (shared_ds_fd <= 0) 
+    if (!shared_ds) 
     {
-      fprintf(stderr, "Could not open %s\n", cfg.runtime.status_shmem_file); 
-      shared_ds_fd = 0; 
+      fprintf(stderr, "Could not set up the shared daqstatus in %s\n", cfg.runtime.status_shmem_file); 
     }
     else
     {
-       size_t file_size = lseek(shared_ds_fd,0,SEEK_END); 
-       lseek(shared_ds_fd,0,SEEK_SET); 
-       if (file_size != sizeof(rno_g_daqstatus_t))
-       {
-         ftruncate(shared_ds_fd, sizeof(rno_g_daqstatus_t)); 
-       }
-
-       ds = mmap(0, sizeof(rno_g_daqstatus_t), PROT_READ | PROT_WRITE, MAP_SHARED, shared_ds_fd,0); 
-
-       if (cfg.radiant.thresholds.load_from_threshold_file && file_size == sizeof(rno_g_daqstatus_t)) 
+       if (cfg.radiant.thresholds.load_from_threshold_file && have_last) 
          need_to_copy_radiant_thresholds = 0; 
 
-       if (cfg.lt.thresholds.load_from_threshold_file && file_size == sizeof(rno_g_daqstatus_t)) 
+       if (cfg.lt.thresholds.load_from_threshold_file && have_last) 
          need_to_copy_lt_thresholds = 0; 
     }
   }
 
-  if (!shared_ds_fd) 
+  if (cfg.runtime.status_history_file && *cfg.runtime.status_history_file && cfg.runtime.status_history_seconds > 0) 
   {
-    ds = calloc(sizeof(rno_g_daqstatus_t),1); 
+    float interval = cfg.output.daqstatus_interval > 0 ? cfg.output.daqstatus_interval : 1; 
+    shared_ds_history = ice_dshist_create(cfg.runtime.status_history_file, ceil(cfg.runtime.status_history_seconds / interval)); 
+    if (!shared_ds_history) fprintf(stderr, "Could not set up the daqstatus history in %s\n", cfg.runtime.status_history_file); 
   }
 
   if (need_to_copy_radiant_thresholds) 
@@ -1820,11 +2512,17 @@ static int initial_setup()
         clamp(cfg.lt.thresholds.initial[i] * cfg.lt.servo.servo_thresh_frac + cfg.lt.servo.servo_thresh_offset, 0, 255); 
     }
   }
-  pthread_rwlock_init(&ds_lock,NULL); 
 
   //initialize the radiant lock
   pthread_rwlock_init(&radiant_lock,NULL); 
 
+  //and the UART one, which inherits priority (the sw thread is SCHED_FIFO, the mon thread isn't) 
+  pthread_mutexattr_t uart_attr; 
+  pthread_mutexattr_init(&uart_attr); 
+  pthread_mutexattr_setprotocol(&uart_attr, PTHREAD_PRIO_INHERIT); 
+  pthread_mutex_init(&radiant_uart_lock, &uart_attr); 
+  pthread_mutexattr_destroy(&uart_attr); 
+
   // When it is time to do a bias scan record the timing before setting up the radiant
   if (cfg.radiant.timing_recording.enable && ((cfg.radiant.timing_recording.skip_runs < 2) ||
       ((run_number % cfg.radiant.timing_recording.skip_runs) == 0)))
@@ -1882,32 +2580,16 @@ static int initial_setup()
   if (flower_initial_setup() && cfg.lt.device.required) return 1; 
   feed_watchdog(0); 
 
+  //no other threads yet, so no locks needed 
+  read_hw_info(); 
+
   //update the run file 
   if (frun) 
   {
     fclose(frun); 
-
-
-    char * tmp_run_file = 0;
-    asprintf(&tmp_run_file, "%s.tmp", cfg.output.runfile); 
-    frun = fopen(tmp_run_file,"w"); 
-    if (!frun) 
-    {
-      fprintf(stderr,"Could not open temporary run file: %s\n", tmp_run_file); 
-      return 1; 
-    }
-    if ( 0 > fprintf(frun,"%d\n", run_number+1) || 0 != fclose(frun))
-    {
-      fprintf(stderr,"Problem writing temporary run file %s\n", tmp_run_file); 
-      return 1; 
-    }
-    if (rename(tmp_run_file, cfg.output.runfile))
-    {
-      fprintf(stderr,"Problem moving %s to %s\n", tmp_run_file, cfg.output.runfile); 
-      return 1; 
-    }
-    free(tmp_run_file); 
+    if (update_runfile(run_number+1)) return 1; 
   }
+  acq_run_number = run_number; 
 
  
   //set up signal handlers 
@@ -1924,11 +2606,39 @@ static int initial_setup()
   //initialize the buffers 
   acq_buffer = ice_buf_init(cfg.runtime.acq_buf_size, sizeof(acq_buffer_item_t)); 
   mon_buffer = ice_buf_init(cfg.runtime.mon_buf_size, sizeof(mon_buffer_item_t)); 
+  sw_log_buffer = ice_buf_init(1024, sizeof(ice_softlog_record_t)); 
+  wri_wait = ice_buf_wait_group_init(); 
+  if (!acq_buffer || !mon_buffer || !sw_log_buffer || !wri_wait) 
+  {
+    fprintf(stderr,"Could not set up the buffers between the threads\n"); 
+    return 1; 
+  }
+  ice_buf_wait_group_add(wri_wait, acq_buffer); 
+  ice_buf_wait_group_add(wri_wait, mon_buffer); 
+
+  //the mon and sw threads' schedulers (before the threads, so they can be woken up from the start) 
+  mon_sched = ice_sched_init(); 
+  sw_sched = ice_sched_init(); 
+  if (!mon_sched || !sw_sched) 
+  {
+    fprintf(stderr,"Could not set up the monitor and soft trigger schedulers\n"); 
+    return 1; 
+  }
+
+  //the metrics thread only reads things, so it can start first 
+  if ((cfg.runtime.metrics_socket && *cfg.runtime.metrics_socket) || cfg.runtime.metrics_port > 0) 
+  {
+    metrics = ice_metrics_start(cfg.runtime.metrics_socket, cfg.runtime.metrics_port, metrics_render, metrics_tick, METRICS_TICK_INTERVAL, 0); 
+    if (!metrics) fprintf(stderr,"Could not start the metrics endpoint\n"); 
+  }
+
+  update_cfg_watch(); 
 
   //now let's make the threads
   clock_gettime(CLOCK_REALTIME, &precise_acq_time);
   pthread_create(&the_acq_thread,NULL, acq_thread, NULL); 
   pthread_create(&the_mon_thread,NULL, mon_thread, NULL); 
+  pthread_create(&the_sw_thread,NULL, sw_thread, NULL); 
   feed_watchdog(0); 
 
   //hold the cfg lock until the write thread is done writing the config 
@@ -1942,11 +2652,161 @@ static int initial_setup()
 
 
 
+/** Graceful degradation 
+ *
+ * Rather than stopping the run as soon as the output partition gets low (and losing everything until there's space again), 
+ * we give things up in steps: compress harder, then stop writing waveforms for forced (soft/PPS) triggers, then stop writing 
+ * waveforms at all. Each step is taken when the free space, or the forecast of it (from the recent fill rate), drops below 
+ * its threshold, and undone (one at a time) once there's hysteresis_MB more than that. Stopping the run below 
+ * min_free_space_MB_output_partition is the last resort. 
+ *
+ * The changes go into aux/degradation-log.txt, so it's clear afterwards what was shed. 
+ */ 
+
+static const char * degrade_tier_names[NUM_DEGRADE_TIERS] = {"normal","compress-harder","drop-forced-waveforms","headers-only"}; 
+
+static void update_degradation(double MBfree) 
+{
+  static struct timespec last_sample; 
+  static double last_free = -1; 
+  static double fill_rate = 0; // MB/s, positive when filling up 
+  static int have_rate = 0; 
+
+  struct timespec now; 
+  clock_gettime(CLOCK_MONOTONIC_COARSE,&now); 
+  if (last_free < 0) 
+  {
+    last_sample = now; 
+    last_free = MBfree; 
+  }
+  else
+  {
+    //sample the rate every so often (statvfs is too coarse to do this every time) and smooth it 
+    double dt = timespec_difference(&now, &last_sample); 
+    if (dt >= 10) 
+    {
+      double rate = (last_free - MBfree) / dt; 
+      fill_rate = have_rate ? 0.9 * fill_rate + 0.1 * rate : rate; 
+      have_rate = 1; 
+      last_free = MBfree; 
+      last_sample = now; 
+    }
+  }
+
+  if (!cfg.output.degrade.enable) 
+  {
+    degrade_tier = DEGRADE_NONE; 
+    return; 
+  }
+
+  //the file list (and aux directory) have to be there for us to log anything 
+  if (!file_list) return; 
+
+  double forecast = MBfree; 
+  if (cfg.output.degrade.forecast_seconds > 0 && fill_rate > 0) forecast -= fill_rate * cfg.output.degrade.forecast_seconds; 
+
+  int thresholds[NUM_DEGRADE_TIERS] = { 0, cfg.output.degrade.compress_below_MB, 
+                                        cfg.output.degrade.drop_forced_below_MB, cfg.output.degrade.headers_only_below_MB }; 
+  int tier = degrade_tier; 
+  while (tier + 1 < NUM_DEGRADE_TIERS && forecast < thresholds[tier+1]) tier++; 
+  if (tier == degrade_tier && tier > DEGRADE_NONE && forecast > thresholds[tier] + cfg.output.degrade.hysteresis_MB) tier--; 
+  if (tier == degrade_tier) return; 
+
+  fprintf(stderr,"Output partition has %.0f MB free (forecast %.0f MB in %d s), going from %s to %s\n", MBfree, forecast, 
+          cfg.output.degrade.forecast_seconds, degrade_tier_names[degrade_tier], degrade_tier_names[tier]); 
+
+  //into the current run's log (which may be switching over under us) 
+  pthread_mutex_lock(&run_lock); 
+  char * path = 0; 
+  asprintf(&path, "%s/aux/degradation-log.txt", output_dir); 
+  int is_new = access(path, F_OK); 
+  FILE * log = fopen(path, "a"); 
+  if (log) 
+  {
+    struct timespec wall; 
+    clock_gettime(CLOCK_REALTIME, &wall); 
+    if (is_new) fprintf(log, "# time tier name free_MB forecast_MB fill_rate_MB_per_hour\n"); 
+    fprintf(log, "%ld.%03ld %d %s %.0f %.0f %.1f\n", wall.tv_sec, wall.tv_nsec / 1000000, tier, degrade_tier_names[tier], 
+            MBfree, forecast, fill_rate * 3600); 
+    fclose(log); 
+    if (is_new && file_list) add_to_file_list(path); 
+  }
+  free(path); 
+  pthread_mutex_unlock(&run_lock); 
+
+  degrade_tier = tier; 
+}
+
+/** Run rollover 
+ *
+ * Instead of exiting after seconds_per_run (and paying for reopening the devices, pedestals, equalization and so on when 
+ * systemd restarts us), we can move on to the next run in place. This picks the next run number, updates the runfile, 
+ * runs any hooks (retaking pedestals, re-equalizing the flower), then switches the run number the acq thread stamps 
+ * events with, while holding the radiant lock so no event is halfway through being read out. The write thread switches 
+ * output directories when it gets the first event of the new run (see roll_over_output). 
+ * Returns 0 on success (otherwise, we should just stop). 
+ */ 
+static int roll_over_run() 
+{
+  int next = acq_run_number + 1; 
+  char * dir = 0; 
+  asprintf(&dir, "%s/run%d/", cfg.output.base_dir, next); 
+  while (!cfg.output.allow_rundir_overwrite && !access(dir, F_OK)) 
+  {
+    fprintf(stderr,"DIR %s exists, incrementing run number\n", dir); 
+    free(dir); 
+    asprintf(&dir, "%s/run%d/", cfg.output.base_dir, ++next); 
+  }
+  free(dir); 
+
+  if (!access(cfg.output.runfile, F_OK) && update_runfile(next+1)) return -1; 
+
+  if (cfg.output.rollover.retake_pedestals) 
+  {
+    pthread_rwlock_wrlock(&radiant_lock); 
+    pthread_rwlock_rdlock(&cfg_lock); 
+    radiant_trigger_enable(radiant,0,0); 
+    radiant_labs_stop(radiant); 
+    if (take_pedestals()) fprintf(stderr,"Problem retaking pedestals, keeping the old ones\n"); 
+    else if (cfg.radiant.pedestals.pedestal_subtract) radiant_set_pedestals(radiant, pedestals); 
+    pthread_rwlock_unlock(&cfg_lock); 
+    pthread_rwlock_unlock(&radiant_lock); 
+    radiant_configure(); // starts the labs and triggers back up 
+  }
+
+  if (cfg.output.rollover.rerun_equalization && flower && cfg.lt.gain.auto_gain) 
+  {
+    pthread_rwlock_wrlock(&flower_lock); 
+    flower_trigger_enables_t trig_enables = {.enable_coinc=0, .enable_pps = 0, .enable_ext = 0};
+    flower_set_trigger_enables(flower,trig_enables);
+    flower_equalize(flower, cfg.lt.gain.target_rms, flower_codes, FLOWER_EQUALIZE_VERBOSE); 
+    pthread_rwlock_unlock(&flower_lock); 
+    flower_configure(); // turns the trigger back on 
+  }
+
+  output_partition_free = get_free_MB_by_path(cfg.output.base_dir); 
+  runfile_partition_free = get_free_MB_by_path(cfg.output.runfile); 
+
+  pthread_rwlock_wrlock(&radiant_lock); 
+  clock_gettime(CLOCK_REALTIME, &precise_rollover_time); 
+  acq_run_number = next; 
+  __sync_synchronize(); 
+  pthread_rwlock_unlock(&radiant_lock); 
+  ice_buf_wait_group_wake(wri_wait); 
+
+  printf("Rolled over to run %d\n", next); 
+  return 0; 
+}
+
 int please_stop()
 {
   printf("Stopping...\n"); 
   quit = 1; 
   clock_gettime(CLOCK_REALTIME, &precise_stop_time);
+  //make sure the other threads notice 
+  if (wri_wait) ice_buf_wait_group_wake(wri_wait); 
+  if (mon_sched) ice_sched_wake(mon_sched); 
+  if (sw_sched) ice_sched_wake(sw_sched); 
   return 0; 
 }
 
@@ -1965,34 +2825,63 @@ int main(int nargs, char ** args)
    clock_gettime(CLOCK_MONOTONIC_COARSE,&start_time); 
 
    struct timespec now; 
+   time_t last_metrics_free_space = 0; 
    while (!quit) 
    {
 
-     if (cfg_reread) 
+     double changed_at = 0; 
+     int watched = cfg_watch ? ice_cfgwatch_check(cfg_watch, &changed_at) : 0; 
+     if (cfg_reread || watched) 
      {
        cfg_reread = 0; 
-       read_config(); 
+       int ok = 1; 
+       if (!watched || (watched & ICE_CFGWATCH_FILE)) ok = !read_config(0) && ok; 
+       //a one-time config goes on top (and the next change to the watched config file takes us back) 
+       if (watched & ICE_CFGWATCH_ONCE) ok = !read_config(1) && ok; 
+       if (watched) 
+       {
+         struct timespec done; 
+         clock_gettime(CLOCK_MONOTONIC, &done); 
+         printf("Config change %s %.0f ms after it was seen (%d ms of that waiting for the writes to settle)\n", 
+             ok ? "applied" : "handled", 1e3 * (done.tv_sec + 1e-9 * done.tv_nsec - changed_at), cfg_watch_debounce_ms); 
+       }
+       update_cfg_watch(); 
      }
 
      //check disk space 
 
-     if (cfg.output.min_free_space_MB_output_partition > 0 ) 
+     if (cfg.output.min_free_space_MB_output_partition > 0 || cfg.output.degrade.enable) 
      {
        double MBfree = get_free_MB_by_path(cfg.output.base_dir); 
-       if (MBfree < cfg.output.min_free_space_MB_output_partition) 
+       if (cfg.output.min_free_space_MB_output_partition > 0 && MBfree < cfg.output.min_free_space_MB_output_partition) 
        {
          fprintf(stderr,"Output partition free space is just %f MB, smaller than minimum %d MB\n", MBfree, cfg.output.min_free_space_MB_output_partition); 
          please_stop(); 
          continue; 
        }
+       update_degradation(MBfree); 
      }
 
      clock_gettime(CLOCK_MONOTONIC_COARSE,&now); 
+
+     if (metrics && now.tv_sec - last_metrics_free_space >= METRICS_TICK_INTERVAL) 
+     {
+       float output_free = get_free_MB_by_path(cfg.output.base_dir); 
+       float runfile_free = get_free_MB_by_path(cfg.output.runfile); 
+       __atomic_store(&metrics_counters.output_free_MB, &output_free, __ATOMIC_RELAXED); 
+       __atomic_store(&metrics_counters.runfile_free_MB, &runfile_free, __ATOMIC_RELAXED); 
+       last_metrics_free_space = now.tv_sec; 
+     }
+
      if (now.tv_sec - start_time.tv_sec > cfg.output.seconds_per_run)
      {
-       please_stop(); 
+       //the rollover can take a while (pedestals, equalization), so the new run starts when it's done 
+       if (cfg.output.rollover.enable && !roll_over_run()) clock_gettime(CLOCK_MONOTONIC_COARSE, &start_time); 
+       else please_stop(); 
      }
-     usleep(500e3); 
+     //sleep, but wake up as soon as the config changes 
+     if (cfg_watch) ice_cfgwatch_wait(cfg_watch, 500); 
+     else usleep(500e3); 
      sched_yield(); 
    }
 
@@ -2001,25 +2890,31 @@ int main(int nargs, char ** args)
 
 int teardown() 
 {
+  ice_metrics_stop(metrics); 
+  metrics = 0; 
+  ice_cfgwatch_close(cfg_watch); 
+  cfg_watch = 0; 
+
   pthread_join(the_acq_thread,0);
   pthread_join(the_mon_thread,0);
+  pthread_join(the_sw_thread,0);
   pthread_join(the_wri_thread,0);
 
+  //nothing is running on the schedulers any more, but a signal could still wake them, so clear it first 
+  ice_sched_t * s = mon_sched; 
+  mon_sched = 0; 
+  ice_sched_destroy(s); 
+  s = sw_sched; 
+  sw_sched = 0; 
+  ice_sched_destroy(s); 
+
   //disable the trigger OVLD
   radiant_trigger_enable(radiant,0,0); 
   radiant_labs_stop(radiant); 
   radiant_close(radiant); 
   if (flower) 
     flower_close(flower); 
-  fclose(file_list); 
-  struct timespec end_time; 
-  clock_gettime(CLOCK_REALTIME, &end_time); 
-  if (runinfo) 
-  {
-    fprintf(runinfo,"RUN-STOP-TIME = %ld.%09ld\n", precise_stop_time.tv_sec, precise_stop_time.tv_nsec); 
-    fprintf(runinfo,"RUN-END-TIME = %ld.%09ld\n", end_time.tv_sec, end_time.tv_nsec); 
-    fclose(runinfo); 
-  }
+  finish_run_output(&precise_stop_time); 
 
 
   //turn off the calpulser on teardown, if it's on?  
@@ -2032,20 +2927,24 @@ int teardown()
     rno_g_cal_close(calpulser); 
   }
 
-  if (shared_ds_fd) 
+  //the final thresholds, for next time 
+  if (shared_ds) 
   {
-    munmap(ds,sizeof(rno_g_daqstatus_t)); 
-    close(shared_ds_fd); 
+    ice_dsshm_publish(shared_ds, ds); 
+    ice_dsshm_close(shared_ds); 
+    shared_ds = 0; 
   }
+  free(ds); 
+  ds = 0; 
+  ice_dshist_close(shared_ds_history); 
+  shared_ds_history = 0; 
 
   return 0; 
 }
 
 // you should be holding a flower lock while calling this
-int flower_update_pps_offset() 
+int flower_update_pps_offset(float wanted_delay) 
 {
-  float wanted_delay = cfg.lt.trigger.pps_trigger_delay; 
-
 
   // clamp to a second
   if (fabs(wanted_delay) >= 1e6) wanted_delay =   (wanted_delay*1e-6 - ((int) (wanted_delay*1e-6)))*1e6;
@@ -0,0 +1,651 @@
+#define _GNU_SOURCE
+#include "ice-index.h"
+#include "ice-manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+
+/** Post-run compaction.
+ *
+ * Merges the finished waveform, header and daqstatus files of a run into bigger files
+ * (up to a target size), so there are fewer files to transfer. gzip files can just be
+ * concatenated (zlib/librno-g read all the members), so this is cheap. Index sidecars
+ * (see ice-index.h) are merged too, with their offsets (and crcs) adjusted.
+ *
+ * A merged file is called FIRST-LAST.ext.dat.gz, where FIRST and LAST are the numbers of the
+ * first and last files that went into it. aux/acq-file-list.txt and the manifest (see ice-manifest.h) are rewritten
+ * to match. Merged files aren't merged again.
+ *
+ * Each merge goes:
+ *    write NAME.partial.tmp (and NAME.idx.tmp), fsync
+ *    rename to NAME.done.tmp
+ *    take the transfer lock, delete the merged files, rename to NAME, release the lock
+ * so the copy script (which holds the transfer lock, shared, while it runs rsync, and skips *.tmp) never
+ * sees half of a merge. If we get interrupted, the next run of this finishes any .done.tmp and
+ * throws away any .partial.tmp.
+ *
+ * Runs at the lowest CPU and idle I/O priority. Only finished runs (with a RUN-END-TIME in runinfo) are touched,
+ * unless forced. The run directory itself is flocked (exclusively) while we work on it, so two of us (or us and
+ * rno-g-recover-run) can't be at the same run at once; if it's already locked, the run is skipped.
+ *
+ * When a run has been compacted without trouble, aux/compacted.txt is written. The copy script holds runs back
+ * until they have it, so the small files don't get transferred first and then again inside the merged ones.
+ */
+
+#define DEFAULT_LOCK_FILE "/rno-g/run/transfer.lock"
+#define DEFAULT_TARGET_KB 20480
+#define COMPACTED_MARKER "aux/compacted.txt"
+
+#define NSTREAMS 3
+static const char * stream_dirs[NSTREAMS] = {"waveforms","header","daqstatus"}; 
+static const char * stream_exts[NSTREAMS] = {"wf","hd","ds"}; 
+
+typedef struct data_file
+{ 
+  uint32_t first; 
+  uint32_t last; 
+  off_t size; 
+  off_t disk_size; 
+  int listed; //already in the new file list
+  int manifest_entry; //1 + where it is in the new manifest, if it's there yet
+  char name[128]; 
+} data_file_t; 
+
+typedef struct stats
+{ 
+  int nfiles; 
+  uint64_t bytes; 
+  uint64_t disk_bytes; 
+} stats_t; 
+
+static int lock_fd = -1; 
+static int dry_run = 0; 
+
+
+static void usage() 
+{ 
+  fprintf(stderr,"Usage: rno-g-compact-run [-s target_kB=%d] [-L lockfile=%s] [-f] [-n] run_dir [run_dir ...]\n", DEFAULT_TARGET_KB, DEFAULT_LOCK_FILE); 
+  fprintf(stderr,"   -f  compact even if the run doesn't look finished (e.g. after a crash)\n"); 
+  fprintf(stderr,"   -n  just say what would be done\n"); 
+}
+
+/* Parses N.ext.dat.gz or N-M.ext.dat.gz (followed by exactly suffix). Returns 0 if it matches */
+static int parse_name(const char * name, const char * ext, const char * suffix, uint32_t * first, uint32_t * last) 
+{ 
+  char * end = 0; 
+  if (name[0] < '0' || name[0] > '9') return -1; 
+  *first = strtoul(name, &end, 10); 
+  *last = *first; 
+  if (*end == '-') 
+  { 
+    const char * start = end + 1; 
+    *last = strtoul(start, &end, 10); 
+    if (end == start) return -1; 
+  }
+
+  char expected[64]; 
+  snprintf(expected, sizeof(expected), ".%s.dat.gz%s", ext, suffix); 
+  return strcmp(end, expected) ? -1 : 0; 
+}
+
+static int compare_files(const void * a, const void * b) 
+{ 
+  const data_file_t * A = a; 
+  const data_file_t * B = b; 
+  if (A->first != B->first) return A->first < B->first ? -1 : 1; 
+  return A->last < B->last ? -1 : A->last > B->last; 
+}
+
+/* Finished data files in dir, sorted */
+static int list_files(const char * dir, const char * ext, data_file_t ** files) 
+{ 
+  *files = 0; 
+  DIR * d = opendir(dir); 
+  if (!d) return 0; 
+
+  int n = 0, cap = 0; 
+  struct dirent * ent; 
+  while ((ent = readdir(d))) 
+  { 
+    uint32_t first, last; 
+    if (strlen(ent->d_name) >= sizeof((*files)->name)) continue; 
+    if (parse_name(ent->d_name, ext, "", &first, &last)) continue; 
+
+    struct stat st; 
+    if (fstatat(dirfd(d), ent->d_name, &st, 0)) continue; 
+
+    if (n == cap) 
+    { 
+      cap = cap ? 2 * cap : 256; 
+      *files = realloc(*files, cap * sizeof(data_file_t)); 
+    }
+    data_file_t * f = &(*files)[n++]; 
+    f->first = first; 
+    f->last = last; 
+    f->size = st.st_size; 
+    f->disk_size = st.st_blocks * 512; 
+    f->listed = 0; 
+    f->manifest_entry = 0; 
+    strcpy(f->name, ent->d_name); 
+  }
+  closedir(d); 
+
+  qsort(*files, n, sizeof(data_file_t), compare_files); 
+  return n; 
+}
+
+static void add_stats(stats_t * s, const data_file_t * files, int n) 
+{ 
+  for (int i = 0; i < n; i++) 
+  { 
+    s->nfiles++; 
+    s->bytes += files[i].size; 
+    s->disk_bytes += files[i].disk_size; 
+  }
+}
+
+
+static void lock_transfer() 
+{ 
+  if (lock_fd >= 0) flock(lock_fd, LOCK_EX); 
+}
+
+static void unlock_transfer() 
+{ 
+  if (lock_fd >= 0) flock(lock_fd, LOCK_UN); 
+}
+
+/* The last step of a merge: delete what went into it and give it its real name */
+static int finish_merge(const char * dir, const char * ext, uint32_t first, uint32_t last) 
+{ 
+  char final[PATH_MAX + 64], done[PATH_MAX + 96], idx_tmp[PATH_MAX + 96], path[PATH_MAX + 256]; 
+  snprintf(final, sizeof(final), "%s/%06u-%06u.%s.dat.gz", dir, first, last, ext); 
+  snprintf(done, sizeof(done), "%s.done.tmp", final); 
+  snprintf(idx_tmp, sizeof(idx_tmp), "%s.idx.tmp", final); 
+
+  data_file_t * files = 0; 
+  int n = list_files(dir, ext, &files); 
+
+  lock_transfer(); 
+  for (int i = 0; i < n; i++) 
+  { 
+    if (files[i].first < first || files[i].first > last) continue; 
+    if (files[i].first == first && files[i].last == last) continue; // (a previous attempt got this far) 
+    snprintf(path, sizeof(path), "%s/%s", dir, files[i].name); 
+    unlink(path); 
+    snprintf(path, sizeof(path), "%s/%s.idx", dir, files[i].name); 
+    unlink(path); 
+  }
+
+  snprintf(path, sizeof(path), "%s.idx", final); 
+  if (!access(idx_tmp, F_OK)) rename(idx_tmp, path); 
+  int ret = rename(done, final); 
+  unlock_transfer(); 
+
+  if (ret) fprintf(stderr,"Could not rename %s to %s\n", done, final); 
+  free(files); 
+  return ret; 
+}
+
+/* Deal with anything left over from an interrupted compaction */
+static void recover_stream(const char * dir, const char * ext) 
+{ 
+  DIR * d = opendir(dir); 
+  if (!d) return; 
+
+  struct dirent * ent; 
+  char path[PATH_MAX + 256]; 
+  while ((ent = readdir(d))) 
+  { 
+    uint32_t first, last; 
+    if (!parse_name(ent->d_name, ext, ".partial.tmp", &first, &last)) 
+    { 
+      printf("  removing unfinished %s/%s\n", dir, ent->d_name); 
+      snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name); 
+      unlink(path); 
+      snprintf(path, sizeof(path), "%s/%06u-%06u.%s.dat.gz.idx.tmp", dir, first, last, ext); 
+      unlink(path); 
+    }
+    else if (!parse_name(ent->d_name, ext, ".done.tmp", &first, &last)) 
+    { 
+      printf("  finishing %s/%s\n", dir, ent->d_name); 
+      finish_merge(dir, ext, first, last); 
+    }
+  }
+  closedir(d); 
+}
+
+/* gzip trailer: crc32 and uncompressed size (mod 2^32) of the last member */
+static int read_trailer(int fd, off_t size, uint32_t * crc, uint32_t * isize) 
+{ 
+  unsigned char t[8]; 
+  if (size < 18 || pread(fd, t, 8, size - 8) != 8) return -1; 
+  *crc = t[0] | (t[1] << 8) | (t[2] << 16) | ((uint32_t) t[3] << 24); 
+  *isize = t[4] | (t[5] << 8) | (t[6] << 16) | ((uint32_t) t[7] << 24); 
+  return 0; 
+}
+
+static int copy_fd(int in, int out, off_t len) 
+{ 
+  static char buf[64 << 10]; 
+  while (len > 0) 
+  { 
+    ssize_t n = read(in, buf, len < (off_t) sizeof(buf) ? len : (off_t) sizeof(buf)); 
+    if (n < 0 && errno == EINTR) continue; 
+    if (n <= 0) return -1; 
+    char * p = buf; 
+    ssize_t left = n; 
+    while (left) 
+    { 
+      ssize_t w = write(out, p, left); 
+      if (w < 0 && errno == EINTR) continue; 
+      if (w <= 0) return -1; 
+      p += w; 
+      left -= w; 
+    }
+    len -= n; 
+  }
+  return 0; 
+}
+
+/* Merge files[0..n) into one */
+static int merge_files(const char * dir, const char * ext, const data_file_t * files, int n) 
+{ 
+  uint32_t first = files[0].first; 
+  uint32_t last = files[n-1].last; 
+  char final[PATH_MAX + 64], partial[PATH_MAX + 96], done[PATH_MAX + 96], idx_tmp[PATH_MAX + 96], path[PATH_MAX + 256]; 
+  snprintf(final, sizeof(final), "%s/%06u-%06u.%s.dat.gz", dir, first, last, ext); 
+  snprintf(partial, sizeof(partial), "%s.partial.tmp", final); 
+  snprintf(done, sizeof(done), "%s.done.tmp", final); 
+  snprintf(idx_tmp, sizeof(idx_tmp), "%s.idx.tmp", final); 
+
+  int out = open(partial, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644); 
+  if (out < 0) 
+  { 
+    fprintf(stderr,"Could not open %s\n", partial); 
+    return -1; 
+  }
+
+  FILE * idx = 0; 
+  uint64_t compressed_base = 0; 
+  uint64_t uncompressed_base = 0; 
+  uint32_t crc_base = crc32(0, Z_NULL, 0); 
+  int failed = 0; 
+
+  for (int i = 0; i < n && !failed; i++) 
+  { 
+    snprintf(path, sizeof(path), "%s/%s", dir, files[i].name); 
+    int in = open(path, O_RDONLY | O_CLOEXEC); 
+    uint32_t crc, isize; 
+    if (in < 0 || read_trailer(in, files[i].size, &crc, &isize) || copy_fd(in, out, files[i].size)) 
+    { 
+      fprintf(stderr,"Problem copying %s\n", path); 
+      failed = 1; 
+    }
+    if (in >= 0) close(in); 
+    if (failed) break; 
+
+    //bring its index along, shifted to where it is now
+    ice_index_entry_t * entries = 0; 
+    snprintf(path, sizeof(path), "%s/%s.idx", dir, files[i].name); 
+    int nentries = ice_index_load(path, &entries); 
+    if (nentries > 0 && !idx) idx = ice_index_create(idx_tmp); 
+    for (int j = 0; j < nentries && idx; j++) 
+    { 
+      entries[j].crc32 = crc32_combine(crc_base, entries[j].crc32, entries[j].uncompressed_offset); 
+      entries[j].compressed_offset += compressed_base; 
+      entries[j].uncompressed_offset += uncompressed_base; 
+      fwrite(&entries[j], sizeof(entries[j]), 1, idx); 
+    }
+    free(entries); 
+
+    crc_base = crc32_combine(crc_base, crc, isize); 
+    compressed_base += files[i].size; 
+    uncompressed_base += isize; 
+  }
+
+  if (idx && fclose(idx)) failed = 1; 
+  if (fsync(out)) failed = 1; 
+  close(out); 
+
+  if (failed || rename(partial, done)) 
+  { 
+    unlink(partial); 
+    unlink(idx_tmp); 
+    return -1; 
+  }
+
+  return finish_merge(dir, ext, first, last); 
+}
+
+/* Rewrite aux/acq-file-list.txt so it lists what's there now */
+static int rewrite_file_list(const char * run_dir, data_file_t ** files, int * nfiles) 
+{ 
+  char list_path[PATH_MAX], tmp_path[PATH_MAX + 32]; 
+  snprintf(list_path, sizeof(list_path), "%s/aux/acq-file-list.txt", run_dir); 
+  snprintf(tmp_path, sizeof(tmp_path), "%s.compact.tmp", list_path); 
+
+  FILE * in = fopen(list_path, "r"); 
+  if (!in) return 0; // nothing to do
+  flock(fileno(in), LOCK_EX); 
+
+  FILE * out = fopen(tmp_path, "w"); 
+  if (!out) 
+  { 
+    fprintf(stderr,"Could not open %s\n", tmp_path); 
+    fclose(in); 
+    return -1; 
+  }
+
+  char * line = 0; 
+  size_t line_size = 0; 
+  ssize_t len; 
+  while ((len = getline(&line, &line_size, in)) > 0) 
+  { 
+    if (line[len-1] == '\n') line[--len] = 0; 
+
+    //is it a data file (or an index) in one of the stream directories?
+    char * base = strrchr(line, '/'); 
+    int is_idx = len > 4 && !strcmp(line + len - 4, ".idx"); 
+    int stream = -1; 
+    uint32_t first = 0, last = 0; 
+    if (base) 
+    { 
+      for (int s = 0; s < NSTREAMS; s++) 
+      { 
+        int dirlen = strlen(stream_dirs[s]); 
+        if (base - line < dirlen || strncmp(base - dirlen, stream_dirs[s], dirlen)) continue; 
+        if (parse_name(base + 1, stream_exts[s], is_idx ? ".idx" : "", &first, &last)) continue; 
+        stream = s; 
+      }
+    }
+
+    struct stat st; 
+    if (stream >= 0 && is_idx) 
+    { 
+      // keep it if it's still there. A merged one gets added along with its data file
+      if (!stat(line, &st)) fprintf(out, "%s\n", line); 
+      continue; 
+    }
+
+    if (stream < 0 || !stat(line, &st)) 
+    { 
+      // not ours, or still there
+      for (int i = 0; stream >= 0 && i < nfiles[stream]; i++) 
+      { 
+        if (files[stream][i].first == first && files[stream][i].last == last) files[stream][i].listed = 1; 
+      }
+      fprintf(out, "%s\n", line); 
+      continue; 
+    }
+
+    //gone, so it was merged (or deleted). Put the file that has it instead (once) 
+    for (int i = 0; i < nfiles[stream]; i++) 
+    { 
+      data_file_t * f = &files[stream][i]; 
+      if (first < f->first || first > f->last) continue; 
+      if (!f->listed) 
+      { 
+        fprintf(out, "%.*s%s\n", (int) (base - line + 1), line, f->name); 
+        char idx_path[PATH_MAX]; 
+        snprintf(idx_path, sizeof(idx_path), "%.*s%s.idx", (int) (base - line + 1), line, f->name); 
+        if (!access(idx_path, F_OK)) fprintf(out, "%s\n", idx_path); 
+        f->listed = 1; 
+      }
+      break; 
+    }
+  }
+  free(line); 
+
+  int ret = fclose(out); 
+  if (!ret) ret = rename(tmp_path, list_path); 
+  fclose(in); 
+  return ret; 
+}
+
+/* Rewrite the manifest the same way: entries for merged files get replaced by one for the file they went into, 
+ * covering all of their events */
+static int rewrite_manifest(const char * run_dir, data_file_t ** files, int * nfiles) 
+{ 
+  ice_manifest_entry_t * entries; 
+  int n = ice_manifest_load(run_dir, &entries); 
+  if (n <= 0) return 0; 
+
+  ice_manifest_entry_t * out = calloc(n, sizeof(*out)); 
+  int nout = 0; 
+  int failed = 0; 
+  char path[PATH_MAX + 256]; 
+
+  for (int i = 0; i < n; i++) 
+  { 
+    ice_manifest_entry_t * e = &entries[i]; 
+    snprintf(path, sizeof(path), "%s/%s", run_dir, e->name); 
+    if (!access(path, F_OK)) 
+    { 
+      out[nout++] = *e; 
+      continue; 
+    }
+
+    //gone. If it's in a stream directory, find what it got merged into 
+    char * base = strrchr(e->name, '/'); 
+    uint32_t first = 0, last = 0; 
+    int stream = -1; 
+    for (int s = 0; base && s < NSTREAMS; s++) 
+    { 
+      int dirlen = strlen(stream_dirs[s]); 
+      if (base - e->name != dirlen || strncmp(e->name, stream_dirs[s], dirlen)) continue; 
+      if (!parse_name(base + 1, stream_exts[s], "", &first, &last)) stream = s; 
+    }
+    if (stream < 0) continue; // deleted, so drop it 
+
+    for (int j = 0; j < nfiles[stream]; j++) 
+    { 
+      data_file_t * f = &files[stream][j]; 
+      if (first < f->first || first > f->last) continue; 
+
+      if (!f->manifest_entry) 
+      { 
+        ice_manifest_entry_t * m = &out[nout]; 
+        snprintf(path, sizeof(path), "%s/%s/%s", run_dir, stream_dirs[stream], f->name); 
+        if (ice_manifest_entry_for_file(run_dir, path, m)) 
+        { 
+          fprintf(stderr,"Could not checksum %s\n", path); 
+          failed = 1; 
+          break; 
+        }
+        *m = (ice_manifest_entry_t) { .size = m->size, .crc32c = m->crc32c, .have_events = e->have_events, 
+                                      .first_event = e->first_event, .last_event = e->last_event }; 
+        ice_manifest_set_name(m, run_dir, path); 
+        f->manifest_entry = ++nout; 
+      }
+      else 
+      { 
+        ice_manifest_entry_t * m = &out[f->manifest_entry-1]; 
+        m->have_events = m->have_events && e->have_events; 
+        if (e->first_event < m->first_event) m->first_event = e->first_event; 
+        if (e->last_event > m->last_event) m->last_event = e->last_event; 
+      }
+      break; 
+    }
+  }
+
+  int ret = failed ? -1 : ice_manifest_rewrite(run_dir, out, nout); 
+  free(out); 
+  free(entries); 
+  return ret; 
+}
+
+static int run_is_finished(const char * run_dir) 
+{ 
+  char path[PATH_MAX]; 
+  snprintf(path, sizeof(path), "%s/aux/runinfo.txt", run_dir); 
+  FILE * f = fopen(path,"r"); 
+  if (!f) return 0; 
+
+  char line[512]; 
+  int finished = 0; 
+  while (fgets(line, sizeof(line), f)) 
+  { 
+    if (!strncmp(line, "RUN-END-TIME", strlen("RUN-END-TIME"))) finished = 1; 
+  }
+  fclose(f); 
+  return finished; 
+}
+
+static int compact_run(const char * run_dir, off_t target, int force) 
+{ 
+  if (!force && !run_is_finished(run_dir)) 
+  { 
+    fprintf(stderr,"%s doesn't look finished (no RUN-END-TIME in aux/runinfo.txt), skipping (use -f to force)\n", run_dir); 
+    return 1; 
+  }
+
+  int run_fd = -1; 
+  if (!dry_run) 
+  { 
+    run_fd = open(run_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC); 
+    if (run_fd < 0 || flock(run_fd, LOCK_EX | LOCK_NB)) 
+    { 
+      fprintf(stderr,"%s is %s, skipping\n", run_dir, run_fd < 0 ? "not there" : "locked (being compacted or recovered)"); 
+      if (run_fd >= 0) close(run_fd); 
+      return 1; 
+    }
+  }
+
+  stats_t before = {0}, after = {0}; 
+  data_file_t * files[NSTREAMS]; 
+  int nfiles[NSTREAMS]; 
+  int nmerges = 0; 
+  int failed = 0; 
+
+  for (int s = 0; s < NSTREAMS; s++) 
+  { 
+    char dir[PATH_MAX]; 
+    snprintf(dir, sizeof(dir), "%s/%s", run_dir, stream_dirs[s]); 
+    if (!dry_run) recover_stream(dir, stream_exts[s]); 
+
+    data_file_t * list = 0; 
+    int n = list_files(dir, stream_exts[s], &list); 
+    add_stats(&before, list, n); 
+
+    //greedily group consecutive files up to the target size (leaving alone anything that's already merged) 
+    int i = 0; 
+    while (i < n) 
+    { 
+      if (list[i].first != list[i].last) 
+      { 
+        i++; 
+        continue; 
+      }
+      off_t total = list[i].size; 
+      int j = i + 1; 
+      while (j < n && list[j].first == list[j].last && total + list[j].size <= target) total += list[j++].size; 
+
+      if (j - i > 1) 
+      { 
+        nmerges++; 
+        if (dry_run) printf("  would merge %d files in %s/%s (%06u-%06u, %lld bytes)\n", j - i, run_dir, stream_dirs[s],
+                            list[i].first, list[j-1].last, (long long) total); 
+        else if (merge_files(dir, stream_exts[s], list + i, j - i)) failed = 1; 
+      }
+      i = j; 
+    }
+    free(list); 
+
+    nfiles[s] = list_files(dir, stream_exts[s], &files[s]); 
+    add_stats(&after, files[s], nfiles[s]); 
+  }
+
+  if (!dry_run) 
+  { 
+    if (rewrite_file_list(run_dir, files, nfiles)) failed = 1; 
+    if (rewrite_manifest(run_dir, files, nfiles)) failed = 1; 
+  }
+
+  char summary[256]; 
+  snprintf(summary, sizeof(summary), "%s: %d merges, %d -> %d files, %.1f -> %.1f MB (%.1f -> %.1f MB on disk)\n", run_dir, nmerges,
+         before.nfiles, after.nfiles, before.bytes / 1048576., after.bytes / 1048576.,
+         before.disk_bytes / 1048576., after.disk_bytes / 1048576.); 
+  printf("%s", summary); 
+
+  //let the copy script know it can have this run now
+  if (!dry_run && !failed) 
+  { 
+    char marker[PATH_MAX]; 
+    snprintf(marker, sizeof(marker), "%s/%s", run_dir, COMPACTED_MARKER); 
+    FILE * m = fopen(marker, "w"); 
+    int bad = !m || fputs(summary, m) < 0; 
+    if (m && fclose(m)) bad = 1; 
+    if (bad) 
+    { 
+      fprintf(stderr,"Could not write %s\n", marker); 
+      failed = 1; 
+    }
+  }
+  else if (failed) 
+  { 
+    fprintf(stderr,"%s: something went wrong, not marking it compacted\n", run_dir); 
+  }
+
+  if (run_fd >= 0) close(run_fd); 
+  for (int s = 0; s < NSTREAMS; s++) free(files[s]); 
+  return failed; 
+}
+
+
+int main(int nargs, char ** args) 
+{ 
+  off_t target = DEFAULT_TARGET_KB; 
+  const char * lock_file = DEFAULT_LOCK_FILE; 
+  int force = 0; 
+  int opt; 
+
+  while ((opt = getopt(nargs, args, "s:L:fnh")) != -1) 
+  { 
+    switch (opt) 
+    { 
+      case 's': target = atol(optarg); break; 
+      case 'L': lock_file = optarg; break; 
+      case 'f': force = 1; break; 
+      case 'n': dry_run = 1; break; 
+      default: usage(); return 1; 
+    }
+  }
+  target *= 1024; 
+
+  if (optind >= nargs) 
+  { 
+    usage(); 
+    return 1; 
+  }
+
+  //stay out of the way of data taking
+  setpriority(PRIO_PROCESS, 0, 19); 
+#ifdef SYS_ioprio_set
+  syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, 3 << 13 /* IOPRIO_CLASS_IDLE */); 
+#endif
+
+  if (!dry_run) 
+  { 
+    lock_fd = open(lock_file, O_RDWR | O_CREAT | O_CLOEXEC, 0664); 
+    if (lock_fd < 0) 
+    { 
+      fprintf(stderr,"Could not open transfer lock %s, not compacting (it wouldn't be safe)\n", lock_file); 
+      return 1; 
+    }
+  }
+
+  int ret = 0; 
+  for (int i = optind; i < nargs; i++) ret |= compact_run(args[i], target, force); 
+  return ret; 
+}
@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+#include "ice-container.h" 
+#include "ice-common.h" 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> 
+#include <unistd.h> 
+#include <fcntl.h> 
+#include <sys/stat.h> 
+
+/** Lists / extracts run containers (see ice-container.h), recreating the usual per-file run layout. 
+ *
+ *  rno-g-container-extract -l container          list the chunks 
+ *  rno-g-container-extract -r container          drop anything after the last good chunk and rewrite the footer
+ *  rno-g-container-extract container [out_dir]   extract into out_dir (default .) 
+ */ 
+
+
+static void usage() 
+{
+  fprintf(stderr,"Usage: rno-g-container-extract [-l | -r] container [out_dir=.]\n"); 
+  fprintf(stderr,"   -l  just list the chunks\n"); 
+  fprintf(stderr,"   -r  recover a container that was not closed cleanly (in place)\n"); 
+}
+
+/* mkdir -p for the directory part of path */ 
+static void make_parent_dirs(char * path) 
+{
+  for (char * p = path + 1; *p; p++) 
+  {
+    if (*p != '/') continue; 
+    *p = 0; 
+    mkdir_if_needed(path); 
+    *p = '/'; 
+  }
+}
+
+int main(int nargs, char ** args) 
+{
+  int list_only = 0; 
+  int recover = 0; 
+  int opt; 
+  while ((opt = getopt(nargs, args, "lrh")) != -1) 
+  {
+    switch (opt) 
+    {
+      case 'l': list_only = 1; break; 
+      case 'r': recover = 1; break; 
+      default: usage(); return 1; 
+    }
+  }
+
+  if (optind >= nargs) 
+  {
+    usage(); 
+    return 1; 
+  }
+
+  const char * path = args[optind]; 
+  const char * out_dir = optind + 1 < nargs ? args[optind+1] : "."; 
+
+  if (recover) 
+  {
+    ice_container_t * c = ice_container_open(path); 
+    if (!c) return 1; 
+    printf("%s: %llu bytes after recovery\n", path, (unsigned long long) ice_container_size(c)); 
+    return ice_container_close(c); 
+  }
+
+  ice_container_footer_entry_t * chunks = 0; 
+  int recovered = 0; 
+  int n = ice_container_list(path, &chunks, &recovered); 
+  if (n < 0) 
+  {
+    fprintf(stderr,"%s does not look like a container\n", path); 
+    return 1; 
+  }
+  if (recovered) fprintf(stderr,"%s has no good footer (not closed cleanly?), found %d good chunks by scanning\n", path, n); 
+
+  int fd = open(path, O_RDONLY); 
+  int nbad = 0; 
+  char name[65536]; 
+  for (int i = 0; i < n; i++) 
+  {
+    void * data = 0; 
+    ssize_t len = ice_container_read_chunk(fd, &chunks[i], name, sizeof(name), &data); 
+    if (len < 0) 
+    {
+      fprintf(stderr,"Chunk %d (at %llu) is bad, skipping\n", i, (unsigned long long) chunks[i].offset); 
+      nbad++; 
+      continue; 
+    }
+
+    if (list_only) 
+    {
+      printf("%-5s %8u %10zd  %s\n", ice_container_stream_name(chunks[i].stream), chunks[i].first_event, len, name); 
+    }
+    else
+    {
+      char * out_path = 0; 
+      asprintf(&out_path, "%s/%s", out_dir, name); 
+      make_parent_dirs(out_path); 
+      FILE * f = fopen(out_path,"w"); 
+      if (!f || fwrite(data, 1, len, f) != (size_t) len) 
+      {
+        fprintf(stderr,"Could not write %s\n", out_path); 
+        nbad++; 
+      }
+      if (f) fclose(f); 
+      free(out_path); 
+    }
+    free(data); 
+  }
+
+  if (!list_only) printf("Extracted %d files from %s into %s\n", n - nbad, path, out_dir); 
+
+  close(fd); 
+  free(chunks); 
+  return nbad ? 1 : 0; 
+}
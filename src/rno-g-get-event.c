@@ -0,0 +1,153 @@
+#define _GNU_SOURCE
+#include "ice-index.h" 
+#include "rno-g.h" 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> 
+#include <dirent.h> 
+#include <time.h> 
+
+/** Pulls a single event out of a run directory, using the .idx sidecars to avoid 
+ * decompressing everything before it. Falls back to reading from the start of the file if there is no sidecar. 
+ *
+ * Writes out prefix.hd.dat.gz and prefix.wf.dat.gz with just that event in them. 
+ */ 
+
+
+/* Find the file in dir (by first event number in the name) that should contain event. Returns 0 if none. */ 
+static char * find_file(const char * run_dir, const char * dir, const char * ext, uint32_t event) 
+{
+  char * dirpath = 0; 
+  asprintf(&dirpath, "%s/%s", run_dir, dir); 
+  DIR * d = opendir(dirpath); 
+  if (!d) 
+  {
+    fprintf(stderr,"Could not open %s\n", dirpath); 
+    free(dirpath); 
+    return 0; 
+  }
+
+  char suffix[32]; 
+  snprintf(suffix, sizeof(suffix), ".%s.dat.gz", ext); 
+
+  char * best = 0; 
+  uint32_t best_first = 0; 
+  struct dirent * ent; 
+  while ((ent = readdir(d))) 
+  {
+    char * end = 0; 
+    unsigned long first = strtoul(ent->d_name, &end, 10); 
+    if (end == ent->d_name) continue; 
+    if (*end == '-') strtoul(end + 1, &end, 10); // merged by rno-g-compact-run 
+    if (strncmp(end, suffix, strlen(suffix))) continue; 
+    //finished files, or ones that are still being written 
+    if (end[strlen(suffix)] && strcmp(end + strlen(suffix), ".tmp")) continue; 
+    if (first > event || (best && first < best_first)) continue; 
+
+    free(best); 
+    asprintf(&best, "%s/%s", dirpath, ent->d_name); 
+    best_first = first; 
+  }
+
+  closedir(d); 
+  free(dirpath); 
+  return best; 
+}
+
+/* Opens path positioned as close as possible before event */ 
+static FILE * open_near(const char * path, uint32_t event) 
+{
+  ice_index_entry_t entry; 
+  FILE * f = ice_index_seek(path, event, &entry); 
+  if (f) 
+  {
+    printf("  %s: starting from record %u (event %u), compressed offset %llu\n", path, entry.record_index, 
+           entry.event_number, (unsigned long long) entry.compressed_offset); 
+    return f; 
+  }
+
+  // no index, start right after the (10-byte, since we don't store names) gzip header 
+  printf("  %s: no usable index, starting from the beginning\n", path); 
+  memset(&entry, 0, sizeof(entry)); 
+  entry.compressed_offset = 10; 
+  return ice_index_open_at(path, &entry); 
+}
+
+
+int main(int nargs, char ** args) 
+{
+  if (nargs < 3) 
+  {
+    fprintf(stderr,"Usage: rno-g-get-event run_dir event_number [output_prefix=event_N]\n"); 
+    return 1; 
+  }
+
+  const char * run_dir = args[1]; 
+  uint32_t event = strtoul(args[2],0,10); 
+  char * prefix = 0; 
+  if (nargs > 3) prefix = strdup(args[3]); 
+  else asprintf(&prefix,"event_%u", event); 
+
+  struct timespec start, end; 
+  clock_gettime(CLOCK_MONOTONIC, &start); 
+
+  char * hd_path = find_file(run_dir, "header", "hd", event); 
+  char * wf_path = find_file(run_dir, "waveforms", "wf", event); 
+  if (!hd_path || !wf_path) 
+  {
+    fprintf(stderr,"Could not find a file containing event %u in %s\n", event, run_dir); 
+    return 1; 
+  }
+
+  static rno_g_header_t hd; 
+  static rno_g_waveform_t wf; 
+  int found_hd = 0, found_wf = 0; 
+
+  rno_g_file_handle_t h = {.type = RNO_G_RAW}; 
+  h.handle.raw = open_near(hd_path, event); 
+  while (h.handle.raw && rno_g_header_read(h, &hd) > 0) 
+  {
+    if (hd.event_number == event) { found_hd = 1; break; } 
+    if (hd.event_number > event) break; 
+  }
+  if (h.handle.raw) fclose(h.handle.raw); 
+
+  h.handle.raw = open_near(wf_path, event); 
+  while (h.handle.raw && rno_g_waveform_read(h, &wf) > 0) 
+  {
+    if (wf.event_number == event) { found_wf = 1; break; } 
+    if (wf.event_number > event) break; 
+  }
+  if (h.handle.raw) fclose(h.handle.raw); 
+
+  clock_gettime(CLOCK_MONOTONIC, &end); 
+
+  if (!found_hd || !found_wf) 
+  {
+    fprintf(stderr,"Event %u not found (header: %s, waveform: %s)\n", event, found_hd ? "yes" : "no", found_wf ? "yes" : "no"); 
+    return 1; 
+  }
+
+  char * out_path = 0; 
+  rno_g_file_handle_t out; 
+  asprintf(&out_path,"%s.hd.dat.gz", prefix); 
+  rno_g_init_handle(&out, out_path, "w"); 
+  rno_g_header_write(out, &hd); 
+  rno_g_close_handle(&out); 
+  printf("Wrote %s\n", out_path); 
+  free(out_path); 
+
+  asprintf(&out_path,"%s.wf.dat.gz", prefix); 
+  rno_g_init_handle(&out, out_path, "w"); 
+  rno_g_waveform_write(out, &wf); 
+  rno_g_close_handle(&out); 
+  printf("Wrote %s\n", out_path); 
+  free(out_path); 
+
+  printf("Found event %u in %g ms\n", event, (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) * 1e-6); 
+
+  free(hd_path); 
+  free(wf_path); 
+  free(prefix); 
+  return 0; 
+}
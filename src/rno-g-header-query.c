@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+#include "ice-hdcol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+/** Quick questions about the headers of one or more runs, answered from the columnar
+ * header store (see ice-hdcol.h) rather than the header files.
+ *
+ * Prints the number of events, the time span, the trigger type breakdown and any event
+ * number gaps, and with -b, the trigger rate over time.
+ */
+
+#define MAX_TRIGGER_TYPES 64
+
+static void usage() 
+{ 
+  fprintf(stderr,"Usage: rno-g-header-query [-b bin_seconds] [-t start_time] [-T end_time] [-g max_gaps_to_print=20] run_dir [run_dir ...]\n"); 
+  fprintf(stderr,"   times are seconds since the epoch (readout time)\n"); 
+}
+
+
+int main(int nargs, char ** args) 
+{ 
+  double bin = 0; 
+  double t0 = 0; 
+  double t1 = INFINITY; 
+  int max_gaps = 20; 
+  int opt; 
+
+  while ((opt = getopt(nargs, args, "b:t:T:g:h")) != -1) 
+  { 
+    switch (opt) 
+    { 
+      case 'b': bin = atof(optarg); break; 
+      case 't': t0 = atof(optarg); break; 
+      case 'T': t1 = atof(optarg); break; 
+      case 'g': max_gaps = atoi(optarg); break; 
+      default: usage(); return 1; 
+    }
+  }
+
+  if (optind >= nargs) 
+  { 
+    usage(); 
+    return 1; 
+  }
+
+  struct timespec start, end; 
+  clock_gettime(CLOCK_MONOTONIC, &start); 
+
+  size_t nevents = 0; 
+  double tmin = INFINITY, tmax = -INFINITY; 
+  uint32_t types[MAX_TRIGGER_TYPES]; 
+  size_t type_counts[MAX_TRIGGER_TYPES] = {0}; 
+  int ntypes = 0; 
+  size_t ngaps = 0; 
+  size_t nmissing = 0; 
+
+  size_t nbins = 0; 
+  size_t * bins = 0; 
+  double bin_start = 0; 
+
+  for (int irun = optind; irun < nargs; irun++) 
+  { 
+    char * dir = 0; 
+    asprintf(&dir,"%s/hdcol", args[irun]); 
+    ice_hdcol_view_t v; 
+    if (ice_hdcol_map(dir, &v)) 
+    { 
+      fprintf(stderr,"No header columns in %s, skipping\n", args[irun]); 
+      free(dir); 
+      continue; 
+    }
+    free(dir); 
+
+    const uint32_t * ev = v.columns[ICE_HDCOL_EVENT_NUMBER]; 
+    const uint32_t * type = v.columns[ICE_HDCOL_TRIGGER_TYPE]; 
+    const double * t = v.columns[ICE_HDCOL_READOUT_TIME]; 
+
+    int have_last = 0; 
+    uint32_t last_ev = 0; 
+    for (size_t i = 0; i < v.nrows; i++) 
+    { 
+      if (t[i] < t0 || t[i] >= t1) continue; 
+      nevents++; 
+      if (t[i] < tmin) tmin = t[i]; 
+      if (t[i] > tmax) tmax = t[i]; 
+
+      int j; 
+      for (j = 0; j < ntypes; j++) if (types[j] == type[i]) break; 
+      if (j == ntypes && ntypes < MAX_TRIGGER_TYPES) types[ntypes++] = type[i]; 
+      if (j < MAX_TRIGGER_TYPES) type_counts[j]++; 
+
+      if (have_last && ev[i] != last_ev + 1) 
+      { 
+        if (ngaps++ < (size_t) max_gaps) printf("Gap in %s: %u -> %u\n", args[irun], last_ev, ev[i]); 
+        if (ev[i] > last_ev) nmissing += ev[i] - last_ev - 1; 
+      }
+      have_last = 1; 
+      last_ev = ev[i]; 
+
+      if (bin > 0) 
+      { 
+        if (!bins) bin_start = floor(t[i] / bin) * bin; 
+        if (t[i] < bin_start) continue; // out of order across runs, not worth shuffling for
+        size_t b = (t[i] - bin_start) / bin; 
+        if (b >= nbins) 
+        { 
+          size_t new_nbins = nbins ? nbins : 1024; 
+          while (new_nbins <= b) new_nbins *= 2; 
+          bins = realloc(bins, new_nbins * sizeof(*bins)); 
+          memset(bins + nbins, 0, (new_nbins - nbins) * sizeof(*bins)); 
+          nbins = new_nbins; 
+        }
+        bins[b]++; 
+      }
+    }
+    ice_hdcol_unmap(&v); 
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end); 
+
+  printf("Events: %zu\n", nevents); 
+  if (nevents) 
+  { 
+    printf("Time: %.3f to %.3f (%.1f s), mean rate %.3f Hz\n", tmin, tmax, tmax - tmin, tmax > tmin ? (nevents - 1) / (tmax - tmin) : 0); 
+    printf("Event number gaps: %zu (%zu events missing)\n", ngaps, nmissing); 
+    printf("Trigger types:\n"); 
+    for (int j = 0; j < ntypes; j++) 
+    { 
+      printf("  0x%08x: %zu (%.2f%%)\n", types[j], type_counts[j], 100. * type_counts[j] / nevents); 
+    }
+  }
+
+  if (bins) 
+  { 
+    //don't print the trailing empty bins
+    size_t last = 0; 
+    for (size_t b = 0; b < nbins; b++) if (bins[b]) last = b; 
+    printf("Rate (bins of %g s):\n", bin); 
+    for (size_t b = 0; b <= last; b++) 
+    { 
+      printf("  %.0f %zu %.3f Hz\n", bin_start + b * bin, bins[b], bins[b] / bin); 
+    }
+    free(bins); 
+  }
+
+  printf("Scanned in %.2f ms\n", (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) * 1e-6); 
+  return 0; 
+}
@@ -0,0 +1,31 @@
+#include "ice-recover.h" 
+#include <stdio.h>
+#include <time.h> 
+
+/** Recovers leftover .tmp files in run directories (see ice-recover.h). 
+ * rno-g-acq does this for the previous runs when it starts, this is for doing it by hand. 
+ */ 
+
+int main(int nargs, char ** args) 
+{
+  if (nargs < 2) 
+  {
+    fprintf(stderr,"Usage: rno-g-recover-run run_dir [run_dir ...]\n"); 
+    return 1; 
+  }
+
+  int ret = 0; 
+  for (int i = 1; i < nargs; i++) 
+  {
+    struct timespec start, end; 
+    clock_gettime(CLOCK_MONOTONIC, &start); 
+    ice_recover_stats_t stats = {0}; 
+    printf("%s:\n", args[i]); 
+    ret = ice_recover_run(args[i], 1, &stats) || ret; 
+    clock_gettime(CLOCK_MONOTONIC, &end); 
+    printf("%s: recovered %d, failed %d, removed %d spares; kept %lld compressed bytes, redid %lld uncompressed bytes, in %.1f ms\n", 
+           args[i], stats.nrecovered, stats.nfailed, stats.nremoved, stats.bytes_kept, stats.bytes_redone, 
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) * 1e-6); 
+  }
+  return ret; 
+}
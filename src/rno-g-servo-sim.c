@@ -0,0 +1,572 @@
+#define _GNU_SOURCE
+#include "ice-servo.h"
+#include "ice-config.h"
+#include "rno-g.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/** Offline threshold servo simulator.
+ *
+ * Replays recorded daqstatus (files, or the daqstatus/ of run directories) through the same servo code rno-g-acq
+ * uses (ice-servo.h), for a grid of servo parameters, using all the cores, and ranks the parameter sets.
+ *
+ * Since we only know the rates at the thresholds that were actually used, the scalers are scaled with a simple
+ * response model: the rate goes exponentially with the difference between the simulated and the recorded
+ * threshold, with an e-folding of -R (RADIANT, in V) or -L (flower, in ADC counts). The direction is the one the
+ * servos assume (a lower RADIANT threshold or a higher flower threshold means a lower rate). Each daqstatus counts as
+ * one scaler update, with the servo stepping after every one (like rno-g-acq does), and to see how the servo
+ * settles, the thresholds start off by -O (RADIANT, in V) / -o (flower) from what was recorded.
+ *
+ * For each board, we look at what the servo sees (value) against its goal, relative to the goal: 
+ *   settling time: when every servoed channel gets (and stays) within the tolerance (-t) of its goal
+ *   overshoot: the furthest a channel goes past its goal after first crossing it
+ *   rate stability: the rms of the relative error after settling (or over the second half if it never does) 
+ *
+ * Parameter sets are ranked by the sum of their ranks in each of these (for the boards that have swept parameters), 
+ * with the ones that never settle last.
+ */ 
+
+#define MAX_SWEEPS 8
+#define MAX_VALUES 64
+
+enum { RADIANT, LT, NUM_BOARDS }; 
+static const char * board_names[NUM_BOARDS] = {"radiant","lt"}; 
+
+/* The parameters that can be swept */ 
+typedef struct sweep_param
+{
+  const char * name; 
+  int board; 
+  size_t offset; // of the float in acq_config_t 
+} sweep_param_t; 
+
+#define PARAM(board, member) { #member, board, offsetof(acq_config_t, member) }
+static const sweep_param_t params[] =
+{
+  PARAM(RADIANT, radiant.servo.P), 
+  PARAM(RADIANT, radiant.servo.I), 
+  PARAM(RADIANT, radiant.servo.D), 
+  PARAM(RADIANT, radiant.servo.period_weights[0]), 
+  PARAM(RADIANT, radiant.servo.period_weights[1]), 
+  PARAM(RADIANT, radiant.servo.period_weights[2]), 
+  PARAM(RADIANT, radiant.servo.max_sum_err), 
+  PARAM(RADIANT, radiant.servo.max_thresh_change), 
+  PARAM(LT, lt.servo.P), 
+  PARAM(LT, lt.servo.I), 
+  PARAM(LT, lt.servo.D), 
+  PARAM(LT, lt.servo.fast_scaler_weight), 
+  PARAM(LT, lt.servo.slow_scaler_weight), 
+}; 
+#define NUM_PARAMS (sizeof(params) / sizeof(*params))
+
+typedef struct sweep
+{
+  const sweep_param_t * param; 
+  int nvalues; 
+  float values[MAX_VALUES]; 
+} sweep_t; 
+
+typedef struct metrics
+{
+  double settling_time; // INFINITY if never 
+  double overshoot; 
+  double rms; 
+} metrics_t; 
+
+typedef struct result
+{
+  int index; 
+  metrics_t m[NUM_BOARDS]; 
+  int rank_sum; 
+  int nunsettled; // boards that never settled, which go last no matter what 
+} result_t; 
+
+static acq_config_t cfg; 
+static rno_g_daqstatus_t * dss = 0; 
+static int nds = 0; 
+static sweep_t sweeps[MAX_SWEEPS]; 
+static int nsweeps = 0; 
+static int npoints = 1; 
+static result_t * results; 
+static int next_point = 0; 
+
+static double radiant_efold = 0.005; // V 
+static double lt_efold = 2; 
+static double radiant_kick = 0.05; // V 
+static double lt_kick = 10; 
+static double tolerance = 0.1; 
+static float fast_factor = 100; 
+
+static const sweep_param_t * find_param(const char * name) 
+{
+  for (unsigned i = 0; i < NUM_PARAMS; i++) 
+  {
+    if (!strcmp(params[i].name, name)) return &params[i]; 
+  }
+  return 0; 
+}
+
+/* name=start:stop:n or name=v1,v2,... */ 
+static int parse_sweep(const char * spec) 
+{
+  if (nsweeps == MAX_SWEEPS) 
+  {
+    fprintf(stderr,"Too many sweeps (max %d)\n", MAX_SWEEPS); 
+    return -1; 
+  }
+
+  const char * eq = strchr(spec,'='); 
+  if (!eq) 
+  {
+    fprintf(stderr,"Bad sweep %s (want name=start:stop:n or name=v1,v2,...)\n", spec); 
+    return -1; 
+  }
+  char name[128]; 
+  snprintf(name, sizeof(name), "%.*s", (int) (eq - spec), spec); 
+  sweep_t * s = &sweeps[nsweeps]; 
+  s->param = find_param(name); 
+  if (!s->param) 
+  {
+    fprintf(stderr,"Don't know how to sweep %s. Can sweep:\n", name); 
+    for (unsigned i = 0; i < NUM_PARAMS; i++) fprintf(stderr,"  %s\n", params[i].name); 
+    return -1; 
+  }
+
+  float start, stop; 
+  int n; 
+  if (sscanf(eq+1, "%f:%f:%d", &start, &stop, &n) == 3) 
+  {
+    if (n < 1 || n > MAX_VALUES) 
+    {
+      fprintf(stderr,"Bad number of steps in %s (max %d)\n", spec, MAX_VALUES); 
+      return -1; 
+    }
+    s->nvalues = n; 
+    for (int i = 0; i < n; i++) s->values[i] = n == 1 ? start : start + i * (stop - start) / (n - 1); 
+  }
+  else
+  {
+    const char * p = eq + 1; 
+    s->nvalues = 0; 
+    while (*p && s->nvalues < MAX_VALUES) 
+    {
+      char * end; 
+      s->values[s->nvalues++] = strtof(p, &end); 
+      if (end == p) break; 
+      p = *end == ',' ? end + 1 : end; 
+    }
+    if (*p) 
+    {
+      fprintf(stderr,"Bad values in %s\n", spec); 
+      return -1; 
+    }
+  }
+
+  npoints *= s->nvalues; 
+  nsweeps++; 
+  return 0; 
+}
+
+/* Fill cfg with the parameters of point i of the grid */ 
+static void set_point(acq_config_t * c, int i) 
+{
+  for (int j = nsweeps - 1; j >= 0; j--) 
+  {
+    *(float*) ((char*) c + sweeps[j].param->offset) = sweeps[j].values[i % sweeps[j].nvalues]; 
+    i /= sweeps[j].nvalues; 
+  }
+}
+
+static int add_daqstatus_file(const char * path) 
+{
+  rno_g_file_handle_t h; 
+  if (rno_g_init_handle(&h, path, "r")) 
+  {
+    fprintf(stderr,"Could not open %s\n", path); 
+    return -1; 
+  }
+
+  static int capacity = 0; 
+  while (1) 
+  {
+    if (nds == capacity) 
+    {
+      capacity = capacity ? 2 * capacity : 1024; 
+      dss = realloc(dss, capacity * sizeof(*dss)); 
+    }
+    if (rno_g_daqstatus_read(h, &dss[nds]) <= 0) break; 
+    nds++; 
+  }
+  rno_g_close_handle(&h); 
+  return 0; 
+}
+
+static int is_ds_file(const struct dirent * d) 
+{
+  return strstr(d->d_name, ".ds.dat") != 0; 
+}
+
+/* A file, or a run directory (in which case its daqstatus files are read in order) */ 
+static int add_daqstatus(const char * path) 
+{
+  struct stat st; 
+  if (stat(path, &st)) 
+  {
+    fprintf(stderr,"No such file: %s\n", path); 
+    return -1; 
+  }
+  if (!S_ISDIR(st.st_mode)) return add_daqstatus_file(path); 
+
+  char * dir = 0; 
+  asprintf(&dir, "%s/daqstatus", path); 
+  struct dirent ** names; 
+  int n = scandir(dir, &names, is_ds_file, versionsort); 
+  if (n < 0) 
+  {
+    fprintf(stderr,"Could not read %s\n", dir); 
+    free(dir); 
+    return -1; 
+  }
+  int ret = 0; 
+  for (int i = 0; i < n; i++) 
+  {
+    char * file = 0; 
+    asprintf(&file, "%s/%s", dir, names[i]->d_name); 
+    ret += add_daqstatus_file(file); 
+    free(file); 
+    free(names[i]); 
+  }
+  free(names); 
+  free(dir); 
+  return ret; 
+}
+
+/* Keeps track of the metrics of one board as the simulation goes on */ 
+typedef struct tracker
+{
+  int nchan; 
+  int chans[RNO_G_NUM_RADIANT_CHANNELS]; 
+  double t0; 
+  double last_outside[RNO_G_NUM_RADIANT_CHANNELS]; // last time outside the tolerance 
+  int initial_sign[RNO_G_NUM_RADIANT_CHANNELS]; 
+  int crossed[RNO_G_NUM_RADIANT_CHANNELS]; 
+  double overshoot; 
+  int nsteps; 
+  float * rel; // [nsteps][nchan], to get the rms after the fact 
+  double * t; 
+} tracker_t; 
+
+static void tracker_init(tracker_t * tr, uint32_t mask, double t0) 
+{
+  memset(tr, 0, sizeof(*tr)); 
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+  {
+    if (mask & (1u << ch)) tr->chans[tr->nchan++] = ch; 
+  }
+  tr->t0 = t0; 
+  tr->rel = calloc(nds * (tr->nchan ?: 1), sizeof(float)); 
+  tr->t = calloc(nds, sizeof(double)); 
+}
+
+static void tracker_add(tracker_t * tr, double t, const float * value, const float * goal) 
+{
+  tr->t[tr->nsteps] = t; 
+  for (int i = 0; i < tr->nchan; i++) 
+  {
+    int ch = tr->chans[i]; 
+    double rel = goal[ch] ? (value[ch] - goal[ch]) / fabs(goal[ch]) : value[ch]; 
+    tr->rel[tr->nsteps * tr->nchan + i] = rel; 
+    if (fabs(rel) > tolerance) tr->last_outside[i] = t; 
+
+    int sign = rel > 0 ? 1 : rel < 0 ? -1 : 0; 
+    if (!tr->initial_sign[i]) tr->initial_sign[i] = sign; 
+    else if (sign == -tr->initial_sign[i]) tr->crossed[i] = 1; 
+    if (tr->crossed[i] && sign == -tr->initial_sign[i] && fabs(rel) > tr->overshoot) tr->overshoot = fabs(rel); 
+  }
+  tr->nsteps++; 
+}
+
+static void tracker_finish(tracker_t * tr, metrics_t * m) 
+{
+  double settled_at = tr->t0; 
+  for (int i = 0; i < tr->nchan; i++) 
+  {
+    if (tr->last_outside[i] > settled_at) settled_at = tr->last_outside[i]; 
+  }
+
+  //never settled if still outside at the end 
+  int never = tr->nsteps && settled_at >= tr->t[tr->nsteps-1] && settled_at > tr->t0; 
+  m->settling_time = never ? INFINITY : settled_at - tr->t0; 
+  m->overshoot = tr->overshoot; 
+
+  double sum2 = 0; 
+  int n = 0; 
+  for (int s = 0; s < tr->nsteps; s++) 
+  {
+    if (never ? s < tr->nsteps / 2 : tr->t[s] <= settled_at) continue; 
+    for (int i = 0; i < tr->nchan; i++) 
+    {
+      double rel = tr->rel[s * tr->nchan + i]; 
+      sum2 += rel * rel; 
+      n++; 
+    }
+  }
+  m->rms = n ? sqrt(sum2 / n) : 0; 
+
+  free(tr->rel); 
+  free(tr->t); 
+}
+
+static double model_factor(double sim_thresh, double rec_thresh, double efold) 
+{
+  double f = exp((sim_thresh - rec_thresh) / efold); 
+  return f > 1e6 ? 1e6 : f; 
+}
+
+static uint32_t scale_count(uint32_t count, double factor, uint32_t max) 
+{
+  double v = round(count * factor); 
+  return v > max ? max : v; 
+}
+
+static void simulate(int ipoint, result_t * res) 
+{
+  acq_config_t c = cfg; 
+  set_point(&c, ipoint); 
+
+  uint32_t radiant_mask = 0; 
+  if (c.radiant.trigger.RF[0].enabled) radiant_mask |= c.radiant.trigger.RF[0].mask; 
+  if (c.radiant.trigger.RF[1].enabled) radiant_mask |= c.radiant.trigger.RF[1].mask; 
+
+  ice_radiant_servo_t rad = {0}; 
+  ice_flower_servo_t flwr; 
+  if (ice_radiant_servo_setup(&rad, &c)) 
+  {
+    fprintf(stderr,"Could not set up the RADIANT servo\n"); 
+    return; 
+  }
+
+  //start off from the first recorded thresholds, kicked 
+  uint32_t rad_thresh[RNO_G_NUM_RADIANT_CHANNELS]; 
+  uint8_t lt_servo[RNO_G_NUM_LT_CHANNELS], lt_trig[RNO_G_NUM_LT_CHANNELS]; 
+  double kick = radiant_kick * 16777215/2.5; 
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+  {
+    double t = dss[0].radiant_thresholds[ch] + kick; 
+    rad_thresh[ch] = t < 0 ? 0 : t > 16777215 ? 16777215 : t; 
+  }
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+  {
+    double t = dss[0].lt_servo_thresholds[ch] + lt_kick; 
+    lt_servo[ch] = t < 4 ? 4 : t > 120 ? 120 : t; 
+    lt_trig[ch] = dss[0].lt_trigger_thresholds[ch]; 
+  }
+  ice_flower_servo_setup(&flwr, lt_servo); 
+
+  tracker_t tr[NUM_BOARDS]; 
+  tracker_init(&tr[RADIANT], radiant_mask, dss[0].when); 
+  tracker_init(&tr[LT], (1u << RNO_G_NUM_LT_CHANNELS) - 1, dss[0].when); 
+  float lt_goals[RNO_G_NUM_LT_CHANNELS]; 
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) lt_goals[ch] = c.lt.servo.scaler_goals[ch]; 
+
+  rno_g_daqstatus_t ds; 
+  double radiant_efold_counts = radiant_efold * 16777215/2.5; 
+  for (int i = 0; i < nds; i++) 
+  {
+    const rno_g_daqstatus_t * rec = &dss[i]; 
+    ds = *rec; 
+
+    //what the scalers would have been at our thresholds 
+    for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+    {
+      double f = model_factor(rad_thresh[ch], rec->radiant_thresholds[ch], radiant_efold_counts); 
+      ds.radiant_scalers[ch] = scale_count(rec->radiant_scalers[ch], f, 65535); 
+    }
+    for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+    {
+      double f = model_factor(rec->lt_servo_thresholds[ch], lt_servo[ch], lt_efold); 
+      ds.lt_scalers.s_100Hz.servo_per_chan[ch] = scale_count(rec->lt_scalers.s_100Hz.servo_per_chan[ch], f, UINT32_MAX); 
+      ds.lt_scalers.s_1Hz.servo_per_chan[ch] = scale_count(rec->lt_scalers.s_1Hz.servo_per_chan[ch], f, UINT32_MAX); 
+      ds.lt_scalers.s_1Hz_gated.servo_per_chan[ch] = scale_count(rec->lt_scalers.s_1Hz_gated.servo_per_chan[ch], f, UINT32_MAX); 
+    }
+
+    ice_radiant_servo_update(&rad, &c, &ds); 
+    ice_flower_servo_update(&flwr, &c, &ds, fast_factor); 
+    tracker_add(&tr[RADIANT], rec->when, rad.value, c.radiant.servo.scaler_goals); 
+    tracker_add(&tr[LT], rec->when, flwr.value, lt_goals); 
+
+    if (c.radiant.servo.enable && c.radiant.servo.servo_interval) ice_radiant_servo_step(&rad, &c, radiant_mask, rad_thresh, 0); 
+    if (c.lt.servo.enable && c.lt.servo.servo_interval) ice_flower_servo_step(&flwr, &c, lt_servo, lt_trig, 0); 
+  }
+
+  res->index = ipoint; 
+  for (int b = 0; b < NUM_BOARDS; b++) tracker_finish(&tr[b], &res->m[b]); 
+  ice_radiant_servo_free(&rad); 
+}
+
+static void * worker(void * v) 
+{
+  (void) v; 
+  int i; 
+  while ((i = __atomic_fetch_add(&next_point, 1, __ATOMIC_RELAXED)) < npoints) 
+  {
+    simulate(i, &results[i]); 
+  }
+  return 0; 
+}
+
+/* For ranking by one metric at a time */ 
+static int rank_board, rank_metric; 
+static double metric(const result_t * r) 
+{
+  const metrics_t * m = &r->m[rank_board]; 
+  return rank_metric == 0 ? m->settling_time : rank_metric == 1 ? m->overshoot : m->rms; 
+}
+
+static int by_metric(const void * a, const void * b) 
+{
+  double ma = metric(*(const result_t**) a); 
+  double mb = metric(*(const result_t**) b); 
+  return ma < mb ? -1 : ma > mb ? 1 : 0; 
+}
+
+static int by_rank_sum(const void * a, const void * b) 
+{
+  const result_t * ra = a; 
+  const result_t * rb = b; 
+  if (ra->nunsettled != rb->nunsettled) return ra->nunsettled - rb->nunsettled; 
+  return ra->rank_sum != rb->rank_sum ? ra->rank_sum - rb->rank_sum : ra->index - rb->index; 
+}
+
+static void usage() 
+{
+  fprintf(stderr,"Usage: rno-g-servo-sim [-c acq.cfg] [-s param=start:stop:n | -s param=v1,v2,...]... [-j nthreads=ncores]\n"); 
+  fprintf(stderr,"                       [-R radiant_efold_V=%g] [-L lt_efold=%g] [-O radiant_kick_V=%g] [-o lt_kick=%g]\n", 
+      radiant_efold, lt_efold, radiant_kick, lt_kick); 
+  fprintf(stderr,"                       [-t tolerance=%g] [-f lt_fast_factor=%g] [-n nshow=20] run_dir_or_ds_file ...\n", 
+      tolerance, fast_factor); 
+  fprintf(stderr,"  can sweep:"); 
+  for (unsigned i = 0; i < NUM_PARAMS; i++) fprintf(stderr," %s", params[i].name); 
+  fprintf(stderr,"\n"); 
+}
+
+int main(int nargs, char ** args) 
+{
+  init_acq_config(&cfg); 
+  int nthreads = sysconf(_SC_NPROCESSORS_ONLN); 
+  int nshow = 20; 
+  int opt; 
+
+  while ((opt = getopt(nargs, args, "c:s:j:R:L:O:o:t:f:n:h")) != -1) 
+  {
+    switch (opt) 
+    {
+      case 'c': 
+      {
+        FILE * f = fopen(optarg,"r"); 
+        if (!f || read_acq_config(f, &cfg)) 
+        {
+          fprintf(stderr,"Couldn't read %s\n", optarg); 
+          return 1; 
+        }
+        fclose(f); 
+        break; 
+      }
+      case 's': if (parse_sweep(optarg)) return 1; break; 
+      case 'j': nthreads = atoi(optarg); break; 
+      case 'R': radiant_efold = atof(optarg); break; 
+      case 'L': lt_efold = atof(optarg); break; 
+      case 'O': radiant_kick = atof(optarg); break; 
+      case 'o': lt_kick = atof(optarg); break; 
+      case 't': tolerance = atof(optarg); break; 
+      case 'f': fast_factor = atof(optarg); break; 
+      case 'n': nshow = atoi(optarg); break; 
+      default: usage(); return 1; 
+    }
+  }
+
+  if (optind >= nargs) 
+  {
+    usage(); 
+    return 1; 
+  }
+
+  for (int i = optind; i < nargs; i++) 
+  {
+    if (add_daqstatus(args[i])) return 1; 
+  }
+  if (nds < 2) 
+  {
+    fprintf(stderr,"Need at least a couple of daqstatus to replay, only have %d\n", nds); 
+    return 1; 
+  }
+
+  //which boards to rank by 
+  int rank_boards[NUM_BOARDS] = {!nsweeps, !nsweeps}; 
+  for (int j = 0; j < nsweeps; j++) rank_boards[sweeps[j].param->board] = 1; 
+
+  if (nthreads < 1) nthreads = 1; 
+  if (nthreads > npoints) nthreads = npoints; 
+  printf("Replaying %d daqstatus (%.0f s) for %d parameter sets on %d threads\n", nds, dss[nds-1].when - dss[0].when, npoints, nthreads); 
+
+  results = calloc(npoints, sizeof(result_t)); 
+  pthread_t threads[nthreads]; 
+  for (int i = 0; i < nthreads; i++) pthread_create(&threads[i], 0, worker, 0); 
+  for (int i = 0; i < nthreads; i++) pthread_join(threads[i], 0); 
+
+  //rank by each metric, then by the sum of ranks 
+  result_t ** sorted = malloc(npoints * sizeof(*sorted)); 
+  for (rank_board = 0; rank_board < NUM_BOARDS; rank_board++) 
+  {
+    if (!rank_boards[rank_board]) continue; 
+    for (rank_metric = 0; rank_metric < 3; rank_metric++) 
+    {
+      for (int i = 0; i < npoints; i++) sorted[i] = &results[i]; 
+      qsort(sorted, npoints, sizeof(*sorted), by_metric); 
+      int rank = 0; 
+      for (int i = 0; i < npoints; i++) 
+      {
+        if (i > 0 && metric(sorted[i]) != metric(sorted[i-1])) rank = i; //ties get the same rank 
+        sorted[i]->rank_sum += rank; 
+        if (rank_metric == 0 && !isfinite(sorted[i]->m[rank_board].settling_time)) sorted[i]->nunsettled++; 
+      }
+    }
+  }
+  free(sorted); 
+  qsort(results, npoints, sizeof(result_t), by_rank_sum); 
+
+  printf("%4s", "rank"); 
+  for (int j = 0; j < nsweeps; j++) printf(" %12s", strchr(sweeps[j].param->name,'.') + 1); 
+  for (int b = 0; b < NUM_BOARDS; b++) 
+  {
+    if (rank_boards[b]) printf(" %9s-settle %9s-over %9s-rms", board_names[b], board_names[b], board_names[b]); 
+  }
+  printf("\n"); 
+
+  for (int i = 0; i < npoints && i < nshow; i++) 
+  {
+    acq_config_t c = cfg; 
+    set_point(&c, results[i].index); 
+    printf("%4d", i+1); 
+    for (int j = 0; j < nsweeps; j++) printf(" %12g", *(float*) ((char*) &c + sweeps[j].param->offset)); 
+    for (int b = 0; b < NUM_BOARDS; b++) 
+    {
+      if (!rank_boards[b]) continue; 
+      const metrics_t * m = &results[i].m[b]; 
+      if (isfinite(m->settling_time)) printf(" %14.0fs", m->settling_time); 
+      else printf(" %15s", "never"); 
+      printf(" %14.3f %13.3f", m->overshoot, m->rms); 
+    }
+    printf("\n"); 
+  }
+
+  free(results); 
+  free(dss); 
+  return 0; 
+}
@@ -0,0 +1,172 @@
+#include "ice-dshist.h"
+#include "rno-g.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+/** Prints recent rate and threshold trends from the shared daqstatus history rno-g-acq keeps (see ice-dshist.h), 
+ * so checking on a station doesn't need to go through the daqstatus files on the SD card.
+ *
+ * For each RADIANT channel and each flower channel, the latest, mean, min and max rate, and the threshold, each with
+ * a trend (least-squares slope, per hour) over the last -t seconds (or everything there is). With -a, every status is
+ * printed instead.
+ */ 
+
+#define V_PER_COUNT (2.5/16777215)
+
+typedef struct stat_acc
+{
+  int n; 
+  double sum, min, max, last; 
+  double st, stt, sx, stx; // for the slope 
+} stat_acc_t; 
+
+static void acc_add(stat_acc_t * a, double t, double x) 
+{
+  if (!a->n || x < a->min) a->min = x; 
+  if (!a->n || x > a->max) a->max = x; 
+  a->n++; 
+  a->sum += x; 
+  a->last = x; 
+  a->st += t; 
+  a->stt += t*t; 
+  a->sx += x; 
+  a->stx += t*x; 
+}
+
+static double acc_mean(const stat_acc_t * a) 
+{
+  return a->n ? a->sum / a->n : 0; 
+}
+
+/* per hour */ 
+static double acc_slope(const stat_acc_t * a) 
+{
+  double d = a->n * a->stt - a->st * a->st; 
+  if (a->n < 2 || d <= 0) return 0; 
+  return 3600 * (a->n * a->stx - a->st * a->sx) / d; 
+}
+
+static double radiant_rate(const rno_g_daqstatus_t * ds, int ch) 
+{
+  float period = ds->radiant_scaler_period ?: 1; 
+  return ds->radiant_scalers[ch] * (1 + ds->radiant_prescalers[ch]) / period; 
+}
+
+static void usage() 
+{
+  fprintf(stderr,"Usage: rno-g-status-trends [-f history=/rno-g/run/daqstatus-history.dat] [-t seconds] [-a]\n"); 
+  fprintf(stderr,"   -t: only look at the last this many seconds\n"); 
+  fprintf(stderr,"   -a: print every status (time, RADIANT rates, flower 1 Hz servo scalers) rather than the trends\n"); 
+}
+
+int main(int nargs, char ** args) 
+{
+  const char * path = "/rno-g/run/daqstatus-history.dat"; 
+  double seconds = 0; 
+  int all = 0; 
+  int opt; 
+
+  while ((opt = getopt(nargs, args, "f:t:ah")) != -1) 
+  {
+    switch (opt) 
+    {
+      case 'f': path = optarg; break; 
+      case 't': seconds = atof(optarg); break; 
+      case 'a': all = 1; break; 
+      default: usage(); return 1; 
+    }
+  }
+
+  ice_dshist_t * h = ice_dshist_open(path); 
+  if (!h) return 1; 
+
+  int nslots = ice_dshist_nslots(h); 
+  rno_g_daqstatus_t * dss = calloc(nslots, sizeof(rno_g_daqstatus_t)); 
+  int n = ice_dshist_read(h, nslots, dss, 0); 
+  ice_dshist_close(h); 
+
+  if (!n) 
+  {
+    printf("Nothing in %s yet\n", path); 
+    free(dss); 
+    return 0; 
+  }
+
+  int first = 0; 
+  if (seconds > 0) 
+  {
+    while (first < n - 1 && dss[first].when < dss[n-1].when - seconds) first++; 
+  }
+
+  double t0 = dss[n-1].when; 
+  time_t tfirst = dss[first].when, tlast = dss[n-1].when; 
+  char sfirst[32], slast[32]; 
+  strftime(sfirst, sizeof(sfirst), "%F %T", gmtime(&tfirst)); 
+  strftime(slast, sizeof(slast), "%F %T", gmtime(&tlast)); 
+  printf("%d statuses from %s to %s UTC (%.0f s), station %d\n", n - first, sfirst, slast, dss[n-1].when - dss[first].when, dss[n-1].station); 
+
+  if (all) 
+  {
+    printf("%-18s", "time"); 
+    for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) printf(" rad%-4d", ch); 
+    for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) printf(" lt%-5d", ch); 
+    printf("\n"); 
+    for (int i = first; i < n; i++) 
+    {
+      printf("%-18.3f", dss[i].when); 
+      for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) printf(" %7.2f", radiant_rate(&dss[i], ch)); 
+      for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) printf(" %7u", dss[i].lt_scalers.s_1Hz.servo_per_chan[ch]); 
+      printf("\n"); 
+    }
+    free(dss); 
+    return 0; 
+  }
+
+  stat_acc_t rad_rate[RNO_G_NUM_RADIANT_CHANNELS] = {0}; 
+  stat_acc_t rad_thresh[RNO_G_NUM_RADIANT_CHANNELS] = {0}; 
+  stat_acc_t lt_rate[RNO_G_NUM_LT_CHANNELS] = {0}; 
+  stat_acc_t lt_servo[RNO_G_NUM_LT_CHANNELS] = {0}; 
+  stat_acc_t lt_trig[RNO_G_NUM_LT_CHANNELS] = {0}; 
+
+  for (int i = first; i < n; i++) 
+  {
+    double t = dss[i].when - t0; // relative, so the sums don't lose precision 
+    for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+    {
+      acc_add(&rad_rate[ch], t, radiant_rate(&dss[i], ch)); 
+      acc_add(&rad_thresh[ch], t, dss[i].radiant_thresholds[ch] * V_PER_COUNT); 
+    }
+    for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+    {
+      acc_add(&lt_rate[ch], t, dss[i].lt_scalers.s_1Hz.servo_per_chan[ch]); 
+      acc_add(&lt_servo[ch], t, dss[i].lt_servo_thresholds[ch]); 
+      acc_add(&lt_trig[ch], t, dss[i].lt_trigger_thresholds[ch]); 
+    }
+  }
+
+  printf("\nRADIANT          rate (Hz)                                     threshold (V)\n"); 
+  printf("%3s %9s %9s %9s %9s %10s   %7s %7s %9s\n", "ch", "now", "mean", "min", "max", "trend/h", "now", "mean", "mV/h"); 
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+  {
+    printf("%3d %9.2f %9.2f %9.2f %9.2f %+10.2f   %7.4f %7.4f %+9.2f\n", ch, 
+        rad_rate[ch].last, acc_mean(&rad_rate[ch]), rad_rate[ch].min, rad_rate[ch].max, acc_slope(&rad_rate[ch]), 
+        rad_thresh[ch].last, acc_mean(&rad_thresh[ch]), 1e3 * acc_slope(&rad_thresh[ch])); 
+  }
+
+  printf("\nflower           servo scalers (1 Hz)                          servo threshold        trigger threshold\n"); 
+  printf("%3s %9s %9s %9s %9s %10s   %7s %7s %9s   %7s %9s\n", "ch", "now", "mean", "min", "max", "trend/h", "now", "mean", "trend/h", "now", "trend/h"); 
+  for (int ch = 0; ch < RNO_G_NUM_LT_CHANNELS; ch++) 
+  {
+    printf("%3d %9.0f %9.1f %9.0f %9.0f %+10.1f   %7.0f %7.2f %+9.2f   %7.0f %+9.2f\n", ch, 
+        lt_rate[ch].last, acc_mean(&lt_rate[ch]), lt_rate[ch].min, lt_rate[ch].max, acc_slope(&lt_rate[ch]), 
+        lt_servo[ch].last, acc_mean(&lt_servo[ch]), acc_slope(&lt_servo[ch]), 
+        lt_trig[ch].last, acc_slope(&lt_trig[ch])); 
+  }
+
+  free(dss); 
+  return 0; 
+}
@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include "ice-manifest.h"
+#include "ice-crc32c.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+/** Checks the files of one or more runs against their manifests (see ice-manifest.h). 
+ *
+ * Every file in the manifest is read back and its size and CRC32C compared. Files are spread over 
+ * several threads, since on anything with more than one core (or storage that likes deep queues), 
+ * that goes a lot faster. Anything missing or different gets printed, and the exit status is 
+ * nonzero if there was any. Files that aren't in the manifest (aux files, containers) aren't checked. 
+ */
+
+enum { CHECK_OK, CHECK_MISSING, CHECK_SIZE, CHECK_CRC }; 
+
+typedef struct job
+{
+  const char * run_dir; 
+  ice_manifest_entry_t * entries; 
+  int * results; 
+  int n; 
+  int next; // shared, handed out with __sync_fetch_and_add 
+  uint64_t bytes; 
+} job_t; 
+
+static void * check_thread(void * v) 
+{
+  job_t * job = v; 
+  int i; 
+  uint64_t bytes = 0; 
+  while ((i = __sync_fetch_and_add(&job->next, 1)) < job->n) 
+  {
+    const ice_manifest_entry_t * e = &job->entries[i]; 
+    char * path = 0; 
+    asprintf(&path, "%s/%s", job->run_dir, e->name); 
+    uint64_t size; 
+    uint32_t crc; 
+    if (ice_manifest_checksum_file(path, &size, &crc)) job->results[i] = CHECK_MISSING; 
+    else if (size != e->size) job->results[i] = CHECK_SIZE; 
+    else if (crc != e->crc32c) job->results[i] = CHECK_CRC; 
+    else job->results[i] = CHECK_OK; 
+    bytes += size; 
+    free(path); 
+  }
+  __sync_fetch_and_add(&job->bytes, bytes); 
+  return 0; 
+}
+
+static void usage() 
+{
+  fprintf(stderr,"Usage: rno-g-verify-run [-j nthreads] [-v] run_dir [run_dir ...]\n"); 
+  fprintf(stderr,"   -j  number of threads (default: number of CPUs)\n"); 
+  fprintf(stderr,"   -v  print every file, not just the bad ones\n"); 
+}
+
+int main(int nargs, char ** args) 
+{
+  int nthreads = sysconf(_SC_NPROCESSORS_ONLN); 
+  int verbose = 0; 
+  int opt; 
+
+  while ((opt = getopt(nargs, args, "j:vh")) != -1) 
+  {
+    switch (opt) 
+    {
+      case 'j': nthreads = atoi(optarg); break; 
+      case 'v': verbose = 1; break; 
+      default: usage(); return 1; 
+    }
+  }
+  if (nthreads < 1) nthreads = 1; 
+
+  if (optind >= nargs) 
+  {
+    usage(); 
+    return 1; 
+  }
+
+  int nbad = 0; 
+  pthread_t * threads = calloc(nthreads, sizeof(pthread_t)); 
+
+  for (int irun = optind; irun < nargs; irun++) 
+  {
+    job_t job = { .run_dir = args[irun] }; 
+    job.n = ice_manifest_load(job.run_dir, &job.entries); 
+    if (job.n < 0) 
+    {
+      fprintf(stderr,"No manifest in %s\n", job.run_dir); 
+      nbad++; 
+      continue; 
+    }
+    job.results = calloc(job.n ? job.n : 1, sizeof(int)); 
+
+    struct timespec start, end; 
+    clock_gettime(CLOCK_MONOTONIC, &start); 
+    int nt = nthreads < job.n ? nthreads : (job.n ? job.n : 1); 
+    for (int i = 0; i < nt; i++) pthread_create(&threads[i], 0, check_thread, &job); 
+    for (int i = 0; i < nt; i++) pthread_join(threads[i], 0); 
+    clock_gettime(CLOCK_MONOTONIC, &end); 
+
+    int counts[4] = {0}; 
+    for (int i = 0; i < job.n; i++) 
+    {
+      int r = job.results[i]; 
+      counts[r]++; 
+      const ice_manifest_entry_t * e = &job.entries[i]; 
+      if (r == CHECK_MISSING) printf("MISSING  %s/%s\n", job.run_dir, e->name); 
+      else if (r == CHECK_SIZE) printf("SIZE     %s/%s\n", job.run_dir, e->name); 
+      else if (r == CHECK_CRC) printf("CRC      %s/%s\n", job.run_dir, e->name); 
+      else if (verbose) printf("OK       %s/%s\n", job.run_dir, e->name); 
+    }
+
+    double dt = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9; 
+    printf("%s: %d files, %d ok, %d missing, %d wrong size, %d bad checksum (%.1f MB in %.2f s, %s, %d threads)\n", 
+           job.run_dir, job.n, counts[CHECK_OK], counts[CHECK_MISSING], counts[CHECK_SIZE], counts[CHECK_CRC], 
+           job.bytes / 1048576., dt, ice_crc32c_impl(), nt); 
+    nbad += job.n - counts[CHECK_OK]; 
+
+    free(job.results); 
+    free(job.entries); 
+  }
+
+  free(threads); 
+  return nbad ? 1 : 0; 
+}
@@ -0,0 +1,257 @@
+#define _GNU_SOURCE
+#include "ice-writer.h"
+#include "ice-config.h"
+#include "ice-common.h"
+#include "ice-manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <ftw.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+/** How fast can the write thread go?
+ *
+ * Feeds synthetic events (band-limited noise at about the RADIANT's level, plus the odd pulse for RF triggers) 
+ * through the same output path rno-g-acq uses (ice-writer.h: rotation, compression, index sidecars, manifest, 
+ * containers, the file list...) into a directory of your choice, once per acq config given (or just the default
+ * one), and reports events/s, MB/s, CPU time per event and file rotation stalls.
+ *
+ * Point -d at a tmpfs to see the CPU side, or at the SD card to see the whole thing.
+ */ 
+
+#define POOL_SIZE 16
+#define NOISE_RMS 20
+
+static FILE * file_list = 0; 
+static int file_list_fd = 0; 
+
+static int add_to_file_list(const char * path) 
+{
+  flock(file_list_fd, LOCK_EX); 
+  fprintf(file_list,"%s\n", path); 
+  fflush(file_list); 
+  flock(file_list_fd, LOCK_UN); 
+  return 0; 
+}
+
+static double total_bytes; 
+static int total_files; 
+static int add_size(const char * path, const struct stat * st, int type, struct FTW * ftw) 
+{
+  (void) path; 
+  (void) ftw; 
+  if (type == FTW_F) 
+  {
+    total_bytes += st->st_size; 
+    total_files++; 
+  }
+  return 0; 
+}
+
+static int remove_file(const char * path, const struct stat * st, int type, struct FTW * ftw) 
+{
+  (void) st; 
+  (void) type; 
+  (void) ftw; 
+  return remove(path); 
+}
+
+static double gaussian(struct drand48_data * rand) 
+{
+  double u1, u2; 
+  drand48_r(rand, &u1); 
+  drand48_r(rand, &u2); 
+  return sqrt(-2 * log(1 - u1)) * cos(2 * M_PI * u2); 
+}
+
+/* White noise through a two-pole bandpass (around a quarter of the sampling rate), scaled to NOISE_RMS.
+ * If pulse, a damped sinusoid goes on top, a bit like a real RF trigger. */ 
+static void fill_waveform(rno_g_waveform_t * wf, int nsamples, int pulse, struct drand48_data * rand) 
+{
+  const double r = 0.9; 
+  const double a1 = 0; // 2 r cos(pi/2) 
+  const double a2 = -r*r; 
+  const double gain = NOISE_RMS * sqrt(1 - r*r*r*r) / sqrt(1 + r*r); 
+
+  wf->radiant_nsamples = nsamples; 
+  for (int ch = 0; ch < RNO_G_NUM_RADIANT_CHANNELS; ch++) 
+  {
+    double y1 = 0, y2 = 0; 
+    int pulse_at = pulse ? nsamples / 3 + ch * 4 : -1; 
+    for (int i = 0; i < nsamples; i++) 
+    {
+      double y = gaussian(rand) + a1 * y1 + a2 * y2; 
+      y2 = y1; 
+      y1 = y; 
+      double v = gain * y; 
+      if (pulse_at >= 0 && i >= pulse_at) 
+      {
+        double t = i - pulse_at; 
+        v += 10 * NOISE_RMS * exp(-t / 20.) * sin(2 * M_PI * t / 5.); 
+      }
+      wf->radiant_waveforms[ch][i] = lrint(v); 
+    }
+  }
+}
+
+static void usage() 
+{
+  fprintf(stderr,"Usage: rno-g-writer-bench [-d dir=/tmp/rno-g-writer-bench] [-n nevents=10000] [-s events_per_daqstatus=100]\n"); 
+  fprintf(stderr,"                          [-f forced_fraction=0.1] [-k] [acq.cfg ...]\n"); 
+  fprintf(stderr,"   each config is run into dir/N (N = 0, 1, ...), which is emptied afterwards unless -k\n"); 
+}
+
+int main(int nargs, char ** args) 
+{
+  const char * dir = "/tmp/rno-g-writer-bench"; 
+  int nevents = 10000; 
+  int events_per_ds = 100; 
+  double forced_fraction = 0.1; 
+  int keep = 0; 
+  int opt; 
+
+  while ((opt = getopt(nargs, args, "d:n:s:f:kh")) != -1) 
+  {
+    switch (opt) 
+    {
+      case 'd': dir = optarg; break; 
+      case 'n': nevents = atoi(optarg); break; 
+      case 's': events_per_ds = atoi(optarg); break; 
+      case 'f': forced_fraction = atof(optarg); break; 
+      case 'k': keep = 1; break; 
+      default: usage(); return 1; 
+    }
+  }
+
+  if (mkdir_if_needed(dir)) 
+  {
+    fprintf(stderr,"Couldn't make %s\n", dir); 
+    return 1; 
+  }
+
+  int nconfigs = nargs > optind ? nargs - optind : 1; 
+  acq_config_t * cfg = calloc(1, sizeof(acq_config_t)); 
+  rno_g_waveform_t * pool = calloc(POOL_SIZE, sizeof(rno_g_waveform_t)); 
+  struct drand48_data rand; 
+  srand48_r(1234, &rand); 
+
+  printf("%-24s %10s %10s %10s %10s %10s %8s %10s %10s\n", "config", "events/s", "in MB/s", "out MB/s", "ratio", "CPU us/ev", 
+         "files", "max stall", "mean stall"); 
+
+  for (int icfg = 0; icfg < nconfigs; icfg++) 
+  {
+    const char * cfg_name = nargs > optind ? args[optind + icfg] : "(default)"; 
+    init_acq_config(cfg); 
+    if (nargs > optind) 
+    {
+      FILE * f = fopen(cfg_name,"r"); 
+      if (!f || read_acq_config(f, cfg)) 
+      {
+        fprintf(stderr,"Couldn't read %s, skipping\n", cfg_name); 
+        if (f) fclose(f); 
+        continue; 
+      }
+      fclose(f); 
+    }
+
+    //the pool of events depends on the number of samples, so make it for each config 
+    int nsamples = 1024 * cfg->radiant.readout.nbuffers_per_readout; 
+    if (nsamples <= 0 || nsamples > RNO_G_MAX_RADIANT_NSAMPLES) nsamples = RNO_G_MAX_RADIANT_NSAMPLES; 
+    for (int i = 0; i < POOL_SIZE; i++) fill_waveform(&pool[i], nsamples, i % 2, &rand); 
+
+    char * run_dir = 0; 
+    asprintf(&run_dir, "%s/%d", dir, icfg); 
+    char path[strlen(run_dir) + 64]; 
+    const char * subdirs[] = {"", "waveforms", "header", "daqstatus", "aux"}; 
+    for (unsigned i = 0; i < sizeof(subdirs) / sizeof(*subdirs); i++) 
+    {
+      sprintf(path, "%s/%s", run_dir, subdirs[i]); 
+      mkdir_if_needed(path); 
+    }
+    sprintf(path, "%s/aux/acq-file-list.txt", run_dir); 
+    file_list = fopen(path, "w"); 
+    if (!file_list) 
+    {
+      fprintf(stderr,"Couldn't open %s, skipping\n", path); 
+      free(run_dir); 
+      continue; 
+    }
+    file_list_fd = fileno(file_list); 
+    ice_manifest_create(run_dir); 
+
+    rno_g_header_t hd = {0}; 
+    rno_g_daqstatus_t ds = {0}; 
+    double in_bytes = 0; 
+
+    struct timespec start, end, cpu_start, cpu_end; 
+    clock_gettime(CLOCK_MONOTONIC, &start); 
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start); 
+
+    ice_writer_t * w = ice_writer_open(cfg, run_dir, add_to_file_list); 
+    if (!w) 
+    {
+      fprintf(stderr,"Couldn't start the writer, stopping\n"); 
+      fclose(file_list); 
+      free(run_dir); 
+      return 1; 
+    }
+    for (int i = 0; i < nevents; i++) 
+    {
+      double u; 
+      drand48_r(&rand, &u); 
+      int forced = u < forced_fraction; 
+      rno_g_waveform_t * wf = &pool[(2 * i + !forced) % POOL_SIZE]; // odd ones have pulses 
+
+      hd.event_number = i; 
+      hd.trigger_number = i; 
+      hd.trigger_type = forced ? RNO_G_TRIGGER_SOFT : RNO_G_TRIGGER_RF_LT_SIMPLE; 
+      hd.readout_time_secs = 1600000000 + i / 10; 
+      hd.readout_time_nsecs = (i % 10) * 100000000; 
+      wf->event_number = i; 
+
+      ice_writer_event(w, &hd, wf, 1); 
+      in_bytes += sizeof(hd) + sizeof(wf->radiant_waveforms[0][0]) * RNO_G_NUM_RADIANT_CHANNELS * nsamples; 
+
+      if (events_per_ds > 0 && i % events_per_ds == 0) 
+      {
+        ds.when = hd.readout_time_secs + 1e-9 * hd.readout_time_nsecs; 
+        ice_writer_daqstatus(w, &ds); 
+        in_bytes += sizeof(ds); 
+      }
+    }
+
+    ice_writer_stats_t stats; 
+    ice_writer_get_stats(w, &stats, 0); 
+    ice_writer_close(w); // include the last files, so the fin thread is counted fully 
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end); 
+    clock_gettime(CLOCK_MONOTONIC, &end); 
+    fclose(file_list); 
+
+    double elapsed = timespec_difference(&end, &start); 
+    double cpu = timespec_difference(&cpu_end, &cpu_start); 
+
+    total_bytes = 0; 
+    total_files = 0; 
+    nftw(run_dir, add_size, 16, FTW_PHYS); 
+
+    printf("%-24s %10.1f %10.2f %10.2f %10.2f %10.1f %8d %8.2fms %8.3fms\n", 
+           cfg_name, nevents / elapsed, in_bytes / elapsed / 1e6, total_bytes / elapsed / 1e6, 
+           total_bytes > 0 ? in_bytes / total_bytes : 0, 1e6 * cpu / nevents, total_files, 
+           stats.max_stall * 1e3, stats.nrotations ? stats.total_stall / stats.nrotations * 1e3 : 0); 
+
+    if (!keep && nftw(run_dir, remove_file, 16, FTW_DEPTH | FTW_PHYS)) 
+    {
+      fprintf(stderr,"Couldn't clean up %s\n", run_dir); 
+    }
+    free(run_dir); 
+  }
+
+  free(pool); 
+  free(cfg); 
+  return 0; 
+}
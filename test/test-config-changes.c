@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+#include "ice-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Checks acq_config_changes: that each runtime setting maps to the hardware changes it needs (and no others), 
+ * that settings the threads just read (or that only matter at startup) don't ask for anything, and that the
+ * log names what changed.
+ */ 
+
+static int nfail = 0; 
+
+#define CHECK(cond, ...) do { if (!(cond)) { nfail++; printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } while(0)
+
+static acq_config_t base; 
+
+/* the changes between base and cfg, with the log in log_buf */ 
+static char log_buf[4096]; 
+static uint32_t changes(const acq_config_t * cfg) 
+{
+  FILE * log = fmemopen(log_buf, sizeof(log_buf), "w"); 
+  uint32_t c = acq_config_changes(&base, cfg, log); 
+  fclose(log); 
+  return c; 
+}
+
+static void expect(const char * what, const acq_config_t * cfg, uint32_t want, const char * log_has) 
+{
+  uint32_t got = changes(cfg); 
+  CHECK(got == want, "%s: got changes 0x%x, wanted 0x%x", what, got, want); 
+  if (log_has) CHECK(strstr(log_buf, log_has) != NULL, "%s: log doesn't mention %s:\n%s", what, log_has, log_buf); 
+  else CHECK(!*log_buf, "%s: nothing should be logged, got:\n%s", what, log_buf); 
+}
+
+int main() 
+{
+  init_acq_config(&base); 
+  acq_config_t cfg; 
+
+  cfg = base; 
+  expect("no change", &cfg, 0, NULL); 
+  CHECK(acq_config_changes(&base, &cfg, NULL) == 0, "no change (no log)"); 
+
+  // things the threads just read, or only use at startup 
+  cfg = base; 
+  cfg.radiant.servo.P += 1; 
+  cfg.radiant.thresholds.max += 0.1; 
+  cfg.lt.servo.I += 1; 
+  cfg.output.seconds_per_run += 1; 
+  cfg.radiant.device.uart_device = "/dev/elsewhere"; 
+  cfg.calib.rev = "Z"; 
+  expect("servo, limits, output, strings", &cfg, 0, NULL); 
+
+  cfg = base; 
+  cfg.radiant.pps.pps_holdoff += 1; 
+  expect("pps holdoff", &cfg, ACQ_CFG_RADIANT_PPS, "radiant.pps.pps_holdoff"); 
+
+  cfg = base; 
+  cfg.radiant.trigger.RF[1].readout_delay += 10; 
+  expect("RF1 readout delay", &cfg, ACQ_CFG_RADIANT_DELAYS, "radiant.trigger.RF[1].readout_delay"); 
+
+  cfg = base; 
+  cfg.radiant.scalers.prescal_m1[5] += 1; 
+  expect("one prescaler", &cfg, ACQ_CFG_RADIANT_SCALERS, "radiant.scalers.prescal_m1[5]"); 
+
+  cfg = base; 
+  cfg.radiant.trigger.RF[0].mask ^= 0x10; 
+  expect("RF0 mask", &cfg, ACQ_CFG_RADIANT_TRIGGER, "radiant.trigger.RF[0].mask: 0x"); 
+
+  cfg = base; 
+  cfg.radiant.trigger.RF[0].window += 5; 
+  expect("RF0 window", &cfg, ACQ_CFG_RADIANT_TRIGGER, "radiant.trigger.RF[0].window"); 
+
+  cfg = base; 
+  cfg.radiant.trigger.pps.enabled = !cfg.radiant.trigger.pps.enabled; 
+  expect("pps trigger", &cfg, ACQ_CFG_RADIANT_TRIGGER_ENABLES, "radiant.trigger.pps.enabled"); 
+
+  cfg = base; 
+  cfg.lt.trigger.vpp = !cfg.lt.trigger.vpp; 
+  expect("lt vpp", &cfg, ACQ_CFG_LT_TRIGGER, "lt.trigger.vpp"); 
+
+  cfg = base; 
+  cfg.lt.trigger.enable_rf_trigger = !cfg.lt.trigger.enable_rf_trigger; 
+  expect("lt rf trigger", &cfg, ACQ_CFG_LT_TRIGGER | ACQ_CFG_LT_TRIGGER_ENABLES, "lt.trigger.enable_rf_trigger"); 
+
+  cfg = base; 
+  cfg.lt.trigger.enable_pps_trigger_sma_out = !cfg.lt.trigger.enable_pps_trigger_sma_out; 
+  expect("lt pps sma out", &cfg, ACQ_CFG_LT_TRIGGER_ENABLES | ACQ_CFG_LT_PPS_DELAY, "lt.trigger.enable_pps_trigger_sma_out"); 
+
+  cfg = base; 
+  cfg.lt.trigger.pps_trigger_delay += 100; 
+  expect("lt pps delay", &cfg, ACQ_CFG_LT_PPS_DELAY, "lt.trigger.pps_trigger_delay"); 
+
+  cfg = base; 
+  cfg.lt.gain.fixed_gain_codes[2] += 1; 
+  expect("one lt gain", &cfg, ACQ_CFG_LT_GAINS, "lt.gain.fixed_gain_codes[2]"); 
+
+  cfg = base; 
+  cfg.calib.atten += 1; 
+  expect("calpulser attenuation", &cfg, ACQ_CFG_CALIB, "calib.atten"); 
+
+  // several at once add up, and each gets logged 
+  cfg = base; 
+  cfg.radiant.pps.sync_out = !cfg.radiant.pps.sync_out; 
+  cfg.lt.trigger.window += 1; 
+  cfg.calib.channel += 1; 
+  expect("several", &cfg, ACQ_CFG_RADIANT_PPS | ACQ_CFG_LT_TRIGGER | ACQ_CFG_CALIB, "radiant.pps.sync_out"); 
+  CHECK(strstr(log_buf, "lt.trigger.window") && strstr(log_buf, "calib.channel"), "several: not all logged:\n%s", log_buf); 
+
+  // and the other way round 
+  CHECK(acq_config_changes(&cfg, &base, NULL) == (ACQ_CFG_RADIANT_PPS | ACQ_CFG_LT_TRIGGER | ACQ_CFG_CALIB), "several, reversed"); 
+
+  // every change type has a name 
+  for (int i = 0; i < ACQ_CFG_NUM_CHANGE_TYPES; i++) 
+  {
+    CHECK(strcmp(acq_config_change_name(1u << i), "?"), "change type %d has no name", i); 
+  }
+  CHECK((ACQ_CFG_RADIANT_ANY & ACQ_CFG_LT_ANY) == 0, "RADIANT and flower changes overlap"); 
+
+  if (nfail) printf("%d FAILED\n", nfail); 
+  else printf("test-config-changes: all OK\n"); 
+  return nfail ? 1 : 0; 
+}
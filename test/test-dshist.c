@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include "ice-dshist.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/** Checks the daqstatus history ring (ice-dshist.h): what ice_dshist_read gives back as the ring fills and wraps, 
+ * that a slot left half-written by a dead writer is skipped, and that a reader racing a writer (through its own
+ * mapping, as rno-g-status-trends would) never gets a torn status, or statuses out of order. (Successive reads
+ * can go backwards: if the writer laps a read, the newer slots are skipped, so less than the last NSLOTS comes back.) 
+ */ 
+
+static int nfail = 0; 
+
+#define CHECK(cond, ...) do { if (!(cond)) { nfail++; printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } while(0)
+
+#define NSLOTS 8
+#define NRACE 200000
+
+/* status i: every byte is i & 0xff, except the first threshold, which is i */ 
+static void fill(rno_g_daqstatus_t * ds, uint32_t i) 
+{
+  memset(ds, i & 0xff, sizeof(*ds)); 
+  ds->radiant_thresholds[0] = i; 
+}
+
+/* returns i if ds is a whole status i, otherwise -1 */ 
+static int64_t check_whole(const rno_g_daqstatus_t * ds) 
+{
+  uint32_t i = ds->radiant_thresholds[0]; 
+  rno_g_daqstatus_t want; 
+  fill(&want, i); 
+  return memcmp(ds, &want, sizeof(want)) ? -1 : (int64_t) i; 
+}
+
+static void expect_range(const char * what, ice_dshist_t * h, int n, int want_n, uint32_t want_first) 
+{
+  rno_g_daqstatus_t ds[2 * NSLOTS]; 
+  uint64_t times[2 * NSLOTS]; 
+  int got = ice_dshist_read(h, n, ds, times); 
+  CHECK(got == want_n, "%s: read %d, wanted %d", what, got, want_n); 
+  for (int k = 0; k < got && k < want_n; k++) 
+  {
+    CHECK(check_whole(&ds[k]) == want_first + k, "%s: status %d is %lld, wanted %u", what, k, (long long) check_whole(&ds[k]), want_first + k); 
+    if (k) CHECK(times[k] >= times[k-1], "%s: times go backwards", what); 
+  }
+}
+
+
+static const char * path; 
+static volatile int writer_done; 
+
+static void * writer(void * arg) 
+{
+  ice_dshist_t * w = arg; 
+  rno_g_daqstatus_t ds; 
+  for (uint32_t i = 0; i < NRACE; i++) 
+  {
+    fill(&ds, 1000 + i); 
+    ice_dshist_append(w, &ds); 
+  }
+  __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE); 
+  return NULL; 
+}
+
+int main() 
+{
+  char tmpl[] = "/tmp/test-dshist-XXXXXX"; 
+  int fd = mkstemp(tmpl); 
+  if (fd < 0) 
+  {
+    printf("Could not make a temporary file\n"); 
+    return 1; 
+  }
+  close(fd); 
+  path = tmpl; 
+
+  ice_dshist_t * w = ice_dshist_create(path, NSLOTS); 
+  CHECK(w != NULL, "create"); 
+  ice_dshist_t * r = ice_dshist_open(path); 
+  CHECK(r != NULL, "open"); 
+  if (!w || !r) return 1; 
+  CHECK(ice_dshist_nslots(r) == NSLOTS, "nslots"); 
+
+  rno_g_daqstatus_t ds; 
+  expect_range("empty", r, NSLOTS, 0, 0); 
+
+  for (uint32_t i = 0; i < 3; i++) 
+  {
+    fill(&ds, i); 
+    ice_dshist_append(w, &ds); 
+  }
+  expect_range("partly full", r, NSLOTS, 3, 0); 
+  expect_range("just the last 2", r, 2, 2, 1); 
+
+  for (uint32_t i = 3; i < 20; i++) 
+  {
+    fill(&ds, i); 
+    ice_dshist_append(w, &ds); 
+  }
+  expect_range("wrapped", r, 2 * NSLOTS, NSLOTS, 20 - NSLOTS); 
+
+  //a writer dying in the middle of a slot: the next one (of the same size) keeps the rest, but not that slot 
+  ice_dshist_close(w); 
+  fd = open(path, O_RDWR); 
+  size_t size = lseek(fd, 0, SEEK_END); 
+  char * map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); 
+  ice_dshist_header_t * hdr = (ice_dshist_header_t*) map; 
+  ice_dshist_slot_t * last = (ice_dshist_slot_t*) (map + hdr->header_size + ((hdr->nwritten - 1) % hdr->nslots) * hdr->slot_size); 
+  last->seq++; 
+  munmap(map, size); 
+  close(fd); 
+
+  w = ice_dshist_create(path, NSLOTS); 
+  expect_range("torn last slot dropped", r, NSLOTS, NSLOTS - 1, 20 - NSLOTS); 
+
+  //now race a reader against the writer, with the ring lapping the reader all the time 
+  pthread_t thread; 
+  pthread_create(&thread, NULL, writer, w); 
+  long nreads = 0, nstatuses = 0; 
+  while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) 
+  {
+    rno_g_daqstatus_t got[NSLOTS]; 
+    int n = ice_dshist_read(r, NSLOTS, got, NULL); 
+    int64_t prev = -1; 
+    for (int k = 0; k < n; k++) 
+    {
+      int64_t i = check_whole(&got[k]); 
+      CHECK(i >= 0, "torn status in read %ld", nreads); 
+      CHECK(i < 0 || i > prev, "out of order in read %ld (%lld after %lld)", nreads, (long long) i, (long long) prev); 
+      if (i < 0 || i <= prev) break; 
+      prev = i; 
+    }
+    nreads++; 
+    nstatuses += n; 
+    if (nfail > 10) break; 
+  }
+  pthread_join(thread, NULL); 
+  expect_range("after the race", r, NSLOTS, NSLOTS, 1000 + NRACE - NSLOTS); 
+  printf("%ld reads racing the writer, %ld statuses\n", nreads, nstatuses); 
+
+  ice_dshist_close(w); 
+  ice_dshist_close(r); 
+
+  //a different size starts over 
+  w = ice_dshist_create(path, NSLOTS / 2); 
+  r = ice_dshist_open(path); 
+  CHECK(r && ice_dshist_nslots(r) == NSLOTS / 2, "resized"); 
+  if (r) expect_range("resized is empty", r, NSLOTS, 0, 0); 
+  ice_dshist_close(w); 
+  ice_dshist_close(r); 
+  unlink(path); 
+
+  if (nfail) printf("%d FAILED\n", nfail); 
+  else printf("test-dshist: all OK\n"); 
+  return nfail ? 1 : 0; 
+}
@@ -0,0 +1,181 @@
+#include "ice-servo.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/** Checks that the running-sum RADIANT servo averages (ice_radiant_servo_update) agree with the old way of doing it, 
+ * re-averaging every window over the whole history on every update (kept below, as it was in rno-g-acq).
+ *
+ * Both get the same random scaler series, with the windows wrapping around the ring many times, a window longer than
+ * what's been seen so far, a zero weight, a window change that keeps the history and one that starts over.
+ */ 
+
+static int nfail = 0; 
+
+#define CHECK(cond, ...) do { if (!(cond)) { nfail++; printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } while(0)
+
+
+/* The old, recomputing servo */ 
+typedef struct old_servo
+{
+  int max_periods; 
+  int nperiods_populated; 
+  float period_weights[NUM_SERVO_PERIODS]; 
+  int nscaler_periods_per_servo_period[NUM_SERVO_PERIODS]; 
+  float * scaler_v[RNO_G_NUM_RADIANT_CHANNELS]; 
+  float * scaler_v_mem; 
+  float value[RNO_G_NUM_RADIANT_CHANNELS]; 
+} old_servo_t; 
+
+static void old_setup(old_servo_t * state, const acq_config_t * cfg) 
+{
+  int max_periods = 0; 
+  for (int i = 0; i < NUM_SERVO_PERIODS; i++) 
+  {
+    if (cfg->radiant.servo.nscaler_periods_per_servo_period[i] > max_periods) 
+    {
+      max_periods = cfg->radiant.servo.nscaler_periods_per_servo_period[i]; 
+    }
+  }
+
+  if (state->max_periods < max_periods) 
+  {
+    if (state->scaler_v_mem) 
+    {
+      free(state->scaler_v_mem); 
+      memset(state,0, sizeof(*state)); 
+    }
+    state->scaler_v_mem = malloc(sizeof(float) * max_periods * RNO_G_NUM_RADIANT_CHANNELS); 
+    state->max_periods = max_periods; 
+    for (int i = 0; i < RNO_G_NUM_RADIANT_CHANNELS; i++) 
+    {
+      state->scaler_v[i]  = state->scaler_v_mem + max_periods * i; 
+    }
+  }
+
+  memcpy(state->nscaler_periods_per_servo_period, cfg->radiant.servo.nscaler_periods_per_servo_period, sizeof(int) * NUM_SERVO_PERIODS); 
+  memcpy(state->period_weights, cfg->radiant.servo.period_weights, sizeof(float) * NUM_SERVO_PERIODS); 
+}
+
+static void old_update(old_servo_t * st, const acq_config_t * cfg, const rno_g_daqstatus_t * ds) 
+{
+  int idx = (st->nperiods_populated++) % st->max_periods; 
+  int max_idxs = st->nperiods_populated < st->max_periods ? st->nperiods_populated : st->max_periods; 
+
+  for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) 
+  {
+    float adjusted_scaler = ds->radiant_scalers[chan] * (1 + ds->radiant_prescalers[chan]) / (ds->radiant_scaler_period?:1); 
+    st->scaler_v[chan][idx] = adjusted_scaler; 
+
+    st->value[chan] = 0; 
+    for (int j = 0; j < NUM_SERVO_PERIODS; j++) 
+    {
+      if (!st->period_weights[j]) continue; 
+      int nthis = 0; 
+      float sumthis = 0; 
+      for (int i = 0; i < max_idxs; i++) 
+      {
+        if (i < st->nscaler_periods_per_servo_period[j]) 
+        {
+          sumthis += st->scaler_v[chan][(st->nperiods_populated-1-i) % st->max_periods ]; 
+          nthis++; 
+        }
+      }
+      st->value[chan] += st->period_weights[j]*sumthis/nthis; 
+    }
+
+    if (cfg->radiant.servo.use_log) 
+    {
+      st->value[chan] = log10(cfg->radiant.servo.log_offset + st->value[chan]); 
+    }
+  }
+}
+
+
+static void set_windows(acq_config_t * cfg, int n0, int n1, int n2, float w0, float w1, float w2) 
+{
+  int n[NUM_SERVO_PERIODS] = {n0, n1, n2}; 
+  float w[NUM_SERVO_PERIODS] = {w0, w1, w2}; 
+  memcpy(cfg->radiant.servo.nscaler_periods_per_servo_period, n, sizeof(n)); 
+  memcpy(cfg->radiant.servo.period_weights, w, sizeof(w)); 
+}
+
+/* feed both nupdates random readings, comparing as we go */ 
+static void run(const char * what, old_servo_t * old_st, ice_radiant_servo_t * new_st, const acq_config_t * cfg, int nupdates) 
+{
+  double worst = 0; 
+  for (int u = 0; u < nupdates; u++) 
+  {
+    rno_g_daqstatus_t ds; 
+    memset(&ds, 0, sizeof(ds)); 
+    ds.radiant_scaler_period = u % 7 ? 1 : 0; // 0 means 1 too 
+    for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) 
+    {
+      ds.radiant_scalers[chan] = rand() % 65536; 
+      ds.radiant_prescalers[chan] = chan % 4; 
+    }
+
+    old_update(old_st, cfg, &ds); 
+    ice_radiant_servo_update(new_st, cfg, &ds); 
+
+    for (int chan = 0; chan < RNO_G_NUM_RADIANT_CHANNELS; chan++) 
+    {
+      double diff = fabs(new_st->value[chan] - old_st->value[chan]) / (fabs(old_st->value[chan]) + 1); 
+      if (diff > worst) worst = diff; 
+    }
+  }
+  // the old sums were floats, the new ones doubles, so they only agree to float rounding 
+  CHECK(worst < 1e-5, "%s: new and old servo values differ by up to %g (relative)", what, worst); 
+  printf("%-45s worst relative difference %g\n", what, worst); 
+}
+
+int main() 
+{
+  srand(1234); 
+  static acq_config_t cfg; 
+  memset(&cfg, 0, sizeof(cfg)); 
+  cfg.radiant.servo.max_sum_err = 1e9; 
+
+  old_servo_t old_st; 
+  ice_radiant_servo_t new_st; 
+  memset(&old_st, 0, sizeof(old_st)); 
+  memset(&new_st, 0, sizeof(new_st)); 
+
+  set_windows(&cfg, 1, 7, 30, 0.5, 0.3, 0.2); 
+  old_setup(&old_st, &cfg); 
+  CHECK(!ice_radiant_servo_setup(&new_st, &cfg), "setup failed"); 
+
+  run("filling up (shorter than the longest window)", &old_st, &new_st, &cfg, 20); 
+  run("wrapping around the ring", &old_st, &new_st, &cfg, 1000); 
+
+  //a zero weight, and shorter windows: the history is kept, the sums have to be redone from it 
+  set_windows(&cfg, 3, 5, 11, 0.6, 0, 0.4); 
+  old_setup(&old_st, &cfg); 
+  ice_radiant_servo_setup(&new_st, &cfg); 
+  run("shorter windows, keeping the history", &old_st, &new_st, &cfg, 100); 
+
+  //longer windows than the ring: both start over 
+  set_windows(&cfg, 2, 13, 60, 0.2, 0.3, 0.5); 
+  old_setup(&old_st, &cfg); 
+  ice_radiant_servo_setup(&new_st, &cfg); 
+  CHECK(new_st.nperiods_populated == 0, "longer windows should start over"); 
+  run("longer windows, starting over", &old_st, &new_st, &cfg, 500); 
+
+  //a window of 1 for everything (the ring is a single reading) 
+  set_windows(&cfg, 1, 1, 1, 0.2, 0.3, 0.5); 
+  old_setup(&old_st, &cfg); 
+  ice_radiant_servo_setup(&new_st, &cfg); 
+  run("windows of one reading", &old_st, &new_st, &cfg, 50); 
+
+  cfg.radiant.servo.use_log = 1; 
+  cfg.radiant.servo.log_offset = 1; 
+  run("log values", &old_st, &new_st, &cfg, 50); 
+
+  ice_radiant_servo_free(&new_st); 
+  free(old_st.scaler_v_mem); 
+
+  if (nfail) printf("%d FAILED\n", nfail); 
+  else printf("test-servo: all OK\n"); 
+  return nfail ? 1 : 0; 
+}